@@ -0,0 +1,49 @@
+/**
+ * @file
+ * @brief Benchmark of short-lived stacks with the system and the pool allocators
+ *
+ * Each iteration constructs a stack, pushes a few elements and destructs it. Prints the number of stacks per second.
+ */
+
+#include <chrono>
+#include <cstdio>
+
+#define STACK_TYPE int
+#include "../src/stack.h"
+#undef STACK_TYPE
+
+/** Number of stacks that are constructed in each measurement */
+constexpr int benchStacksNumber = 1'000'000;
+
+/** Number of elements that are pushed to each stack */
+constexpr int benchElementsNumber = 12;
+
+/**
+ * Measures how many short-lived stacks per second can be created with the given allocator and prints it.
+ * @param[in] name      name of the allocator to print
+ * @param[in] allocator allocator to measure
+ */
+static void benchAllocator(const char* name, const StackAllocator* allocator) {
+    using Clock = std::chrono::steady_clock;
+
+    long long checksum = 0;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < benchStacksNumber; ++i) {
+        Stack_int s{};
+        constructStack(&s, 4, allocator);
+        for (int j = 0; j < benchElementsNumber; ++j) {
+            push(&s, j);
+        }
+        checksum += pop(&s);
+        destructStack(&s);
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    printf("%-8s %8.2f M stacks/s (checksum = %lld)\n", name, benchStacksNumber / elapsed / 1e6, checksum);
+}
+
+int main() {
+    benchAllocator("system", &systemStackAllocator);
+    benchAllocator("pool",   &poolStackAllocator);
+    return 0;
+}
@@ -0,0 +1,112 @@
+/**
+ * @file
+ * @brief Benchmark of the fully verified shared stack throughput with different numbers of threads
+ *
+ * Each thread pushes and pops elements of one shared stack with security level 3, that already contains
+ * benchPreloadedElementsNumber elements, so each check of the stack hashes all of them.
+ * The stack is ImmortalStack, whose operations are wrapped in a global mutex (checked on each operation),
+ * or CombiningStack (checked once per batch). Average batch size is printed for the last one.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "../src/combining_stack.h"
+
+/** Security policy of the measured stacks */
+typedef StackSecurityPolicy<3> BenchPolicy;
+
+/** Number of push/pop pairs that are made by each thread */
+constexpr long benchThreadOperationsNumber = 1L << 14;
+
+/** Number of elements that are pushed to the stack before the measurement */
+constexpr long benchPreloadedElementsNumber = 1024;
+
+/** Maximal number of threads to measure */
+constexpr int benchMaxThreadsNumber = 32;
+
+/** Mutex that guards the locked stack */
+static std::mutex lockedStackMutex;
+
+/**
+ * Pushes and pops the elements of the stack wrapped in a global mutex.
+ * @param[in, out] s stack to use
+ */
+static void runLockedStackThread(ImmortalStack<long, BenchPolicy>* s) {
+    for (long i = 0; i < benchThreadOperationsNumber; ++i) {
+        {
+            std::lock_guard<std::mutex> guard(lockedStackMutex);
+            push(s, i);
+        }
+        std::lock_guard<std::mutex> guard(lockedStackMutex);
+        pop(s);
+    }
+}
+
+/**
+ * Pushes and pops the elements of the combining stack.
+ * @param[in, out] s stack to use
+ */
+static void runCombiningStackThread(CombiningStack<long, BenchPolicy>* s) {
+    long value = 0;
+    for (long i = 0; i < benchThreadOperationsNumber; ++i) {
+        push(s, i);
+        tryPop(s, &value);
+    }
+}
+
+/**
+ * Runs the given function in the given number of threads and prints the throughput.
+ * @param[in] name          name of the stack to print
+ * @param[in] threadsNumber number of threads to run
+ * @param[in] run           function to run in each thread
+ * @param[in, out] s        constructed stack to pass to the function
+ */
+template <typename Stack>
+static void benchThroughput(const char* name, int threadsNumber, void (*run)(Stack*), Stack* s) {
+    using Clock = std::chrono::steady_clock;
+
+    Clock::time_point start = Clock::now();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadsNumber; ++t) {
+        threads.emplace_back(run, s);
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    printf(
+        "%-12s %3d threads %8.3f M ops/s",
+        name, threadsNumber, 2.0 * benchThreadOperationsNumber * threadsNumber / elapsed / 1e6
+    );
+}
+
+int main() {
+    for (int threadsNumber = 1; threadsNumber <= benchMaxThreadsNumber; threadsNumber *= 2) {
+        ImmortalStack<long, BenchPolicy> locked{};
+        constructStack(&locked);
+        for (long i = 0; i < benchPreloadedElementsNumber; ++i) {
+            push(&locked, i);
+        }
+        benchThroughput("mutex", threadsNumber, runLockedStackThread, &locked);
+        printf("\n");
+        destructStack(&locked);
+
+        CombiningStack<long, BenchPolicy> combining{};
+        constructStack(&combining);
+        for (long i = 0; i < benchPreloadedElementsNumber; ++i) {
+            push(&combining, i);
+        }
+        StackCombiningStats preloadStats = getCombiningStats(&combining);
+        benchThroughput("combining", threadsNumber, runCombiningStackThread, &combining);
+        StackCombiningStats stats = getCombiningStats(&combining);
+        printf(", average batch %5.2f requests\n",
+               (double)(stats.requests - preloadStats.requests) / (double)(stats.batches - preloadStats.batches));
+        destructStack(&combining);
+    }
+
+    return 0;
+}
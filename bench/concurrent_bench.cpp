@@ -0,0 +1,93 @@
+/**
+ * @file
+ * @brief Benchmark of the shared stack throughput with different numbers of threads
+ *
+ * Each thread pushes and pops elements of one shared stack. The stack is ImmortalStack,
+ * whose operations are wrapped in a global mutex, or lock-free ConcurrentStack.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "../src/concurrent_stack.h"
+
+/** Number of push/pop pairs that are made by each thread */
+constexpr long benchThreadOperationsNumber = 1L << 20;
+
+/** Maximal number of threads to measure */
+constexpr int benchMaxThreadsNumber = 32;
+
+/** Mutex that guards the locked stack */
+static std::mutex lockedStackMutex;
+
+/**
+ * Pushes and pops the elements of the stack wrapped in a global mutex.
+ * @param[in, out] s stack to use
+ */
+static void runLockedStackThread(ImmortalStack<long>* s) {
+    for (long i = 0; i < benchThreadOperationsNumber; ++i) {
+        {
+            std::lock_guard<std::mutex> guard(lockedStackMutex);
+            push(s, i);
+        }
+        std::lock_guard<std::mutex> guard(lockedStackMutex);
+        pop(s);
+    }
+}
+
+/**
+ * Pushes and pops the elements of the lock-free stack.
+ * @param[in, out] s stack to use
+ */
+static void runConcurrentStackThread(ConcurrentStack<long>* s) {
+    long value = 0;
+    for (long i = 0; i < benchThreadOperationsNumber; ++i) {
+        push(s, i);
+        tryPop(s, &value);
+    }
+}
+
+/**
+ * Runs the given function in the given number of threads and prints the throughput.
+ * @param[in] name          name of the stack to print
+ * @param[in] threadsNumber number of threads to run
+ * @param[in] run           function to run in each thread
+ * @param[in, out] s        constructed empty stack to pass to the function
+ */
+template <typename Stack>
+static void benchThroughput(const char* name, int threadsNumber, void (*run)(Stack*), Stack* s) {
+    using Clock = std::chrono::steady_clock;
+
+    Clock::time_point start = Clock::now();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadsNumber; ++t) {
+        threads.emplace_back(run, s);
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    printf(
+        "%-12s %3d threads %8.2f M ops/s\n",
+        name, threadsNumber, 2.0 * benchThreadOperationsNumber * threadsNumber / elapsed / 1e6
+    );
+}
+
+int main() {
+    for (int threadsNumber = 1; threadsNumber <= benchMaxThreadsNumber; threadsNumber *= 2) {
+        ImmortalStack<long> locked{};
+        constructStack(&locked);
+        benchThroughput("mutex", threadsNumber, runLockedStackThread, &locked);
+        destructStack(&locked);
+
+        ConcurrentStack<long> concurrent{};
+        constructStack(&concurrent);
+        benchThroughput("lock-free", threadsNumber, runConcurrentStackThread, &concurrent);
+        destructStack(&concurrent);
+    }
+
+    return 0;
+}
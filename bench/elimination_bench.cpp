@@ -0,0 +1,119 @@
+/**
+ * @file
+ * @brief Benchmark of the shared stack throughput with equal numbers of pushing and popping threads
+ *
+ * Half of the threads push elements to one shared stack, the other half pop them.
+ * The stack is Stack_long wrapped in a global mutex, lock-free ConcurrentStack (plain CAS on the top)
+ * or EliminationStack (CAS with elimination backoff). Elimination hit rate is printed for the last one.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "../src/elimination_stack.h"
+
+#define STACK_TYPE long
+#include "../src/stack.h"
+#undef STACK_TYPE
+
+/** Number of elements that are pushed by each pushing thread */
+constexpr long benchPusherElementsNumber = 1L << 19;
+
+/** Maximal number of threads to measure */
+constexpr int benchMaxThreadsNumber = 64;
+
+/** Mutex that guards the locked stack */
+static std::mutex lockedStackMutex;
+
+/** Pushes the element to the stack wrapped in a global mutex */
+static void benchPush(Stack_long* s, long value) {
+    std::lock_guard<std::mutex> guard(lockedStackMutex);
+    push(s, value);
+}
+
+/** Pops the element from the stack wrapped in a global mutex, if it's not empty */
+static bool benchTryPop(Stack_long* s, long* value) {
+    std::lock_guard<std::mutex> guard(lockedStackMutex);
+    if (getStackSize(s) == 0) return false;
+
+    *value = pop(s);
+    return true;
+}
+
+/** Pushes the element to the lock-free stack */
+template <typename Stack>
+static void benchPush(Stack* s, long value) {
+    push(s, value);
+}
+
+/** Pops the element from the lock-free stack, if it's not empty */
+template <typename Stack>
+static bool benchTryPop(Stack* s, long* value) {
+    return tryPop(s, value);
+}
+
+/**
+ * Runs the pushing and popping threads with the given stack and prints the throughput.
+ * @param[in] name          name of the stack to print
+ * @param[in] threadsNumber number of threads to run (half of them push, the other half pop)
+ * @param[in, out] s        constructed empty stack
+ * @return elapsed time in seconds.
+ */
+template <typename Stack>
+static double benchThroughput(const char* name, int threadsNumber, Stack* s) {
+    using Clock = std::chrono::steady_clock;
+
+    Clock::time_point start = Clock::now();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadsNumber / 2; ++t) {
+        threads.emplace_back([s]() {
+            for (long i = 0; i < benchPusherElementsNumber; ++i) {
+                benchPush(s, i);
+            }
+        });
+        threads.emplace_back([s]() {
+            long value = 0;
+            for (long popped = 0; popped < benchPusherElementsNumber; ) {
+                if (benchTryPop(s, &value)) ++popped;
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    printf(
+        "%-12s %3d threads %8.2f M ops/s",
+        name, threadsNumber, 2.0 * benchPusherElementsNumber * (threadsNumber / 2) / elapsed / 1e6
+    );
+    return elapsed;
+}
+
+int main() {
+    for (int threadsNumber = 2; threadsNumber <= benchMaxThreadsNumber; threadsNumber *= 2) {
+        Stack_long locked{};
+        constructStack(&locked);
+        benchThroughput("mutex", threadsNumber, &locked);
+        printf("\n");
+        destructStack(&locked);
+
+        ConcurrentStack<long> concurrent{};
+        constructStack(&concurrent);
+        benchThroughput("CAS", threadsNumber, &concurrent);
+        printf("\n");
+        destructStack(&concurrent);
+
+        EliminationStack<long> elimination{};
+        constructStack(&elimination);
+        benchThroughput("elimination", threadsNumber, &elimination);
+        StackEliminationStats stats = getEliminationStats(&elimination);
+        printf(", elimination hit rate %5.1f%% of %zu visits\n",
+               stats.visits ? 100.0 * stats.hits / stats.visits : 0.0, stats.visits);
+        destructStack(&elimination);
+    }
+
+    return 0;
+}
@@ -0,0 +1,83 @@
+/**
+ * @file
+ * @brief Throughput benchmark of the hash algorithm chosen by STACK_HASH_ALGORITHM
+ *
+ * Compares the chosen algorithm with the bytewise polynomial hash and the hash that was used before
+ * (two divisions per byte). Prints throughput in GB/s.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "../src/hash.h"
+
+/** Size of the hashed buffer in bytes */
+constexpr size_t benchBufferSize = 64 * 1024 * 1024;
+
+/** Minimal duration of each measurement in seconds */
+constexpr double benchMinDuration = 0.5;
+
+/**
+ * Hash that was used in getHash before hash algorithms were introduced. Kept here for comparison only.
+ */
+static unsigned long long moduloHashBytes(unsigned long long hash, const void* data, size_t length) {
+    constexpr long long modulo = 1'000'000'009L;
+    constexpr long long p = 31L;
+
+    const char* bytes = (const char*)data;
+    long long result = (long long)hash;
+    for (size_t i = 0; i < length; ++i) {
+        result = (result * p) % modulo;
+        result = (result + bytes[i]) % modulo;
+    }
+    return (unsigned long long)result;
+}
+
+/**
+ * Measures the throughput of the given hash function and prints it.
+ * @param[in] name     name of the hash function to print
+ * @param[in] hashFunc hash function to measure
+ * @param[in] buffer   buffer to hash
+ * @param[in] size     size of the buffer in bytes
+ */
+static void benchHash(
+    const char* name,
+    unsigned long long (*hashFunc)(unsigned long long, const void*, size_t),
+    const unsigned char* buffer,
+    size_t size
+) {
+    using Clock = std::chrono::steady_clock;
+
+    unsigned long long hash = 0;
+    size_t hashedBytes = 0;
+    Clock::time_point start = Clock::now();
+    double elapsed = 0;
+    do {
+        hash = hashFunc(hash, buffer, size);
+        hashedBytes += size;
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    } while (elapsed < benchMinDuration);
+
+    printf("%-36s %8.3f GB/s (hash = 0x%016llX)\n", name, (double)hashedBytes / elapsed / 1e9, hash);
+}
+
+int main() {
+    unsigned char* buffer = (unsigned char*)malloc(benchBufferSize);
+    if (buffer == nullptr) {
+        fprintf(stderr, "Failed to allocate %zu bytes\n", benchBufferSize);
+        return -1;
+    }
+
+    srand(0);
+    for (size_t i = 0; i < benchBufferSize; ++i) {
+        buffer[i] = (unsigned char)rand();
+    }
+
+    printf("Hashing %zu MiB buffer\n", benchBufferSize / (1024 * 1024));
+    benchHash("modulo (previous getHash)",   moduloHashBytes,             buffer, benchBufferSize / 16);
+    benchHash("polynomial (bytewise)",       polynomialHashBytesBytewise, buffer, benchBufferSize);
+    benchHash(STACK_HASH_ALGORITHM_NAME,     hashBytes,                   buffer, benchBufferSize);
+
+    free(buffer);
+    return 0;
+}
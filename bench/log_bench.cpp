@@ -0,0 +1,72 @@
+/**
+ * @file
+ * @brief Throughput benchmark of logging the arrays of numbers
+ *
+ * Logs large arrays of ints and doubles with LOG_ARRAY (values are converted with std::to_chars into the buffer)
+ * and with fprintf calls per element, as logValue did before. Prints throughput in MB/s of the log text.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "../src/logger.h"
+
+/** Number of the logged elements */
+constexpr size_t benchElementsNumber = 1 << 22;
+
+/** Log file of the benchmark */
+static const char* benchLogFileName = "log-bench.txt";
+
+/**
+ * Logs the array with LOG_ARRAY or with fprintf per element and prints the throughput.
+ * @param[in] name       name of the measurement to print
+ * @param[in] array      logged array
+ * @param[in] useFprintf array is logged with fprintf per element
+ * @param[in] format     format of fprintf
+ */
+template <typename T>
+static void benchLog(const char* name, const T* array, const bool useFprintf, const char* format) {
+    using Clock = std::chrono::steady_clock;
+
+    logOpen(benchLogFileName, "w");
+    Clock::time_point start = Clock::now();
+    if (useFprintf) {
+        fprintf(_logFile, "array [" PTR_FORMAT "] = {\n", (uintptr_t)array);
+        for (size_t i = 0; i < benchElementsNumber; ++i) {
+            fprintf(_logFile, "\t[%zu] = ", i);
+            fprintf(_logFile, format, array[i]);
+            fprintf(_logFile, "\n");
+        }
+        fprintf(_logFile, "}\n");
+    } else {
+        LOG_ARRAY(array, benchElementsNumber);
+    }
+    logFlush();
+    long bytes = ftell(_logFile);
+    logClose();
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    printf("%-20s %10.1f MB/s\n", name, bytes / elapsed / 1e6);
+    remove(benchLogFileName);
+}
+
+int main() {
+    int* ints = (int*)malloc(sizeof(int) * benchElementsNumber);
+    double* doubles = (double*)malloc(sizeof(double) * benchElementsNumber);
+    if (ints == nullptr || doubles == nullptr) return 1;
+
+    srand(42);
+    for (size_t i = 0; i < benchElementsNumber; ++i) {
+        ints[i] = rand() - RAND_MAX / 2;
+        doubles[i] = ints[i] / 1000.0;
+    }
+
+    benchLog("int fprintf",    ints,    true,  "%d");
+    benchLog("int to_chars",   ints,    false, "%d");
+    benchLog("double fprintf", doubles, true,  "%lg");
+    benchLog("double to_chars", doubles, false, "%lg");
+
+    free(ints);
+    free(doubles);
+    return 0;
+}
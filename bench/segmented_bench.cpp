@@ -0,0 +1,85 @@
+/**
+ * @file
+ * @brief Benchmark of push latency of the contiguous and the segmented stacks
+ *
+ * Pushes a lot of elements to each stack and prints the throughput, the worst push latency and the number of slow pushes.
+ * Contiguous stack copies all its elements on some pushes, unless its data array is grown in place (with mremap),
+ * segmented stack only links a new chunk.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include "../src/segmented_stack.h"
+
+/** Number of elements that are pushed to each stack */
+constexpr long benchElementsNumber = 1L << 26;
+
+/** Pushes that take longer are counted as slow ones */
+constexpr std::chrono::microseconds benchSlowPushLatency(100);
+
+/** Allocator that never grows blocks in place, as systemStackAllocator without mremap */
+static const StackAllocator copyingStackAllocator = {
+    systemStackAllocate,
+    [](void* context, void* memory, size_t oldBytes, size_t newBytes) {
+        void* newMemory = systemStackAllocate(context, newBytes);
+        if (newMemory == nullptr) return newMemory;
+
+        memcpy(newMemory, memory, (oldBytes < newBytes) ? oldBytes : newBytes);
+        systemStackDeallocate(context, memory, oldBytes);
+        return newMemory;
+    },
+    systemStackDeallocate,
+    nullptr
+};
+
+/**
+ * Pushes benchElementsNumber elements to the given stack and prints the throughput and the push latencies.
+ * @param[in] name name of the stack to print
+ * @param[in] s    constructed empty stack to measure
+ */
+template <typename Stack>
+static void benchPushLatency(const char* name, Stack* s) {
+    using Clock = std::chrono::steady_clock;
+
+    Clock::duration maxLatency{};
+    long slowPushes = 0;
+    Clock::time_point start = Clock::now();
+    Clock::time_point previous = start;
+    for (long i = 0; i < benchElementsNumber; ++i) {
+        push(s, i);
+
+        Clock::time_point now = Clock::now();
+        if (now - previous > benchSlowPushLatency) {
+            ++slowPushes;
+        }
+        if (now - previous > maxLatency) {
+            maxLatency = now - previous;
+        }
+        previous = now;
+    }
+    double elapsed = std::chrono::duration<double>(previous - start).count();
+
+    printf(
+        "%-20s %8.2f M pushes/s, max latency %10.3f us, %4ld slow pushes (top = %ld)\n",
+        name, benchElementsNumber / elapsed / 1e6, std::chrono::duration<double, std::micro>(maxLatency).count(),
+        slowPushes, top(s)
+    );
+}
+
+int main() {
+    ImmortalStack<long> contiguous{};
+    constructStack(&contiguous);
+    benchPushLatency("contiguous", &contiguous);
+    destructStack(&contiguous);
+
+    constructStack(&contiguous, 0, &copyingStackAllocator);
+    benchPushLatency("contiguous (copying)", &contiguous);
+    destructStack(&contiguous);
+
+    SegmentedStack<long> segmented{};
+    constructStack(&segmented);
+    benchPushLatency("segmented", &segmented);
+    destructStack(&segmented);
+
+    return 0;
+}
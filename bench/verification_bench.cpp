@@ -0,0 +1,55 @@
+/**
+ * @file
+ * @brief Benchmark of the stack operations with different verification policies
+ *
+ * The stack already contains benchPreloadedElementsNumber elements, then push/pop pairs are made.
+ * Level 1 checks only the stack members, level 3 verifies canaries and hashes in each check (hashing all elements),
+ * in sampled checks (every STACK_SAMPLING_PERIOD-th one) or in the background verifier thread.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include "../src/immortal_stack.h"
+
+/** Number of push/pop pairs to measure */
+constexpr long benchOperationsNumber = 1L << 12;
+
+/** Number of elements that are pushed to the stack before the measurement */
+constexpr long benchPreloadedElementsNumber = 1L << 16;
+
+/**
+ * Makes push/pop pairs with the stack of the given type and prints their throughput.
+ * @param[in] name name of the stack to print
+ */
+template <typename Stack>
+static void benchVerification(const char* name) {
+    using Clock = std::chrono::steady_clock;
+
+    Stack s{};
+    constructStack(&s);
+    for (long i = 0; i < benchPreloadedElementsNumber; ++i) {
+        push(&s, i);
+    }
+
+    Clock::time_point start = Clock::now();
+    for (long i = 0; i < benchOperationsNumber; ++i) {
+        push(&s, i);
+        pop(&s);
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    printf("%-20s %10.3f M ops/s\n", name, 2.0 * benchOperationsNumber / elapsed / 1e6);
+    destructStack(&s);
+}
+
+int main() {
+    benchVerification<ImmortalStack<long, StackSecurityPolicy<1>>>("level 1");
+    benchVerification<ImmortalStack<long, StackSecurityPolicy<3>>>("level 3");
+    benchVerification<ImmortalStack<long, StackSecurityPolicy<3, StackSampledVerification>>>("level 3 sampled");
+
+    startStackVerifier();
+    benchVerification<ImmortalStack<long, StackSecurityPolicy<3, StackBackgroundVerification>>>("level 3 background");
+    stopStackVerifier();
+
+    return 0;
+}
@@ -0,0 +1,410 @@
+/**
+ * @file
+ * @brief Definition and implementation of allocators for stack storage
+ *
+ * Stack storage is allocated through StackAllocator, that can be set per stack (see constructStack)
+ * or per stack type (see STACK_ALLOCATOR). There are three built-in allocators:
+ *   - systemStackAllocator : small blocks are allocated with malloc and grown with realloc (that can grow them in place).
+ *                            Blocks of at least STACK_MMAP_THRESHOLD bytes are mapped with mmap and grown with mremap,
+ *                            so the kernel moves their pages instead of copying them;
+ *   - poolStackAllocator   : blocks are rounded up to size classes (powers of two) and recycled
+ *                            through thread-local free lists of these classes;
+ *   - guardPageStackAllocator : blocks are mapped with mmap between inaccessible guard pages, so accesses past their ends
+ *                               trap (see guard_pages.h). Address range is reserved ahead, so blocks grow in place.
+ * Allocated memory is not zeroed.
+ */
+#ifndef IMMORTAL_STACK_ALLOCATOR_H
+#define IMMORTAL_STACK_ALLOCATOR_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __linux__
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif
+
+#ifndef STACK_MMAP_THRESHOLD
+    /** Size of the block in bytes starting from which it's mapped with mmap (works only on Linux) */
+    #define STACK_MMAP_THRESHOLD (1024 * 1024)
+#endif
+
+/**
+ * Checks if the block of the given size is mapped with mmap (instead of malloc).
+ * @param[in] bytes size of the block
+ * @return true, if the block is mapped, false otherwise.
+ */
+inline bool isStackMemoryMapped(size_t bytes) {
+    #ifdef __linux__
+        return bytes >= STACK_MMAP_THRESHOLD;
+    #else
+        (void)bytes;
+        return false;
+    #endif
+}
+
+#ifdef __linux__
+/**
+ * Rounds the given size up to the whole number of pages.
+ * @param[in] bytes size to round
+ * @return rounded size.
+ */
+inline size_t roundUpToPageSize(size_t bytes) {
+    static const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    return (bytes + pageSize - 1) / pageSize * pageSize;
+}
+#endif
+
+/**
+ * Allocates the block of the given size. Memory is not initialized.
+ * @param[in] bytes size of the block
+ * @return pointer to the allocated block, or nullptr if there's not enough memory.
+ */
+inline void* allocateStackMemory(size_t bytes) {
+    #ifdef __linux__
+        if (isStackMemoryMapped(bytes)) {
+            void* memory = mmap(nullptr, roundUpToPageSize(bytes), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            return (memory == MAP_FAILED) ? nullptr : memory;
+        }
+    #endif
+    return malloc((bytes == 0) ? 1 : bytes);
+}
+
+/**
+ * Frees the block that was allocated with allocateStackMemory or reallocateStackMemory.
+ * @param[in] memory pointer to the block
+ * @param[in] bytes  size of the block (exactly the one it was allocated with)
+ */
+inline void freeStackMemory(void* memory, size_t bytes) {
+    #ifdef __linux__
+        if (isStackMemoryMapped(bytes)) {
+            if (memory != nullptr) munmap(memory, roundUpToPageSize(bytes));
+            return;
+        }
+    #endif
+    (void)bytes;
+    free(memory);
+}
+
+/**
+ * Changes the size of the block. Keeps the contents of the block up to the lesser of the sizes.
+ * Grows the block in place if possible, otherwise moves it (mapped blocks are moved without copying).
+ * Only bytewise copyable contents can be reallocated with this function.
+ * @param[in] memory   pointer to the block
+ * @param[in] oldBytes current size of the block (exactly the one it was allocated with)
+ * @param[in] newBytes new size of the block
+ * @return pointer to the reallocated block, or nullptr if there's not enough memory (the old block is kept then).
+ */
+inline void* reallocateStackMemory(void* memory, size_t oldBytes, size_t newBytes) {
+    const bool wasMapped = isStackMemoryMapped(oldBytes);
+    const bool isMapped  = isStackMemoryMapped(newBytes);
+
+    if (!wasMapped && !isMapped) {
+        return realloc(memory, (newBytes == 0) ? 1 : newBytes);
+    }
+
+    #ifdef __linux__
+        if (wasMapped && isMapped) {
+            void* newMemory = mremap(memory, roundUpToPageSize(oldBytes), roundUpToPageSize(newBytes), MREMAP_MAYMOVE);
+            return (newMemory == MAP_FAILED) ? nullptr : newMemory;
+        }
+    #endif
+
+    void* newMemory = allocateStackMemory(newBytes);
+    if (newMemory == nullptr) return nullptr;
+
+    memcpy(newMemory, memory, (oldBytes < newBytes) ? oldBytes : newBytes);
+    freeStackMemory(memory, oldBytes);
+    return newMemory;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * Set of callbacks that are used to manage stack storage. Every callback gets the context of the allocator.
+ * Sizes of the blocks are always passed to the callbacks, so allocators don't need to store them.
+ */
+struct StackAllocator {
+    /** Allocates the block of the given size. Returns nullptr if there's not enough memory */
+    void* (*allocate)(void* context, size_t bytes);
+
+    /**
+     * Changes the size of the block keeping its contents (contents are always bytewise copyable).
+     * Returns nullptr if there's not enough memory, the old block must be kept then.
+     */
+    void* (*reallocate)(void* context, void* memory, size_t oldBytes, size_t newBytes);
+
+    /** Frees the block (free callback) */
+    void (*deallocate)(void* context, void* memory, size_t bytes);
+
+    /** Allocator-specific data */
+    void* context;
+};
+
+/** Allocates the block with allocateStackMemory. Used in systemStackAllocator */
+inline void* systemStackAllocate(void*, size_t bytes) {
+    return allocateStackMemory(bytes);
+}
+
+/** Reallocates the block with reallocateStackMemory. Used in systemStackAllocator */
+inline void* systemStackReallocate(void*, void* memory, size_t oldBytes, size_t newBytes) {
+    return reallocateStackMemory(memory, oldBytes, newBytes);
+}
+
+/** Frees the block with freeStackMemory. Used in systemStackAllocator */
+inline void systemStackDeallocate(void*, void* memory, size_t bytes) {
+    freeStackMemory(memory, bytes);
+}
+
+/** Allocator that uses malloc/realloc for small blocks and mmap/mremap for large ones */
+constexpr StackAllocator systemStackAllocator = {
+    systemStackAllocate,
+    systemStackReallocate,
+    systemStackDeallocate,
+    nullptr
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/** Size of the smallest size class of poolStackAllocator in bytes. Must be a power of two */
+#define STACK_POOL_MIN_BLOCK_SIZE 16
+
+/** Number of size classes of poolStackAllocator. Larger blocks are allocated with systemStackAllocator */
+#define STACK_POOL_CLASSES_NUMBER 13
+
+#ifndef STACK_POOL_MAX_CACHED_BLOCKS
+    /** Maximal number of free blocks each thread keeps for each size class */
+    #define STACK_POOL_MAX_CACHED_BLOCKS 64
+#endif
+
+/**
+ * Thread-local free lists of poolStackAllocator. Free blocks are linked through their first bytes.
+ * Blocks that are left in the lists are freed when the thread exits.
+ */
+struct StackPoolFreeLists {
+    void*  heads [STACK_POOL_CLASSES_NUMBER] = {};
+    size_t counts[STACK_POOL_CLASSES_NUMBER] = {};
+
+    ~StackPoolFreeLists() {
+        for (void* head : heads) {
+            while (head != nullptr) {
+                void* next = *(void**)head;
+                free(head);
+                head = next;
+            }
+        }
+    }
+};
+
+/**
+ * Gives the free lists of poolStackAllocator of the current thread.
+ * @return pointer to the free lists.
+ */
+inline StackPoolFreeLists* getStackPoolFreeLists() {
+    static thread_local StackPoolFreeLists freeLists;
+    return &freeLists;
+}
+
+/**
+ * Gives the size class of the block of the given size.
+ * @param[in] bytes size of the block
+ * @return index of the size class, or STACK_POOL_CLASSES_NUMBER if the block is too large for the pool.
+ */
+inline size_t getStackPoolClass(size_t bytes) {
+    size_t sizeClass = 0;
+    for (size_t classSize = STACK_POOL_MIN_BLOCK_SIZE; classSize < bytes; classSize *= 2) {
+        ++sizeClass;
+    }
+    return (sizeClass < STACK_POOL_CLASSES_NUMBER) ? sizeClass : STACK_POOL_CLASSES_NUMBER;
+}
+
+/** Takes the block from the free list of its size class, or allocates it with malloc. Used in poolStackAllocator */
+inline void* poolStackAllocate(void*, size_t bytes) {
+    const size_t sizeClass = getStackPoolClass(bytes);
+    if (sizeClass == STACK_POOL_CLASSES_NUMBER) {
+        return allocateStackMemory(bytes);
+    }
+
+    StackPoolFreeLists* freeLists = getStackPoolFreeLists();
+    void* block = freeLists->heads[sizeClass];
+    if (block != nullptr) {
+        freeLists->heads[sizeClass] = *(void**)block;
+        --freeLists->counts[sizeClass];
+        return block;
+    }
+    return malloc((size_t)STACK_POOL_MIN_BLOCK_SIZE << sizeClass);
+}
+
+/** Puts the block to the free list of its size class, or frees it if the list is full. Used in poolStackAllocator */
+inline void poolStackDeallocate(void*, void* memory, size_t bytes) {
+    const size_t sizeClass = getStackPoolClass(bytes);
+    if (sizeClass == STACK_POOL_CLASSES_NUMBER) {
+        freeStackMemory(memory, bytes);
+        return;
+    }
+    if (memory == nullptr) return;
+
+    StackPoolFreeLists* freeLists = getStackPoolFreeLists();
+    if (freeLists->counts[sizeClass] == STACK_POOL_MAX_CACHED_BLOCKS) {
+        free(memory);
+        return;
+    }
+    *(void**)memory = freeLists->heads[sizeClass];
+    freeLists->heads[sizeClass] = memory;
+    ++freeLists->counts[sizeClass];
+}
+
+/** Keeps the block if the new size has the same size class, moves it to another block otherwise. Used in poolStackAllocator */
+inline void* poolStackReallocate(void* context, void* memory, size_t oldBytes, size_t newBytes) {
+    const size_t oldClass = getStackPoolClass(oldBytes);
+    const size_t newClass = getStackPoolClass(newBytes);
+    if (oldClass == newClass) {
+        return (newClass == STACK_POOL_CLASSES_NUMBER) ? reallocateStackMemory(memory, oldBytes, newBytes) : memory;
+    }
+
+    void* newMemory = poolStackAllocate(context, newBytes);
+    if (newMemory == nullptr) return nullptr;
+
+    memcpy(newMemory, memory, (oldBytes < newBytes) ? oldBytes : newBytes);
+    poolStackDeallocate(context, memory, oldBytes);
+    return newMemory;
+}
+
+/** Allocator that recycles blocks through thread-local free lists of size classes */
+constexpr StackAllocator poolStackAllocator = {
+    poolStackAllocate,
+    poolStackReallocate,
+    poolStackDeallocate,
+    nullptr
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+
+#ifndef STACK_GUARD_RESERVE_BYTES
+    /** Smallest address range in bytes, that is reserved for each block of guardPageStackAllocator to grow in place */
+    #define STACK_GUARD_RESERVE_BYTES (64 * 1024 * 1024)
+#endif
+
+/**
+ * Gives the accessible size of the block of guardPageStackAllocator: the given size rounded up to the whole number of pages.
+ * Block ends right before the trailing guard page, only if its size is equal to the rounded one.
+ * @param[in] bytes size of the block
+ * @return accessible size of the block.
+ */
+inline size_t getStackGuardedBytes(size_t bytes) {
+    #ifdef __linux__
+        return roundUpToPageSize(bytes);
+    #else
+        return bytes;
+    #endif
+}
+
+#ifdef __linux__
+/**
+ * Gives the size of the address range, that is reserved for the block of the given size (without guard pages):
+ * STACK_GUARD_RESERVE_BYTES multiplied by the least power of two, that fits the block.
+ * Blocks grow in place while they fit their reserved range.
+ * @param[in] bytes size of the block
+ * @return reserved size.
+ */
+inline size_t getStackGuardReserveBytes(size_t bytes) {
+    size_t reserveBytes = roundUpToPageSize(STACK_GUARD_RESERVE_BYTES);
+    while (reserveBytes < bytes) {
+        reserveBytes *= 2;
+    }
+    return reserveBytes;
+}
+
+/**
+ * Reserves the guarded range for the block and makes the block accessible. Used in guardPageStackAllocator.
+ * Layout of the range: guard page, block (its pages are accessible), rest of the reserved range and guard page
+ * (they are inaccessible).
+ */
+inline void* guardPageStackAllocate(void*, size_t bytes) {
+    const size_t pageSize   = roundUpToPageSize(1);
+    const size_t rangeBytes = pageSize + getStackGuardReserveBytes(bytes) + pageSize;
+
+    char* range = (char*)mmap(nullptr, rangeBytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (range == MAP_FAILED) return nullptr;
+
+    char* memory = range + pageSize;
+    if (bytes > 0 && mprotect(memory, roundUpToPageSize(bytes), PROT_READ | PROT_WRITE) != 0) {
+        munmap(range, rangeBytes);
+        return nullptr;
+    }
+    return memory;
+}
+
+/** Unmaps the whole guarded range of the block. Used in guardPageStackAllocator */
+inline void guardPageStackDeallocate(void*, void* memory, size_t bytes) {
+    if (memory == nullptr) return;
+
+    const size_t pageSize = roundUpToPageSize(1);
+    munmap((char*)memory - pageSize, pageSize + getStackGuardReserveBytes(bytes) + pageSize);
+}
+
+/**
+ * Changes the accessible part of the reserved range, if the new size fits it, moves the block to the new range otherwise.
+ * Pages that are cut off by shrinking are given back to the system. Used in guardPageStackAllocator.
+ */
+inline void* guardPageStackReallocate(void* context, void* memory, size_t oldBytes, size_t newBytes) {
+    if (getStackGuardReserveBytes(oldBytes) == getStackGuardReserveBytes(newBytes)) {
+        char* const  block       = (char*)memory;
+        const size_t oldAccessible = roundUpToPageSize(oldBytes);
+        const size_t newAccessible = roundUpToPageSize(newBytes);
+
+        if (newAccessible > oldAccessible) {
+            if (mprotect(block + oldAccessible, newAccessible - oldAccessible, PROT_READ | PROT_WRITE) != 0) return nullptr;
+        } else if (newAccessible < oldAccessible) {
+            madvise(block + newAccessible, oldAccessible - newAccessible, MADV_DONTNEED);
+            mprotect(block + newAccessible, oldAccessible - newAccessible, PROT_NONE);
+        }
+        return memory;
+    }
+
+    void* newMemory = guardPageStackAllocate(context, newBytes);
+    if (newMemory == nullptr) return nullptr;
+
+    memcpy(newMemory, memory, (oldBytes < newBytes) ? oldBytes : newBytes);
+    guardPageStackDeallocate(context, memory, oldBytes);
+    return newMemory;
+}
+
+/**
+ * Checks if the given address is in the inaccessible part of the guarded range of the block:
+ * in the leading guard page, or after the accessible pages of the block up to the end of the trailing guard page.
+ * @param[in] memory  pointer to the block of guardPageStackAllocator
+ * @param[in] bytes   size of the block
+ * @param[in] address address to check
+ * @return true, if the address is in the guards of the block, false otherwise.
+ */
+inline bool isInStackGuard(const void* memory, size_t bytes, const void* address) {
+    const size_t pageSize = roundUpToPageSize(1);
+    const uintptr_t block = (uintptr_t)memory;
+    const uintptr_t point = (uintptr_t)address;
+
+    const bool isBefore = (point >= block - pageSize) && (point < block);
+    const bool isAfter  = (point >= block + roundUpToPageSize(bytes)) &&
+                          (point <  block + getStackGuardReserveBytes(bytes) + pageSize);
+    return isBefore || isAfter;
+}
+
+/** Allocator that maps blocks between guard pages and grows them in place inside the reserved address range */
+constexpr StackAllocator guardPageStackAllocator = {
+    guardPageStackAllocate,
+    guardPageStackReallocate,
+    guardPageStackDeallocate,
+    nullptr
+};
+#else
+/** Blocks can't be guarded without mmap, so there are no guards */
+inline bool isInStackGuard(const void*, size_t, const void*) {
+    return false;
+}
+
+/** Guard pages work only on Linux, systemStackAllocator is used on other systems */
+constexpr StackAllocator guardPageStackAllocator = systemStackAllocator;
+#endif
+
+#endif // IMMORTAL_STACK_ALLOCATOR_H
@@ -0,0 +1,413 @@
+/**
+ * @file
+ * @brief Definition and implementation of flat-combining stack template
+ *
+ * CombiningStack<T, Policy, InlineCapacity> makes ImmortalStack (and so Stack_T) thread-safe with flat combining.
+ * Each thread posts its push or pop request to its own slot and tries to take the lock. The thread that takes it
+ * becomes the combiner: it applies the requests of all threads as one batch and marks them done,
+ * while the other threads wait for their requests to be done (or for the lock, if the combiner missed them).
+ *
+ * Unlike the lock-free stacks, the combining stack keeps the full verification of ImmortalStack,
+ * but the stack is checked and its hash is updated once per batch, not once per operation.
+ * So the cost of the level 3 checks is shared between the threads that wait for the combiner.
+ */
+#ifndef IMMORTAL_STACK_COMBINING_STACK_H
+#define IMMORTAL_STACK_COMBINING_STACK_H
+
+#include <mutex>
+#include <thread>
+#include "concurrent_stack.h"
+
+/** Number of spins the thread waits for its request to be done, before it starts to yield the CPU */
+#ifndef STACK_COMBINING_SPINS
+    #define STACK_COMBINING_SPINS 64
+#endif
+
+/** Operation that is requested by the thread from the combiner */
+enum class StackCombiningOperation {
+    none,
+    push,
+    pop
+};
+
+/**
+ * Request slot of one thread (slots don't share cache lines).
+ * Owner thread writes the request and sets the operation, combiner applies it and resets the operation to none.
+ */
+template <typename T>
+struct alignas(stackCacheLineSize) StackCombiningRequest {
+    /** Requested operation, or none if there's no request (or it's done) */
+    std::atomic<StackCombiningOperation> operation{StackCombiningOperation::none};
+
+    /** Element to move on top of the stack (push), or where to move the top element (pop) */
+    T* value;
+
+    /** Result of the pop request: true, if the value was popped, false if the stack was empty */
+    bool popped;
+};
+
+/** Counters of the combiner work */
+struct StackCombiningStats {
+    /** Number of batches applied by the combiners */
+    size_t batches;
+
+    /** Number of requests applied by the combiners. Average batch size is requests / batches */
+    size_t requests;
+};
+
+/**
+ * Generic thread-safe stack with flat combining, that can contain any (almost) value of type T.
+ * Stack operations (construct/destruct, push, pop, etc) should be performed using the functions below.
+ * Only push, emplace, tryPop, getStackSize and getCombiningStats can be called concurrently.
+ * Stack can perform different corruption checking (see StackPolicy): silent verification, canary guards, hash checking.
+ */
+template <typename T, typename Policy = StackSecurityPolicy<0>, size_t InlineCapacity = 0>
+struct CombiningStack {
+    using ElementType    = T;
+    using SecurityPolicy = Policy;
+
+    /* !!! Private members !!! */
+
+    /** Stack the elements are stored in. Used only by the combiner */
+    ImmortalStack<T, Policy, InlineCapacity> _stack;
+
+    /** Request slots of the threads, indexed by getStackThreadIndex */
+    StackCombiningRequest<T> _requests[STACK_MAX_THREADS];
+
+    /** Lock of the combiner */
+    alignas(stackCacheLineSize) std::mutex _lock;
+
+    /** Number of batches applied by the combiners */
+    size_t _batches;
+
+    /** Number of requests applied by the combiners */
+    size_t _combinedRequests;
+};
+
+/**
+ * Checks if the given combining stack is in normal state. Must be called by the combiner (with the lock taken).
+ * @param[in, out] stack stack to check
+ * @return true, if the given stack is ok, false otherwise.
+ */
+template <typename T, typename P, size_t N>
+bool isStackOk(CombiningStack<T, P, N>* stack);
+
+/**
+ * Creates a new combining stack with a given initial size of the data array.
+ * @param[in, out] thiz       pointer to the stack this operation should be performed on
+ * @param[in] initialCapacity initial size of the data array
+ * @param[in] allocator       allocator of the data array
+ */
+template <typename T, typename P, size_t N>
+void constructStack(
+    CombiningStack<T, P, N>* thiz,
+    size_t initialCapacity = 0,
+    const StackAllocator* allocator = &systemStackAllocator
+);
+
+/**
+ * Destructs the given combining stack. Frees the dynamic memory and resets all struct members to initial state.
+ * Must not be called while other threads use the stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ */
+template <typename T, typename P, size_t N>
+void destructStack(CombiningStack<T, P, N>* thiz);
+
+/**
+ * Constructs the new element from the given arguments and pushes it on top of the combining stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] args      arguments of the element constructor
+ */
+template <typename T, typename P, size_t N, typename... Args>
+void emplace(CombiningStack<T, P, N>* thiz, Args&&... args);
+
+/**
+ * Pushes the copy of the given element on top of the combining stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] x         value to put on top of the stack
+ */
+template <typename T, typename P, size_t N>
+void push(CombiningStack<T, P, N>* thiz, const StackNonDeduced<T>& x);
+
+/**
+ * Moves the given element on top of the combining stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] x         value to put on top of the stack
+ */
+template <typename T, typename P, size_t N>
+void push(CombiningStack<T, P, N>* thiz, StackNonDeduced<T>&& x);
+
+/**
+ * Removes value from top of the combining stack, if it's not empty. The value is moved out of the stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[out] value    where to move the value that was on top of the stack
+ * @return true, if the value was popped, false if the stack was empty.
+ */
+template <typename T, typename P, size_t N>
+bool tryPop(CombiningStack<T, P, N>* thiz, T* value);
+
+/**
+ * Gives the number of elements in the given combining stack.
+ * Other threads can change it at any moment, so it's only an estimate, if the stack is used concurrently.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return size of the stack.
+ */
+template <typename T, typename P, size_t N>
+ssize_t getStackSize(CombiningStack<T, P, N>* thiz);
+
+/**
+ * Gives the counters of the combiner work.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return combining counters.
+ */
+template <typename T, typename P, size_t N>
+StackCombiningStats getCombiningStats(CombiningStack<T, P, N>* thiz);
+
+/**
+ * Posts the request of the current thread and waits until it's done, combining the requests if the lock is free.
+ * @param[in, out] thiz    pointer to the stack this operation should be performed on
+ * @param[in] operation    push or pop
+ * @param[in, out] value   element to push, or where to move the popped element
+ * @return true, if the request was pop and the value was popped, false otherwise.
+ */
+template <typename T, typename P, size_t N>
+bool postStackRequest(CombiningStack<T, P, N>* thiz, StackCombiningOperation operation, T* value);
+
+/**
+ * Applies all posted requests as one batch. The stack is checked and its hash is updated once for the whole batch.
+ * Must be called with the lock taken.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ */
+template <typename T, typename P, size_t N>
+void combineStackRequests(CombiningStack<T, P, N>* thiz);
+
+/**
+ * Logs the members of the given combining stack (combining counters and the stack) into the log file. Used in LOG_STACK.
+ * @param[in] stack stack to log (not nullptr)
+ */
+template <typename T, typename P, size_t N>
+void logStackMembers(CombiningStack<T, P, N>* stack);
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * Checks if the given combining stack is in normal state. Must be called by the combiner (with the lock taken).
+ * @param[in, out] stack stack to check
+ * @return true, if the given stack is ok, false otherwise.
+ */
+template <typename T, typename P, size_t N>
+bool isStackOk(CombiningStack<T, P, N>* stack) {
+    return (stack != nullptr) && isStackOk(&stack->_stack);
+}
+
+/**
+ * Creates a new combining stack with a given initial size of the data array.
+ * @param[in, out] thiz       pointer to the stack this operation should be performed on
+ * @param[in] initialCapacity initial size of the data array
+ * @param[in] allocator       allocator of the data array
+ */
+template <typename T, typename P, size_t N>
+void constructStack(CombiningStack<T, P, N>* const thiz, size_t initialCapacity, const StackAllocator* allocator) {
+    CHECK_STACK_CONDITION(thiz, thiz != nullptr);
+
+    constructStack(&thiz->_stack, initialCapacity, allocator);
+    thiz->_batches = 0;
+    thiz->_combinedRequests = 0;
+}
+
+/**
+ * Destructs the given combining stack. Frees the dynamic memory and resets all struct members to initial state.
+ * Must not be called while other threads use the stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ */
+template <typename T, typename P, size_t N>
+void destructStack(CombiningStack<T, P, N>* const thiz) {
+    CHECK_STACK_OK(thiz);
+
+    destructStack(&thiz->_stack);
+    thiz->_batches = 0;
+    thiz->_combinedRequests = 0;
+}
+
+/**
+ * Constructs the new element from the given arguments and pushes it on top of the combining stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] args      arguments of the element constructor
+ */
+template <typename T, typename P, size_t N, typename... Args>
+void emplace(CombiningStack<T, P, N>* const thiz, Args&&... args) {
+    CHECK_STACK_CONDITION(thiz, thiz != nullptr);
+
+    T value(std::forward<Args>(args)...);
+    postStackRequest(thiz, StackCombiningOperation::push, &value);
+}
+
+/**
+ * Pushes the copy of the given element on top of the combining stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] x         value to put on top of the stack
+ */
+template <typename T, typename P, size_t N>
+void push(CombiningStack<T, P, N>* const thiz, const StackNonDeduced<T>& x) {
+    emplace(thiz, x);
+}
+
+/**
+ * Moves the given element on top of the combining stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] x         value to put on top of the stack
+ */
+template <typename T, typename P, size_t N>
+void push(CombiningStack<T, P, N>* const thiz, StackNonDeduced<T>&& x) {
+    CHECK_STACK_CONDITION(thiz, thiz != nullptr);
+
+    postStackRequest(thiz, StackCombiningOperation::push, &x);
+}
+
+/**
+ * Removes value from top of the combining stack, if it's not empty. The value is moved out of the stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[out] value    where to move the value that was on top of the stack
+ * @return true, if the value was popped, false if the stack was empty.
+ */
+template <typename T, typename P, size_t N>
+bool tryPop(CombiningStack<T, P, N>* const thiz, T* const value) {
+    CHECK_STACK_CONDITION(thiz, thiz != nullptr);
+    CHECK_STACK_CONDITION(thiz, value != nullptr);
+
+    return postStackRequest(thiz, StackCombiningOperation::pop, value);
+}
+
+/**
+ * Gives the number of elements in the given combining stack.
+ * Other threads can change it at any moment, so it's only an estimate, if the stack is used concurrently.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return size of the stack.
+ */
+template <typename T, typename P, size_t N>
+ssize_t getStackSize(CombiningStack<T, P, N>* const thiz) {
+    CHECK_STACK_CONDITION(thiz, thiz != nullptr);
+
+    std::lock_guard<std::mutex> guard(thiz->_lock);
+    return getStackSize(&thiz->_stack);
+}
+
+/**
+ * Gives the counters of the combiner work.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return combining counters.
+ */
+template <typename T, typename P, size_t N>
+StackCombiningStats getCombiningStats(CombiningStack<T, P, N>* const thiz) {
+    CHECK_STACK_CONDITION(thiz, thiz != nullptr);
+
+    std::lock_guard<std::mutex> guard(thiz->_lock);
+    return {thiz->_batches, thiz->_combinedRequests};
+}
+
+/**
+ * Posts the request of the current thread and waits until it's done, combining the requests if the lock is free.
+ * @param[in, out] thiz    pointer to the stack this operation should be performed on
+ * @param[in] operation    push or pop
+ * @param[in, out] value   element to push, or where to move the popped element
+ * @return true, if the request was pop and the value was popped, false otherwise.
+ */
+template <typename T, typename P, size_t N>
+bool postStackRequest(CombiningStack<T, P, N>* const thiz, StackCombiningOperation operation, T* const value) {
+    StackCombiningRequest<T>* request = &thiz->_requests[getStackThreadIndex()];
+    request->value = value;
+    request->popped = false;
+    request->operation.store(operation, std::memory_order_release);
+
+    for (size_t spins = 0; request->operation.load(std::memory_order_acquire) != StackCombiningOperation::none; ) {
+        if (thiz->_lock.try_lock()) {
+            // Request is posted before the lock is taken, so the combiner applies it too
+            combineStackRequests(thiz);
+            thiz->_lock.unlock();
+        } else if (spins < STACK_COMBINING_SPINS) {
+            STACK_CPU_RELAX();
+            ++spins;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    return request->popped;
+}
+
+/**
+ * Applies all posted requests as one batch. The stack is checked and its hash is updated once for the whole batch.
+ * Must be called with the lock taken.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ */
+template <typename T, typename P, size_t N>
+void combineStackRequests(CombiningStack<T, P, N>* const thiz) {
+    ImmortalStack<T, P, N>* stack = &thiz->_stack;
+    CHECK_STACK_OK(stack);
+
+    // Requests are marked done only after the batch is verified, the threads can post new ones meanwhile
+    StackCombiningRequest<T>* batch[STACK_MAX_THREADS];
+    size_t batchSize = 0;
+
+    for (StackCombiningRequest<T>& request : thiz->_requests) {
+        StackCombiningOperation operation = request.operation.load(std::memory_order_acquire);
+        if (operation == StackCombiningOperation::none) continue;
+
+        if (operation == StackCombiningOperation::push) {
+            if (stack->_size == stack->_capacity) {
+                reallocateStackData(stack, (stack->_capacity == 0) ? 1 : stack->_capacity * STACK_ENLARGE_MULTIPLIER);
+            }
+            T* slot = getStackData(stack) + stack->_size;
+            new (slot) T(std::move(*request.value));
+            ++stack->_size;
+            STACK_METRICS_ADD(stack, STACK_METRIC_PUSHES, 1);
+            STACK_METRICS_RAISE(stack, STACK_METRIC_PEAK_SIZE, stack->_size);
+
+            if constexpr (P::Hashing::enabled) {
+                hashPushedElements(stack, stack->_size - 1, 1);
+            }
+        } else if (stack->_size > 0) {
+            STACK_METRICS_ADD(stack, STACK_METRIC_POPS, 1);
+            --stack->_size;
+            T* slot = getStackData(stack) + stack->_size;
+            if constexpr (P::Hashing::enabled) {
+                unhashPoppedElements(stack, stack->_size, 1);
+            }
+
+            moveStackElements(request.value, slot, 1);
+            destructStackElements(slot, 1);
+            request.popped = true;
+        }
+
+        batch[batchSize++] = &request;
+    }
+
+    shrinkIfSparse(stack);
+    if constexpr (P::Hashing::enabled) {
+        updateStackHash(stack);
+    }
+
+    CHECK_STACK_OK(stack);
+
+    ++thiz->_batches;
+    thiz->_combinedRequests += batchSize;
+    for (size_t i = 0; i < batchSize; ++i) {
+        batch[i]->operation.store(StackCombiningOperation::none, std::memory_order_release);
+    }
+}
+
+/**
+ * Logs the members of the given combining stack (combining counters and the stack) into the log file. Used in LOG_STACK.
+ * @param[in] stack stack to log (not nullptr)
+ */
+template <typename T, typename P, size_t N>
+void logStackMembers(CombiningStack<T, P, N>* const stack) {
+    size_t batches = stack->_batches;
+    size_t requests = stack->_combinedRequests;
+    LOG_VALUE_INDENTED(batches, "\t");
+    LOG_VALUE_INDENTED(requests, "\t");
+
+    logStackMembers(&stack->_stack);
+}
+
+#endif // IMMORTAL_STACK_COMBINING_STACK_H
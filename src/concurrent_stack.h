@@ -0,0 +1,733 @@
+/**
+ * @file
+ * @brief Definition and implementation of lock-free concurrent stack template
+ *
+ * ConcurrentStack<T, Policy> is a Treiber stack: a singly linked list of nodes, whose top is replaced
+ * with compare-and-swap, so push and pop can be called from any number of threads without locks.
+ * Popped nodes are reclaimed with hazard pointers: a thread publishes the node it's going to read,
+ * and retired nodes are freed only when no thread has published them. As a node can't be reused while it's
+ * published, hazard pointers protect from ABA problem too.
+ *
+ * Security policies are the same as for ImmortalStack, but they are applied to each node: with canaries each node
+ * is guarded by its own canaries, with hashing each node keeps the hash of its element and link.
+ * Nodes are verified when they are popped. Stack members change concurrently, so they are not hashed.
+ */
+#ifndef IMMORTAL_STACK_CONCURRENT_STACK_H
+#define IMMORTAL_STACK_CONCURRENT_STACK_H
+
+#include <algorithm>
+#include <atomic>
+#include "immortal_stack.h"
+
+/** Maximal number of threads that use concurrent stacks at the same time */
+#ifndef STACK_MAX_THREADS
+    #define STACK_MAX_THREADS 128
+#endif
+
+/** Retired nodes of the concurrent stack are reclaimed when there are at least this number of them */
+#ifndef STACK_RECLAIM_THRESHOLD
+    #define STACK_RECLAIM_THRESHOLD (2 * STACK_MAX_THREADS)
+#endif
+
+/** Size of the cache line, data that is written by different threads doesn't share cache lines */
+constexpr size_t stackCacheLineSize = 64;
+
+/** Hazard pointers of the threads. Node that is the hazard pointer of some thread is not freed */
+inline std::atomic<void*> stackHazardPointers[STACK_MAX_THREADS];
+
+/** Flags of the hazard pointers that are owned by running threads */
+inline std::atomic<bool> stackHazardPointersOwned[STACK_MAX_THREADS];
+
+/**
+ * Owner of the hazard pointer of the current thread.
+ * Takes a free hazard pointer on the first use by the thread and releases it when the thread exits.
+ * If more than STACK_MAX_THREADS threads use concurrent stacks at the same time, the process is aborted
+ * (in release builds too, as the thread index would be out of bounds).
+ */
+struct StackHazardPointerOwner {
+    std::atomic<void*>* hazardPointer = nullptr;
+    std::atomic<bool>*  owned = nullptr;
+
+    StackHazardPointerOwner() {
+        for (size_t i = 0; i < STACK_MAX_THREADS; ++i) {
+            bool expected = false;
+            if (stackHazardPointersOwned[i].compare_exchange_strong(expected, true)) {
+                hazardPointer = &stackHazardPointers[i];
+                owned = &stackHazardPointersOwned[i];
+                break;
+            }
+        }
+        if (hazardPointer == nullptr) {
+            fprintf(stderr, "More than %d threads use concurrent stacks, increase STACK_MAX_THREADS\n", STACK_MAX_THREADS);
+            abort();
+        }
+    }
+
+    ~StackHazardPointerOwner() {
+        hazardPointer->store(nullptr);
+        owned->store(false);
+    }
+};
+
+/**
+ * Gives the hazard pointer of the current thread.
+ * @return pointer to the hazard pointer.
+ */
+inline std::atomic<void*>* getStackHazardPointer() {
+    static thread_local StackHazardPointerOwner owner;
+    return owner.hazardPointer;
+}
+
+/**
+ * Gives the index of the current thread among the running threads, that is the index of its hazard pointer.
+ * @return index from 0 to STACK_MAX_THREADS - 1, unique among the running threads.
+ */
+inline size_t getStackThreadIndex() {
+    return (size_t)(getStackHazardPointer() - stackHazardPointers);
+}
+
+/**
+ * Node of the concurrent stack with one element.
+ * Element is constructed in place, the node is allocated with the stack allocator.
+ */
+template <typename T, typename Policy>
+struct ConcurrentStackNode {
+    [[no_unique_address]] typename StackCanaryArray<Policy::Canaries::number, 0>::Type _canariesBefore;
+
+    /** Hash of the node members (see getNodeHash) */
+    [[no_unique_address]] StackHashValue<Policy::Hashing::enabled, 1> _hash;
+
+    /**
+     * Node below this one, or nullptr if it's the bottom one. Links the retired nodes after the node is popped.
+     * Atomic, as the popping threads read it while the node can be popped and retired by another thread
+     */
+    std::atomic<ConcurrentStackNode*> _next;
+
+    /** Element of the node */
+    alignas(T) char _value[sizeof(T)];
+
+    [[no_unique_address]] typename StackCanaryArray<Policy::Canaries::number, 2>::Type _canariesAfter;
+};
+
+/**
+ * Generic lock-free stack that can contain any (almost) value of type T.
+ * Stack operations (construct/destruct, push, pop, etc) should be performed using the functions below.
+ * Only push, emplace, tryPop and getStackSize can be called concurrently.
+ * Stack can perform different corruption checking (see StackPolicy): silent verification, canary guards, hash checking.
+ */
+template <typename T, typename Policy = StackSecurityPolicy<0>>
+struct ConcurrentStack {
+    using ElementType    = T;
+    using SecurityPolicy = Policy;
+    using Node           = ConcurrentStackNode<T, Policy>;
+
+    /* !!! Private members !!! */
+
+    [[no_unique_address]] typename StackCanaryArray<Policy::Canaries::number, 0>::Type _canariesBefore;
+
+    /** The top node, or nullptr if the stack is empty */
+    std::atomic<Node*> _top{nullptr};
+
+    /** Number of elements in stack. Incremented before the node is pushed and decremented after it's popped */
+    std::atomic<ssize_t> _size{0};
+
+    /** List of popped nodes that are not freed yet */
+    std::atomic<Node*> _retired{nullptr};
+
+    /** Number of nodes in the retired list */
+    std::atomic<ssize_t> _retiredCount{0};
+
+    /** Allocator of the nodes */
+    const StackAllocator* _allocator = nullptr;
+
+    [[no_unique_address]] typename StackCanaryArray<Policy::Canaries::number, 1>::Type _canariesAfter;
+};
+
+/**
+ * Checks if the given concurrent stack is in normal state (correct size, allocator and canary values).
+ * Nodes are not checked, they are checked one by one when they are popped (see isStackNodeOk).
+ * @param[in, out] stack stack to check
+ * @return true, if the given stack is ok, false otherwise.
+ */
+template <typename T, typename P>
+bool isStackOk(ConcurrentStack<T, P>* stack);
+
+/**
+ * Checks if canaries and hash of the given node are correct.
+ * @param[in] node pointer to the node to check
+ * @return true, if the node is ok, false otherwise.
+ */
+template <typename T, typename P>
+bool isStackNodeOk(ConcurrentStackNode<T, P>* node);
+
+/**
+ * Creates a new concurrent stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] allocator allocator of the nodes (must be thread-safe)
+ */
+template <typename T, typename P>
+void constructStack(ConcurrentStack<T, P>* thiz, const StackAllocator* allocator = &systemStackAllocator);
+
+/**
+ * Destructs the given concurrent stack. Frees all its nodes and resets all struct members to initial state.
+ * Must not be called while other threads use the stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ */
+template <typename T, typename P>
+void destructStack(ConcurrentStack<T, P>* thiz);
+
+/**
+ * Constructs the new element on top of the concurrent stack from the given arguments (in place).
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] args      arguments of the element constructor
+ */
+template <typename T, typename P, typename... Args>
+void emplace(ConcurrentStack<T, P>* thiz, Args&&... args);
+
+/**
+ * Pushes the copy of the given element on top of the concurrent stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] x         value to put on top of the stack
+ */
+template <typename T, typename P>
+void push(ConcurrentStack<T, P>* thiz, const StackNonDeduced<T>& x);
+
+/**
+ * Moves the given element on top of the concurrent stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] x         value to put on top of the stack
+ */
+template <typename T, typename P>
+void push(ConcurrentStack<T, P>* thiz, StackNonDeduced<T>&& x);
+
+/**
+ * Removes value from top of the concurrent stack, if it's not empty. The value is moved out of the stack.
+ * The popped node is verified after it's unlinked, when other threads can't access it.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[out] value    where to move the value that was on top of the stack
+ * @return true, if the value was popped, false if the stack was empty.
+ */
+template <typename T, typename P>
+bool tryPop(ConcurrentStack<T, P>* thiz, T* value);
+
+/**
+ * Gives the number of elements in the given concurrent stack.
+ * Other threads can change it at any moment, so it's only an estimate, if the stack is used concurrently.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return size of the stack.
+ */
+template <typename T, typename P>
+ssize_t getStackSize(ConcurrentStack<T, P>* thiz);
+
+/**
+ * Allocates a new node, constructs its element from the given arguments and hashes the node.
+ * Counts the element in the stack size.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] args      arguments of the element constructor
+ * @return pointer to the node, that is not linked yet.
+ */
+template <typename T, typename P, typename... Args>
+ConcurrentStackNode<T, P>* createStackNode(ConcurrentStack<T, P>* thiz, Args&&... args);
+
+/**
+ * Makes one attempt to link the given node on top of the concurrent stack. Hashes the node before linking it.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] node      pointer to the node created with createStackNode
+ * @return true, if the node is linked, false if another thread has changed the top of the stack.
+ */
+template <typename T, typename P>
+bool tryLinkStackNode(ConcurrentStack<T, P>* thiz, ConcurrentStackNode<T, P>* node);
+
+/**
+ * Makes one attempt to unlink the top node of the concurrent stack. The node is verified after it's unlinked.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[out] node     the unlinked node, or nullptr if the stack is empty
+ * @return true, if the attempt is completed, false if another thread has changed the top of the stack.
+ */
+template <typename T, typename P>
+bool tryUnlinkStackNode(ConcurrentStack<T, P>* thiz, ConcurrentStackNode<T, P>** node);
+
+/**
+ * Moves the element out of the unlinked node, destructs it and retires the node.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] node      pointer to the unlinked node
+ * @param[out] value    where to move the element of the node
+ */
+template <typename T, typename P>
+void releaseStackNode(ConcurrentStack<T, P>* thiz, ConcurrentStackNode<T, P>* node, T* value);
+
+/**
+ * Allocates a new node with the stack allocator and sets its canaries.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return pointer to the allocated node, or nullptr if there's not enough memory.
+ */
+template <typename T, typename P>
+ConcurrentStackNode<T, P>* allocateStackNode(ConcurrentStack<T, P>* thiz);
+
+/**
+ * Frees the given node with the stack allocator. Element of the node must be already destructed.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @param[in] node pointer to the node to free
+ */
+template <typename T, typename P>
+void freeStackNode(ConcurrentStack<T, P>* thiz, ConcurrentStackNode<T, P>* node);
+
+/**
+ * Puts the popped node into the retired list of the concurrent stack.
+ * Reclaims the retired nodes, if there are STACK_RECLAIM_THRESHOLD of them.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] node      pointer to the popped node, its element must be already destructed
+ */
+template <typename T, typename P>
+void retireStackNode(ConcurrentStack<T, P>* thiz, ConcurrentStackNode<T, P>* node);
+
+/**
+ * Frees the retired nodes of the concurrent stack, that are not hazard pointers of any thread.
+ * Other nodes are put back into the retired list.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ */
+template <typename T, typename P>
+void reclaimStackNodes(ConcurrentStack<T, P>* thiz);
+
+/**
+ * Calculates the hash value of the given node members (see STACK_HASH_ALGORITHM). Skips _hash member of the node.
+ * @param[in] node pointer to the node
+ * @return calculated hash value.
+ */
+template <typename T, typename P>
+unsigned long long getNodeHash(ConcurrentStackNode<T, P>* node);
+
+/**
+ * Logs the members of the given concurrent stack (size, number of retired nodes and the top node) into the log file.
+ * Used in LOG_STACK. Other threads can pop and reclaim the nodes while the stack is logged, so only the top node is logged:
+ * it's protected with the hazard pointer of this thread, and its element is logged only if T is trivially copyable
+ * (it may be already moved out by another thread).
+ * @param[in] stack stack to log (not nullptr)
+ */
+template <typename T, typename P>
+void logStackMembers(ConcurrentStack<T, P>* stack);
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * Checks if the given concurrent stack is in normal state (correct size, allocator and canary values).
+ * Nodes are not checked, they are checked one by one when they are popped (see isStackNodeOk).
+ * @param[in, out] stack stack to check
+ * @return true, if the given stack is ok, false otherwise.
+ */
+template <typename T, typename P>
+bool isStackOk(ConcurrentStack<T, P>* stack) {
+    if (
+        (stack == nullptr)                               ||
+        (stack->_size.load(std::memory_order_relaxed) < 0) ||
+        (stack->_allocator == nullptr)
+    ) {
+        return false;
+    }
+
+    if constexpr (P::Canaries::number > 0) {
+        for (size_t i = 0; i < P::Canaries::number; ++i) {
+            if (stack->_canariesBefore[i] != canaryValue) return false;
+            if (stack->_canariesAfter [i] != canaryValue) return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Checks if canaries and hash of the given node are correct.
+ * @param[in] node pointer to the node to check
+ * @return true, if the node is ok, false otherwise.
+ */
+template <typename T, typename P>
+bool isStackNodeOk(ConcurrentStackNode<T, P>* const node) {
+    if constexpr (P::Canaries::number > 0) {
+        for (size_t i = 0; i < P::Canaries::number; ++i) {
+            if (node->_canariesBefore[i] != canaryValue) return false;
+            if (node->_canariesAfter [i] != canaryValue) return false;
+        }
+    }
+
+    if constexpr (P::Hashing::enabled) {
+        if (getNodeHash(node) != node->_hash) return false;
+    }
+
+    (void)node;
+    return true;
+}
+
+/**
+ * Creates a new concurrent stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] allocator allocator of the nodes (must be thread-safe)
+ */
+template <typename T, typename P>
+void constructStack(ConcurrentStack<T, P>* const thiz, const StackAllocator* allocator) {
+    CHECK_STACK_CONDITION(thiz, (thiz != nullptr) && (thiz->_top.load() == nullptr));
+    CHECK_STACK_CONDITION(thiz, allocator != nullptr);
+
+    if constexpr (P::Canaries::number > 0) {
+        for (size_t i = 0; i < P::Canaries::number; ++i) {
+            thiz->_canariesBefore[i] = canaryValue;
+            thiz->_canariesAfter [i] = canaryValue;
+        }
+    }
+
+    thiz->_top.store(nullptr);
+    thiz->_size.store(0);
+    thiz->_retired.store(nullptr);
+    thiz->_retiredCount.store(0);
+    thiz->_allocator = allocator;
+}
+
+/**
+ * Destructs the given concurrent stack. Frees all its nodes and resets all struct members to initial state.
+ * Must not be called while other threads use the stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ */
+template <typename T, typename P>
+void destructStack(ConcurrentStack<T, P>* const thiz) {
+    CHECK_STACK_OK(thiz);
+
+    ConcurrentStackNode<T, P>* node = thiz->_top.exchange(nullptr);
+    while (node != nullptr) {
+        ConcurrentStackNode<T, P>* next = node->_next.load(std::memory_order_relaxed);
+        destructStackElements((T*)node->_value, 1);
+        freeStackNode(thiz, node);
+        node = next;
+    }
+
+    node = thiz->_retired.exchange(nullptr);
+    while (node != nullptr) {
+        ConcurrentStackNode<T, P>* next = node->_next.load(std::memory_order_relaxed);
+        freeStackNode(thiz, node);
+        node = next;
+    }
+
+    thiz->_size.store(0);
+    thiz->_retiredCount.store(0);
+    thiz->_allocator = nullptr;
+}
+
+/**
+ * Constructs the new element on top of the concurrent stack from the given arguments (in place).
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] args      arguments of the element constructor
+ */
+template <typename T, typename P, typename... Args>
+void emplace(ConcurrentStack<T, P>* const thiz, Args&&... args) {
+    CHECK_STACK_OK(thiz);
+
+    ConcurrentStackNode<T, P>* node = createStackNode(thiz, std::forward<Args>(args)...);
+    while (!tryLinkStackNode(thiz, node)) {}
+}
+
+/**
+ * Pushes the copy of the given element on top of the concurrent stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] x         value to put on top of the stack
+ */
+template <typename T, typename P>
+void push(ConcurrentStack<T, P>* const thiz, const StackNonDeduced<T>& x) {
+    emplace(thiz, x);
+}
+
+/**
+ * Moves the given element on top of the concurrent stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] x         value to put on top of the stack
+ */
+template <typename T, typename P>
+void push(ConcurrentStack<T, P>* const thiz, StackNonDeduced<T>&& x) {
+    emplace(thiz, std::move(x));
+}
+
+/**
+ * Removes value from top of the concurrent stack, if it's not empty. The value is moved out of the stack.
+ * The popped node is verified after it's unlinked, when other threads can't access it.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[out] value    where to move the value that was on top of the stack
+ * @return true, if the value was popped, false if the stack was empty.
+ */
+template <typename T, typename P>
+bool tryPop(ConcurrentStack<T, P>* const thiz, T* const value) {
+    CHECK_STACK_OK(thiz);
+    CHECK_STACK_CONDITION(thiz, value != nullptr);
+
+    ConcurrentStackNode<T, P>* node = nullptr;
+    while (!tryUnlinkStackNode(thiz, &node)) {}
+    if (node == nullptr) {
+        return false;
+    }
+
+    releaseStackNode(thiz, node, value);
+    return true;
+}
+
+/**
+ * Gives the number of elements in the given concurrent stack.
+ * Other threads can change it at any moment, so it's only an estimate, if the stack is used concurrently.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return size of the stack.
+ */
+template <typename T, typename P>
+ssize_t getStackSize(ConcurrentStack<T, P>* const thiz) {
+    CHECK_STACK_CONDITION(thiz, thiz != nullptr);
+
+    return thiz->_size.load(std::memory_order_relaxed);
+}
+
+/**
+ * Allocates a new node, constructs its element from the given arguments and hashes the node.
+ * Counts the element in the stack size.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] args      arguments of the element constructor
+ * @return pointer to the node, that is not linked yet.
+ */
+template <typename T, typename P, typename... Args>
+ConcurrentStackNode<T, P>* createStackNode(ConcurrentStack<T, P>* const thiz, Args&&... args) {
+    ConcurrentStackNode<T, P>* node = allocateStackNode(thiz);
+    CHECK_STACK_CONDITION(thiz, node != nullptr);
+    new (node->_value) T(std::forward<Args>(args)...);
+    if constexpr (P::Hashing::enabled) {
+        node->_hash = getNodeHash(node);
+    }
+
+    thiz->_size.fetch_add(1, std::memory_order_relaxed);
+
+    return node;
+}
+
+/**
+ * Makes one attempt to link the given node on top of the concurrent stack. Hashes the node before linking it.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] node      pointer to the node created with createStackNode
+ * @return true, if the node is linked, false if another thread has changed the top of the stack.
+ */
+template <typename T, typename P>
+bool tryLinkStackNode(ConcurrentStack<T, P>* const thiz, ConcurrentStackNode<T, P>* const node) {
+    ConcurrentStackNode<T, P>* next = thiz->_top.load(std::memory_order_relaxed);
+    node->_next.store(next, std::memory_order_relaxed);
+    if constexpr (P::Hashing::enabled) {
+        node->_hash = getNodeHash(node);
+    }
+
+    return thiz->_top.compare_exchange_strong(next, node, std::memory_order_release, std::memory_order_relaxed);
+}
+
+/**
+ * Makes one attempt to unlink the top node of the concurrent stack. The node is verified after it's unlinked.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[out] node     the unlinked node, or nullptr if the stack is empty
+ * @return true, if the attempt is completed, false if another thread has changed the top of the stack.
+ */
+template <typename T, typename P>
+bool tryUnlinkStackNode(ConcurrentStack<T, P>* const thiz, ConcurrentStackNode<T, P>** const node) {
+    std::atomic<void*>* hazardPointer = getStackHazardPointer();
+    ConcurrentStackNode<T, P>* top = thiz->_top.load();
+    if (top == nullptr) {
+        *node = nullptr;
+        return true;
+    }
+
+    // The node can't be freed after it's published, if it's still on top
+    hazardPointer->store(top);
+    if (thiz->_top.load() != top) {
+        hazardPointer->store(nullptr);
+        return false;
+    }
+
+    bool unlinked = thiz->_top.compare_exchange_strong(top, top->_next.load(std::memory_order_relaxed));
+    hazardPointer->store(nullptr);
+    if (!unlinked) {
+        *node = nullptr;
+        return false;
+    }
+
+    // Other threads can move the element out of the node and retire it until it's unlinked, so it's checked only now
+    CHECK_STACK_CONDITION(thiz, isStackNodeOk(top));
+    *node = top;
+    return true;
+}
+
+/**
+ * Moves the element out of the unlinked node, destructs it and retires the node.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] node      pointer to the unlinked node
+ * @param[out] value    where to move the element of the node
+ */
+template <typename T, typename P>
+void releaseStackNode(ConcurrentStack<T, P>* const thiz, ConcurrentStackNode<T, P>* const node, T* const value) {
+    thiz->_size.fetch_sub(1, std::memory_order_relaxed);
+
+    *value = std::move(*(T*)node->_value);
+    destructStackElements((T*)node->_value, 1);
+    retireStackNode(thiz, node);
+}
+
+/**
+ * Allocates a new node with the stack allocator and sets its canaries.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return pointer to the allocated node, or nullptr if there's not enough memory.
+ */
+template <typename T, typename P>
+ConcurrentStackNode<T, P>* allocateStackNode(ConcurrentStack<T, P>* const thiz) {
+    auto node = (ConcurrentStackNode<T, P>*)thiz->_allocator->allocate(
+        thiz->_allocator->context, sizeof(ConcurrentStackNode<T, P>)
+    );
+    if (node == nullptr) return nullptr;
+
+    if constexpr (P::Canaries::number > 0) {
+        for (size_t i = 0; i < P::Canaries::number; ++i) {
+            node->_canariesBefore[i] = canaryValue;
+            node->_canariesAfter [i] = canaryValue;
+        }
+    }
+    node->_next.store(nullptr, std::memory_order_relaxed);
+
+    return node;
+}
+
+/**
+ * Frees the given node with the stack allocator. Element of the node must be already destructed.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @param[in] node pointer to the node to free
+ */
+template <typename T, typename P>
+void freeStackNode(ConcurrentStack<T, P>* const thiz, ConcurrentStackNode<T, P>* const node) {
+    thiz->_allocator->deallocate(thiz->_allocator->context, node, sizeof(ConcurrentStackNode<T, P>));
+}
+
+/**
+ * Puts the popped node into the retired list of the concurrent stack.
+ * Reclaims the retired nodes, if there are STACK_RECLAIM_THRESHOLD of them.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] node      pointer to the popped node, its element must be already destructed
+ */
+template <typename T, typename P>
+void retireStackNode(ConcurrentStack<T, P>* const thiz, ConcurrentStackNode<T, P>* const node) {
+    ConcurrentStackNode<T, P>* retired = thiz->_retired.load(std::memory_order_relaxed);
+    do {
+        node->_next.store(retired, std::memory_order_relaxed);
+    } while (!thiz->_retired.compare_exchange_weak(retired, node));
+
+    if (thiz->_retiredCount.fetch_add(1, std::memory_order_relaxed) + 1 >= STACK_RECLAIM_THRESHOLD) {
+        reclaimStackNodes(thiz);
+    }
+}
+
+/**
+ * Frees the retired nodes of the concurrent stack, that are not hazard pointers of any thread.
+ * Other nodes are put back into the retired list.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ */
+template <typename T, typename P>
+void reclaimStackNodes(ConcurrentStack<T, P>* const thiz) {
+    ConcurrentStackNode<T, P>* node = thiz->_retired.exchange(nullptr);
+    if (node == nullptr) return;
+
+    void* hazardPointers[STACK_MAX_THREADS];
+    size_t hazardPointersCount = 0;
+    for (size_t i = 0; i < STACK_MAX_THREADS; ++i) {
+        void* hazardPointer = stackHazardPointers[i].load();
+        if (hazardPointer != nullptr) {
+            hazardPointers[hazardPointersCount++] = hazardPointer;
+        }
+    }
+    std::sort(hazardPointers, hazardPointers + hazardPointersCount);
+
+    ConcurrentStackNode<T, P>* kept = nullptr;
+    ConcurrentStackNode<T, P>* keptLast = nullptr;
+    ssize_t freedCount = 0;
+    while (node != nullptr) {
+        ConcurrentStackNode<T, P>* next = node->_next.load(std::memory_order_relaxed);
+        if (std::binary_search(hazardPointers, hazardPointers + hazardPointersCount, (void*)node)) {
+            node->_next.store(kept, std::memory_order_relaxed);
+            kept = node;
+            if (keptLast == nullptr) keptLast = node;
+        } else {
+            freeStackNode(thiz, node);
+            ++freedCount;
+        }
+        node = next;
+    }
+    thiz->_retiredCount.fetch_sub(freedCount, std::memory_order_relaxed);
+
+    if (kept != nullptr) {
+        ConcurrentStackNode<T, P>* retired = thiz->_retired.load(std::memory_order_relaxed);
+        do {
+            keptLast->_next.store(retired, std::memory_order_relaxed);
+        } while (!thiz->_retired.compare_exchange_weak(retired, kept));
+    }
+}
+
+/**
+ * Calculates the hash value of the given node members (see STACK_HASH_ALGORITHM). Skips _hash member of the node.
+ * @param[in] node pointer to the node
+ * @return calculated hash value.
+ */
+template <typename T, typename P>
+unsigned long long getNodeHash(ConcurrentStackNode<T, P>* const node) {
+    char* hashBegin = (char*)&(node->_hash);
+    char* hashEnd   = hashBegin + sizeof(node->_hash);
+
+    unsigned long long hash = hashBytes(0, node, hashBegin - (char*)node);
+    return hashBytes(hash, hashEnd, (char*)node + sizeof(ConcurrentStackNode<T, P>) - hashEnd);
+}
+
+/**
+ * Logs the members of the given concurrent stack (size, number of retired nodes and the top node) into the log file.
+ * Used in LOG_STACK. Other threads can pop and reclaim the nodes while the stack is logged, so only the top node is logged:
+ * it's protected with the hazard pointer of this thread, and its element is logged only if T is trivially copyable
+ * (it may be already moved out by another thread).
+ * @param[in] stack stack to log (not nullptr)
+ */
+template <typename T, typename P>
+void logStackMembers(ConcurrentStack<T, P>* const stack) {
+    ssize_t size = stack->_size.load();
+    ssize_t retiredCount = stack->_retiredCount.load();
+    LOG_VALUE_INDENTED(size, "\t");
+    LOG_VALUE_INDENTED(retiredCount, "\t");
+
+    // Stack may be logged while this thread protects the corrupted node, so the hazard pointer is restored afterwards
+    std::atomic<void*>* hazardPointer = getStackHazardPointer();
+    void* protectedNode = hazardPointer->load();
+
+    ConcurrentStackNode<T, P>* node = stack->_top.load();
+    hazardPointer->store(node);
+    while (node != stack->_top.load()) {
+        node = stack->_top.load();
+        hazardPointer->store(node);
+    }
+
+    if (node != nullptr) {
+        logPrintf("\ttop node [" PTR_FORMAT "] = {\n", (uintptr_t)node);
+
+        if constexpr (std::is_trivially_copyable<T>::value) {
+            T* value = (T*)node->_value;
+            LOG_ARRAY_INDENTED(value, 1, "\t\t");
+        }
+        if constexpr (P::Hashing::enabled) {
+            unsigned long long hash = node->_hash;
+            LOG_VALUE_INDENTED(hash, "\t\t");
+        }
+        if constexpr (P::Canaries::number > 0) {
+            long long* canariesBefore = node->_canariesBefore;
+            long long* canariesAfter  = node->_canariesAfter;
+            LOG_ARRAY_INDENTED(canariesBefore, P::Canaries::number, "\t\t");
+            LOG_ARRAY_INDENTED(canariesAfter,  P::Canaries::number, "\t\t");
+        }
+        logPrintf("\t}\n");
+    }
+    hazardPointer->store(protectedNode);
+
+    if constexpr (P::Canaries::number > 0) {
+        long long* canariesBefore = stack->_canariesBefore;
+        long long* canariesAfter  = stack->_canariesAfter;
+        LOG_ARRAY_INDENTED(canariesBefore, P::Canaries::number, "\t");
+        LOG_ARRAY_INDENTED(canariesAfter,  P::Canaries::number, "\t");
+    }
+}
+
+#endif // IMMORTAL_STACK_CONCURRENT_STACK_H
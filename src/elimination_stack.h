@@ -0,0 +1,453 @@
+/**
+ * @file
+ * @brief Definition and implementation of elimination-backoff stack template
+ *
+ * EliminationStack<T, Policy, SlotsNumber> is ConcurrentStack with an elimination array in front of it.
+ * When compare-and-swap on the top of the stack fails, the thread backs off to a random slot of the array:
+ * pushing thread offers its node in the slot, popping thread takes the node that is offered there.
+ * Push and pop that meet in the slot cancel each other out without touching the top of the stack,
+ * so contention on the top doesn't grow with the number of threads.
+ *
+ * Backoff is adaptive: the number of slots in use grows when the slots are busy and shrinks when nobody comes,
+ * the time a thread waits in the slot doubles with each failed attempt.
+ * Nodes that are passed through the array are verified as the ones that are popped from the stack.
+ */
+#ifndef IMMORTAL_STACK_ELIMINATION_STACK_H
+#define IMMORTAL_STACK_ELIMINATION_STACK_H
+
+#include "concurrent_stack.h"
+
+/** Default number of slots in the elimination array */
+#ifndef STACK_ELIMINATION_SLOTS
+    #define STACK_ELIMINATION_SLOTS 16
+#endif
+
+/** Number of spins the thread waits in the elimination slot on the first attempt */
+#ifndef STACK_BACKOFF_MIN_SPINS
+    #define STACK_BACKOFF_MIN_SPINS 16
+#endif
+
+/** Maximal number of spins the thread waits in the elimination slot */
+#ifndef STACK_BACKOFF_MAX_SPINS
+    #define STACK_BACKOFF_MAX_SPINS 1024
+#endif
+
+/** Slot of the elimination array (slots don't share cache lines). Contains the node that is offered by the pushing thread, or nullptr */
+struct alignas(stackCacheLineSize) StackEliminationSlot {
+    std::atomic<void*> offer{nullptr};
+};
+
+/** Counters of the elimination array usage */
+struct StackEliminationStats {
+    /** Number of times the threads backed off to the elimination array */
+    size_t visits;
+
+    /** Number of times push or pop was completed in the elimination array (each exchange is counted twice) */
+    size_t hits;
+};
+
+/**
+ * Generic lock-free stack with elimination backoff, that can contain any (almost) value of type T.
+ * Stack operations (construct/destruct, push, pop, etc) should be performed using the functions below.
+ * Only push, emplace, tryPop, getStackSize and getEliminationStats can be called concurrently.
+ * Stack can perform different corruption checking (see StackPolicy): silent verification, canary guards, hash checking.
+ */
+template <typename T, typename Policy = StackSecurityPolicy<0>, size_t SlotsNumber = STACK_ELIMINATION_SLOTS>
+struct EliminationStack {
+    using ElementType    = T;
+    using SecurityPolicy = Policy;
+    using Node           = ConcurrentStackNode<T, Policy>;
+
+    static_assert(SlotsNumber > 0, "elimination array must contain at least one slot");
+
+    static constexpr size_t slotsNumber = SlotsNumber;
+
+    /* !!! Private members !!! */
+
+    /** Stack the pushed elements are stored in, if they are not eliminated */
+    ConcurrentStack<T, Policy> _stack;
+
+    /** Elimination array */
+    StackEliminationSlot _slots[SlotsNumber];
+
+    /** Number of the first slots that are in use, from 1 to SlotsNumber */
+    alignas(stackCacheLineSize) std::atomic<size_t> _range{1};
+
+    /** Number of times the threads backed off to the elimination array */
+    std::atomic<size_t> _visits{0};
+
+    /** Number of times push or pop was completed in the elimination array */
+    std::atomic<size_t> _hits{0};
+};
+
+/**
+ * Checks if the given elimination stack is in normal state (correct stack and range of the elimination array).
+ * @param[in, out] stack stack to check
+ * @return true, if the given stack is ok, false otherwise.
+ */
+template <typename T, typename P, size_t S>
+bool isStackOk(EliminationStack<T, P, S>* stack);
+
+/**
+ * Creates a new elimination stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] allocator allocator of the nodes (must be thread-safe)
+ */
+template <typename T, typename P, size_t S>
+void constructStack(EliminationStack<T, P, S>* thiz, const StackAllocator* allocator = &systemStackAllocator);
+
+/**
+ * Destructs the given elimination stack. Frees all its nodes and resets all struct members to initial state.
+ * Must not be called while other threads use the stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ */
+template <typename T, typename P, size_t S>
+void destructStack(EliminationStack<T, P, S>* thiz);
+
+/**
+ * Constructs the new element on top of the elimination stack from the given arguments (in place).
+ * Element is passed to a popping thread directly, if they meet in the elimination array.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] args      arguments of the element constructor
+ */
+template <typename T, typename P, size_t S, typename... Args>
+void emplace(EliminationStack<T, P, S>* thiz, Args&&... args);
+
+/**
+ * Pushes the copy of the given element on top of the elimination stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] x         value to put on top of the stack
+ */
+template <typename T, typename P, size_t S>
+void push(EliminationStack<T, P, S>* thiz, const StackNonDeduced<T>& x);
+
+/**
+ * Moves the given element on top of the elimination stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] x         value to put on top of the stack
+ */
+template <typename T, typename P, size_t S>
+void push(EliminationStack<T, P, S>* thiz, StackNonDeduced<T>&& x);
+
+/**
+ * Removes value from top of the elimination stack, if it's not empty. The value is moved out of the stack.
+ * Value can be taken from a pushing thread directly, if they meet in the elimination array.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[out] value    where to move the value that was on top of the stack
+ * @return true, if the value was popped, false if the stack was empty.
+ */
+template <typename T, typename P, size_t S>
+bool tryPop(EliminationStack<T, P, S>* thiz, T* value);
+
+/**
+ * Gives the number of elements in the given elimination stack.
+ * Other threads can change it at any moment, so it's only an estimate, if the stack is used concurrently.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return size of the stack.
+ */
+template <typename T, typename P, size_t S>
+ssize_t getStackSize(EliminationStack<T, P, S>* thiz);
+
+/**
+ * Gives the counters of the elimination array usage. Hit rate is hits / visits.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return elimination counters.
+ */
+template <typename T, typename P, size_t S>
+StackEliminationStats getEliminationStats(EliminationStack<T, P, S>* thiz);
+
+/**
+ * Offers the node in a random slot of the elimination array and waits for a popping thread to take it.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] node      pointer to the node created with createStackNode
+ * @param[in] spins     number of spins to wait
+ * @return true, if the node was taken, false otherwise (the node is still owned by the caller).
+ */
+template <typename T, typename P, size_t S>
+bool offerStackNode(EliminationStack<T, P, S>* thiz, ConcurrentStackNode<T, P>* node, size_t spins);
+
+/**
+ * Waits for a node in a random slot of the elimination array and takes it.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] spins     number of spins to wait
+ * @return the taken node, or nullptr if no node was offered.
+ */
+template <typename T, typename P, size_t S>
+ConcurrentStackNode<T, P>* takeStackNode(EliminationStack<T, P, S>* thiz, size_t spins);
+
+/**
+ * Gives a random slot among the slots of the elimination array that are in use.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return pointer to the slot.
+ */
+template <typename T, typename P, size_t S>
+StackEliminationSlot* getRandomEliminationSlot(EliminationStack<T, P, S>* thiz);
+
+/**
+ * Changes the number of slots of the elimination array that are in use by the given delta (within 1 and SlotsNumber).
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] delta     +1 to use more slots, -1 to use fewer ones
+ */
+template <typename T, typename P, size_t S>
+void adjustEliminationRange(EliminationStack<T, P, S>* thiz, int delta);
+
+/**
+ * Logs the members of the given elimination stack (elimination counters and the stack) into the log file. Used in LOG_STACK.
+ * @param[in] stack stack to log (not nullptr)
+ */
+template <typename T, typename P, size_t S>
+void logStackMembers(EliminationStack<T, P, S>* stack);
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * Checks if the given elimination stack is in normal state (correct stack and range of the elimination array).
+ * @param[in, out] stack stack to check
+ * @return true, if the given stack is ok, false otherwise.
+ */
+template <typename T, typename P, size_t S>
+bool isStackOk(EliminationStack<T, P, S>* stack) {
+    if (stack == nullptr || !isStackOk(&stack->_stack)) {
+        return false;
+    }
+
+    size_t range = stack->_range.load(std::memory_order_relaxed);
+    return (range >= 1) && (range <= S);
+}
+
+/**
+ * Creates a new elimination stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] allocator allocator of the nodes (must be thread-safe)
+ */
+template <typename T, typename P, size_t S>
+void constructStack(EliminationStack<T, P, S>* const thiz, const StackAllocator* allocator) {
+    CHECK_STACK_CONDITION(thiz, thiz != nullptr);
+
+    constructStack(&thiz->_stack, allocator);
+    for (StackEliminationSlot& slot : thiz->_slots) {
+        slot.offer.store(nullptr);
+    }
+    thiz->_range.store(1);
+    thiz->_visits.store(0);
+    thiz->_hits.store(0);
+}
+
+/**
+ * Destructs the given elimination stack. Frees all its nodes and resets all struct members to initial state.
+ * Must not be called while other threads use the stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ */
+template <typename T, typename P, size_t S>
+void destructStack(EliminationStack<T, P, S>* const thiz) {
+    CHECK_STACK_OK(thiz);
+
+    destructStack(&thiz->_stack);
+    thiz->_range.store(1);
+    thiz->_visits.store(0);
+    thiz->_hits.store(0);
+}
+
+/**
+ * Constructs the new element on top of the elimination stack from the given arguments (in place).
+ * Element is passed to a popping thread directly, if they meet in the elimination array.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] args      arguments of the element constructor
+ */
+template <typename T, typename P, size_t S, typename... Args>
+void emplace(EliminationStack<T, P, S>* const thiz, Args&&... args) {
+    CHECK_STACK_OK(thiz);
+
+    ConcurrentStackNode<T, P>* node = createStackNode(&thiz->_stack, std::forward<Args>(args)...);
+    for (size_t spins = STACK_BACKOFF_MIN_SPINS; !tryLinkStackNode(&thiz->_stack, node); ) {
+        if (offerStackNode(thiz, node, spins)) {
+            break;
+        }
+        spins = (spins * 2 < STACK_BACKOFF_MAX_SPINS) ? spins * 2 : STACK_BACKOFF_MAX_SPINS;
+    }
+}
+
+/**
+ * Pushes the copy of the given element on top of the elimination stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] x         value to put on top of the stack
+ */
+template <typename T, typename P, size_t S>
+void push(EliminationStack<T, P, S>* const thiz, const StackNonDeduced<T>& x) {
+    emplace(thiz, x);
+}
+
+/**
+ * Moves the given element on top of the elimination stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] x         value to put on top of the stack
+ */
+template <typename T, typename P, size_t S>
+void push(EliminationStack<T, P, S>* const thiz, StackNonDeduced<T>&& x) {
+    emplace(thiz, std::move(x));
+}
+
+/**
+ * Removes value from top of the elimination stack, if it's not empty. The value is moved out of the stack.
+ * Value can be taken from a pushing thread directly, if they meet in the elimination array.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[out] value    where to move the value that was on top of the stack
+ * @return true, if the value was popped, false if the stack was empty.
+ */
+template <typename T, typename P, size_t S>
+bool tryPop(EliminationStack<T, P, S>* const thiz, T* const value) {
+    CHECK_STACK_OK(thiz);
+    CHECK_STACK_CONDITION(thiz, value != nullptr);
+
+    ConcurrentStackNode<T, P>* node = nullptr;
+    for (size_t spins = STACK_BACKOFF_MIN_SPINS; !tryUnlinkStackNode(&thiz->_stack, &node); ) {
+        node = takeStackNode(thiz, spins);
+        if (node != nullptr) {
+            CHECK_STACK_CONDITION(thiz, isStackNodeOk(node));
+            break;
+        }
+        spins = (spins * 2 < STACK_BACKOFF_MAX_SPINS) ? spins * 2 : STACK_BACKOFF_MAX_SPINS;
+    }
+    if (node == nullptr) {
+        return false;
+    }
+
+    releaseStackNode(&thiz->_stack, node, value);
+    return true;
+}
+
+/**
+ * Gives the number of elements in the given elimination stack.
+ * Other threads can change it at any moment, so it's only an estimate, if the stack is used concurrently.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return size of the stack.
+ */
+template <typename T, typename P, size_t S>
+ssize_t getStackSize(EliminationStack<T, P, S>* const thiz) {
+    CHECK_STACK_CONDITION(thiz, thiz != nullptr);
+
+    return getStackSize(&thiz->_stack);
+}
+
+/**
+ * Gives the counters of the elimination array usage. Hit rate is hits / visits.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return elimination counters.
+ */
+template <typename T, typename P, size_t S>
+StackEliminationStats getEliminationStats(EliminationStack<T, P, S>* const thiz) {
+    CHECK_STACK_CONDITION(thiz, thiz != nullptr);
+
+    return { thiz->_visits.load(std::memory_order_relaxed), thiz->_hits.load(std::memory_order_relaxed) };
+}
+
+/**
+ * Offers the node in a random slot of the elimination array and waits for a popping thread to take it.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] node      pointer to the node created with createStackNode
+ * @param[in] spins     number of spins to wait
+ * @return true, if the node was taken, false otherwise (the node is still owned by the caller).
+ */
+template <typename T, typename P, size_t S>
+bool offerStackNode(EliminationStack<T, P, S>* const thiz, ConcurrentStackNode<T, P>* const node, size_t spins) {
+    thiz->_visits.fetch_add(1, std::memory_order_relaxed);
+    StackEliminationSlot* slot = getRandomEliminationSlot(thiz);
+
+    // Taken node can't be freed and offered again by another thread, while it's the hazard pointer of this one
+    std::atomic<void*>* hazardPointer = getStackHazardPointer();
+    hazardPointer->store(node);
+
+    void* expected = nullptr;
+    if (!slot->offer.compare_exchange_strong(expected, node)) {
+        hazardPointer->store(nullptr);
+        adjustEliminationRange(thiz, +1);
+        return false;
+    }
+
+    for (size_t i = 0; i < spins && slot->offer.load(std::memory_order_relaxed) == node; ++i) {
+        STACK_CPU_RELAX();
+    }
+
+    expected = node;
+    bool taken = !slot->offer.compare_exchange_strong(expected, nullptr);
+    hazardPointer->store(nullptr);
+
+    if (taken) {
+        thiz->_hits.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        adjustEliminationRange(thiz, -1);
+    }
+    return taken;
+}
+
+/**
+ * Waits for a node in a random slot of the elimination array and takes it.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] spins     number of spins to wait
+ * @return the taken node, or nullptr if no node was offered.
+ */
+template <typename T, typename P, size_t S>
+ConcurrentStackNode<T, P>* takeStackNode(EliminationStack<T, P, S>* const thiz, size_t spins) {
+    thiz->_visits.fetch_add(1, std::memory_order_relaxed);
+    StackEliminationSlot* slot = getRandomEliminationSlot(thiz);
+
+    for (size_t i = 0; i < spins; ++i) {
+        void* offer = slot->offer.load(std::memory_order_relaxed);
+        if (offer != nullptr && slot->offer.compare_exchange_strong(offer, nullptr)) {
+            thiz->_hits.fetch_add(1, std::memory_order_relaxed);
+            return (ConcurrentStackNode<T, P>*)offer;
+        }
+        STACK_CPU_RELAX();
+    }
+
+    adjustEliminationRange(thiz, -1);
+    return nullptr;
+}
+
+/**
+ * Gives a random slot among the slots of the elimination array that are in use.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return pointer to the slot.
+ */
+template <typename T, typename P, size_t S>
+StackEliminationSlot* getRandomEliminationSlot(EliminationStack<T, P, S>* const thiz) {
+    // xorshift generator, each thread has its own state
+    static thread_local unsigned int state = (unsigned int)(uintptr_t)&state | 1u;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+
+    return &thiz->_slots[state % thiz->_range.load(std::memory_order_relaxed)];
+}
+
+/**
+ * Changes the number of slots of the elimination array that are in use by the given delta (within 1 and SlotsNumber).
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] delta     +1 to use more slots, -1 to use fewer ones
+ */
+template <typename T, typename P, size_t S>
+void adjustEliminationRange(EliminationStack<T, P, S>* const thiz, int delta) {
+    size_t range = thiz->_range.load(std::memory_order_relaxed);
+    if ((delta > 0 && range < S) || (delta < 0 && range > 1)) {
+        // Lost update only delays the adjustment
+        thiz->_range.compare_exchange_weak(range, range + delta, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Logs the members of the given elimination stack (elimination counters and the stack) into the log file. Used in LOG_STACK.
+ * @param[in] stack stack to log (not nullptr)
+ */
+template <typename T, typename P, size_t S>
+void logStackMembers(EliminationStack<T, P, S>* const stack) {
+    size_t range = stack->_range.load();
+    size_t visits = stack->_visits.load();
+    size_t hits = stack->_hits.load();
+    LOG_VALUE_INDENTED(range, "\t");
+    LOG_VALUE_INDENTED(visits, "\t");
+    LOG_VALUE_INDENTED(hits, "\t");
+
+    logStackMembers(&stack->_stack);
+}
+
+#endif // IMMORTAL_STACK_ELIMINATION_STACK_H
@@ -36,4 +36,13 @@
     #define __FILENAME__ (strrchr(__FILE__, '/') ? strrchr(__FILE__, '/') + 1 : __FILE__)
 #endif
 
+/** Hint to the CPU, that the thread is spinning in a busy-wait loop */
+#if defined(__x86_64__) || defined(__i386__)
+    #define STACK_CPU_RELAX() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+    #define STACK_CPU_RELAX() __asm__ __volatile__("yield")
+#else
+    #define STACK_CPU_RELAX() ((void)0)
+#endif
+
 #endif // IMMORTAL_STACK_ENVIRONMENT_H
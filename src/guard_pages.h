@@ -0,0 +1,327 @@
+/**
+ * @file
+ * @brief Definition and implementation of the table of stacks with guard pages and the guard page handler
+ *
+ * Stacks with StackGuardPages policy keep their data arrays in the blocks of guardPageStackAllocator,
+ * that are surrounded by inaccessible guard pages, so an access past either end of the data array traps on the spot
+ * instead of being found by the next check. Stacks join the table of guarded stacks when they are constructed
+ * and leave it when they are destructed. The first guarded stack installs the SIGSEGV handler.
+ *
+ * Handler looks for the stack, whose guard pages contain the faulting address, writes a short dump of the stack
+ * (its type, members and the faulting address) into the stack log file and aborts. Faults outside the guard pages
+ * are passed to the previous handler. The handler is async-signal-safe: the log file is opened on registration,
+ * the dump is formatted into a local buffer and written with write(2), so a fault inside malloc or the logger
+ * doesn't deadlock. It runs on the alternate signal stack of the thread, if there's one (see installStackGuardAltStack),
+ * so even an overflow of the thread stack is reported. Works only on Linux.
+ */
+#ifndef IMMORTAL_STACK_GUARD_PAGES_H
+#define IMMORTAL_STACK_GUARD_PAGES_H
+
+#include <atomic>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <sys/types.h>
+#include "allocator.h"
+#include "logger.h"
+
+/** Maximal number of stacks with guard pages that exist at the same time */
+#ifndef STACK_MAX_GUARDED_STACKS
+    #define STACK_MAX_GUARDED_STACKS 1024
+#endif
+
+/** Size of the alternate signal stack of each thread, that the guard page handler runs on */
+#ifndef STACK_GUARD_ALT_STACK_BYTES
+    #define STACK_GUARD_ALT_STACK_BYTES (64 * 1024)
+#endif
+
+/** Members of the guarded stack, that are written in its dump by the guard page handler */
+struct StackGuardedState {
+    ssize_t size;
+    ssize_t capacity;
+    const void* data;
+    size_t dataBytes;
+};
+
+/** Entry of the stack in the table of guarded stacks. Functions of the entry are instantiated for the type of the stack */
+struct StackGuardedEntry {
+    /** Entry is taken by the stack (the stack may be not published yet) */
+    std::atomic<bool> taken;
+
+    /** Guarded stack, or nullptr if the entry is free. Published after the functions */
+    std::atomic<void*> stack;
+
+    /** Checks if the address is in the guard pages of the stack */
+    bool (*isGuardHit)(void* stack, const void* address);
+
+    /** Reads the members of the stack. Called from the signal handler, so it must only read memory */
+    StackGuardedState (*getState)(void* stack);
+
+    /** Name of the stack type, that is written in the dump (it's computed on registration) */
+    const char* typeName;
+};
+
+/** Global table of the stacks with guard pages. It's a fixed array, so the signal handler walks it without locks */
+inline StackGuardedEntry stackGuardedEntries[STACK_MAX_GUARDED_STACKS];
+
+/** Descriptor of the log file, that the guard page handler writes the dumps to. Opened by the first registered stack */
+inline std::atomic<int> stackGuardLogFd{-1};
+
+/**
+ * Adds the stack to the table of guarded stacks and installs the guard page handler, if it's not installed yet.
+ * Opens the log file for the handler, if it's not opened yet, and gives the current thread the alternate signal stack.
+ * @param[in] stack       pointer to the stack
+ * @param[in] typeName    name of the stack type (must stay valid while the stack is registered)
+ * @param[in] isGuardHit  function that checks if the address is in the guard pages of the stack
+ * @param[in] getState    function that reads the members of the stack
+ * @param[in] logFileName name of the log file, that the dumps are appended to
+ * @return true, if the stack is added, false if the table is full or the log file can't be opened.
+ */
+inline bool registerGuardedStack(void* stack, const char* typeName, bool (*isGuardHit)(void*, const void*),
+                                 StackGuardedState (*getState)(void*), const char* logFileName);
+
+/**
+ * Removes the stack from the table of guarded stacks.
+ * @param[in] stack pointer to the registered stack
+ */
+inline void unregisterGuardedStack(void* stack);
+
+/**
+ * Installs the SIGSEGV handler, that dumps the stack whose guard page is hit. Called once by registerGuardedStack.
+ */
+inline void installStackGuardHandler();
+
+/**
+ * Gives the current thread the alternate signal stack, that the guard page handler runs on.
+ * Called by registerGuardedStack for the registering thread. Other threads that use guarded stacks may call it too.
+ * The stack is freed when the thread exits. Does nothing if the thread has the alternate signal stack already.
+ */
+inline void installStackGuardAltStack();
+
+//----------------------------------------------------------------------------------------------------------------------
+
+#ifdef __linux__
+/** SIGSEGV action that was set before the guard page handler, faults outside the guard pages are passed to it */
+inline struct sigaction previousStackGuardAction;
+
+/** Buffer of the stack dump, that is formatted by the guard page handler without allocations */
+struct StackGuardDumpBuffer {
+    char text[512];
+    size_t length;
+};
+
+/**
+ * Appends the string to the dump buffer. Async-signal-safe.
+ * @param[in, out] buffer dump buffer
+ * @param[in] string      string to append (it's truncated if the buffer is full)
+ */
+inline void appendStackGuardDump(StackGuardDumpBuffer* buffer, const char* string) {
+    while (*string != '\0' && buffer->length < sizeof(buffer->text)) {
+        buffer->text[buffer->length++] = *string++;
+    }
+}
+
+/**
+ * Appends the number to the dump buffer. Async-signal-safe.
+ * @param[in, out] buffer dump buffer
+ * @param[in] value       number to append
+ * @param[in] isHex       append the number as 0x and 16 hex digits (as PTR_FORMAT does), or as a decimal one
+ */
+inline void appendStackGuardDump(StackGuardDumpBuffer* buffer, unsigned long long value, bool isHex) {
+    char digits[24] = {};
+    size_t length = 0;
+    const unsigned base = isHex ? 16 : 10;
+    do {
+        digits[length++] = "0123456789ABCDEF"[value % base];
+        value /= base;
+    } while (value != 0 || (isHex && length < 16));
+
+    if (isHex) appendStackGuardDump(buffer, "0x");
+    while (length > 0 && buffer->length < sizeof(buffer->text)) {
+        buffer->text[buffer->length++] = digits[--length];
+    }
+}
+
+/**
+ * Appends the signed decimal number to the dump buffer. Async-signal-safe.
+ * @param[in, out] buffer dump buffer
+ * @param[in] value       number to append
+ */
+inline void appendStackGuardDump(StackGuardDumpBuffer* buffer, long long value) {
+    if (value < 0) {
+        appendStackGuardDump(buffer, "-");
+        appendStackGuardDump(buffer, (unsigned long long)-(value + 1) + 1, false);
+    } else {
+        appendStackGuardDump(buffer, (unsigned long long)value, false);
+    }
+}
+
+/**
+ * Writes the dump of the guarded stack into the log file of the guard page handler. Async-signal-safe.
+ * @param[in] entry   entry of the stack, whose guard page is hit
+ * @param[in] stack   pointer to the stack
+ * @param[in] address faulting address
+ */
+inline void writeStackGuardDump(const StackGuardedEntry* entry, void* stack, const void* address) {
+    const int fd = stackGuardLogFd.load(std::memory_order_acquire);
+    if (fd == -1) return;
+
+    const StackGuardedState state = entry->getState(stack);
+    StackGuardDumpBuffer buffer = {};
+    appendStackGuardDump(&buffer, entry->typeName);
+    appendStackGuardDump(&buffer, " [");
+    appendStackGuardDump(&buffer, (uintptr_t)stack, true);
+    appendStackGuardDump(&buffer, "] guard page is hit at ");
+    appendStackGuardDump(&buffer, (uintptr_t)address, true);
+    appendStackGuardDump(&buffer, " = {\n\tsize = ");
+    appendStackGuardDump(&buffer, (long long)state.size);
+    appendStackGuardDump(&buffer, "\n\tcapacity = ");
+    appendStackGuardDump(&buffer, (long long)state.capacity);
+    appendStackGuardDump(&buffer, "\n\tdata [");
+    appendStackGuardDump(&buffer, (uintptr_t)state.data, true);
+    appendStackGuardDump(&buffer, "] (");
+    appendStackGuardDump(&buffer, (unsigned long long)state.dataBytes, false);
+    appendStackGuardDump(&buffer, " bytes)\n}\n");
+
+    for (size_t written = 0; written < buffer.length;) {
+        const ssize_t result = write(fd, buffer.text + written, buffer.length - written);
+        if (result <= 0) return;
+        written += result;
+    }
+}
+
+/**
+ * SIGSEGV handler: dumps the stack whose guard page is hit and aborts.
+ * Otherwise restores the previous action, so the faulting instruction is repeated and the fault is handled by it.
+ * @param[in] signal  number of the signal
+ * @param[in] info    information about the fault
+ * @param[in] context context of the faulting thread
+ */
+inline void handleStackGuardFault(int signal, siginfo_t* info, void* context) {
+    (void)signal;
+    (void)context;
+
+    for (StackGuardedEntry& entry : stackGuardedEntries) {
+        void* stack = entry.stack.load(std::memory_order_acquire);
+        if (stack != nullptr && entry.isGuardHit(stack, info->si_addr)) {
+            writeStackGuardDump(&entry, stack, info->si_addr);
+            abort();
+        }
+    }
+
+    sigaction(SIGSEGV, &previousStackGuardAction, nullptr);
+}
+
+/** Alternate signal stack of the thread. Unmapped when the thread exits */
+struct StackGuardAltStack {
+    void* memory = nullptr;
+
+    ~StackGuardAltStack() {
+        if (memory == nullptr) return;
+
+        stack_t disabled = {};
+        disabled.ss_flags = SS_DISABLE;
+        sigaltstack(&disabled, nullptr);
+        munmap(memory, STACK_GUARD_ALT_STACK_BYTES);
+    }
+};
+#endif
+
+/**
+ * Installs the SIGSEGV handler, that dumps the stack whose guard page is hit. Called once by registerGuardedStack.
+ */
+inline void installStackGuardHandler() {
+    #ifdef __linux__
+        static std::once_flag installed;
+        std::call_once(installed, []() {
+            struct sigaction action = {};
+            action.sa_sigaction = handleStackGuardFault;
+            action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+            sigemptyset(&action.sa_mask);
+            sigaction(SIGSEGV, &action, &previousStackGuardAction);
+        });
+    #endif
+}
+
+/**
+ * Gives the current thread the alternate signal stack, that the guard page handler runs on.
+ * Called by registerGuardedStack for the registering thread. Other threads that use guarded stacks may call it too.
+ * The stack is freed when the thread exits. Does nothing if the thread has the alternate signal stack already.
+ */
+inline void installStackGuardAltStack() {
+    #ifdef __linux__
+        thread_local StackGuardAltStack altStack;
+
+        stack_t current = {};
+        if (sigaltstack(nullptr, &current) != 0 || !(current.ss_flags & SS_DISABLE)) return;
+
+        void* memory = mmap(nullptr, STACK_GUARD_ALT_STACK_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) return;
+
+        stack_t installed = {};
+        installed.ss_sp = memory;
+        installed.ss_size = STACK_GUARD_ALT_STACK_BYTES;
+        if (sigaltstack(&installed, nullptr) != 0) {
+            munmap(memory, STACK_GUARD_ALT_STACK_BYTES);
+            return;
+        }
+        altStack.memory = memory;
+    #endif
+}
+
+/**
+ * Adds the stack to the table of guarded stacks and installs the guard page handler, if it's not installed yet.
+ * Opens the log file for the handler, if it's not opened yet, and gives the current thread the alternate signal stack.
+ * @param[in] stack       pointer to the stack
+ * @param[in] typeName    name of the stack type (must stay valid while the stack is registered)
+ * @param[in] isGuardHit  function that checks if the address is in the guard pages of the stack
+ * @param[in] getState    function that reads the members of the stack
+ * @param[in] logFileName name of the log file, that the dumps are appended to
+ * @return true, if the stack is added, false if the table is full or the log file can't be opened.
+ */
+inline bool registerGuardedStack(void* stack, const char* typeName, bool (*isGuardHit)(void*, const void*),
+                                 StackGuardedState (*getState)(void*), const char* logFileName) {
+    if (stackGuardLogFd.load(std::memory_order_acquire) == -1) {
+        int fd = open(logFileName, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd == -1) return false;
+
+        int expected = -1;
+        if (!stackGuardLogFd.compare_exchange_strong(expected, fd)) {
+            close(fd);
+        }
+    }
+
+    installStackGuardHandler();
+    installStackGuardAltStack();
+
+    for (StackGuardedEntry& entry : stackGuardedEntries) {
+        bool taken = false;
+        if (entry.taken.compare_exchange_strong(taken, true)) {
+            entry.isGuardHit = isGuardHit;
+            entry.getState = getState;
+            entry.typeName = typeName;
+            entry.stack.store(stack, std::memory_order_release);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Removes the stack from the table of guarded stacks.
+ * @param[in] stack pointer to the registered stack
+ */
+inline void unregisterGuardedStack(void* stack) {
+    for (StackGuardedEntry& entry : stackGuardedEntries) {
+        if (entry.stack.load() == stack) {
+            entry.stack.store(nullptr);
+            entry.taken.store(false);
+            return;
+        }
+    }
+}
+
+#endif // IMMORTAL_STACK_GUARD_PAGES_H
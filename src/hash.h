@@ -0,0 +1,320 @@
+/**
+ * @file
+ * @brief Definition and implementation of hashing functions used for stack integrity checking
+ *
+ * Hash algorithm is chosen at compile time with STACK_HASH_ALGORITHM macro (define it before including stack.h):
+ *   - STACK_HASH_POLYNOMIAL      : polynomial hashing modulo 2^64, 8 bytes per step (default);
+ *   - STACK_HASH_POLYNOMIAL_AVX2 : the same polynomial hash, computed with AVX2 multi-lane kernel
+ *                                  (falls back to STACK_HASH_POLYNOMIAL if AVX2 is not enabled, e.g. with -mavx2);
+ *   - STACK_HASH_CRC32C          : CRC32C, computed with SSE4.2 crc32 instructions if they are enabled (e.g. with -msse4.2),
+ *                                  table-driven otherwise.
+ *
+ * Every algorithm is streaming and invertible, so stack can update hash of its elements in constant time.
+ */
+#ifndef IMMORTAL_STACK_HASH_H
+#define IMMORTAL_STACK_HASH_H
+
+#include <cstddef>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE4_2__)
+    #include <immintrin.h>
+#endif
+
+#define STACK_HASH_POLYNOMIAL      1
+#define STACK_HASH_POLYNOMIAL_AVX2 2
+#define STACK_HASH_CRC32C          3
+
+#ifndef STACK_HASH_ALGORITHM
+    #define STACK_HASH_ALGORITHM STACK_HASH_POLYNOMIAL
+#endif
+
+/** Multiplier of the polynomial hash. Must be odd to be invertible modulo 2^64 */
+constexpr unsigned long long hashMultiplier = 0x100000001B3ULL;
+
+/**
+ * Calculates multiplicative inverse of the given odd number modulo 2^64 (Newton's iterations).
+ * @param[in] x odd number to invert
+ * @return inverse of x modulo 2^64.
+ */
+constexpr unsigned long long inverseModulo64(unsigned long long x) {
+    unsigned long long inverse = x; // Correct for the lowest 3 bits, each iteration doubles the number of correct bits
+    for (int i = 0; i < 5; ++i) {
+        inverse *= 2 - x * inverse;
+    }
+    return inverse;
+}
+
+/** Inverse of hashMultiplier modulo 2^64. Used to remove bytes from the end of the hashed sequence */
+constexpr unsigned long long hashMultiplierInverse = inverseModulo64(hashMultiplier);
+
+static_assert(hashMultiplier * hashMultiplierInverse == 1ULL, "hash multiplier must be invertible");
+
+/** Number of bytes that are hashed in one step of AVX2 polynomial hashing kernel */
+#define POLYNOMIAL_HASH_BLOCK_SIZE 64
+
+/**
+ * Powers of hashMultiplier (values[i] = hashMultiplier^i), split into low and high 32-bit halves for AVX2 kernel.
+ */
+struct PolynomialHashPowers {
+    unsigned long long values[POLYNOMIAL_HASH_BLOCK_SIZE + 1];
+    alignas(32) unsigned long long blockLow [POLYNOMIAL_HASH_BLOCK_SIZE];
+    alignas(32) unsigned long long blockHigh[POLYNOMIAL_HASH_BLOCK_SIZE];
+
+    constexpr PolynomialHashPowers() : values(), blockLow(), blockHigh() {
+        values[0] = 1;
+        for (size_t i = 1; i <= POLYNOMIAL_HASH_BLOCK_SIZE; ++i) {
+            values[i] = values[i - 1] * hashMultiplier;
+        }
+        for (size_t i = 0; i < POLYNOMIAL_HASH_BLOCK_SIZE; ++i) {
+            blockLow [i] = values[POLYNOMIAL_HASH_BLOCK_SIZE - 1 - i] & 0xFFFFFFFFULL;
+            blockHigh[i] = values[POLYNOMIAL_HASH_BLOCK_SIZE - 1 - i] >> 32;
+        }
+    }
+};
+
+constexpr PolynomialHashPowers polynomialHashPowers{};
+
+/**
+ * Appends the given bytes to the polynomially hashed sequence, one byte per step.
+ * Reference implementation of the polynomial hash: every other polynomial kernel gives the same results.
+ * @param[in] hash   hash of the sequence the bytes are appended to
+ * @param[in] data   pointer to the bytes to append
+ * @param[in] length number of bytes to append
+ * @return hash of the extended sequence.
+ */
+inline unsigned long long polynomialHashBytesBytewise(unsigned long long hash, const void* data, size_t length) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < length; ++i) {
+        hash = hash * hashMultiplier + bytes[i];
+    }
+    return hash;
+}
+
+/**
+ * Appends the given bytes to the polynomially hashed sequence, 8 bytes per step.
+ * Multiplications of one step don't depend on each other, so only one of them is on the critical path.
+ * @param[in] hash   hash of the sequence the bytes are appended to
+ * @param[in] data   pointer to the bytes to append
+ * @param[in] length number of bytes to append
+ * @return hash of the extended sequence.
+ */
+inline unsigned long long polynomialHashBytes(unsigned long long hash, const void* data, size_t length) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    const unsigned long long* powers = polynomialHashPowers.values;
+    for (; length >= 8; bytes += 8, length -= 8) {
+        hash = hash * powers[8] +
+            bytes[0] * powers[7] + bytes[1] * powers[6] + bytes[2] * powers[5] + bytes[3] * powers[4] +
+            bytes[4] * powers[3] + bytes[5] * powers[2] + bytes[6] * powers[1] + bytes[7];
+    }
+    return polynomialHashBytesBytewise(hash, bytes, length);
+}
+
+#ifdef __AVX2__
+/**
+ * Appends the given bytes to the polynomially hashed sequence, POLYNOMIAL_HASH_BLOCK_SIZE bytes per step.
+ * Each of 4 lanes multiplies bytes by the low and high halves of the corresponding powers (bytes fit in 8 bits,
+ * so both products are exact), halves are combined once per block.
+ * @param[in] hash   hash of the sequence the bytes are appended to
+ * @param[in] data   pointer to the bytes to append
+ * @param[in] length number of bytes to append
+ * @return hash of the extended sequence.
+ */
+inline unsigned long long polynomialHashBytesAvx2(unsigned long long hash, const void* data, size_t length) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (; length >= POLYNOMIAL_HASH_BLOCK_SIZE; bytes += POLYNOMIAL_HASH_BLOCK_SIZE, length -= POLYNOMIAL_HASH_BLOCK_SIZE) {
+        __m256i sumLow  = _mm256_setzero_si256();
+        __m256i sumHigh = _mm256_setzero_si256();
+        for (size_t i = 0; i < POLYNOMIAL_HASH_BLOCK_SIZE; i += 16) {
+            __m128i chunk = _mm_loadu_si128((const __m128i*)(bytes + i));
+            for (size_t j = 0; j < 16; j += 4) {
+                __m256i lanes = _mm256_cvtepu8_epi64(chunk);
+                __m256i low   = _mm256_load_si256((const __m256i*)(polynomialHashPowers.blockLow  + i + j));
+                __m256i high  = _mm256_load_si256((const __m256i*)(polynomialHashPowers.blockHigh + i + j));
+                sumLow  = _mm256_add_epi64(sumLow,  _mm256_mul_epu32(lanes, low));
+                sumHigh = _mm256_add_epi64(sumHigh, _mm256_mul_epu32(lanes, high));
+                chunk = _mm_srli_si128(chunk, 4);
+            }
+        }
+        __m256i sum = _mm256_add_epi64(sumLow, _mm256_slli_epi64(sumHigh, 32));
+        __m128i halves = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+        unsigned long long blockHash =
+            (unsigned long long)_mm_cvtsi128_si64(halves) + (unsigned long long)_mm_extract_epi64(halves, 1);
+
+        hash = hash * polynomialHashPowers.values[POLYNOMIAL_HASH_BLOCK_SIZE] + blockHash;
+    }
+    return polynomialHashBytes(hash, bytes, length);
+}
+#else
+/**
+ * AVX2 is not enabled: falls back to polynomialHashBytes, that gives the same results.
+ */
+inline unsigned long long polynomialHashBytesAvx2(unsigned long long hash, const void* data, size_t length) {
+    return polynomialHashBytes(hash, data, length);
+}
+#endif
+
+/**
+ * Removes the given bytes from the end of the polynomially hashed sequence.
+ * @param[in] hash   hash of the sequence that ends with the given bytes
+ * @param[in] data   pointer to the bytes to remove
+ * @param[in] length number of bytes to remove
+ * @return hash of the shortened sequence.
+ */
+inline unsigned long long polynomialUnhashBytes(unsigned long long hash, const void* data, size_t length) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = length; i > 0; --i) {
+        hash = (hash - bytes[i - 1]) * hashMultiplierInverse;
+    }
+    return hash;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/** CRC32C (Castagnoli) polynomial in reversed bit order */
+constexpr unsigned int crc32cPolynomial = 0x82F63B78U;
+
+/**
+ * Lookup tables for CRC32C:
+ *   - forward[i] is CRC of byte i;
+ *   - reverse[j] is byte i, such that the highest byte of forward[i] is j (it's unique for every i).
+ */
+struct Crc32cTables {
+    unsigned int  forward[256];
+    unsigned char reverse[256];
+
+    constexpr Crc32cTables() : forward(), reverse() {
+        for (unsigned int i = 0; i < 256; ++i) {
+            unsigned int crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc & 1U) ? (crc >> 1) ^ crc32cPolynomial : (crc >> 1);
+            }
+            forward[i] = crc;
+            reverse[crc >> 24] = (unsigned char)i;
+        }
+    }
+};
+
+constexpr Crc32cTables crc32cTables{};
+
+/**
+ * Appends the given bytes to the CRC32C hashed sequence using lookup table.
+ * No initial or final inversion is performed, so calls can be chained.
+ * @param[in] hash   hash of the sequence the bytes are appended to
+ * @param[in] data   pointer to the bytes to append
+ * @param[in] length number of bytes to append
+ * @return hash of the extended sequence.
+ */
+inline unsigned long long crc32cHashBytesPortable(unsigned long long hash, const void* data, size_t length) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    unsigned int crc = (unsigned int)hash;
+    for (size_t i = 0; i < length; ++i) {
+        crc = (crc >> 8) ^ crc32cTables.forward[(crc ^ bytes[i]) & 0xFFU];
+    }
+    return crc;
+}
+
+#ifdef __SSE4_2__
+/**
+ * Appends the given bytes to the CRC32C hashed sequence using SSE4.2 crc32 instructions, 8 bytes per instruction.
+ * @param[in] hash   hash of the sequence the bytes are appended to
+ * @param[in] data   pointer to the bytes to append
+ * @param[in] length number of bytes to append
+ * @return hash of the extended sequence.
+ */
+inline unsigned long long crc32cHashBytes(unsigned long long hash, const void* data, size_t length) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    #ifdef __x86_64__
+        for (; length >= 8; bytes += 8, length -= 8) {
+            unsigned long long word = 0;
+            memcpy(&word, bytes, sizeof(word));
+            hash = _mm_crc32_u64(hash, word);
+        }
+    #endif
+    unsigned int crc = (unsigned int)hash;
+    for (; length > 0; ++bytes, --length) {
+        crc = _mm_crc32_u8(crc, *bytes);
+    }
+    return crc;
+}
+#else
+/**
+ * SSE4.2 is not enabled: falls back to crc32cHashBytesPortable.
+ */
+inline unsigned long long crc32cHashBytes(unsigned long long hash, const void* data, size_t length) {
+    return crc32cHashBytesPortable(hash, data, length);
+}
+#endif
+
+/**
+ * Removes the given bytes from the end of the CRC32C hashed sequence (runs lookup table steps backwards).
+ * @param[in] hash   hash of the sequence that ends with the given bytes
+ * @param[in] data   pointer to the bytes to remove
+ * @param[in] length number of bytes to remove
+ * @return hash of the shortened sequence.
+ */
+inline unsigned long long crc32cUnhashBytes(unsigned long long hash, const void* data, size_t length) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    unsigned int crc = (unsigned int)hash;
+    for (size_t i = length; i > 0; --i) {
+        unsigned char index = crc32cTables.reverse[crc >> 24];
+        crc = ((crc ^ crc32cTables.forward[index]) << 8) | (unsigned char)(index ^ bytes[i - 1]);
+    }
+    return crc;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+#if STACK_HASH_ALGORITHM == STACK_HASH_POLYNOMIAL
+    #define STACK_HASH_ALGORITHM_NAME "polynomial"
+#elif STACK_HASH_ALGORITHM == STACK_HASH_POLYNOMIAL_AVX2
+    #ifdef __AVX2__
+        #define STACK_HASH_ALGORITHM_NAME "polynomial (AVX2)"
+    #else
+        #define STACK_HASH_ALGORITHM_NAME "polynomial (AVX2 is not enabled)"
+    #endif
+#elif STACK_HASH_ALGORITHM == STACK_HASH_CRC32C
+    #ifdef __SSE4_2__
+        #define STACK_HASH_ALGORITHM_NAME "crc32c (SSE4.2)"
+    #else
+        #define STACK_HASH_ALGORITHM_NAME "crc32c (portable)"
+    #endif
+#else
+    #error "Unknown STACK_HASH_ALGORITHM"
+#endif
+
+/**
+ * Appends the given bytes to the hashed sequence using the algorithm chosen by STACK_HASH_ALGORITHM.
+ * Hashing is streaming: hashBytes(hashBytes(h, a), b) is the hash of a concatenated with b.
+ * @param[in] hash   hash of the sequence the bytes are appended to
+ * @param[in] data   pointer to the bytes to append
+ * @param[in] length number of bytes to append
+ * @return hash of the extended sequence.
+ */
+static inline unsigned long long hashBytes(unsigned long long hash, const void* data, size_t length) {
+    #if STACK_HASH_ALGORITHM == STACK_HASH_POLYNOMIAL
+        return polynomialHashBytes(hash, data, length);
+    #elif STACK_HASH_ALGORITHM == STACK_HASH_POLYNOMIAL_AVX2
+        return polynomialHashBytesAvx2(hash, data, length);
+    #else
+        return crc32cHashBytes(hash, data, length);
+    #endif
+}
+
+/**
+ * Removes the given bytes from the end of the hashed sequence. Reverts hashBytes:
+ * unhashBytes(hashBytes(h, data, length), data, length) == h.
+ * @param[in] hash   hash of the sequence that ends with the given bytes
+ * @param[in] data   pointer to the bytes to remove
+ * @param[in] length number of bytes to remove
+ * @return hash of the shortened sequence.
+ */
+static inline unsigned long long unhashBytes(unsigned long long hash, const void* data, size_t length) {
+    #if STACK_HASH_ALGORITHM == STACK_HASH_CRC32C
+        return crc32cUnhashBytes(hash, data, length);
+    #else
+        return polynomialUnhashBytes(hash, data, length);
+    #endif
+}
+
+#endif // IMMORTAL_STACK_HASH_H
@@ -0,0 +1,2731 @@
+/**
+ * @file
+ * @brief Definition and implementation of generic stack template with compile-time security policies
+ *
+ * ImmortalStack<T, Policy> is a stack of T, that performs corruption checking chosen by Policy
+ * (see StackPolicy): silent verification with logging, canary guards, hash checking.
+ * Stacks with different policies can be used in one program. Policies are resolved at compile time,
+ * so disabled checks cost nothing. Canaries and hashes can be verified by the background verifier
+ * instead of each operation (see StackBackgroundVerification and verifier.h).
+ * Data canaries can be replaced by guard pages, so overflows trap without any checks (see StackGuardPages and guard_pages.h).
+ * Operations count themselves into the per-thread metrics, if STACK_METRICS is 1 (see metrics.h),
+ * and record their trace events, if STACK_TRACE is 1 (see trace.h).
+ *
+ * See stack.h for C-style interface (Stack_int, etc).
+ */
+#ifndef IMMORTAL_STACK_IMMORTAL_STACK_H
+#define IMMORTAL_STACK_IMMORTAL_STACK_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <sys/types.h>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include "allocator.h"
+#include "environment.h"
+#include "guard_pages.h"
+#include "hash.h"
+#include "logger.h"
+#include "metrics.h"
+#include "stack_dump.h"
+#include "trace.h"
+#include "verifier.h"
+
+/** Number of canary guards */
+constexpr size_t canariesNumber = 1;
+/** Value of each canary guard */
+constexpr long long canaryValue = 0x0C4ECCED;
+/** Number of elements in each hashed block of the stacks with StackBlockHashing policy */
+constexpr size_t hashBlockSize = 4096;
+
+/** Logging policy: stack is not verified, nothing is logged */
+struct NoStackLogging {
+    static constexpr bool enabled    = false;
+    static constexpr bool binary     = false;
+    static constexpr bool compressed = false;
+};
+
+/** Logging policy: stack is verified silently, it's logged into stackLogFileName and assertion fails on errors */
+struct StackDumpLogging {
+    static constexpr bool enabled    = true;
+    static constexpr bool binary     = false;
+    static constexpr bool compressed = false;
+};
+
+/**
+ * Logging policy: stack is verified silently, it's dumped in the binary format into stackDumpFileName
+ * (see stack_dump.h), optionally compressed, and assertion fails on errors. Only a line about the dump is logged.
+ */
+template <bool isCompressed = false>
+struct StackBinaryDumpLogging {
+    static constexpr bool enabled    = true;
+    static constexpr bool binary     = true;
+    static constexpr bool compressed = isCompressed;
+};
+
+/** Canaries policy: no canary guards */
+struct NoStackCanaries {
+    static constexpr size_t number     = 0;
+    static constexpr size_t dataNumber = 0;
+    static constexpr bool   guardPages = false;
+};
+
+/** Canaries policy: the stack struct and its data array are guarded by N canaries at the beginning and at the end */
+template <size_t N = canariesNumber>
+struct StackCanaries {
+    static_assert(N > 0, "use NoStackCanaries to turn canaries off");
+    static constexpr size_t number     = N;
+    static constexpr size_t dataNumber = N;
+    static constexpr bool   guardPages = false;
+};
+
+/**
+ * Canaries policy: the stack struct is guarded by N canaries, the data array is surrounded by inaccessible guard pages
+ * instead of canaries (see guard_pages.h). Overflow of the data array traps on the spot and isn't checked by operations.
+ * Data array is allocated with guardPageStackAllocator, so the stack can't have the inline one.
+ */
+template <size_t N = canariesNumber>
+struct StackGuardPages {
+    static constexpr size_t number     = N;
+    static constexpr size_t dataNumber = 0;
+    static constexpr bool   guardPages = true;
+};
+
+/** Hashing policy: no hash checking */
+struct NoStackHashing {
+    static constexpr bool   enabled   = false;
+    static constexpr size_t blockSize = 0;
+};
+
+/** Hashing policy: hashes of the stack members and elements are checked (see STACK_HASH_ALGORITHM) */
+struct StackStateHashing {
+    static constexpr bool   enabled   = true;
+    static constexpr size_t blockSize = 0;
+};
+
+/**
+ * Hashing policy: stack members are hashed as with StackStateHashing, elements are split into blocks of B elements,
+ * that are hashed separately, and the hash of the elements is the hash of the block hashes (two-level hash tree).
+ * Operations check only the top block, that they change. Full checks (the background or sampled ones, or isStackIntegrityOk)
+ * check all blocks and find the corrupted ones (see findCorruptedStackBlock). LOG_STACK logs only the corrupted blocks.
+ */
+template <size_t B = hashBlockSize>
+struct StackBlockHashing {
+    static_assert(B > 0, "use StackStateHashing to hash the elements as a whole");
+    static constexpr bool   enabled   = true;
+    static constexpr size_t blockSize = B;
+};
+
+/** Verification policy: canaries and hashes are checked by each stack operation */
+struct StackSyncVerification {
+    static constexpr bool background = false;
+    static constexpr bool sampled    = false;
+};
+
+/**
+ * Verification policy: stack operations check only the stack members in constant time,
+ * canaries and hashes are checked by the background verifier (see verifier.h). Stack joins its registry on construction.
+ */
+struct StackBackgroundVerification {
+    static constexpr bool background = true;
+    static constexpr bool sampled    = false;
+};
+
+/**
+ * Verification policy: stack operations check the stack members in constant time, canaries and hashes are checked
+ * only in sampled checks (every STACK_SAMPLING_PERIOD-th check, or with the given probability, see verifier.h).
+ */
+struct StackSampledVerification {
+    static constexpr bool background = false;
+    static constexpr bool sampled    = true;
+};
+
+/** Repair policy: corrupted stack is logged and fails an assertion */
+struct NoStackRepair {
+    static constexpr bool enabled = false;
+};
+
+/**
+ * Repair policy: stack keeps XOR parity of its element blocks and a mirror of its members. When a check fails,
+ * the stack restores its canaries, its members (from the mirror) and one corrupted block (from the parity),
+ * logs what is repaired and keeps going (see repairStack). Assertion fails only if the stack can't be repaired.
+ * Needs block hashing (to find the corrupted block) and trivially copyable elements.
+ */
+struct StackParityRepair {
+    static constexpr bool enabled = true;
+};
+
+/**
+ * Security policy of the stack: a combination of logging, canaries, hashing, verification and repair policies.
+ * Canaries and hashing are checked only if logging is enabled.
+ */
+template <
+    typename LoggingPolicy,
+    typename CanariesPolicy,
+    typename HashingPolicy,
+    typename VerificationPolicy = StackSyncVerification,
+    typename RepairPolicy       = NoStackRepair
+>
+struct StackPolicy {
+    using Logging      = LoggingPolicy;
+    using Canaries     = CanariesPolicy;
+    using Hashing      = HashingPolicy;
+    using Verification = VerificationPolicy;
+    using Repair       = RepairPolicy;
+
+    static_assert(
+        Logging::enabled || (Canaries::number == 0 && !Canaries::guardPages && !Hashing::enabled),
+        "checks need logging to be enabled"
+    );
+    static_assert(Logging::enabled || !Verification::background, "background verification needs logging to be enabled");
+    static_assert(Logging::enabled || !Verification::sampled, "sampled verification needs logging to be enabled");
+    static_assert(!Repair::enabled || Hashing::blockSize > 0, "repair needs block hashing to find corrupted blocks");
+    static_assert(!Repair::enabled || !Verification::background, "stack verified in the background can't be repaired");
+};
+
+/**
+ * Security policy of the given level:
+ *   - 0 : no checks performed;
+ *   - 1 : silent verification, logging;
+ *   - 2 : silent verification, logging, canary guards;
+ *   - 3 : silent verification, logging, canary guards, hash checking.
+ * Canaries and hashes are checked by each operation, or in the background (level 1 or higher, see VerificationPolicy).
+ */
+template <int level, typename VerificationPolicy = StackSyncVerification>
+using StackSecurityPolicy = StackPolicy<
+    std::conditional_t<(level >= 1), StackDumpLogging,  NoStackLogging>,
+    std::conditional_t<(level >= 2), StackCanaries<>,   NoStackCanaries>,
+    std::conditional_t<(level >= 3), StackStateHashing, NoStackHashing>,
+    VerificationPolicy
+>;
+
+/**
+ * Type of the stack member that is turned off by the policy. Takes no space in the stack struct.
+ * Each member has its own id, because empty members of the same type can't share the address.
+ */
+template <int id>
+struct StackDisabledMember {};
+
+/** Type of canary guards array: long long[N], or StackDisabledMember if there are no canaries */
+template <size_t N, int id>
+struct StackCanaryArray {
+    using Type = long long[N];
+};
+
+template <int id>
+struct StackCanaryArray<0, id> {
+    using Type = StackDisabledMember<id>;
+};
+
+/** Type of the hash member: unsigned long long, or StackDisabledMember if there's no hashing */
+template <bool enabled, int id>
+using StackHashValue = std::conditional_t<enabled, unsigned long long, StackDisabledMember<id>>;
+
+/** Type of the block hashes member: unsigned long long*, or StackDisabledMember if the elements aren't hashed by blocks */
+template <bool enabled, int id>
+using StackBlockHashesPointer = std::conditional_t<enabled, unsigned long long*, StackDisabledMember<id>>;
+
+/** Copy of the stack members, that the stack with StackParityRepair policy restores its corrupted members from */
+struct StackHeaderMirror {
+    ssize_t size;
+    ssize_t capacity;
+    void* data;
+    unsigned long long dataHash;
+    unsigned long long* blockHashes;
+    unsigned char* parity;
+    const StackAllocator* allocator;
+
+    /** Hash of the fields above. Corrupted mirror is not used */
+    unsigned long long checksum;
+};
+
+/** Type of the repair member: T, or StackDisabledMember if the stack doesn't repair itself */
+template <bool enabled, typename T, int id>
+using StackRepairMember = std::conditional_t<enabled, T, StackDisabledMember<id>>;
+
+/** Type of the registry entry member: StackRegistryEntry*, or StackDisabledMember if the stack isn't verified in the background */
+template <bool enabled, int id>
+using StackRegistryEntryPointer = std::conditional_t<enabled, StackRegistryEntry*, StackDisabledMember<id>>;
+
+/** Type of the sampling counters member: StackSamplingState, or StackDisabledMember if the checks aren't sampled */
+template <bool enabled, int id>
+using StackSamplingValue = std::conditional_t<enabled, StackSamplingState, StackDisabledMember<id>>;
+
+/**
+ * Type of the inline data array of N elements of T, that is laid out as the dynamic one (with data canaries if they are turned on).
+ * StackDisabledMember if there's no inline data array.
+ */
+template <typename T, size_t canaries, size_t N, int id>
+struct StackInlineData {
+    struct Type {
+        alignas(T) alignas(long long) char bytes[sizeof(long long) * canaries + sizeof(T) * N + sizeof(long long) * canaries];
+    };
+};
+
+template <typename T, size_t canaries, int id>
+struct StackInlineData<T, canaries, 0, id> {
+    using Type = StackDisabledMember<id>;
+};
+
+/**
+ * Generic stack that can contain any (almost) value of type T.
+ * Stack allocates new memory if there's no empty space left to add new element.
+ * First InlineCapacity elements are stored inside the stack struct, so the stack allocates memory only if it grows larger.
+ * Stack operations (construct/destruct, push, pop, etc) should be performed using the functions below.
+ * Stack can perform different corruption checking (see StackPolicy): silent verification, canary guards, hash checking.
+ */
+template <typename T, typename Policy = StackSecurityPolicy<0>, size_t InlineCapacity = 0>
+struct ImmortalStack {
+    using ElementType    = T;
+    using SecurityPolicy = Policy;
+
+    static constexpr size_t inlineCapacity = InlineCapacity;
+
+    static_assert(!Policy::Canaries::guardPages || InlineCapacity == 0, "stack with guard pages can't have inline data array");
+    static_assert(!Policy::Repair::enabled || std::is_trivially_copyable<T>::value, "repaired elements must be trivially copyable");
+
+    /* !!! Private members !!! */
+
+    [[no_unique_address]] typename StackCanaryArray<Policy::Canaries::number, 0>::Type _canariesBefore;
+
+    /** Hash of the stack members (see getHash) */
+    [[no_unique_address]] StackHashValue<Policy::Hashing::enabled, 1> _hash{};
+
+    /** Sampling counters. They change on each check, so they follow _hash and aren't hashed with getHash */
+    [[no_unique_address]] StackSamplingValue<Policy::Verification::sampled, 6> _sampling{};
+
+    /** Number of elements in stack */
+    ssize_t _size = 0;
+
+    /** Actual size of the stack data array */
+    ssize_t _capacity = 0;
+
+    /**
+     * Array with stack data (_inlineData or the dynamic one). Contains canaries at the beginning and the end if they are turned on
+     * (and aren't replaced by guard pages)
+     */
+    std::conditional_t<(Policy::Canaries::dataNumber > 0), char*, T*> _data = nullptr;
+
+    /** Hash of the stack elements (see getDataHash). Updated incrementally on push and pop */
+    [[no_unique_address]] StackHashValue<Policy::Hashing::enabled, 2> _dataHash{};
+
+    /**
+     * Hash of the stack elements below the top one, so _dataHash is its hash with the top element.
+     * Operations check the top element with it in constant time (see isStackIntegrityOk)
+     */
+    [[no_unique_address]] StackHashValue<(Policy::Hashing::enabled && Policy::Hashing::blockSize == 0), 10> _belowTopHash{};
+
+    /** Hashes of the element blocks (see StackBlockHashing). Array has a hash for each block of the data array */
+    [[no_unique_address]] StackBlockHashesPointer<(Policy::Hashing::blockSize > 0), 7> _blockHashes{};
+
+    /** XOR of the element blocks (the missing elements of the top block are zeros). Array of blockSize elements */
+    [[no_unique_address]] StackRepairMember<Policy::Repair::enabled, unsigned char*, 8> _parity{};
+
+    /** Allocator of the stack data array */
+    const StackAllocator* _allocator = nullptr;
+
+    /** Entry of the stack in the registry of the background verifier */
+    [[no_unique_address]] StackRegistryEntryPointer<Policy::Verification::background, 5> _registryEntry{};
+
+    /** Array with the first InlineCapacity stack elements. It's guarded by the struct canaries, but isn't hashed with getHash */
+    [[no_unique_address]] typename StackInlineData<T, Policy::Canaries::dataNumber, InlineCapacity, 3>::Type _inlineData;
+
+    [[no_unique_address]] typename StackCanaryArray<Policy::Canaries::number, 4>::Type _canariesAfter;
+
+    /** Mirror of the members, that is updated with _hash. It's out of the canaries, and isn't hashed with getHash */
+    [[no_unique_address]] StackRepairMember<Policy::Repair::enabled, StackHeaderMirror, 9> _mirror{};
+};
+
+/** Stack type by the type of pointer to it */
+template <typename StackPointer>
+using StackOf = std::remove_pointer_t<std::decay_t<StackPointer>>;
+
+/** Helper to exclude function parameter from template argument deduction (e.g. push(&doubleStack, 1)) */
+template <typename T>
+struct StackNonDeducedHelper {
+    using Type = T;
+};
+
+/** The same type as T, but it's not deduced */
+template <typename T>
+using StackNonDeduced = typename StackNonDeducedHelper<T>::Type;
+
+/**
+ * Checks if the given stack is in normal state (correct size and capacity, no nullptrs, correct canary values and hashes).
+ * If the stack is verified in the background, only the stack members are checked (see isStackMembersOk).
+ * If the checks are sampled, canaries and hashes are checked only in sampled ones (see sampleStackCheck).
+ * Otherwise, only the top element (or the top block, if the elements are hashed by blocks) is checked with the hashes,
+ * so the check doesn't depend on the stack size. Elements below it aren't rehashed, so their modification isn't
+ * detected here, only by isStackFullyOk.
+ * @param[in, out] stack stack to check
+ * @return true, if the given stack is ok, false otherwise.
+ */
+template <typename T, typename P, size_t N>
+bool isStackOk(ImmortalStack<T, P, N>* stack);
+
+/**
+ * Checks the whole stack: its members, canaries and hashes of all the elements. Takes linear time with hashing.
+ * @param[in] stack stack to check
+ * @return true, if the given stack is ok, false otherwise.
+ */
+template <typename T, typename P, size_t N>
+bool isStackFullyOk(ImmortalStack<T, P, N>* stack);
+
+/**
+ * Checks the stack members in constant time: correct size and capacity, no nullptrs.
+ * @param[in] stack stack to check
+ * @return true, if the stack members are ok, false otherwise.
+ */
+template <typename T, typename P, size_t N>
+bool isStackMembersOk(ImmortalStack<T, P, N>* stack);
+
+/**
+ * Checks the canary values and hashes of the stack, whose members are ok. Takes linear time with hashing,
+ * unless only the top is checked.
+ * @param[in] stack   stack to check
+ * @param[in] topOnly check only the top element (or the top block, if the elements are hashed by blocks)
+ * @return true, if the canaries and hashes are correct, false otherwise.
+ */
+template <typename T, typename P, size_t N>
+bool isStackIntegrityOk(ImmortalStack<T, P, N>* stack, bool topOnly = false);
+
+/**
+ * Repairs the stack that repairs itself (see StackParityRepair): restores its canaries, its members from their mirror
+ * and one corrupted block of the elements from the parity. Logs what is repaired into the stack log file.
+ * @param[in, out] stack stack to repair
+ * @return true, if the stack is repaired (it's ok now), false if it can't be repaired or it doesn't repair itself.
+ */
+template <typename T, typename P, size_t N>
+bool repairStack(ImmortalStack<T, P, N>* stack);
+
+/**
+ * Stacks of the other types don't repair themselves.
+ * @param[in] stack stack to repair
+ * @return false.
+ */
+template <typename Stack>
+bool repairStack(Stack* stack);
+
+/**
+ * Creates a new stack with a given initial size of the data array.
+ * Stack joins the registry of the background verifier, if it's verified in the background.
+ * Stack with guard pages joins the table of guarded stacks, and its data array is allocated with guardPageStackAllocator.
+ * @param[in, out] thiz       pointer to the stack this operation should be performed on
+ * @param[in] initialCapacity initial size of the data array
+ * @param[in] allocator       allocator of the data array (ignored if the stack has guard pages)
+ */
+template <typename T, typename P, size_t N>
+void constructStack(
+    ImmortalStack<T, P, N>* thiz,
+    size_t initialCapacity = 0,
+    const StackAllocator* allocator = &systemStackAllocator
+);
+
+/**
+ * Destructs the given stack. Frees the dynamic memory and resets all struct members to initial state.
+ * Stack leaves the registry of the background verifier, if it's verified in the background.
+ * Stack with guard pages leaves the table of guarded stacks.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ */
+template <typename T, typename P, size_t N>
+void destructStack(ImmortalStack<T, P, N>* thiz);
+
+/**
+ * Multiplier that is used in enlarge function.
+ */
+#define STACK_ENLARGE_MULTIPLIER 2
+
+/**
+ * Enlarges the internal data array of the given stack.
+ * If the capacity of the data array is zero, then it's set to one.
+ * Otherwise, capacity is multiplied by STACK_ENLARGE_MULTIPLIER.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ */
+template <typename T, typename P, size_t N>
+void enlarge(ImmortalStack<T, P, N>* thiz);
+
+/**
+ * Reallocates the internal data array of the given stack, so it can contain the given number of elements.
+ * Keeps the stack elements. Doesn't check if the stack is ok, it's up to the caller.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] capacity  new capacity of the stack (not less than its size)
+ */
+template <typename T, typename P, size_t N>
+void reallocateStackData(ImmortalStack<T, P, N>* thiz, ssize_t capacity);
+
+/**
+ * Moves the elements of the given stack to the new data array of the given capacity and frees the old one.
+ * Used when the data array can't be reallocated in place: when it's moved from or to the inline data array,
+ * or when T is not trivially copyable (its elements are moved with move constructor). Doesn't update the capacity of the stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] capacity  capacity of the new data array (not less than the stack size)
+ */
+template <typename T, typename P, size_t N>
+void moveStackData(ImmortalStack<T, P, N>* thiz, ssize_t capacity);
+
+/**
+ * Allocates the data array of the given capacity with the stack allocator.
+ * If the capacity is equal to InlineCapacity, gives the inline data array instead.
+ * @param[in] thiz     pointer to the stack this operation should be performed on
+ * @param[in] capacity capacity of the data array
+ * @return pointer to the data array (with data canaries if they are turned on), or nullptr if there's not enough memory.
+ */
+template <typename T, typename P, size_t N>
+void* allocateStackData(ImmortalStack<T, P, N>* thiz, ssize_t capacity);
+
+/**
+ * Frees the data array that was allocated with allocateStackData. Inline data array is not freed.
+ * @param[in] thiz     pointer to the stack this operation should be performed on
+ * @param[in] data     pointer to the data array
+ * @param[in] capacity capacity of the data array
+ */
+template <typename T, typename P, size_t N>
+void deallocateStackData(ImmortalStack<T, P, N>* thiz, void* data, ssize_t capacity);
+
+/**
+ * Checks if the elements of the given stack are stored in its inline data array.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return true, if the elements are stored inside the stack struct, false otherwise.
+ */
+template <typename T, typename P, size_t N>
+bool isStackDataInline(ImmortalStack<T, P, N>* thiz);
+
+/**
+ * Checks if the data array of the given capacity is the inline one (capacity is equal to InlineCapacity).
+ * @param[in] thiz     pointer to the stack this operation should be performed on
+ * @param[in] capacity capacity of the data array
+ * @return true, if the data array of the given capacity is stored inside the stack struct, false otherwise.
+ */
+template <typename T, typename P, size_t N>
+bool isStackCapacityInline(ImmortalStack<T, P, N>* thiz, ssize_t capacity);
+
+/**
+ * Gives the pointer to the inline data array of the given stack.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return pointer to the inline data array (with data canaries if they are turned on), or nullptr if there's no one.
+ */
+template <typename T, typename P, size_t N>
+char* getStackInlineData(ImmortalStack<T, P, N>* thiz);
+
+/**
+ * Stack data array is shrunk (see shrinkIfSparse), when the stack size becomes STACK_SHRINK_DIVISOR times less than its capacity.
+ * Define it as 0 to turn automatic shrinking off.
+ */
+#ifndef STACK_SHRINK_DIVISOR
+    #define STACK_SHRINK_DIVISOR 4
+#endif
+
+/**
+ * Stack data array is not shrunk automatically, if it takes less than this number of bytes.
+ */
+#ifndef STACK_SHRINK_MIN_BYTES
+    #define STACK_SHRINK_MIN_BYTES (64 * 1024)
+#endif
+
+/**
+ * Shrinks the internal data array of the given stack, so its capacity is equal to its size.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ */
+template <typename T, typename P, size_t N>
+void shrinkToFit(ImmortalStack<T, P, N>* thiz);
+
+/**
+ * Divides the capacity of the given stack by STACK_ENLARGE_MULTIPLIER, if the stack size is STACK_SHRINK_DIVISOR times less
+ * than its capacity. As the divisor is greater than the multiplier, stack doesn't shrink and enlarge in turns.
+ * Doesn't check if the stack is ok, it's up to the caller.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ */
+template <typename T, typename P, size_t N>
+void shrinkIfSparse(ImmortalStack<T, P, N>* thiz);
+
+/**
+ * Gives the size in bytes of the data array of the given capacity (with data canaries if they are turned on).
+ * @param[in] thiz     pointer to the stack this operation should be performed on
+ * @param[in] capacity capacity of the data array
+ * @return size of the data array in bytes.
+ */
+template <typename T, typename P, size_t N>
+size_t getStackDataBytes(ImmortalStack<T, P, N>* thiz, ssize_t capacity);
+
+/**
+ * Rounds the capacity of the data array up, so the data array with guard pages ends right before the trailing guard page
+ * (as close as the element size allows), and writing past its end traps. Other capacities are not changed.
+ * @param[in] thiz     pointer to the stack this operation should be performed on
+ * @param[in] capacity capacity of the data array
+ * @return rounded capacity.
+ */
+template <typename T, typename P, size_t N>
+ssize_t roundStackCapacity(ImmortalStack<T, P, N>* thiz, ssize_t capacity);
+
+/**
+ * Copy-constructs elements in the given uninitialized memory. Uses memcpy if T is trivially copyable.
+ * @param[out] dst memory to construct elements in
+ * @param[in] src  array to copy elements from
+ * @param[in] n    number of elements to construct
+ */
+template <typename T>
+void constructStackElements(T* dst, const T* src, size_t n);
+
+/**
+ * Moves elements to the given uninitialized memory: move-constructs them there and destructs the source ones.
+ * Uses memcpy if T is trivially copyable.
+ * @param[out] dst     memory to move elements to
+ * @param[in, out] src array to move elements from
+ * @param[in] n        number of elements to move
+ */
+template <typename T>
+void relocateStackElements(T* dst, T* src, size_t n);
+
+/**
+ * Destructs the given elements, if T is not trivially destructible.
+ * @param[in, out] data pointer to the elements to destruct
+ * @param[in] n         number of elements to destruct
+ */
+template <typename T>
+void destructStackElements(T* data, size_t n);
+
+/**
+ * Constructs the new element on top of the stack from the given arguments (in place, without copying or moving it).
+ * If the data array is enlarged, the element is constructed before and moved in, as the arguments can refer to the elements.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] args      arguments of the element constructor
+ */
+template <typename T, typename P, size_t N, typename... Args>
+void emplace(ImmortalStack<T, P, N>* thiz, Args&&... args);
+
+/**
+ * Pushes the copy of the given element on top of the stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] x         value to put on top of the stack
+ */
+template <typename T, typename P, size_t N>
+void push(ImmortalStack<T, P, N>* thiz, const StackNonDeduced<T>& x);
+
+/**
+ * Moves the given element on top of the stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] x         value to put on top of the stack
+ */
+template <typename T, typename P, size_t N>
+void push(ImmortalStack<T, P, N>* thiz, StackNonDeduced<T>&& x);
+
+/**
+ * Removes value from top of the stack. The value is moved out of the stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @return value that was on top of the stack.
+ */
+template <typename T, typename P, size_t N>
+T pop(ImmortalStack<T, P, N>* thiz);
+
+/**
+ * Gives value from top of the stack without removing it (unlike pop function).
+ * The value is not copied, so the reference is valid until the stack is modified.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return reference to the value that is located on top of the stack
+ */
+template <typename T, typename P, size_t N>
+const T& top(ImmortalStack<T, P, N>* thiz);
+
+/**
+ * Pushes the given elements on top of the stack (the last one ends up on top).
+ * Enlarges the data array at most once and checks the stack once before and once after the whole operation.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] src       array of values to put on top of the stack
+ * @param[in] n         number of values to put on top of the stack
+ */
+template <typename T, typename P, size_t N>
+void pushN(ImmortalStack<T, P, N>* thiz, const StackNonDeduced<T>* src, size_t n);
+
+/**
+ * Removes n values from top of the stack. The values are moved out of the stack.
+ * Values are written in the order they were pushed (top of the stack ends up last), so popN reverts pushN.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[out] dst      array to write the removed values to
+ * @param[in] n         number of values to remove
+ */
+template <typename T, typename P, size_t N>
+void popN(ImmortalStack<T, P, N>* thiz, StackNonDeduced<T>* dst, size_t n);
+
+/**
+ * Gives n values from top of the stack without removing them (unlike popN function).
+ * Values are written in the order they were pushed (top of the stack ends up last).
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @param[out] dst array to write the values to
+ * @param[in] n    number of values to give
+ */
+template <typename T, typename P, size_t N>
+void peekN(ImmortalStack<T, P, N>* thiz, StackNonDeduced<T>* dst, size_t n);
+
+/**
+ * Copy-assigns elements of one array to another. Uses memcpy if T is trivially copyable.
+ * @param[out] dst array to copy elements to
+ * @param[in] src  array to copy elements from
+ * @param[in] n    number of elements to copy
+ */
+template <typename T>
+void copyStackElements(T* dst, const T* src, size_t n);
+
+/**
+ * Move-assigns elements of one array to another. Uses memcpy if T is trivially copyable.
+ * @param[out] dst     array to move elements to
+ * @param[in, out] src array to move elements from
+ * @param[in] n        number of elements to move
+ */
+template <typename T>
+void moveStackElements(T* dst, T* src, size_t n);
+
+/**
+ * Gives the number of elements in the given stack.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return size of the stack.
+ */
+template <typename T, typename P, size_t N>
+ssize_t getStackSize(ImmortalStack<T, P, N>* thiz);
+
+/**
+ * Gives the actual size of the stack (size of the data holder array).
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return capacity of the stack.
+ */
+template <typename T, typename P, size_t N>
+ssize_t getStackCapacity(ImmortalStack<T, P, N>* thiz);
+
+/**
+ * Gives the sampling counters of the given stack with sampled verification (see StackSampledVerification).
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return number of checks and number of checks that skipped canaries and hashes.
+ */
+template <typename T, typename P, size_t N>
+StackSamplingState getStackSamplingState(ImmortalStack<T, P, N>* thiz);
+
+/**
+ * Gives the pointer to the actual dynamic array of contained data:
+ *   - If the canary guards are turned on, adds the necessary offset to Stack _data pointer;
+ *   - Otherwise, just returns _data pointer.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return pointer to the actual data array.
+ */
+template <typename T, typename P, size_t N>
+T* getStackData(ImmortalStack<T, P, N>* thiz);
+
+/**
+ * Calculates the hash value of the given stack members (see STACK_HASH_ALGORITHM). Skips _hash, _sampling, _inlineData
+ * and _mirror members of the stack.
+ * Stack elements are covered by _dataHash member, that is hashed here too.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return calculated hash value.
+ */
+template <typename T, typename P, size_t N>
+unsigned long long getHash(ImmortalStack<T, P, N>* thiz);
+
+/**
+ * Updates the hash of the stack members (_hash) after they are changed.
+ * Updates the mirror of the members too, if the stack repairs itself.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ */
+template <typename T, typename P, size_t N>
+void updateStackHash(ImmortalStack<T, P, N>* thiz);
+
+/**
+ * Calculates the hash value of the stack elements from bottom to top (see STACK_HASH_ALGORITHM).
+ * If the elements are hashed by blocks, it's the hash of the block hashes (that are calculated too).
+ * Push and pop don't call this function, they update _dataHash in constant time instead (see hashPushedElements).
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return calculated hash value.
+ */
+template <typename T, typename P, size_t N>
+unsigned long long getDataHash(ImmortalStack<T, P, N>* thiz);
+
+/**
+ * Adds the given elements, that are just pushed, to the hash of the elements (and to the hashes of their blocks).
+ * Takes time proportional to the number of the elements.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] first     index of the first pushed element
+ * @param[in] n         number of the pushed elements (they are on top of the stack)
+ */
+template <typename T, typename P, size_t N>
+void hashPushedElements(ImmortalStack<T, P, N>* thiz, ssize_t first, size_t n);
+
+/**
+ * Removes the given elements, that are being popped, from the hash of the elements (and from the hashes of their blocks).
+ * Takes time proportional to the number of the elements.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] first     index of the first popped element (the stack size is already decreased to it)
+ * @param[in] n         number of the popped elements (they are still in the data array)
+ */
+template <typename T, typename P, size_t N>
+void unhashPoppedElements(ImmortalStack<T, P, N>* thiz, ssize_t first, size_t n);
+
+/**
+ * Recalculates the hash of the elements (and the hashes of their blocks) from scratch.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ */
+template <typename T, typename P, size_t N>
+void rehashStackData(ImmortalStack<T, P, N>* thiz);
+
+/**
+ * Updates the hash of the elements below the top one (_belowTopHash) after _dataHash is changed.
+ * Works when the elements are hashed as a whole (not by blocks).
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ */
+template <typename T, typename P, size_t N>
+void updateStackBelowTopHash(ImmortalStack<T, P, N>* thiz);
+
+/**
+ * Finds the first block of the elements starting from the given one, whose hash differs from the saved one.
+ * Works when the elements are hashed by blocks.
+ * @param[in] thiz      pointer to the stack this operation should be performed on
+ * @param[in] fromBlock index of the block to start from
+ * @return index of the corrupted block, or -1 if there's no one.
+ */
+template <typename T, typename P, size_t N>
+ssize_t findCorruptedStackBlock(ImmortalStack<T, P, N>* thiz, ssize_t fromBlock);
+
+/**
+ * Gives the number of the hashed blocks, that contain the given number of elements (the last one can be incomplete).
+ * Works when the elements are hashed by blocks.
+ * @param[in] thiz     pointer to the stack this operation should be performed on
+ * @param[in] elements number of elements
+ * @return number of blocks.
+ */
+template <typename T, typename P, size_t N>
+ssize_t getStackBlocksNumber(ImmortalStack<T, P, N>* thiz, ssize_t elements);
+
+/**
+ * Gives the size in bytes of the block hashes array for the data array of the given capacity.
+ * @param[in] thiz     pointer to the stack this operation should be performed on
+ * @param[in] capacity capacity of the data array
+ * @return size of the block hashes array in bytes.
+ */
+template <typename T, typename P, size_t N>
+size_t getStackBlockHashesBytes(ImmortalStack<T, P, N>* thiz, ssize_t capacity);
+
+/**
+ * Restores the canaries and the members of the stack, that repairs itself. Members are restored from their mirror,
+ * if they are corrupted, or the mirror is restored from them. Logs what is restored. Used by repairStack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @return true, if the members are ok now, false otherwise.
+ */
+template <typename T, typename P, size_t N>
+bool repairStackHeader(ImmortalStack<T, P, N>* thiz);
+
+/**
+ * Restores one corrupted block of the elements (or its hash) of the stack, that repairs itself, whose members are ok.
+ * Corrupted block is the XOR of the parity and the other blocks. Logs what is restored. Used by repairStack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @return true, if the elements and their hashes are ok now, false otherwise (e.g. if several blocks are corrupted).
+ */
+template <typename T, typename P, size_t N>
+bool repairStackData(ImmortalStack<T, P, N>* thiz);
+
+/**
+ * XORs the given elements into the parity of the stack, that repairs itself: each element is XORed into the parity
+ * element with the same index in the block. Applying it twice to the same elements reverts it.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] first     index of the first element
+ * @param[in] n         number of the elements (all of them are in one block)
+ */
+template <typename T, typename P, size_t N>
+void xorStackParity(ImmortalStack<T, P, N>* thiz, size_t first, size_t n);
+
+/**
+ * Gives the size in bytes of the parity of the stack, that repairs itself (it's the size of one block of the elements).
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return size of the parity in bytes.
+ */
+template <typename T, typename P, size_t N>
+size_t getStackParityBytes(ImmortalStack<T, P, N>* thiz);
+
+/**
+ * Calculates the checksum of the mirror of the stack members (hash of all its fields except the checksum).
+ * @param[in] mirror mirror of the stack members
+ * @return calculated checksum.
+ */
+inline unsigned long long getStackMirrorChecksum(const StackHeaderMirror* mirror);
+
+/**
+ * XORs the source bytes into the destination ones.
+ * @param[in, out] dst bytes to XOR into
+ * @param[in] src      bytes to XOR
+ * @param[in] bytes    number of bytes
+ */
+inline void xorStackBytes(unsigned char* dst, const void* src, size_t bytes);
+
+/**
+ * Logs the members of the given stack (size, capacity, elements and canaries) into the log file. Used in LOG_STACK.
+ * Only constructed elements are logged if T is not trivially copyable.
+ * If the elements are hashed by blocks, only the corrupted blocks are logged (see logStackBlocks).
+ * Elements are logged as the log mode says (see StackLogMode, logStackWindows and hexdumpStackData).
+ * @param[in] stack stack to log (not nullptr)
+ */
+template <typename T, typename P, size_t N>
+void logStackMembers(ImmortalStack<T, P, N>* stack);
+
+/**
+ * Logs STACK_LOG_WINDOW elements of the given stack at the bottom, around the top, before the corrupted data canaries
+ * after the elements and at both ends of the corrupted blocks. Other elements are marked with "...".
+ * @param[in] stack    stack to log (not nullptr)
+ * @param[in] capacity number of the logged elements
+ */
+template <typename T, typename P, size_t N>
+void logStackWindows(ImmortalStack<T, P, N>* stack, size_t capacity);
+
+/**
+ * Appends the hexdump of the whole data array of the given stack, whose members are ok, (with data canaries)
+ * to stackHexdumpFileName and logs a line about it.
+ * @param[in] stack stack to dump (not nullptr)
+ * @return true, if the data array is hexdumped, false otherwise.
+ */
+template <typename T, typename P, size_t N>
+bool hexdumpStackData(ImmortalStack<T, P, N>* stack);
+
+/**
+ * Logs the corrupted blocks of the elements of the given stack, whose members are ok, with their indices.
+ * If there are no corrupted blocks, logs the top block. Works when the elements are hashed by blocks.
+ * @param[in] stack stack to log (not nullptr)
+ */
+template <typename T, typename P, size_t N>
+void logStackBlocks(ImmortalStack<T, P, N>* stack);
+
+/**
+ * Appends the binary dump of the given stack (members, canaries and elements) to stackDumpFileName. Used in DUMP_STACK.
+ * Elements are written with one write call, or compressed by blocks if the logging policy says so.
+ * Only constructed elements are dumped if T is not trivially copyable.
+ * @param[in] stack     stack to dump
+ * @param[in] stackName name of the stack expression
+ * @param[in] fileName  name of the source file
+ * @param[in] line      line of the source file
+ * @return true, if the stack is dumped, false otherwise.
+ */
+template <typename T, typename P, size_t N>
+bool dumpStack(ImmortalStack<T, P, N>* stack, const char* stackName, const char* fileName, int line);
+
+/**
+ * Stacks of the other types are not dumped in the binary format, DUMP_STACK logs them as text.
+ * @return false.
+ */
+template <typename Stack>
+bool dumpStack(Stack* stack, const char* stackName, const char* fileName, int line);
+
+/**
+ * Checks the members, canaries and hashes of the registered stack. Used by the background verifier.
+ * @param[in] stack pointer to the stack (ImmortalStack<T, P, N>)
+ * @return true, if the stack is ok, false otherwise.
+ */
+template <typename T, typename P, size_t N>
+bool isRegisteredStackOk(void* stack);
+
+/**
+ * Logs the registered stack into the stack log file. Used by the background verifier.
+ * @param[in] stack pointer to the stack (ImmortalStack<T, P, N>)
+ */
+template <typename T, typename P, size_t N>
+void logRegisteredStack(void* stack);
+
+/**
+ * Checks if the given address is in the guard pages around the data array of the stack. Used by the guard page handler.
+ * @param[in] stack   pointer to the stack (ImmortalStack<T, P, N>)
+ * @param[in] address faulting address
+ * @return true, if the address is in the guard pages of the stack, false otherwise.
+ */
+template <typename T, typename P, size_t N>
+bool isStackGuardHit(void* stack, const void* address);
+
+/**
+ * Reads the members of the stack with guard pages, that the guard page handler dumps. Only reads memory (async-signal-safe).
+ * @param[in] stack pointer to the stack (ImmortalStack<T, P, N>)
+ * @return members of the stack.
+ */
+template <typename T, typename P, size_t N>
+StackGuardedState getGuardedStackState(void* stack);
+
+/** Maximal length of the stack type name in logs */
+#define STACK_TYPE_NAME_MAX_LENGTH 256
+
+/**
+ * Gives the name of the stack of the given element type for logging (e.g. Stack_int).
+ * @return name of the stack type.
+ */
+template <typename T>
+const char* getStackTypeName();
+
+/**
+ * Gives the metrics slot of the current thread for the stacks of the given element type (see metrics.h).
+ * @param[in] thiz pointer to the stack (may be nullptr, the slot depends only on its type)
+ * @return slot of the stack family.
+ */
+template <typename T, typename P, size_t N>
+StackMetricsSlot* getStackMetricsSlot(ImmortalStack<T, P, N>* thiz);
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/** Name of the stack log file */
+#define stackLogFileName "stack-dump.txt"
+
+/** Name of the binary stack dump file */
+#define stackDumpFileName "stack-dump.bin"
+
+/** Name of the file with the hexdumps of the data arrays (see STACK_LOG_HEXDUMP) */
+#define stackHexdumpFileName "stack-dump.hex"
+
+/** Maximal number of the corrupted blocks, whose elements are logged in windowed mode */
+#ifndef STACK_LOG_WINDOWED_BLOCKS
+    #define STACK_LOG_WINDOWED_BLOCKS 8
+#endif
+
+/**
+ * Logs the canary values of the given stack (data canaries are not logged, if they are replaced by guard pages).
+ *
+ * Works when canaries are turned on.
+ */
+#define LOG_STACK_CANARIES(stack) do {                                                                                 \
+    using LoggedStack = StackOf<decltype(stack)>;                                                                      \
+    constexpr size_t loggedCanariesNumber     = LoggedStack::SecurityPolicy::Canaries::number;                         \
+    constexpr size_t loggedDataCanariesNumber = LoggedStack::SecurityPolicy::Canaries::dataNumber;                     \
+    if constexpr (loggedCanariesNumber > 0) {                                                                          \
+        long long* canariesBefore = stack->_canariesBefore;                                                            \
+        long long* canariesAfter  = stack->_canariesAfter;                                                             \
+        LOG_ARRAY_INDENTED(canariesBefore, loggedCanariesNumber, "\t");                                                \
+        LOG_ARRAY_INDENTED(canariesAfter,  loggedCanariesNumber, "\t");                                                \
+    }                                                                                                                  \
+    if constexpr (loggedDataCanariesNumber > 0) {                                                                      \
+        long long* dataCanariesBefore =                                                                                \
+            (long long*)stack->_data;                                                                                  \
+        long long* dataCanariesAfter  =                                                                                \
+            (long long*)(stack->_data + sizeof(long long) * loggedDataCanariesNumber +                                 \
+                         sizeof(typename LoggedStack::ElementType) * stack->_capacity);                                \
+        LOG_ARRAY_INDENTED(dataCanariesBefore, loggedDataCanariesNumber, "\t");                                        \
+        LOG_ARRAY_INDENTED(dataCanariesAfter,  loggedDataCanariesNumber, "\t");                                        \
+    }                                                                                                                  \
+} while (0)
+
+/**
+ * Logs the given stack into the log file.          <br>
+ * Logged stack example:                            <br>
+ * <code>
+ *     stack [0x00007FFC455B9830] (main.cpp:12) = { <br>
+ *         size = 3                                 <br>
+ *         capacity = 5                             <br>
+ *         data [0x0000560884197ED0] = {            <br>
+ *             [0] = 1                              <br>
+ *             [1] = 2                              <br>
+ *             [2] = 3                              <br>
+ *             [3] = 0                              <br>
+ *             [4] = 0                              <br>
+ *         }                                        <br>
+ *     }                                            <br>
+ * </code>
+ */
+#define LOG_STACK(stack) do {                                                                                          \
+    logPrintf("%s %s [" PTR_FORMAT "] (%s:%d)",                                                                        \
+        getStackTypeName<typename StackOf<decltype(stack)>::ElementType>(), #stack, (uintptr_t)stack,                  \
+        __FILENAME__, __LINE__);                                                                                       \
+    if (stack == nullptr) {                                                                                            \
+        logPrintf("\n");                                                                                               \
+        break;                                                                                                         \
+    }                                                                                                                  \
+    logPrintf(" = {\n");                                                                                               \
+    logStackMembers(stack);                                                                                            \
+    logPrintf("}\n");                                                                                                  \
+} while (0)
+// TODO: Convert all stack operations to macros for proper name and file displaying in log file.
+
+/**
+ * Logs the given stack into the log file in the given mode (see StackLogMode), whatever the global mode is.
+ */
+#define LOG_STACK_MODE(stack, mode) do {                                                                               \
+    StackLogModeGuard logModeGuard(mode);                                                                              \
+    LOG_STACK(stack);                                                                                                  \
+} while (0)
+
+/**
+ * Dumps the given stack in the binary format into stackDumpFileName and logs a line about the dump into the log file.
+ * Stack is logged as text (LOG_STACK), if it can't be dumped.
+ * @see dumpStack
+ */
+#define DUMP_STACK(stack) do {                                                                                         \
+    if (!dumpStack(stack, #stack, __FILENAME__, __LINE__)) {                                                           \
+        LOG_STACK(stack);                                                                                              \
+        break;                                                                                                         \
+    }                                                                                                                  \
+    logPrintf("%s %s [" PTR_FORMAT "] (%s:%d) is dumped into %s\n",                                                    \
+        getStackTypeName<typename StackOf<decltype(stack)>::ElementType>(), #stack, (uintptr_t)stack,                  \
+        __FILENAME__, __LINE__, stackDumpFileName);                                                                    \
+} while (0)
+
+/**
+ * Logs the given stack as the logging policy of the stack says: as text (LOG_STACK) or as a binary dump (DUMP_STACK).
+ */
+#define LOG_STACK_BY_POLICY(stack) do {                                                                                \
+    if constexpr (StackOf<decltype(stack)>::SecurityPolicy::Logging::binary) {                                         \
+        DUMP_STACK(stack);                                                                                             \
+    } else {                                                                                                           \
+        LOG_STACK(stack);                                                                                              \
+    }                                                                                                                  \
+} while (0)
+
+/**
+ * Checks if the given condition is true for this stack.
+ * If the condition is false, logs the stack into the file and fails an assertion.
+ * Log file is locked while the stack is logged, so threads don't mix their dumps.
+ * Log is flushed before the assertion fails, so the dump is not lost, when logging is asynchronous.
+ * Condition is evaluated once, as sampled checks count each evaluation.
+ *
+ * Works when logging is enabled by the stack policy.
+ */
+#define CHECK_STACK_CONDITION(stack, condition) do {                                                                   \
+    if constexpr (StackOf<decltype(stack)>::SecurityPolicy::Logging::enabled) {                                        \
+        bool stackConditionHolds = (condition);                                                                        \
+        if (!stackConditionHolds) {                                                                                    \
+            std::lock_guard<std::mutex> logGuard(_logMutex);                                                           \
+            logOpen(stackLogFileName);                                                                                 \
+            LOG_STACK_BY_POLICY(stack);                                                                                \
+            logClose();                                                                                                \
+            logFlush();                                                                                                \
+            assert(stackConditionHolds && #condition);                                                                 \
+        }                                                                                                              \
+    }                                                                                                                  \
+} while (0)
+
+/**
+ * Checks if the given stack is in normal state. Stack that can repair itself is repaired instead of failing the check.
+ *
+ * Works when logging is enabled by the stack policy.
+ *
+ * @see isStackOk
+ * @see repairStack
+ */
+#define CHECK_STACK_OK(stack) CHECK_STACK_CONDITION(stack, isStackOk(stack) || repairStack(stack))
+
+/**
+ * Checks the whole stack (all the elements are hashed). Used where linear time is spent anyway (e.g. destructStack).
+ *
+ * Works when logging is enabled by the stack policy.
+ *
+ * @see isStackFullyOk
+ * @see repairStack
+ */
+#define CHECK_STACK_FULLY_OK(stack) CHECK_STACK_CONDITION(stack, isStackFullyOk(stack) || repairStack(stack))
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * Checks if the given stack is in normal state (correct size and capacity, no nullptrs, correct canary values and hashes).
+ * If the stack is verified in the background, only the stack members are checked (see isStackMembersOk).
+ * If the checks are sampled, canaries and hashes are checked only in sampled ones (see sampleStackCheck).
+ * Otherwise, only the top element (or the top block, if the elements are hashed by blocks) is checked with the hashes,
+ * so the check doesn't depend on the stack size. Elements below it aren't rehashed, so their modification isn't
+ * detected here, only by isStackFullyOk.
+ * @param[in, out] stack stack to check
+ * @return true, if the given stack is ok, false otherwise.
+ */
+template <typename T, typename P, size_t N>
+bool isStackOk(ImmortalStack<T, P, N>* stack) {
+    STACK_TRACE_SCOPE("isStackOk", stack);
+    StackMetricsTimer checkTimer(stack, STACK_METRIC_CHECK_CYCLES);
+    if (!isStackMembersOk(stack)) {
+        return false;
+    }
+
+    if constexpr (P::Verification::background) {
+        return true;
+    } else if constexpr (P::Verification::sampled) {
+        return !sampleStackCheck(&stack->_sampling) || isStackIntegrityOk(stack);
+    } else {
+        return isStackIntegrityOk(stack, true);
+    }
+}
+
+/**
+ * Checks the whole stack: its members, canaries and hashes of all the elements. Takes linear time with hashing.
+ * @param[in] stack stack to check
+ * @return true, if the given stack is ok, false otherwise.
+ */
+template <typename T, typename P, size_t N>
+bool isStackFullyOk(ImmortalStack<T, P, N>* stack) {
+    STACK_TRACE_SCOPE("isStackFullyOk", stack);
+    StackMetricsTimer checkTimer(stack, STACK_METRIC_CHECK_CYCLES);
+    return isStackMembersOk(stack) && isStackIntegrityOk(stack);
+}
+
+/**
+ * Checks the stack members in constant time: correct size and capacity, no nullptrs.
+ * @param[in] stack stack to check
+ * @return true, if the stack members are ok, false otherwise.
+ */
+template <typename T, typename P, size_t N>
+bool isStackMembersOk(ImmortalStack<T, P, N>* stack) {
+    if constexpr (P::Hashing::blockSize > 0) {
+        if (stack != nullptr && stack->_blockHashes == nullptr) return false;
+    }
+
+    return (stack != nullptr)                 &&
+           (stack->_size != -1)               &&
+           (stack->_capacity != -1)           &&
+           (stack->_size <= stack->_capacity) &&
+           (stack->_data != nullptr)          &&
+           (stack->_allocator != nullptr);
+}
+
+/**
+ * Checks the canary values and hashes of the stack, whose members are ok. Takes linear time with hashing,
+ * unless only the top is checked.
+ * @param[in] stack   stack to check
+ * @param[in] topOnly check only the top element (or the top block, if the elements are hashed by blocks)
+ * @return true, if the canaries and hashes are correct, false otherwise.
+ */
+template <typename T, typename P, size_t N>
+bool isStackIntegrityOk(ImmortalStack<T, P, N>* stack, bool topOnly) {
+    if constexpr (P::Canaries::number > 0) {
+        for (size_t i = 0; i < P::Canaries::number; ++i) {
+            if (stack->_canariesBefore[i] != canaryValue) return false;
+            if (stack->_canariesAfter [i] != canaryValue) return false;
+        }
+    }
+
+    if constexpr (P::Canaries::dataNumber > 0) {
+        constexpr size_t canaries = P::Canaries::dataNumber;
+        long long* dataCanariesBefore =
+            ((long long*)(stack->_data));
+        long long* dataCanariesAfter =
+            ((long long*)(stack->_data + sizeof(long long) * canaries + sizeof(T) * stack->_capacity));
+        for (size_t i = 0; i < canaries; ++i) {
+            if (dataCanariesBefore[i] != canaryValue) return false;
+            if (dataCanariesAfter [i] != canaryValue) return false;
+        }
+    }
+
+    if constexpr (P::Hashing::blockSize > 0) {
+        if (getHash(stack) != stack->_hash) return false;
+
+        const ssize_t blocksNumber = getStackBlocksNumber(stack, stack->_size);
+        if (topOnly) {
+            return (blocksNumber == 0) || (findCorruptedStackBlock(stack, blocksNumber - 1) == -1);
+        }
+        if (findCorruptedStackBlock(stack, 0) != -1) return false;
+        if (hashBytes(0, stack->_blockHashes, sizeof(unsigned long long) * blocksNumber) != stack->_dataHash) return false;
+    } else if constexpr (P::Hashing::enabled) {
+        // _hash covers _dataHash and _belowTopHash, so the top element is checked against them in constant time
+        if (getHash(stack) != stack->_hash) return false;
+        if (stack->_size > 0) {
+            const T* top = getStackData(stack) + stack->_size - 1;
+            if (hashBytes(stack->_belowTopHash, top, sizeof(T)) != stack->_dataHash) return false;
+        }
+        if (topOnly) return true;
+        if (getDataHash(stack) != stack->_dataHash) return false;
+    } else {
+        (void)topOnly;
+    }
+
+    return true;
+}
+
+/**
+ * Repairs the stack that repairs itself (see StackParityRepair): restores its canaries, its members from their mirror
+ * and one corrupted block of the elements from the parity. Logs what is repaired into the stack log file.
+ * @param[in, out] stack stack to repair
+ * @return true, if the stack is repaired (it's ok now), false if it can't be repaired or it doesn't repair itself.
+ */
+template <typename T, typename P, size_t N>
+bool repairStack(ImmortalStack<T, P, N>* const stack) {
+    if constexpr (P::Repair::enabled) {
+        if (stack == nullptr) return false;
+
+        std::lock_guard<std::mutex> logGuard(_logMutex);
+        logOpen(stackLogFileName);
+        logPrintf("%s [" PTR_FORMAT "] is corrupted, repairing:\n", getStackTypeName<T>(), (uintptr_t)stack);
+        const bool isRepaired = repairStackHeader(stack) && repairStackData(stack) && isStackIntegrityOk(stack);
+        logPrintf(isRepaired ? "\tstack is repaired\n" : "\tstack can't be repaired\n");
+        logClose();
+
+        return isRepaired;
+    } else {
+        (void)stack;
+        return false;
+    }
+}
+
+/**
+ * Stacks of the other types don't repair themselves.
+ * @param[in] stack stack to repair
+ * @return false.
+ */
+template <typename Stack>
+bool repairStack(Stack* const) {
+    return false;
+}
+
+/**
+ * Creates a new stack with a given initial size of the data array.
+ * Stack joins the registry of the background verifier, if it's verified in the background.
+ * Stack with guard pages joins the table of guarded stacks, and its data array is allocated with guardPageStackAllocator.
+ * @param[in, out] thiz       pointer to the stack this operation should be performed on
+ * @param[in] initialCapacity initial size of the data array
+ * @param[in] allocator       allocator of the data array (ignored if the stack has guard pages)
+ */
+template <typename T, typename P, size_t N>
+void constructStack(ImmortalStack<T, P, N>* const thiz, size_t initialCapacity, const StackAllocator* allocator) {
+    CHECK_STACK_CONDITION(thiz, (thiz != nullptr) && (thiz->_data == nullptr));
+    CHECK_STACK_CONDITION(thiz, allocator != nullptr);
+
+    if constexpr (P::Canaries::number > 0) {
+        for (size_t i = 0; i < P::Canaries::number; ++i) {
+            thiz->_canariesBefore[i] = canaryValue;
+            thiz->_canariesAfter [i] = canaryValue;
+        }
+    }
+
+    if constexpr (N > 0) {
+        if (initialCapacity < N) initialCapacity = N;
+    }
+
+    if constexpr (P::Canaries::guardPages) {
+        allocator = &guardPageStackAllocator;
+        initialCapacity = roundStackCapacity(thiz, initialCapacity);
+    }
+
+    thiz->_size = 0;
+    thiz->_capacity = initialCapacity;
+    thiz->_allocator = allocator;
+    thiz->_data = (decltype(thiz->_data))allocateStackData(thiz, initialCapacity);
+    CHECK_STACK_CONDITION(thiz, thiz->_data != nullptr);
+
+    constexpr size_t canaries = P::Canaries::dataNumber;
+    if constexpr (canaries > 0) {
+        long long* dataCanariesBefore =
+            ((long long*)thiz->_data);
+        long long* dataCanariesAfter  =
+            ((long long*)(thiz->_data + sizeof(long long) * canaries + sizeof(T) * initialCapacity));
+        for (size_t i = 0; i < canaries; ++i) {
+            dataCanariesBefore[i] = canaryValue;
+            dataCanariesAfter [i] = canaryValue;
+        }
+    }
+
+    if constexpr (P::Verification::background) {
+        thiz->_registryEntry = new StackRegistryEntry();
+        thiz->_registryEntry->stack = thiz;
+        thiz->_registryEntry->isOk  = isRegisteredStackOk<T, P, N>;
+        thiz->_registryEntry->log   = logRegisteredStack<T, P, N>;
+    }
+
+    if constexpr (P::Hashing::blockSize > 0) {
+        thiz->_blockHashes = (unsigned long long*)allocateStackMemory(getStackBlockHashesBytes(thiz, initialCapacity));
+        CHECK_STACK_CONDITION(thiz, thiz->_blockHashes != nullptr);
+    }
+
+    if constexpr (P::Repair::enabled) {
+        thiz->_parity = (unsigned char*)allocateStackMemory(getStackParityBytes(thiz));
+        CHECK_STACK_CONDITION(thiz, thiz->_parity != nullptr);
+        memset(thiz->_parity, 0, getStackParityBytes(thiz));
+    }
+
+    if constexpr (P::Hashing::enabled) {
+        thiz->_dataHash = 0;
+        if constexpr (P::Hashing::blockSize == 0) {
+            thiz->_belowTopHash = 0;
+        }
+        updateStackHash(thiz);
+    }
+
+    if constexpr (P::Verification::background) {
+        registerStack(thiz->_registryEntry);
+    }
+
+    if constexpr (P::Canaries::guardPages) {
+        CHECK_STACK_CONDITION(thiz, registerGuardedStack(
+            thiz, getStackTypeName<T>(), isStackGuardHit<T, P, N>, getGuardedStackState<T, P, N>, stackLogFileName
+        ));
+    }
+
+    STACK_METRICS_ADD(thiz, STACK_METRIC_CONSTRUCTS, 1);
+}
+
+/**
+ * Destructs the given stack. Frees the dynamic memory and resets all struct members to initial state.
+ * Stack leaves the registry of the background verifier, if it's verified in the background.
+ * Stack with guard pages leaves the table of guarded stacks.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ */
+template <typename T, typename P, size_t N>
+void destructStack(ImmortalStack<T, P, N>* const thiz) {
+    CHECK_STACK_FULLY_OK(thiz);
+
+    if constexpr (P::Verification::background) {
+        unregisterStack(thiz->_registryEntry);
+        delete thiz->_registryEntry;
+        thiz->_registryEntry = nullptr;
+    }
+
+    if constexpr (P::Canaries::guardPages) {
+        unregisterGuardedStack(thiz);
+    }
+
+    destructStackElements(getStackData(thiz), thiz->_size);
+    deallocateStackData(thiz, thiz->_data, thiz->_capacity);
+
+    if constexpr (P::Hashing::blockSize > 0) {
+        freeStackMemory(thiz->_blockHashes, getStackBlockHashesBytes(thiz, thiz->_capacity));
+        thiz->_blockHashes = nullptr;
+    }
+
+    if constexpr (P::Repair::enabled) {
+        freeStackMemory(thiz->_parity, getStackParityBytes(thiz));
+        thiz->_parity = nullptr;
+        thiz->_mirror = {};
+    }
+
+    thiz->_size = 0;
+    thiz->_capacity = 0;
+    thiz->_data = nullptr;
+    thiz->_allocator = nullptr;
+
+    if constexpr (P::Hashing::enabled) {
+        thiz->_dataHash = 0;
+        if constexpr (P::Hashing::blockSize == 0) {
+            thiz->_belowTopHash = 0;
+        }
+        thiz->_hash = 0;
+    }
+}
+
+/**
+ * Enlarges the internal data array of the given stack.
+ * If the capacity of the data array is zero, then it's set to one.
+ * Otherwise, capacity is multiplied by STACK_ENLARGE_MULTIPLIER.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ */
+template <typename T, typename P, size_t N>
+void enlarge(ImmortalStack<T, P, N>* const thiz) {
+    STACK_REGISTRY_GUARD(thiz);
+    CHECK_STACK_OK(thiz);
+
+    if (thiz->_size == thiz->_capacity) {
+        reallocateStackData(thiz, (thiz->_capacity == 0) ? 1 : thiz->_capacity * STACK_ENLARGE_MULTIPLIER);
+    }
+
+    CHECK_STACK_OK(thiz);
+}
+
+/**
+ * Reallocates the internal data array of the given stack, so it can contain the given number of elements.
+ * Keeps the stack elements. Doesn't check if the stack is ok, it's up to the caller.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] capacity  new capacity of the stack (not less than its size)
+ */
+template <typename T, typename P, size_t N>
+void reallocateStackData(ImmortalStack<T, P, N>* const thiz, ssize_t capacity) {
+    CHECK_STACK_CONDITION(thiz, (thiz != nullptr) && (capacity >= thiz->_size));
+
+    if constexpr (N > 0) {
+        // Inline data array can't be shrunk, so it's the smallest one
+        if (capacity < (ssize_t)N) capacity = N;
+    }
+    capacity = roundStackCapacity(thiz, capacity);
+    if (capacity == thiz->_capacity) return;
+
+    STACK_TRACE_SCOPE((capacity > thiz->_capacity) ? "enlarge" : "shrink", thiz);
+    STACK_METRICS_ADD(thiz, STACK_METRIC_ENLARGES, (capacity > thiz->_capacity) ? 1 : 0);
+    STACK_METRICS_ADD(thiz, STACK_METRIC_RELOCATED_BYTES, sizeof(T) * thiz->_size);
+
+    constexpr size_t canaries = P::Canaries::dataNumber;
+    if (
+        isStackDataInline(thiz) || isStackCapacityInline(thiz, capacity) ||
+        !std::is_trivially_copyable<T>::value
+    ) {
+        moveStackData(thiz, capacity);
+    } else {
+        const StackAllocator* allocator = thiz->_allocator;
+        const size_t oldBytes = getStackDataBytes(thiz, thiz->_capacity);
+        const size_t newBytes = getStackDataBytes(thiz, capacity);
+
+        // Data array is reallocated with both canaries (contents are copied as bytes), then the trailing canary is moved
+        void* newData = allocator->reallocate(allocator->context, thiz->_data, oldBytes, newBytes);
+        CHECK_STACK_CONDITION(thiz, newData != nullptr);
+        thiz->_data = (decltype(thiz->_data))newData;
+        STACK_METRICS_ADD(thiz, STACK_METRIC_ALLOCATED_BYTES, (long long)newBytes - (long long)oldBytes);
+
+        if constexpr (canaries > 0) {
+            long long* dataCanariesAfter =
+                ((long long*)(thiz->_data + sizeof(long long) * canaries + sizeof(T) * capacity));
+            for (size_t i = 0; i < canaries; ++i) {
+                dataCanariesAfter[i] = canaryValue;
+            }
+        }
+    }
+
+    if constexpr (P::Hashing::blockSize > 0) {
+        void* blockHashes = reallocateStackMemory(
+            thiz->_blockHashes, getStackBlockHashesBytes(thiz, thiz->_capacity), getStackBlockHashesBytes(thiz, capacity)
+        );
+        CHECK_STACK_CONDITION(thiz, blockHashes != nullptr);
+        thiz->_blockHashes = (unsigned long long*)blockHashes;
+    }
+
+    thiz->_capacity = capacity;
+
+    if constexpr (P::Hashing::enabled) {
+        updateStackHash(thiz);
+    }
+}
+
+/**
+ * Moves the elements of the given stack to the new data array of the given capacity and frees the old one.
+ * Used when the data array can't be reallocated in place: when it's moved from or to the inline data array,
+ * or when T is not trivially copyable (its elements are moved with move constructor). Doesn't update the capacity of the stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] capacity  capacity of the new data array (not less than the stack size)
+ */
+template <typename T, typename P, size_t N>
+void moveStackData(ImmortalStack<T, P, N>* const thiz, ssize_t capacity) {
+    CHECK_STACK_CONDITION(thiz, (thiz != nullptr) && (capacity >= thiz->_size));
+
+    auto newData = (decltype(thiz->_data))allocateStackData(thiz, capacity);
+    CHECK_STACK_CONDITION(thiz, newData != nullptr);
+
+    constexpr size_t canaries = P::Canaries::dataNumber;
+    if constexpr (canaries > 0) {
+        long long* dataCanariesBefore =
+            ((long long*)newData);
+        long long* dataCanariesAfter  =
+            ((long long*)(newData + sizeof(long long) * canaries + sizeof(T) * capacity));
+        for (size_t i = 0; i < canaries; ++i) {
+            dataCanariesBefore[i] = canaryValue;
+            dataCanariesAfter [i] = canaryValue;
+        }
+    }
+
+    relocateStackElements((T*)((char*)newData + sizeof(long long) * canaries), getStackData(thiz), thiz->_size);
+
+    deallocateStackData(thiz, thiz->_data, thiz->_capacity);
+    thiz->_data = newData;
+
+    if constexpr (P::Hashing::enabled && !std::is_trivially_copyable<T>::value) {
+        // Moved elements can differ from the source ones bytewise (e.g. if they point to themselves)
+        rehashStackData(thiz);
+    }
+}
+
+/**
+ * Allocates the data array of the given capacity with the stack allocator.
+ * If the capacity is equal to InlineCapacity, gives the inline data array instead.
+ * @param[in] thiz     pointer to the stack this operation should be performed on
+ * @param[in] capacity capacity of the data array
+ * @return pointer to the data array (with data canaries if they are turned on), or nullptr if there's not enough memory.
+ */
+template <typename T, typename P, size_t N>
+void* allocateStackData(ImmortalStack<T, P, N>* const thiz, ssize_t capacity) {
+    if constexpr (N > 0) {
+        if (isStackCapacityInline(thiz, capacity)) {
+            return thiz->_inlineData.bytes;
+        }
+    }
+
+    void* data = thiz->_allocator->allocate(thiz->_allocator->context, getStackDataBytes(thiz, capacity));
+    if (data != nullptr) {
+        STACK_METRICS_ADD(thiz, STACK_METRIC_ALLOCATED_BYTES, getStackDataBytes(thiz, capacity));
+    }
+    return data;
+}
+
+/**
+ * Frees the data array that was allocated with allocateStackData. Inline data array is not freed.
+ * @param[in] thiz     pointer to the stack this operation should be performed on
+ * @param[in] data     pointer to the data array
+ * @param[in] capacity capacity of the data array
+ */
+template <typename T, typename P, size_t N>
+void deallocateStackData(ImmortalStack<T, P, N>* const thiz, void* data, ssize_t capacity) {
+    if (data != (void*)getStackInlineData(thiz)) {
+        thiz->_allocator->deallocate(thiz->_allocator->context, data, getStackDataBytes(thiz, capacity));
+        STACK_METRICS_ADD(thiz, STACK_METRIC_ALLOCATED_BYTES, -(long long)getStackDataBytes(thiz, capacity));
+    }
+}
+
+/**
+ * Checks if the elements of the given stack are stored in its inline data array.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return true, if the elements are stored inside the stack struct, false otherwise.
+ */
+template <typename T, typename P, size_t N>
+bool isStackDataInline(ImmortalStack<T, P, N>* const thiz) {
+    return (N > 0) && ((void*)thiz->_data == (void*)getStackInlineData(thiz));
+}
+
+/**
+ * Checks if the data array of the given capacity is the inline one (capacity is equal to InlineCapacity).
+ * @param[in] thiz     pointer to the stack this operation should be performed on
+ * @param[in] capacity capacity of the data array
+ * @return true, if the data array of the given capacity is stored inside the stack struct, false otherwise.
+ */
+template <typename T, typename P, size_t N>
+bool isStackCapacityInline(ImmortalStack<T, P, N>* const, ssize_t capacity) {
+    return (N > 0) && (capacity == (ssize_t)N);
+}
+
+/**
+ * Gives the pointer to the inline data array of the given stack.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return pointer to the inline data array (with data canaries if they are turned on), or nullptr if there's no one.
+ */
+template <typename T, typename P, size_t N>
+char* getStackInlineData(ImmortalStack<T, P, N>* const thiz) {
+    if constexpr (N > 0) {
+        return thiz->_inlineData.bytes;
+    } else {
+        (void)thiz;
+        return nullptr;
+    }
+}
+
+/**
+ * Shrinks the internal data array of the given stack, so its capacity is equal to its size.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ */
+template <typename T, typename P, size_t N>
+void shrinkToFit(ImmortalStack<T, P, N>* const thiz) {
+    STACK_REGISTRY_GUARD(thiz);
+    CHECK_STACK_FULLY_OK(thiz);
+
+    if (thiz->_size != thiz->_capacity) {
+        reallocateStackData(thiz, thiz->_size);
+    }
+
+    CHECK_STACK_OK(thiz);
+}
+
+/**
+ * Divides the capacity of the given stack by STACK_ENLARGE_MULTIPLIER, if the stack size is STACK_SHRINK_DIVISOR times less
+ * than its capacity. As the divisor is greater than the multiplier, stack doesn't shrink and enlarge in turns.
+ * Doesn't check if the stack is ok, it's up to the caller.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ */
+template <typename T, typename P, size_t N>
+void shrinkIfSparse(ImmortalStack<T, P, N>* const thiz) {
+    static_assert(
+        STACK_SHRINK_DIVISOR == 0 || STACK_SHRINK_DIVISOR > STACK_ENLARGE_MULTIPLIER,
+        "stack must not shrink right after enlarging"
+    );
+
+    if constexpr (STACK_SHRINK_DIVISOR > 0) {
+        if (
+            (thiz->_size <= thiz->_capacity / STACK_SHRINK_DIVISOR) &&
+            (sizeof(T) * thiz->_capacity >= STACK_SHRINK_MIN_BYTES)
+        ) {
+            reallocateStackData(thiz, thiz->_capacity / STACK_ENLARGE_MULTIPLIER);
+        }
+    }
+}
+
+/**
+ * Gives the size in bytes of the data array of the given capacity (with data canaries if they are turned on).
+ * @param[in] thiz     pointer to the stack this operation should be performed on
+ * @param[in] capacity capacity of the data array
+ * @return size of the data array in bytes.
+ */
+template <typename T, typename P, size_t N>
+size_t getStackDataBytes(ImmortalStack<T, P, N>* const, ssize_t capacity) {
+    constexpr size_t canaries = P::Canaries::dataNumber;
+    return sizeof(long long) * canaries + sizeof(T) * capacity + sizeof(long long) * canaries;
+}
+
+/**
+ * Rounds the capacity of the data array up, so the data array with guard pages ends right before the trailing guard page
+ * (as close as the element size allows), and writing past its end traps. Other capacities are not changed.
+ * @param[in] thiz     pointer to the stack this operation should be performed on
+ * @param[in] capacity capacity of the data array
+ * @return rounded capacity.
+ */
+template <typename T, typename P, size_t N>
+ssize_t roundStackCapacity(ImmortalStack<T, P, N>* const, ssize_t capacity) {
+    if constexpr (P::Canaries::guardPages) {
+        return (ssize_t)(getStackGuardedBytes(sizeof(T) * capacity) / sizeof(T));
+    } else {
+        return capacity;
+    }
+}
+
+/**
+ * Copy-constructs elements in the given uninitialized memory. Uses memcpy if T is trivially copyable.
+ * @param[out] dst memory to construct elements in
+ * @param[in] src  array to copy elements from
+ * @param[in] n    number of elements to construct
+ */
+template <typename T>
+void constructStackElements(T* const dst, const T* const src, size_t n) {
+    if constexpr (std::is_trivially_copyable<T>::value) {
+        if (n > 0) {
+            memcpy((void*)dst, src, sizeof(T) * n);
+        }
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            new (dst + i) T(src[i]);
+        }
+    }
+}
+
+/**
+ * Moves elements to the given uninitialized memory: move-constructs them there and destructs the source ones.
+ * Uses memcpy if T is trivially copyable.
+ * @param[out] dst     memory to move elements to
+ * @param[in, out] src array to move elements from
+ * @param[in] n        number of elements to move
+ */
+template <typename T>
+void relocateStackElements(T* const dst, T* const src, size_t n) {
+    if constexpr (std::is_trivially_copyable<T>::value) {
+        if (n > 0) {
+            memcpy((void*)dst, src, sizeof(T) * n);
+        }
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            new (dst + i) T(std::move(src[i]));
+            src[i].~T();
+        }
+    }
+}
+
+/**
+ * Destructs the given elements, if T is not trivially destructible.
+ * @param[in, out] data pointer to the elements to destruct
+ * @param[in] n         number of elements to destruct
+ */
+template <typename T>
+void destructStackElements(T* const data, size_t n) {
+    if constexpr (!std::is_trivially_destructible<T>::value) {
+        for (size_t i = 0; i < n; ++i) {
+            data[i].~T();
+        }
+    }
+}
+
+/**
+ * Constructs the new element on top of the stack from the given arguments (in place, without copying or moving it).
+ * If the data array is enlarged, the element is constructed before and moved in, as the arguments can refer to the elements.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] args      arguments of the element constructor
+ */
+template <typename T, typename P, size_t N, typename... Args>
+void emplace(ImmortalStack<T, P, N>* const thiz, Args&&... args) {
+    STACK_TRACE_SCOPE("push", thiz);
+    STACK_REGISTRY_GUARD(thiz);
+    CHECK_STACK_OK(thiz);
+
+    if (thiz->_size == thiz->_capacity) {
+        // Arguments can refer to the elements (e.g. push(&s, top(&s))), so the element is built before they are freed
+        T element(std::forward<Args>(args)...);
+        reallocateStackData(thiz, (thiz->_capacity == 0) ? 1 : thiz->_capacity * STACK_ENLARGE_MULTIPLIER);
+        new (getStackData(thiz) + thiz->_size) T(std::move(element));
+    } else {
+        new (getStackData(thiz) + thiz->_size) T(std::forward<Args>(args)...);
+    }
+    ++thiz->_size;
+    STACK_METRICS_ADD(thiz, STACK_METRIC_PUSHES, 1);
+    STACK_METRICS_RAISE(thiz, STACK_METRIC_PEAK_SIZE, thiz->_size);
+
+    if constexpr (P::Hashing::enabled) {
+        hashPushedElements(thiz, thiz->_size - 1, 1);
+        updateStackHash(thiz);
+    }
+
+    CHECK_STACK_OK(thiz);
+}
+
+/**
+ * Pushes the copy of the given element on top of the stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] x         value to put on top of the stack
+ */
+template <typename T, typename P, size_t N>
+void push(ImmortalStack<T, P, N>* const thiz, const StackNonDeduced<T>& x) {
+    emplace(thiz, x);
+}
+
+/**
+ * Moves the given element on top of the stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] x         value to put on top of the stack
+ */
+template <typename T, typename P, size_t N>
+void push(ImmortalStack<T, P, N>* const thiz, StackNonDeduced<T>&& x) {
+    emplace(thiz, std::move(x));
+}
+
+/**
+ * Removes value from top of the stack. The value is moved out of the stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @return value that was on top of the stack.
+ */
+template <typename T, typename P, size_t N>
+T pop(ImmortalStack<T, P, N>* const thiz) {
+    STACK_TRACE_SCOPE("pop", thiz);
+    STACK_REGISTRY_GUARD(thiz);
+    CHECK_STACK_OK(thiz);
+    CHECK_STACK_CONDITION(thiz, thiz->_size > 0);
+    STACK_METRICS_ADD(thiz, STACK_METRIC_POPS, 1);
+
+    T* slot = getStackData(thiz) + --thiz->_size;
+    if constexpr (P::Hashing::enabled) {
+        unhashPoppedElements(thiz, thiz->_size, 1);
+    }
+
+    T top = std::move(*slot);
+    destructStackElements(slot, 1);
+
+    if constexpr (P::Hashing::enabled) {
+        updateStackHash(thiz);
+    }
+
+    shrinkIfSparse(thiz);
+
+    return top;
+}
+
+/**
+ * Gives value from top of the stack without removing it (unlike pop function).
+ * The value is not copied, so the reference is valid until the stack is modified.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return reference to the value that is located on top of the stack
+ */
+template <typename T, typename P, size_t N>
+const T& top(ImmortalStack<T, P, N>* const thiz) {
+    CHECK_STACK_OK(thiz);
+    CHECK_STACK_CONDITION(thiz, thiz->_size > 0);
+    STACK_METRICS_ADD(thiz, STACK_METRIC_TOPS, 1);
+
+    return getStackData(thiz)[thiz->_size - 1];
+}
+
+/**
+ * Pushes the given elements on top of the stack (the last one ends up on top).
+ * Enlarges the data array at most once and checks the stack once before and once after the whole operation.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] src       array of values to put on top of the stack
+ * @param[in] n         number of values to put on top of the stack
+ */
+template <typename T, typename P, size_t N>
+void pushN(ImmortalStack<T, P, N>* const thiz, const StackNonDeduced<T>* src, size_t n) {
+    STACK_REGISTRY_GUARD(thiz);
+    CHECK_STACK_OK(thiz);
+    CHECK_STACK_CONDITION(thiz, (src != nullptr) || (n == 0));
+
+    if (thiz->_size + (ssize_t)n > thiz->_capacity) {
+        // Source can be the stack elements themselves, they are kept by the reallocation at the same indices
+        const T* const data = getStackData(thiz);
+        const ssize_t srcIndex = (src >= data && src < data + thiz->_size) ? src - data : -1;
+
+        ssize_t enlargedCapacity = thiz->_capacity * STACK_ENLARGE_MULTIPLIER;
+        reallocateStackData(thiz, (thiz->_size + (ssize_t)n > enlargedCapacity) ? thiz->_size + (ssize_t)n : enlargedCapacity);
+        if (srcIndex != -1) {
+            src = getStackData(thiz) + srcIndex;
+        }
+    }
+    T* slots = getStackData(thiz) + thiz->_size;
+    constructStackElements(slots, src, n);
+    thiz->_size += n;
+    STACK_METRICS_ADD(thiz, STACK_METRIC_PUSHES, n);
+    STACK_METRICS_RAISE(thiz, STACK_METRIC_PEAK_SIZE, thiz->_size);
+
+    if constexpr (P::Hashing::enabled) {
+        hashPushedElements(thiz, thiz->_size - (ssize_t)n, n);
+        updateStackHash(thiz);
+    }
+
+    CHECK_STACK_OK(thiz);
+}
+
+/**
+ * Removes n values from top of the stack. The values are moved out of the stack.
+ * Values are written in the order they were pushed (top of the stack ends up last), so popN reverts pushN.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[out] dst      array to write the removed values to
+ * @param[in] n         number of values to remove
+ */
+template <typename T, typename P, size_t N>
+void popN(ImmortalStack<T, P, N>* const thiz, StackNonDeduced<T>* dst, size_t n) {
+    STACK_REGISTRY_GUARD(thiz);
+    CHECK_STACK_OK(thiz);
+    CHECK_STACK_CONDITION(thiz, (dst != nullptr) || (n == 0));
+    CHECK_STACK_CONDITION(thiz, thiz->_size >= (ssize_t)n);
+    STACK_METRICS_ADD(thiz, STACK_METRIC_POPS, n);
+
+    thiz->_size -= n;
+    T* slots = getStackData(thiz) + thiz->_size;
+    if constexpr (P::Hashing::enabled) {
+        unhashPoppedElements(thiz, thiz->_size, n);
+    }
+
+    moveStackElements(dst, slots, n);
+    destructStackElements(slots, n);
+
+    if constexpr (P::Hashing::enabled) {
+        updateStackHash(thiz);
+    }
+
+    shrinkIfSparse(thiz);
+
+    CHECK_STACK_OK(thiz);
+}
+
+/**
+ * Gives n values from top of the stack without removing them (unlike popN function).
+ * Values are written in the order they were pushed (top of the stack ends up last).
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @param[out] dst array to write the values to
+ * @param[in] n    number of values to give
+ */
+template <typename T, typename P, size_t N>
+void peekN(ImmortalStack<T, P, N>* const thiz, StackNonDeduced<T>* dst, size_t n) {
+    CHECK_STACK_OK(thiz);
+    CHECK_STACK_CONDITION(thiz, (dst != nullptr) || (n == 0));
+    CHECK_STACK_CONDITION(thiz, thiz->_size >= (ssize_t)n);
+
+    copyStackElements(dst, getStackData(thiz) + thiz->_size - n, n);
+}
+
+/**
+ * Copy-assigns elements of one array to another. Uses memcpy if T is trivially copyable.
+ * @param[out] dst array to copy elements to
+ * @param[in] src  array to copy elements from
+ * @param[in] n    number of elements to copy
+ */
+template <typename T>
+void copyStackElements(T* const dst, const T* const src, size_t n) {
+    if constexpr (std::is_trivially_copyable<T>::value) {
+        if (n > 0) {
+            memcpy((void*)dst, src, sizeof(T) * n);
+        }
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            dst[i] = src[i];
+        }
+    }
+}
+
+/**
+ * Move-assigns elements of one array to another. Uses memcpy if T is trivially copyable.
+ * @param[out] dst     array to move elements to
+ * @param[in, out] src array to move elements from
+ * @param[in] n        number of elements to move
+ */
+template <typename T>
+void moveStackElements(T* const dst, T* const src, size_t n) {
+    if constexpr (std::is_trivially_copyable<T>::value) {
+        if (n > 0) {
+            memcpy((void*)dst, src, sizeof(T) * n);
+        }
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            dst[i] = std::move(src[i]);
+        }
+    }
+}
+
+/**
+ * Gives the number of elements in the given stack.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return size of the stack.
+ */
+template <typename T, typename P, size_t N>
+ssize_t getStackSize(ImmortalStack<T, P, N>* const thiz) {
+    CHECK_STACK_CONDITION(thiz, thiz != nullptr);
+
+    return thiz->_size;
+}
+
+/**
+ * Gives the actual size of the stack (size of the data holder array).
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return capacity of the stack.
+ */
+template <typename T, typename P, size_t N>
+ssize_t getStackCapacity(ImmortalStack<T, P, N>* const thiz) {
+    CHECK_STACK_CONDITION(thiz, thiz != nullptr);
+
+    return thiz->_capacity;
+}
+
+/**
+ * Gives the sampling counters of the given stack with sampled verification (see StackSampledVerification).
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return number of checks and number of checks that skipped canaries and hashes.
+ */
+template <typename T, typename P, size_t N>
+StackSamplingState getStackSamplingState(ImmortalStack<T, P, N>* const thiz) {
+    static_assert(P::Verification::sampled, "stack checks are not sampled");
+    CHECK_STACK_CONDITION(thiz, thiz != nullptr);
+
+    return thiz->_sampling;
+}
+
+/**
+ * Gives the pointer to the actual dynamic array of contained data:
+ *   - If the canary guards are turned on, adds the necessary offset to Stack _data pointer;
+ *   - Otherwise, just returns _data pointer.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return pointer to the actual data array.
+ */
+template <typename T, typename P, size_t N>
+T* getStackData(ImmortalStack<T, P, N>* const thiz) {
+    CHECK_STACK_CONDITION(thiz, thiz != nullptr);
+
+    if constexpr (P::Canaries::dataNumber > 0) {
+        return (T*)(thiz->_data + sizeof(long long) * P::Canaries::dataNumber);
+    } else {
+        return thiz->_data;
+    }
+}
+
+/**
+ * Calculates the hash value of the given stack members (see STACK_HASH_ALGORITHM). Skips _hash, _sampling, _inlineData
+ * and _mirror members of the stack.
+ * Stack elements are covered by _dataHash member, that is hashed here too.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return calculated hash value.
+ */
+template <typename T, typename P, size_t N>
+unsigned long long getHash(ImmortalStack<T, P, N>* const thiz) {
+    STACK_TRACE_SCOPE("getHash", thiz);
+    StackMetricsTimer hashTimer(thiz, STACK_METRIC_HASH_CYCLES);
+    CHECK_STACK_CONDITION(thiz, thiz != nullptr && thiz->_data != nullptr);
+
+    char* hashBegin = (char*)&(thiz->_hash);
+    char* hashEnd   = hashBegin + sizeof(thiz->_hash);
+    if constexpr (P::Verification::sampled) {
+        hashEnd = (char*)&(thiz->_sampling) + sizeof(thiz->_sampling);
+    }
+
+    char* structEnd = (char*)thiz + sizeof(ImmortalStack<T, P, N>);
+    if constexpr (P::Repair::enabled) {
+        structEnd = (char*)&(thiz->_mirror);
+    }
+
+    unsigned long long hash = hashBytes(0, thiz, hashBegin - (char*)thiz);
+    if constexpr (N > 0) {
+        // Inline elements are covered by _dataHash, so the inline data array is skipped
+        char* inlineDataBegin = (char*)&(thiz->_inlineData);
+        char* inlineDataEnd   = inlineDataBegin + sizeof(thiz->_inlineData);
+
+        hash = hashBytes(hash, hashEnd, inlineDataBegin - hashEnd);
+        return hashBytes(hash, inlineDataEnd, structEnd - inlineDataEnd);
+    } else {
+        return hashBytes(hash, hashEnd, structEnd - hashEnd);
+    }
+}
+
+/**
+ * Updates the hash of the stack members (_hash) after they are changed.
+ * Updates the mirror of the members too, if the stack repairs itself.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ */
+template <typename T, typename P, size_t N>
+void updateStackHash(ImmortalStack<T, P, N>* const thiz) {
+    thiz->_hash = getHash(thiz);
+
+    if constexpr (P::Repair::enabled) {
+        StackHeaderMirror* mirror = &thiz->_mirror;
+        mirror->size        = thiz->_size;
+        mirror->capacity    = thiz->_capacity;
+        mirror->data        = thiz->_data;
+        mirror->dataHash    = thiz->_dataHash;
+        mirror->blockHashes = thiz->_blockHashes;
+        mirror->parity      = thiz->_parity;
+        mirror->allocator   = thiz->_allocator;
+        mirror->checksum    = getStackMirrorChecksum(mirror);
+    }
+}
+
+/**
+ * Calculates the hash value of the stack elements from bottom to top (see STACK_HASH_ALGORITHM).
+ * If the elements are hashed by blocks, it's the hash of the block hashes (that are calculated too).
+ * Push and pop don't call this function, they update _dataHash in constant time instead (see hashPushedElements).
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return calculated hash value.
+ */
+template <typename T, typename P, size_t N>
+unsigned long long getDataHash(ImmortalStack<T, P, N>* const thiz) {
+    STACK_TRACE_SCOPE("getDataHash", thiz);
+    CHECK_STACK_CONDITION(thiz, thiz != nullptr && thiz->_data != nullptr && thiz->_size >= 0);
+
+    if constexpr (P::Hashing::blockSize > 0) {
+        constexpr size_t blockSize = P::Hashing::blockSize;
+        const T* const data = getStackData(thiz);
+        const ssize_t blocksNumber = getStackBlocksNumber(thiz, thiz->_size);
+
+        unsigned long long hash = 0;
+        for (ssize_t block = 0; block < blocksNumber; ++block) {
+            const size_t blockBegin = block * blockSize;
+            const size_t blockEnd   = ((size_t)thiz->_size < blockBegin + blockSize) ? thiz->_size : blockBegin + blockSize;
+            const unsigned long long blockHash = hashBytes(0, data + blockBegin, sizeof(T) * (blockEnd - blockBegin));
+            hash = hashBytes(hash, &blockHash, sizeof(blockHash));
+        }
+        return hash;
+    } else {
+        return hashBytes(0, getStackData(thiz), sizeof(T) * thiz->_size);
+    }
+}
+
+/**
+ * Adds the given elements, that are just pushed, to the hash of the elements (and to the hashes of their blocks).
+ * Takes time proportional to the number of the elements.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] first     index of the first pushed element
+ * @param[in] n         number of the pushed elements (they are on top of the stack)
+ */
+template <typename T, typename P, size_t N>
+void hashPushedElements(ImmortalStack<T, P, N>* const thiz, ssize_t first, size_t n) {
+    if constexpr (P::Hashing::blockSize > 0) {
+        constexpr size_t blockSize = P::Hashing::blockSize;
+        const T* const data = getStackData(thiz);
+
+        // Only the block hashes from the first changed one are updated, they are at the end of the hashed sequence
+        for (size_t index = first, end = first + n; index < end;) {
+            const size_t block      = index / blockSize;
+            const size_t blockEnd   = (end < (block + 1) * blockSize) ? end : (block + 1) * blockSize;
+            unsigned long long hash = 0;
+            if (index % blockSize != 0) {
+                hash = thiz->_blockHashes[block];
+                thiz->_dataHash = unhashBytes(thiz->_dataHash, &hash, sizeof(hash));
+            }
+
+            hash = hashBytes(hash, data + index, sizeof(T) * (blockEnd - index));
+            thiz->_blockHashes[block] = hash;
+            if constexpr (P::Repair::enabled) {
+                xorStackParity(thiz, index, blockEnd - index);
+            }
+            thiz->_dataHash = hashBytes(thiz->_dataHash, &hash, sizeof(hash));
+            index = blockEnd;
+        }
+    } else {
+        thiz->_dataHash = hashBytes(thiz->_dataHash, getStackData(thiz) + first, sizeof(T) * n);
+        updateStackBelowTopHash(thiz);
+    }
+}
+
+/**
+ * Removes the given elements, that are being popped, from the hash of the elements (and from the hashes of their blocks).
+ * Takes time proportional to the number of the elements.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] first     index of the first popped element (the stack size is already decreased to it)
+ * @param[in] n         number of the popped elements (they are still in the data array)
+ */
+template <typename T, typename P, size_t N>
+void unhashPoppedElements(ImmortalStack<T, P, N>* const thiz, ssize_t first, size_t n) {
+    if constexpr (P::Hashing::blockSize > 0) {
+        constexpr size_t blockSize = P::Hashing::blockSize;
+        const T* const data = getStackData(thiz);
+
+        for (size_t end = first + n; end > (size_t)first;) {
+            const size_t block      = (end - 1) / blockSize;
+            const size_t blockBegin = ((size_t)first > block * blockSize) ? first : block * blockSize;
+            unsigned long long hash = thiz->_blockHashes[block];
+            thiz->_dataHash = unhashBytes(thiz->_dataHash, &hash, sizeof(hash));
+
+            hash = unhashBytes(hash, data + blockBegin, sizeof(T) * (end - blockBegin));
+            thiz->_blockHashes[block] = hash;
+            if constexpr (P::Repair::enabled) {
+                xorStackParity(thiz, blockBegin, end - blockBegin);
+            }
+            if (blockBegin % blockSize != 0) {
+                thiz->_dataHash = hashBytes(thiz->_dataHash, &hash, sizeof(hash));
+            }
+            end = blockBegin;
+        }
+    } else {
+        thiz->_dataHash = unhashBytes(thiz->_dataHash, getStackData(thiz) + first, sizeof(T) * n);
+        updateStackBelowTopHash(thiz);
+    }
+}
+
+/**
+ * Recalculates the hash of the elements (and the hashes of their blocks) from scratch.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ */
+template <typename T, typename P, size_t N>
+void rehashStackData(ImmortalStack<T, P, N>* const thiz) {
+    STACK_TRACE_SCOPE("rehashStackData", thiz);
+    if constexpr (P::Hashing::blockSize > 0) {
+        constexpr size_t blockSize = P::Hashing::blockSize;
+        const T* const data = getStackData(thiz);
+        const ssize_t blocksNumber = getStackBlocksNumber(thiz, thiz->_size);
+
+        for (ssize_t block = 0; block < blocksNumber; ++block) {
+            const size_t blockBegin = block * blockSize;
+            const size_t blockEnd   = ((size_t)thiz->_size < blockBegin + blockSize) ? thiz->_size : blockBegin + blockSize;
+            thiz->_blockHashes[block] = hashBytes(0, data + blockBegin, sizeof(T) * (blockEnd - blockBegin));
+        }
+        thiz->_dataHash = hashBytes(0, thiz->_blockHashes, sizeof(unsigned long long) * blocksNumber);
+    } else {
+        thiz->_dataHash = getDataHash(thiz);
+        updateStackBelowTopHash(thiz);
+    }
+}
+
+/**
+ * Updates the hash of the elements below the top one (_belowTopHash) after _dataHash is changed.
+ * Works when the elements are hashed as a whole (not by blocks).
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ */
+template <typename T, typename P, size_t N>
+void updateStackBelowTopHash(ImmortalStack<T, P, N>* const thiz) {
+    static_assert(P::Hashing::enabled && P::Hashing::blockSize == 0, "elements must be hashed as a whole");
+    if (thiz->_size > 0) {
+        thiz->_belowTopHash = unhashBytes(thiz->_dataHash, getStackData(thiz) + thiz->_size - 1, sizeof(T));
+    } else {
+        thiz->_belowTopHash = thiz->_dataHash;
+    }
+}
+
+/**
+ * Finds the first block of the elements starting from the given one, whose hash differs from the saved one.
+ * Works when the elements are hashed by blocks.
+ * @param[in] thiz      pointer to the stack this operation should be performed on
+ * @param[in] fromBlock index of the block to start from
+ * @return index of the corrupted block, or -1 if there's no one.
+ */
+template <typename T, typename P, size_t N>
+ssize_t findCorruptedStackBlock(ImmortalStack<T, P, N>* const thiz, ssize_t fromBlock) {
+    static_assert(P::Hashing::blockSize > 0, "elements must be hashed by blocks");
+    constexpr size_t blockSize = P::Hashing::blockSize;
+
+    const T* const data = getStackData(thiz);
+    const ssize_t blocksNumber = getStackBlocksNumber(thiz, thiz->_size);
+    for (ssize_t block = (fromBlock < 0) ? 0 : fromBlock; block < blocksNumber; ++block) {
+        const size_t blockBegin = block * blockSize;
+        const size_t blockEnd   = ((size_t)thiz->_size < blockBegin + blockSize) ? thiz->_size : blockBegin + blockSize;
+        if (hashBytes(0, data + blockBegin, sizeof(T) * (blockEnd - blockBegin)) != thiz->_blockHashes[block]) {
+            return block;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Gives the number of the hashed blocks, that contain the given number of elements (the last one can be incomplete).
+ * Works when the elements are hashed by blocks.
+ * @param[in] thiz     pointer to the stack this operation should be performed on
+ * @param[in] elements number of elements
+ * @return number of blocks.
+ */
+template <typename T, typename P, size_t N>
+ssize_t getStackBlocksNumber(ImmortalStack<T, P, N>* const, ssize_t elements) {
+    static_assert(P::Hashing::blockSize > 0, "elements must be hashed by blocks");
+    return (elements + (ssize_t)P::Hashing::blockSize - 1) / (ssize_t)P::Hashing::blockSize;
+}
+
+/**
+ * Gives the size in bytes of the block hashes array for the data array of the given capacity.
+ * @param[in] thiz     pointer to the stack this operation should be performed on
+ * @param[in] capacity capacity of the data array
+ * @return size of the block hashes array in bytes.
+ */
+template <typename T, typename P, size_t N>
+size_t getStackBlockHashesBytes(ImmortalStack<T, P, N>* const thiz, ssize_t capacity) {
+    return sizeof(unsigned long long) * getStackBlocksNumber(thiz, capacity);
+}
+
+/**
+ * Restores the canaries and the members of the stack, that repairs itself. Members are restored from their mirror,
+ * if they are corrupted, or the mirror is restored from them. Logs what is restored. Used by repairStack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @return true, if the members are ok now, false otherwise.
+ */
+template <typename T, typename P, size_t N>
+bool repairStackHeader(ImmortalStack<T, P, N>* const thiz) {
+    if constexpr (P::Canaries::number > 0) {
+        bool areCanariesRestored = false;
+        for (size_t i = 0; i < P::Canaries::number; ++i) {
+            areCanariesRestored |= (thiz->_canariesBefore[i] != canaryValue) || (thiz->_canariesAfter[i] != canaryValue);
+            thiz->_canariesBefore[i] = canaryValue;
+            thiz->_canariesAfter [i] = canaryValue;
+        }
+        if (areCanariesRestored) logPrintf("\tcanaries are restored\n");
+    }
+
+    StackHeaderMirror* mirror = &thiz->_mirror;
+    const bool isMirrorOk = (getStackMirrorChecksum(mirror) == mirror->checksum);
+    if (!isStackMembersOk(thiz) || getHash(thiz) != thiz->_hash) {
+        if (!isMirrorOk) {
+            logPrintf("\tmembers and their mirror are corrupted\n");
+            return false;
+        }
+
+        thiz->_size        = mirror->size;
+        thiz->_capacity    = mirror->capacity;
+        thiz->_data        = (decltype(thiz->_data))mirror->data;
+        thiz->_dataHash    = mirror->dataHash;
+        thiz->_blockHashes = mirror->blockHashes;
+        thiz->_parity      = mirror->parity;
+        thiz->_allocator   = mirror->allocator;
+        thiz->_hash        = getHash(thiz);
+        logPrintf("\tmembers are restored from the mirror\n");
+    } else if (!isMirrorOk) {
+        updateStackHash(thiz);
+        logPrintf("\tmirror is restored from the members\n");
+    }
+
+    constexpr size_t canaries = P::Canaries::dataNumber;
+    if constexpr (canaries > 0) {
+        long long* dataCanariesBefore =
+            ((long long*)thiz->_data);
+        long long* dataCanariesAfter  =
+            ((long long*)(thiz->_data + sizeof(long long) * canaries + sizeof(T) * thiz->_capacity));
+        bool areCanariesRestored = false;
+        for (size_t i = 0; i < canaries; ++i) {
+            areCanariesRestored |= (dataCanariesBefore[i] != canaryValue) || (dataCanariesAfter[i] != canaryValue);
+            dataCanariesBefore[i] = canaryValue;
+            dataCanariesAfter [i] = canaryValue;
+        }
+        if (areCanariesRestored) logPrintf("\tdata canaries are restored\n");
+    }
+
+    return true;
+}
+
+/**
+ * Restores one corrupted block of the elements (or its hash) of the stack, that repairs itself, whose members are ok.
+ * Corrupted block is the XOR of the parity and the other blocks. Logs what is restored. Used by repairStack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @return true, if the elements and their hashes are ok now, false otherwise (e.g. if several blocks are corrupted).
+ */
+template <typename T, typename P, size_t N>
+bool repairStackData(ImmortalStack<T, P, N>* const thiz) {
+    constexpr size_t blockSize = P::Hashing::blockSize;
+    T* const data = getStackData(thiz);
+    const ssize_t blocksNumber   = getStackBlocksNumber(thiz, thiz->_size);
+    const ssize_t corruptedBlock = findCorruptedStackBlock(thiz, 0);
+
+    if (corruptedBlock != -1) {
+        if (findCorruptedStackBlock(thiz, corruptedBlock + 1) != -1) {
+            logPrintf("\tseveral blocks are corrupted\n");
+            return false;
+        }
+
+        const size_t parityBytes = getStackParityBytes(thiz);
+        unsigned char* restored = (unsigned char*)allocateStackMemory(parityBytes);
+        if (restored == nullptr) {
+            logPrintf("\tnot enough memory to restore block %zd\n", corruptedBlock);
+            return false;
+        }
+
+        memcpy(restored, thiz->_parity, parityBytes);
+        for (ssize_t block = 0; block < blocksNumber; ++block) {
+            if (block != corruptedBlock) {
+                const size_t blockBegin = block * blockSize;
+                const size_t blockEnd   = ((size_t)thiz->_size < blockBegin + blockSize) ? thiz->_size : blockBegin + blockSize;
+                xorStackBytes(restored, data + blockBegin, sizeof(T) * (blockEnd - blockBegin));
+            }
+        }
+
+        const size_t blockBegin = corruptedBlock * blockSize;
+        const size_t blockEnd   = ((size_t)thiz->_size < blockBegin + blockSize) ? thiz->_size : blockBegin + blockSize;
+        const size_t blockBytes = sizeof(T) * (blockEnd - blockBegin);
+
+        bool isBlockRestored = true;
+        if (hashBytes(0, restored, blockBytes) == thiz->_blockHashes[corruptedBlock]) {
+            memcpy((void*)(data + blockBegin), restored, blockBytes);
+            logPrintf("\tblock %zd is restored from the parity\n", corruptedBlock);
+        } else if (memcmp(restored, (void*)(data + blockBegin), blockBytes) == 0) {
+            thiz->_blockHashes[corruptedBlock] = hashBytes(0, data + blockBegin, blockBytes);
+            logPrintf("\thash of block %zd is restored\n", corruptedBlock);
+        } else {
+            logPrintf("\tblock %zd and the parity are corrupted\n", corruptedBlock);
+            isBlockRestored = false;
+        }
+
+        freeStackMemory(restored, parityBytes);
+        if (!isBlockRestored) return false;
+    }
+
+    return hashBytes(0, thiz->_blockHashes, sizeof(unsigned long long) * blocksNumber) == thiz->_dataHash;
+}
+
+/**
+ * XORs the given elements into the parity of the stack, that repairs itself: each element is XORed into the parity
+ * element with the same index in the block. Applying it twice to the same elements reverts it.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] first     index of the first element
+ * @param[in] n         number of the elements (all of them are in one block)
+ */
+template <typename T, typename P, size_t N>
+void xorStackParity(ImmortalStack<T, P, N>* const thiz, size_t first, size_t n) {
+    xorStackBytes(thiz->_parity + sizeof(T) * (first % P::Hashing::blockSize), getStackData(thiz) + first, sizeof(T) * n);
+}
+
+/**
+ * Gives the size in bytes of the parity of the stack, that repairs itself (it's the size of one block of the elements).
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return size of the parity in bytes.
+ */
+template <typename T, typename P, size_t N>
+size_t getStackParityBytes(ImmortalStack<T, P, N>* const) {
+    return sizeof(T) * P::Hashing::blockSize;
+}
+
+/**
+ * Calculates the checksum of the mirror of the stack members (hash of all its fields except the checksum).
+ * @param[in] mirror mirror of the stack members
+ * @return calculated checksum.
+ */
+inline unsigned long long getStackMirrorChecksum(const StackHeaderMirror* mirror) {
+    return hashBytes(0, mirror, offsetof(StackHeaderMirror, checksum));
+}
+
+/**
+ * XORs the source bytes into the destination ones.
+ * @param[in, out] dst bytes to XOR into
+ * @param[in] src      bytes to XOR
+ * @param[in] bytes    number of bytes
+ */
+inline void xorStackBytes(unsigned char* dst, const void* src, size_t bytes) {
+    const unsigned char* source = (const unsigned char*)src;
+    for (size_t i = 0; i < bytes; ++i) {
+        dst[i] ^= source[i];
+    }
+}
+
+/**
+ * Logs the members of the given stack (size, capacity, elements and canaries) into the log file. Used in LOG_STACK.
+ * Only constructed elements are logged if T is not trivially copyable.
+ * If the elements are hashed by blocks, only the corrupted blocks are logged (see logStackBlocks).
+ * Elements are logged as the log mode says (see StackLogMode, logStackWindows and hexdumpStackData).
+ * @param[in] stack stack to log (not nullptr)
+ */
+template <typename T, typename P, size_t N>
+void logStackMembers(ImmortalStack<T, P, N>* const stack) {
+    ssize_t size = stack->_size;
+    ssize_t capacity = stack->_capacity;
+    LOG_VALUE_INDENTED(size, "\t");
+    LOG_VALUE_INDENTED(capacity, "\t");
+
+    const StackLogMode mode = getStackLogMode();
+    if (mode == STACK_LOG_HEXDUMP && isStackMembersOk(stack) && hexdumpStackData(stack)) {
+        LOG_STACK_CANARIES(stack);
+        return;
+    }
+
+    T* data = getStackData(stack);
+    if constexpr (P::Hashing::blockSize > 0) {
+        if (mode != STACK_LOG_WINDOWED && isStackMembersOk(stack)) {
+            logStackBlocks(stack);
+            LOG_STACK_CANARIES(stack);
+            return;
+        }
+    }
+
+    size_t trueCapacity = (capacity < 0) ? 0 : capacity;
+    if constexpr (!std::is_trivially_copyable<T>::value) {
+        trueCapacity = (size < 0) ? 0 : (size > (ssize_t)trueCapacity) ? trueCapacity : size;
+    }
+    if (mode == STACK_LOG_WINDOWED && data != nullptr) {
+        logStackWindows(stack, trueCapacity);
+    } else {
+        LOG_ARRAY_INDENTED(data, trueCapacity, "\t");
+    }
+
+    LOG_STACK_CANARIES(stack);
+}
+
+/**
+ * Logs STACK_LOG_WINDOW elements of the given stack at the bottom, around the top, before the corrupted data canaries
+ * after the elements and at both ends of the corrupted blocks. Other elements are marked with "...".
+ * @param[in] stack    stack to log (not nullptr)
+ * @param[in] capacity number of the logged elements
+ */
+template <typename T, typename P, size_t N>
+void logStackWindows(ImmortalStack<T, P, N>* const stack, const size_t capacity) {
+    constexpr size_t window = STACK_LOG_WINDOW;
+    const size_t size = (stack->_size < 0) ? 0 : stack->_size;
+    T* data = getStackData(stack);
+
+    StackLogRange ranges[3 + 2 * STACK_LOG_WINDOWED_BLOCKS] = {};
+    size_t rangesNumber = 0;
+    ranges[rangesNumber++] = {0, window};
+    ranges[rangesNumber++] = {(size < window) ? 0 : size - window, size + window};
+
+    if constexpr (P::Canaries::dataNumber > 0) {
+        constexpr size_t canaries = P::Canaries::dataNumber;
+        long long* dataCanariesAfter =
+            ((long long*)(stack->_data + sizeof(long long) * canaries + sizeof(T) * stack->_capacity));
+        for (size_t i = 0; i < canaries; ++i) {
+            if (dataCanariesAfter[i] != canaryValue) {
+                ranges[rangesNumber++] = {(capacity < window) ? 0 : capacity - window, capacity};
+                break;
+            }
+        }
+    }
+
+    if constexpr (P::Hashing::blockSize > 0) {
+        constexpr size_t blockSize = P::Hashing::blockSize;
+        if (isStackMembersOk(stack)) {
+            ssize_t block = findCorruptedStackBlock(stack, 0);
+            for (size_t i = 0; block != -1 && i < STACK_LOG_WINDOWED_BLOCKS; ++i) {
+                const size_t blockBegin = block * blockSize;
+                const size_t blockEnd   = (size < blockBegin + blockSize) ? size : blockBegin + blockSize;
+                ranges[rangesNumber++] = {blockBegin, blockBegin + window};
+                ranges[rangesNumber++] = {(blockEnd < window) ? 0 : blockEnd - window, blockEnd};
+                block = findCorruptedStackBlock(stack, block + 1);
+            }
+        }
+    }
+
+    logPrintf("\tdata [" PTR_FORMAT "] = {\n", (uintptr_t)data);
+    rangesNumber = normalizeStackLogRanges(ranges, rangesNumber, 0, capacity);
+    logArrayRanges(data, 0, capacity, ranges, rangesNumber, "\t\t");
+    logPrintf("\t}\n");
+}
+
+/**
+ * Appends the hexdump of the whole data array of the given stack, whose members are ok, (with data canaries)
+ * to stackHexdumpFileName and logs a line about it.
+ * @param[in] stack stack to dump (not nullptr)
+ * @return true, if the data array is hexdumped, false otherwise.
+ */
+template <typename T, typename P, size_t N>
+bool hexdumpStackData(ImmortalStack<T, P, N>* const stack) {
+    const size_t bytes = getStackDataBytes(stack, stack->_capacity);
+
+    // Type name takes up to STACK_TYPE_NAME_MAX_LENGTH bytes, the rest of the title is at most 80 bytes
+    char title[STACK_TYPE_NAME_MAX_LENGTH + 80] = "";
+    snprintf(title, sizeof(title), "%s [" PTR_FORMAT "] data [" PTR_FORMAT "] (%zu bytes):",
+             getStackTypeName<T>(), (uintptr_t)stack, (uintptr_t)stack->_data, bytes);
+    if (!writeHexdumpFile(stackHexdumpFileName, title, stack->_data, bytes)) return false;
+
+    logPrintf("\tdata [" PTR_FORMAT "] (%zu bytes) is hexdumped into %s\n", (uintptr_t)stack->_data, bytes,
+              stackHexdumpFileName);
+    return true;
+}
+
+/**
+ * Logs the corrupted blocks of the elements of the given stack, whose members are ok, with their indices.
+ * If there are no corrupted blocks, logs the top block. Works when the elements are hashed by blocks.
+ * @param[in] stack stack to log (not nullptr)
+ */
+template <typename T, typename P, size_t N>
+void logStackBlocks(ImmortalStack<T, P, N>* const stack) {
+    constexpr size_t blockSize = P::Hashing::blockSize;
+    const size_t size = stack->_size;
+    T* data = getStackData(stack);
+
+    ssize_t corruptedBlock = findCorruptedStackBlock(stack, 0);
+    if (corruptedBlock == -1) {
+        const size_t topBlockBegin = (size == 0) ? 0 : (size - 1) / blockSize * blockSize;
+        LOG_ARRAY_SLICE_INDENTED(data, topBlockBegin, size, "\t");
+        return;
+    }
+
+    for (; corruptedBlock != -1; corruptedBlock = findCorruptedStackBlock(stack, corruptedBlock + 1)) {
+        const size_t blockBegin = corruptedBlock * blockSize;
+        const size_t blockEnd   = (size < blockBegin + blockSize) ? size : blockBegin + blockSize;
+        LOG_VALUE_INDENTED(corruptedBlock, "\t");
+        LOG_ARRAY_SLICE_INDENTED(data, blockBegin, blockEnd, "\t");
+    }
+}
+
+/**
+ * Appends the binary dump of the given stack (members, canaries and elements) to stackDumpFileName. Used in DUMP_STACK.
+ * Elements are written with one write call, or compressed by blocks if the logging policy says so.
+ * Only constructed elements are dumped if T is not trivially copyable.
+ * @param[in] stack     stack to dump
+ * @param[in] stackName name of the stack expression
+ * @param[in] fileName  name of the source file
+ * @param[in] line      line of the source file
+ * @return true, if the stack is dumped, false otherwise.
+ */
+template <typename T, typename P, size_t N>
+bool dumpStack(ImmortalStack<T, P, N>* const stack, const char* const stackName, const char* const fileName,
+               const int line) {
+    constexpr size_t canaries     = P::Canaries::number;
+    constexpr size_t dataCanaries = P::Canaries::dataNumber;
+
+    StackDumpHeader header = {};
+    memcpy(header.magic, stackDumpMagic, sizeof(stackDumpMagic));
+    header.version = stackDumpVersion;
+    snprintf(header.typeName,  sizeof(header.typeName),  "%s", getStackTypeName<T>());
+    snprintf(header.stackName, sizeof(header.stackName), "%s", stackName);
+    snprintf(header.fileName,  sizeof(header.fileName),  "%s", fileName);
+    header.line = (uint32_t)line;
+    header.elementKind = getStackDumpElementKind<T>();
+    header.elementSize = sizeof(T);
+    header.stackAddress = (uintptr_t)stack;
+
+    long long canaryValues[2 * canaries + 2 * dataCanaries + 1] = {};
+    const T* data = nullptr;
+    if (stack == nullptr) {
+        header.flags |= stackDumpNullStack;
+    } else {
+        header.flags |= P::Logging::compressed ? stackDumpCompressed : 0;
+        header.flags |= P::Hashing::enabled    ? stackDumpHashed     : 0;
+        header.size = stack->_size;
+        header.capacity = stack->_capacity;
+        if constexpr (P::Hashing::enabled) {
+            header.hash = stack->_hash;
+            header.dataHash = stack->_dataHash;
+        }
+
+        data = getStackData(stack);
+        header.dataAddress = (uintptr_t)data;
+        if (data != nullptr) {
+            size_t dumpedElements = (stack->_capacity < 0) ? 0 : stack->_capacity;
+            if constexpr (!std::is_trivially_copyable<T>::value) {
+                dumpedElements = (stack->_size < 0) ? 0 : ((size_t)stack->_size > dumpedElements) ? dumpedElements
+                                                                                                    : stack->_size;
+            }
+            header.dumpedElements = dumpedElements;
+        }
+
+        if constexpr (canaries > 0) {
+            header.canariesNumber = canaries;
+            header.canariesAddresses[0] = (uintptr_t)stack->_canariesBefore;
+            header.canariesAddresses[1] = (uintptr_t)stack->_canariesAfter;
+            memcpy(canaryValues,            stack->_canariesBefore, sizeof(long long) * canaries);
+            memcpy(canaryValues + canaries, stack->_canariesAfter,  sizeof(long long) * canaries);
+        }
+        if constexpr (dataCanaries > 0) {
+            if (stack->_data != nullptr) {
+                const long long* dataCanariesBefore =
+                    (const long long*)stack->_data;
+                const long long* dataCanariesAfter  =
+                    (const long long*)(stack->_data + sizeof(long long) * dataCanaries + sizeof(T) * stack->_capacity);
+                header.dataCanariesNumber = dataCanaries;
+                header.canariesAddresses[2] = (uintptr_t)dataCanariesBefore;
+                header.canariesAddresses[3] = (uintptr_t)dataCanariesAfter;
+                memcpy(canaryValues + 2 * canaries,                dataCanariesBefore, sizeof(long long) * dataCanaries);
+                memcpy(canaryValues + 2 * canaries + dataCanaries, dataCanariesAfter,  sizeof(long long) * dataCanaries);
+            }
+        }
+    }
+
+    FILE* dumpFile = fopen(stackDumpFileName, "ab");
+    if (dumpFile == nullptr) return false;
+    // Elements are passed to write as is, without copying them into the file buffer
+    setvbuf(dumpFile, nullptr, _IONBF, 0);
+
+    const size_t canariesBytes = sizeof(long long) * 2 * (header.canariesNumber + header.dataCanariesNumber);
+    const uint64_t dataBytes = header.dumpedElements * sizeof(T);
+    bool isDumped = fwrite(&header, sizeof(header), 1, dumpFile) == 1 &&
+                    (canariesBytes == 0 || fwrite(canaryValues, canariesBytes, 1, dumpFile) == 1);
+    if constexpr (P::Logging::compressed) {
+        isDumped = isDumped && writeStackDumpBlocks(dumpFile, (const void*)data, dataBytes);
+    } else {
+        isDumped = isDumped && (dataBytes == 0 || fwrite((const void*)data, dataBytes, 1, dumpFile) == 1);
+    }
+
+    return (fclose(dumpFile) == 0) && isDumped;
+}
+
+/**
+ * Stacks of the other types are not dumped in the binary format, DUMP_STACK logs them as text.
+ * @return false.
+ */
+template <typename Stack>
+bool dumpStack(Stack* const, const char* const, const char* const, const int) {
+    return false;
+}
+
+/**
+ * Checks the members, canaries and hashes of the registered stack. Used by the background verifier.
+ * @param[in] stack pointer to the stack (ImmortalStack<T, P, N>)
+ * @return true, if the stack is ok, false otherwise.
+ */
+template <typename T, typename P, size_t N>
+bool isRegisteredStackOk(void* const stack) {
+    return isStackFullyOk((ImmortalStack<T, P, N>*)stack);
+}
+
+/**
+ * Logs the registered stack into the stack log file. Used by the background verifier.
+ * @param[in] stack pointer to the stack (ImmortalStack<T, P, N>)
+ */
+template <typename T, typename P, size_t N>
+void logRegisteredStack(void* const stack) {
+    auto registeredStack = (ImmortalStack<T, P, N>*)stack;
+    logOpen(stackLogFileName);
+    LOG_STACK_BY_POLICY(registeredStack);
+    logClose();
+}
+
+/**
+ * Checks if the given address is in the guard pages around the data array of the stack. Used by the guard page handler.
+ * @param[in] stack   pointer to the stack (ImmortalStack<T, P, N>)
+ * @param[in] address faulting address
+ * @return true, if the address is in the guard pages of the stack, false otherwise.
+ */
+template <typename T, typename P, size_t N>
+bool isStackGuardHit(void* const stack, const void* const address) {
+    auto guardedStack = (ImmortalStack<T, P, N>*)stack;
+    return isInStackGuard(guardedStack->_data, getStackDataBytes(guardedStack, guardedStack->_capacity), address);
+}
+
+/**
+ * Reads the members of the stack with guard pages, that the guard page handler dumps. Only reads memory (async-signal-safe).
+ * @param[in] stack pointer to the stack (ImmortalStack<T, P, N>)
+ * @return members of the stack.
+ */
+template <typename T, typename P, size_t N>
+StackGuardedState getGuardedStackState(void* const stack) {
+    auto guardedStack = (ImmortalStack<T, P, N>*)stack;
+    return {
+        guardedStack->_size,
+        guardedStack->_capacity,
+        guardedStack->_data,
+        getStackDataBytes(guardedStack, guardedStack->_capacity)
+    };
+}
+
+/**
+ * Gives the signature of this function, that contains the name of T (for compilers that support it).
+ * @return signature of the function, or nullptr if it's not supported.
+ */
+template <typename T>
+const char* getStackTypeSignature() {
+    #ifdef __GNUC__
+        return __PRETTY_FUNCTION__;
+    #else
+        return nullptr;
+    #endif
+}
+
+/**
+ * Gives the name of the stack of the given element type for logging (e.g. Stack_int).
+ * @return name of the stack type.
+ */
+template <typename T>
+const char* getStackTypeName() {
+    static char name[STACK_TYPE_NAME_MAX_LENGTH] = {};
+    static const bool isNameInitialized = [] {
+        const char* typeName = typeid(T).name();
+        size_t typeNameLength = strlen(typeName);
+
+        const char* signature = getStackTypeSignature<T>();
+        const char* signatureTypeName = (signature == nullptr) ? nullptr : strstr(signature, "T = ");
+        if (signatureTypeName != nullptr) {
+            typeName = signatureTypeName + strlen("T = ");
+            typeNameLength = strcspn(typeName, ";]");
+        }
+
+        snprintf(name, sizeof(name), "Stack_%.*s", (int)typeNameLength, typeName);
+        return true;
+    }();
+    (void)isNameInitialized;
+
+    return name;
+}
+
+/**
+ * Gives the metrics slot of the current thread for the stacks of the given element type (see metrics.h).
+ * @param[in] thiz pointer to the stack (may be nullptr, the slot depends only on its type)
+ * @return slot of the stack family.
+ */
+template <typename T, typename P, size_t N>
+StackMetricsSlot* getStackMetricsSlot(ImmortalStack<T, P, N>* const) {
+    static const size_t family = registerStackMetricsFamily(getStackTypeName<T>());
+    return getThreadStackMetricsSlot(family);
+}
+
+#endif // IMMORTAL_STACK_IMMORTAL_STACK_H
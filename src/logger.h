@@ -1,23 +1,373 @@
 /**
  * @file
  * @brief Definition and implementation of logging functions and macros
+ *
+ * Logging is synchronous by default: logPrintf formats straight into the log file.
+ * When the flusher thread is started (see startLogFlusher), logging is asynchronous: each thread formats its messages
+ * into its own ring buffer, and the flusher writes the rings into the log file with batched writev calls.
+ * Messages (everything that is logged between logOpen and logClose) are committed whole, so threads don't mix them.
+ * Message that doesn't fit into the ring is written by its thread in parts, the thread holds the drain lock until
+ * the message is committed, so the other rings aren't written in between.
+ * Log file is kept open between the messages. logFlush writes everything that is committed before it returns,
+ * so it's called before aborting. LOG_ macros work the same way in both modes.
+ *
+ * Values are formatted without format strings: logValue converts them with std::to_chars straight into the buffer
+ * of the current thread (see StackLogFormatter), and the buffer is written in large chunks (see logWrite).
+ * Formatter of the user types (e.g. STACK_TYPE structs) is added by the specialization of StackLogFormatter.
+ *
+ * Arrays are logged in one of StackLogMode modes: all elements, only the elements at both ends (and the other ranges
+ * given by the caller), or the hexdump of their bytes. Mode is set globally (setStackLogMode) or for the current thread
+ * while the guard exists (StackLogModeGuard, LOG_ARRAY_INDENTED_MODE).
  */
 #ifndef IMMORTAL_STACK_LOGGER_H
 #define IMMORTAL_STACK_LOGGER_H
 
+#include <atomic>
 #include <cassert>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
 #include <cstdarg>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
 #include "environment.h"
 
-static FILE* _logFile = nullptr;
+#if defined(__unix__) || defined(__APPLE__)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <sys/uio.h>
+    #include <unistd.h>
+#endif
+
+/** Size of the ring buffer of each thread that logs asynchronously, in bytes */
+#ifndef STACK_LOG_RING_BYTES
+    #define STACK_LOG_RING_BYTES (64 * 1024)
+#endif
+
+/** Maximal number of threads that log asynchronously at the same time, the other threads log synchronously */
+#ifndef STACK_LOG_MAX_THREADS
+    #define STACK_LOG_MAX_THREADS 64
+#endif
+
+/** Default interval between the passes of the flusher thread over the rings, in milliseconds */
+#ifndef STACK_LOG_FLUSH_INTERVAL_MS
+    #define STACK_LOG_FLUSH_INTERVAL_MS 10
+#endif
+
+/** Maximal number of the rings that are written into the log file by one writev call */
+#ifndef STACK_LOG_WRITE_RINGS
+    #define STACK_LOG_WRITE_RINGS 32
+#endif
+
+/** Mode of logging the arrays */
+enum StackLogMode {
+    STACK_LOG_FULL     = 0, ///< All elements are logged
+    STACK_LOG_WINDOWED = 1, ///< Only STACK_LOG_WINDOW elements at each end and around the mismatches are logged
+    STACK_LOG_HEXDUMP  = 2  ///< Bytes of the arrays are hexdumped
+};
+
+/** Mode of logging the arrays, that is used by default */
+#ifndef STACK_LOG_DEFAULT_MODE
+    #define STACK_LOG_DEFAULT_MODE STACK_LOG_FULL
+#endif
+
+/** Number of the elements at each end of the array (and around each mismatch), that are logged in windowed mode */
+#ifndef STACK_LOG_WINDOW
+    #define STACK_LOG_WINDOW 16
+#endif
+
+/** Size of the buffer of each thread, that the logged values are formatted into */
+#ifndef STACK_LOG_BUFFER_BYTES
+    #define STACK_LOG_BUFFER_BYTES (16 * 1024)
+#endif
+
+/** Current log file, shared by all threads */
+inline FILE* _logFile = nullptr;
+
+/** Path of the current log file, so asynchronous logOpen doesn't reopen it */
+inline std::string _logFilePath;
+
+/** Mutex that should be locked by the threads while they use the log file */
+inline std::mutex _logMutex;
 
 constexpr const char* defaultLogFileName = "log.txt";
 
+/**
+ * Ring buffer of the thread that logs asynchronously. It has a single producer (the owner thread)
+ * and a single consumer (the thread that writes the rings, under the drain lock). Positions grow forever.
+ */
+struct StackLogRing {
+    /** Ring is owned by a thread */
+    std::atomic<bool> taken;
+
+    /** Number of bytes that are written into the log file */
+    std::atomic<size_t> head;
+
+    /** Number of bytes that are committed by the owner thread (whole messages) */
+    std::atomic<size_t> tail;
+
+    /** Number of bytes that are formatted by the owner thread, including the uncommitted ones. Used only by the owner */
+    size_t end;
+
+    /** Owner thread holds the drain lock until its message, that doesn't fit into the ring, is committed */
+    bool draining;
+
+    /** Buffer of STACK_LOG_RING_BYTES bytes. It's allocated when the ring is taken for the first time and kept */
+    char* buffer;
+};
+
+/** Ring of the current thread. The ring is released when the thread exits, its bytes are still written */
+struct StackLogRingOwner {
+    /** Ring of the thread, or nullptr if the thread hasn't logged asynchronously yet */
+    StackLogRing* ring = nullptr;
+
+    ~StackLogRingOwner();
+};
+
+/** Flusher thread, that writes the rings into the log file */
+struct StackLogFlusher {
+    /** Lock of the flusher state */
+    std::mutex lock;
+
+    /** Wakes the flusher when it's stopped */
+    std::condition_variable wakeUp;
+
+    /** Thread of the flusher, not joinable if the flusher is not running */
+    std::thread thread;
+
+    /** Flusher should stop */
+    bool stopping = false;
+
+    /** Logging is asynchronous */
+    std::atomic<bool> running{false};
+
+    /** Lock that is held while the rings are written into the log file and while the log file is switched */
+    std::mutex drainLock;
+
+    /** Number of writev calls */
+    std::atomic<size_t> writes{0};
+
+    ~StackLogFlusher();
+};
+
+/** Global table of the rings. It's a fixed array, so the rings are never freed while the threads use them */
+inline StackLogRing stackLogRings[STACK_LOG_MAX_THREADS];
+
+/** Ring of the current thread */
+inline thread_local StackLogRingOwner stackLogRingOwner;
+
+/** Global flusher */
+inline StackLogFlusher stackLogFlusher;
+
+/** Buffer of the thread, that the logged values are formatted into. It's written into the log file when it's full */
+struct StackLogBuffer {
+    /** Number of the formatted bytes */
+    size_t size;
+
+    /** Formatted bytes */
+    char bytes[STACK_LOG_BUFFER_BYTES];
+};
+
+/** Buffer of the current thread */
+inline thread_local StackLogBuffer stackLogBuffer;
+
+/** Global mode of logging the arrays */
+inline std::atomic<StackLogMode> stackLogMode{STACK_LOG_DEFAULT_MODE};
+
+/** Mode of logging the arrays, that is set for the current thread, or -1 if the global one is used */
+inline thread_local int stackThreadLogMode = -1;
+
+/** Sets the mode of logging the arrays for the current thread, while it exists (e.g. for one LOG_STACK call) */
+struct StackLogModeGuard {
+    /** Mode of the current thread before the guard */
+    int previousMode;
+
+    explicit StackLogModeGuard(StackLogMode mode);
+    ~StackLogModeGuard();
+};
+
+/** Range of the logged elements of the array */
+struct StackLogRange {
+    /** Index of the first element */
+    size_t begin;
+
+    /** Index after the last element */
+    size_t end;
+};
+
+/** Number of the bytes in each hexdump line */
+constexpr size_t hexdumpLineBytes = 16;
+
+/** Length of each hexdump line: address, bytes in hex, bytes as characters and the new line */
+constexpr size_t hexdumpLineLength = 16 + 2 + 3 * hexdumpLineBytes + 1 + 2 + hexdumpLineBytes + 2;
+
+/**
+ * Sets the global mode of logging the arrays.
+ * @param[in] mode mode of logging
+ */
+inline void setStackLogMode(StackLogMode mode);
+
+/**
+ * Gives the mode of logging the arrays: the one of the current thread, or the global one.
+ * @return mode of logging.
+ */
+inline StackLogMode getStackLogMode();
+
+/**
+ * Sorts the ranges, clips them to [from, to) and merges the overlapping ones.
+ * @param[in, out] ranges ranges of the elements
+ * @param[in] number      number of the ranges
+ * @param[in] from        index of the first element of the array
+ * @param[in] to          index after the last element of the array
+ * @return number of the ranges after merging.
+ */
+inline size_t normalizeStackLogRanges(StackLogRange* ranges, size_t number, size_t from, size_t to);
+
+/**
+ * Logs the elements of the array from the given ranges with their indices. Skipped elements are marked with "...".
+ * @param[in] array  array to log
+ * @param[in] from   index of the first element of the array
+ * @param[in] to     index after the last element of the array
+ * @param[in] ranges sorted disjoint ranges of the logged elements (see normalizeStackLogRanges)
+ * @param[in] number number of the ranges
+ * @param[in] indent indent of the elements
+ */
+template <typename T>
+void logArrayRanges(const T* array, size_t from, size_t to, const StackLogRange* ranges, size_t number,
+                    const char* indent);
+
+/**
+ * Formats the hexdump line: address, bytes in hex and bytes as characters. Line has hexdumpLineLength characters.
+ * @param[out] line   buffer of hexdumpLineLength characters
+ * @param[in] bytes   bytes of the line
+ * @param[in] size    number of the bytes (not more than hexdumpLineBytes)
+ * @param[in] address address of the first byte
+ */
+inline void formatHexdumpLine(char* line, const unsigned char* bytes, size_t size, uintptr_t address);
+
+/**
+ * Logs the hexdump of the bytes into log file.
+ * @param[in] bytes  bytes to dump
+ * @param[in] size   number of the bytes
+ * @param[in] indent indent of the hexdump lines
+ */
+inline void logHexdump(const void* bytes, size_t size, const char* indent);
+
+/**
+ * Appends the title line and the hexdump of the bytes to the file. Hexdump is formatted straight into the mapped file.
+ * @param[in] fileName name of the file
+ * @param[in] title    title line (without the new line)
+ * @param[in] bytes    bytes to dump
+ * @param[in] size     number of the bytes
+ * @return true, if the hexdump is written, false otherwise.
+ */
+inline bool writeHexdumpFile(const char* fileName, const char* title, const void* bytes, size_t size);
+
+/**
+ * Formatter of the logged values of type T, that is used by logValue. It has the static function
+ * void write(const T& value), that formats the value with logWrite and logValue calls.
+ * Formatters of arithmetic types and strings are built in. Specialize it to log the values of the other types.
+ */
+template <typename T, typename Enable = void>
+struct StackLogFormatter;
+
+/**
+ * Appends the bytes to the buffer of the current thread. Writes the buffer, if they don't fit.
+ * @param[in] bytes bytes to append
+ * @param[in] size  number of the bytes
+ */
+inline void logWrite(const char* bytes, size_t size);
+
+/**
+ * Appends the string to the buffer of the current thread. Writes the buffer, if it doesn't fit.
+ * @param[in] string string to append
+ */
+inline void logWrite(const char* string);
+
+/**
+ * Writes the bytes into the log file, or into the ring of the current thread, when logging is asynchronous.
+ * @param[in] bytes bytes to write
+ * @param[in] size  number of the bytes
+ */
+inline void writeLogBytes(const char* bytes, size_t size);
+
+/**
+ * Writes the buffer of the current thread into the log file (see writeLogBytes).
+ */
+inline void logFlushBuffer();
+
+/**
+ * Logs value of any type, that has StackLogFormatter, into log file.
+ * @param[in] value value to log
+ */
+template <typename T>
+void logValue(const T& value);
+
+/**
+ * Gives the ring of the current thread, takes a free ring if the thread has none.
+ * @return ring of the current thread, or nullptr if all rings are taken.
+ */
+inline StackLogRing* getStackLogRing();
+
+/**
+ * Commits the bytes, that are formatted by the current thread, so they can be written into the log file.
+ * Writes the rest of the message and releases the drain lock, if the message doesn't fit into the ring.
+ */
+inline void commitStackLogRing();
+
+/**
+ * Appends the bytes to the ring of the current thread. Writes the rings itself, if the ring is full.
+ * @param[in, out] ring ring of the current thread
+ * @param[in] bytes     bytes to append
+ * @param[in] size      number of the bytes
+ */
+inline void appendStackLogRing(StackLogRing* ring, const char* bytes, size_t size);
+
+/**
+ * Writes the committed bytes of the rings into the log file. Drain lock should be held.
+ * @param[in, out] onlyRing ring to write, or nullptr to write all rings
+ */
+inline void writeStackLogRings(StackLogRing* onlyRing = nullptr);
+
+/**
+ * Starts the flusher thread, so logging becomes asynchronous.
+ * @param[in] intervalMs interval between the passes of the flusher over the rings, in milliseconds
+ * @return true, if the flusher is started, false if it's already running.
+ */
+inline bool startLogFlusher(unsigned intervalMs = STACK_LOG_FLUSH_INTERVAL_MS);
+
+/**
+ * Stops the flusher thread, writes the rest of the rings and closes the log file.
+ * Logging becomes synchronous. Does nothing if the flusher is not running.
+ */
+inline void stopLogFlusher();
+
+/**
+ * Writes everything that is logged and committed so far into the log file. Blocks until it's written.
+ */
+inline void logFlush();
+
+//----------------------------------------------------------------------------------------------------------------------
+
 /**
  * Closes the current log file.
+ * When logging is asynchronous, commits the message of the current thread instead and keeps the file open.
  */
 inline void logClose() {
+    logFlushBuffer();
+    if (stackLogFlusher.running.load(std::memory_order_acquire)) {
+        commitStackLogRing();
+        return;
+    }
+
     if (_logFile != nullptr) {
         fclose(_logFile);
         _logFile = nullptr;
@@ -26,6 +376,7 @@ inline void logClose() {
 
 /**
  * Opens a file for logging.
+ * When logging is asynchronous, the open file is reused, if it has the same path and it's opened for appending.
  * @param[in] logFilePath path to the file to log info in
  * @param[in] modes       modes to open file in
  */
@@ -33,128 +384,660 @@ inline void logOpen(const char* logFilePath = defaultLogFileName, const char* mo
     assert(logFilePath != nullptr);
     assert(modes != nullptr);
 
+    if (_logFile != nullptr) logFlushBuffer();
+    if (stackLogFlusher.running.load(std::memory_order_acquire)) {
+        commitStackLogRing();
+
+        std::lock_guard<std::mutex> drainGuard(stackLogFlusher.drainLock);
+        if (_logFile != nullptr && modes[0] == 'a' && _logFilePath == logFilePath) return;
+
+        // Messages that are committed before go to the previous file
+        writeStackLogRings();
+        if (_logFile != nullptr) fclose(_logFile);
+        _logFile = fopen(logFilePath, modes);
+        _logFilePath = logFilePath;
+        return;
+    }
+
     if (_logFile != nullptr) logClose();
     _logFile = fopen(logFilePath, modes);
+    _logFilePath = logFilePath;
 }
 
 /**
  * Prints formatted string (like printf or fprintf) in the log file.
+ * String is formatted into the buffer of the current thread.
  */
 inline void logPrintf(const char* format, ...) {
     assert(_logFile != nullptr);
     assert(format != nullptr);
 
     va_list args;
+    va_list argsCopy;
     va_start(args, format);
-    vfprintf(_logFile, format, args);
+    va_copy(argsCopy, args);
+
+    StackLogBuffer& buffer = stackLogBuffer;
+    const size_t available = STACK_LOG_BUFFER_BYTES - buffer.size;
+    const int length = vsnprintf(buffer.bytes + buffer.size, available, format, args);
+    if (length >= 0 && (size_t)length < available) {
+        buffer.size += length;
+    } else if (length > 0) {
+        logFlushBuffer();
+        if (length < STACK_LOG_BUFFER_BYTES) {
+            buffer.size = vsnprintf(buffer.bytes, STACK_LOG_BUFFER_BYTES, format, argsCopy);
+        } else {
+            char* longBuffer = (char*)malloc(length + 1);
+            if (longBuffer != nullptr) {
+                vsnprintf(longBuffer, length + 1, format, argsCopy);
+                writeLogBytes(longBuffer, length);
+                free(longBuffer);
+            }
+        }
+    }
+
+    va_end(argsCopy);
     va_end(args);
 }
 
-//----------------------------------------------------------------------------------------------------------------------
+/**
+ * Appends the bytes to the buffer of the current thread. Writes the buffer, if they don't fit.
+ * @param[in] bytes bytes to append
+ * @param[in] size  number of the bytes
+ */
+inline void logWrite(const char* const bytes, const size_t size) {
+    assert(bytes != nullptr);
+
+    StackLogBuffer& buffer = stackLogBuffer;
+    if (size > STACK_LOG_BUFFER_BYTES - buffer.size) {
+        logFlushBuffer();
+        if (size > STACK_LOG_BUFFER_BYTES) {
+            writeLogBytes(bytes, size);
+            return;
+        }
+    }
+
+    memcpy(buffer.bytes + buffer.size, bytes, size);
+    buffer.size += size;
+}
 
 /**
- * Logs int value into log file.
+ * Appends the string to the buffer of the current thread. Writes the buffer, if it doesn't fit.
+ * @param[in] string string to append
  */
-inline void logValue(int value) {
-    logPrintf("%d", value);
+inline void logWrite(const char* const string) {
+    assert(string != nullptr);
+
+    logWrite(string, strlen(string));
 }
 
 /**
- * Logs unsigned int value into log file.
+ * Writes the bytes into the log file, or into the ring of the current thread, when logging is asynchronous.
+ * @param[in] bytes bytes to write
+ * @param[in] size  number of the bytes
  */
-inline void logValue(unsigned int value) {
-    logPrintf("%u", value);
+inline void writeLogBytes(const char* const bytes, const size_t size) {
+    StackLogRing* ring = nullptr;
+    if (stackLogFlusher.running.load(std::memory_order_acquire) && (ring = getStackLogRing()) != nullptr) {
+        appendStackLogRing(ring, bytes, size);
+    } else {
+        assert(_logFile != nullptr);
+        fwrite(bytes, 1, size, _logFile);
+    }
 }
 
 /**
- * Logs long int value into log file.
+ * Writes the buffer of the current thread into the log file (see writeLogBytes).
  */
-inline void logValue(long int value) {
-    logPrintf("%ld", value);
+inline void logFlushBuffer() {
+    StackLogBuffer& buffer = stackLogBuffer;
+    if (buffer.size > 0) {
+        writeLogBytes(buffer.bytes, buffer.size);
+        buffer.size = 0;
+    }
 }
 
 /**
- * Logs unsigned long int value into log file.
+ * Gives the ring of the current thread, takes a free ring if the thread has none.
+ * @return ring of the current thread, or nullptr if all rings are taken.
  */
-inline void logValue(unsigned long int value) {
-    logPrintf("%zu", value);
+inline StackLogRing* getStackLogRing() {
+    if (stackLogRingOwner.ring != nullptr) return stackLogRingOwner.ring;
+
+    for (StackLogRing& ring : stackLogRings) {
+        bool taken = false;
+        if (ring.taken.compare_exchange_strong(taken, true, std::memory_order_acquire)) {
+            if (ring.buffer == nullptr) {
+                ring.buffer = (char*)malloc(STACK_LOG_RING_BYTES);
+                if (ring.buffer == nullptr) {
+                    ring.taken.store(false, std::memory_order_release);
+                    return nullptr;
+                }
+            }
+
+            // Bytes of the previous owner are committed, the new ones follow them
+            ring.end = ring.tail.load(std::memory_order_relaxed);
+            stackLogRingOwner.ring = &ring;
+            return &ring;
+        }
+    }
+    return nullptr;
 }
 
 /**
- * Logs long long value into log file.
+ * Commits the bytes, that are formatted by the current thread, so they can be written into the log file.
+ * Writes the rest of the message and releases the drain lock, if the message doesn't fit into the ring.
  */
-inline void logValue(long long value) {
-    logPrintf("%lld", value);
+inline void commitStackLogRing() {
+    StackLogRing* ring = stackLogRingOwner.ring;
+    if (ring != nullptr) {
+        ring->tail.store(ring->end, std::memory_order_release);
+        if (ring->draining) {
+            writeStackLogRings(ring);
+            ring->draining = false;
+            stackLogFlusher.drainLock.unlock();
+        }
+    }
 }
 
 /**
- * Logs unsigned long long value into log file.
+ * Appends the bytes to the ring of the current thread. Writes the rings itself, if the ring is full.
+ * @param[in, out] ring ring of the current thread
+ * @param[in] bytes     bytes to append
+ * @param[in] size      number of the bytes
  */
-inline void logValue(unsigned long long value) {
-    logPrintf("%llu", value);
+inline void appendStackLogRing(StackLogRing* const ring, const char* bytes, size_t size) {
+    assert(ring != nullptr);
+    assert(bytes != nullptr);
+
+    while (size > 0) {
+        const size_t used = ring->end - ring->head.load(std::memory_order_acquire);
+        if (used == STACK_LOG_RING_BYTES) {
+            // Message doesn't fit into the ring, so it's written in parts. The other rings wait until it's committed
+            if (!ring->draining) {
+                stackLogFlusher.drainLock.lock();
+                ring->draining = true;
+                writeStackLogRings();
+            }
+            ring->tail.store(ring->end, std::memory_order_release);
+            writeStackLogRings(ring);
+            continue;
+        }
+
+        const size_t offset = ring->end % STACK_LOG_RING_BYTES;
+        size_t chunk = size;
+        if (chunk > STACK_LOG_RING_BYTES - used)   chunk = STACK_LOG_RING_BYTES - used;
+        if (chunk > STACK_LOG_RING_BYTES - offset) chunk = STACK_LOG_RING_BYTES - offset;
+
+        memcpy(ring->buffer + offset, bytes, chunk);
+        ring->end += chunk;
+        bytes += chunk;
+        size -= chunk;
+    }
+}
+
+/**
+ * Writes the parts of the rings into the log file, retries partial writes.
+ * @param[in] parts  pointers to the parts
+ * @param[in] sizes  sizes of the parts
+ * @param[in] number number of the parts
+ */
+inline void writeStackLogParts(const char** parts, size_t* sizes, size_t number) {
+    #if defined(__unix__) || defined(__APPLE__)
+        struct iovec chunks[2 * STACK_LOG_WRITE_RINGS];
+        for (size_t i = 0; i < number; ++i) {
+            chunks[i].iov_base = (void*)parts[i];
+            chunks[i].iov_len  = sizes[i];
+        }
+
+        struct iovec* chunk = chunks;
+        const int fd = fileno(_logFile);
+        while (number > 0) {
+            ssize_t written = writev(fd, chunk, (int)number);
+            ++stackLogFlusher.writes;
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                return;
+            }
+
+            while (number > 0 && (size_t)written >= chunk->iov_len) {
+                written -= chunk->iov_len;
+                ++chunk;
+                --number;
+            }
+            if (number > 0) {
+                chunk->iov_base = (char*)chunk->iov_base + written;
+                chunk->iov_len -= written;
+            }
+        }
+    #else
+        for (size_t i = 0; i < number; ++i) {
+            fwrite(parts[i], 1, sizes[i], _logFile);
+        }
+        fflush(_logFile);
+        ++stackLogFlusher.writes;
+    #endif
+}
+
+/**
+ * Writes the committed bytes of the rings into the log file. Drain lock should be held.
+ * @param[in, out] onlyRing ring to write, or nullptr to write all rings
+ */
+inline void writeStackLogRings(StackLogRing* const onlyRing) {
+    const char* parts[2 * STACK_LOG_WRITE_RINGS];
+    size_t sizes[2 * STACK_LOG_WRITE_RINGS];
+    StackLogRing* writtenRings[STACK_LOG_WRITE_RINGS];
+    size_t writtenTails[STACK_LOG_WRITE_RINGS];
+    size_t partsNumber = 0;
+    size_t ringsNumber = 0;
+
+    for (size_t i = 0; i <= STACK_LOG_MAX_THREADS; ++i) {
+        if (ringsNumber == STACK_LOG_WRITE_RINGS || (i == STACK_LOG_MAX_THREADS && ringsNumber > 0)) {
+            if (_logFile != nullptr) writeStackLogParts(parts, sizes, partsNumber);
+            for (size_t j = 0; j < ringsNumber; ++j) {
+                writtenRings[j]->head.store(writtenTails[j], std::memory_order_release);
+            }
+            partsNumber = 0;
+            ringsNumber = 0;
+        }
+        if (i == STACK_LOG_MAX_THREADS) break;
+
+        StackLogRing* ring = &stackLogRings[i];
+        if (onlyRing != nullptr && ring != onlyRing) continue;
+
+        const size_t head = ring->head.load(std::memory_order_relaxed);
+        const size_t tail = ring->tail.load(std::memory_order_acquire);
+        if (head == tail) continue;
+
+        // Committed bytes may wrap around the end of the buffer
+        const size_t offset = head % STACK_LOG_RING_BYTES;
+        const size_t size   = tail - head;
+        const size_t first  = (size < STACK_LOG_RING_BYTES - offset) ? size : STACK_LOG_RING_BYTES - offset;
+        parts[partsNumber] = ring->buffer + offset;
+        sizes[partsNumber++] = first;
+        if (first < size) {
+            parts[partsNumber] = ring->buffer;
+            sizes[partsNumber++] = size - first;
+        }
+
+        writtenRings[ringsNumber] = ring;
+        writtenTails[ringsNumber++] = tail;
+    }
 }
 
 /**
- * Logs short value into log file.
+ * Writes everything that is logged and committed so far into the log file. Blocks until it's written.
  */
-inline void logValue(short value) {
-    logPrintf("%hd", value);
+inline void logFlush() {
+    if (_logFile != nullptr) logFlushBuffer();
+    commitStackLogRing();
+    {
+        std::lock_guard<std::mutex> drainGuard(stackLogFlusher.drainLock);
+        writeStackLogRings();
+    }
+
+    if (_logFile != nullptr) fflush(_logFile);
 }
 
 /**
- * Logs unsigned short value into log file.
+ * Starts the flusher thread, so logging becomes asynchronous.
+ * @param[in] intervalMs interval between the passes of the flusher over the rings, in milliseconds
+ * @return true, if the flusher is started, false if it's already running.
  */
-inline void logValue(unsigned short value) {
-    logPrintf("%hu", value);
+inline bool startLogFlusher(unsigned intervalMs) {
+    std::lock_guard<std::mutex> guard(stackLogFlusher.lock);
+    if (stackLogFlusher.thread.joinable()) return false;
+
+    // Flusher writes the log file bypassing its buffer
+    if (_logFile != nullptr) fflush(_logFile);
+
+    stackLogFlusher.stopping = false;
+    stackLogFlusher.running.store(true, std::memory_order_release);
+    stackLogFlusher.thread = std::thread([intervalMs]() {
+        std::unique_lock<std::mutex> lock(stackLogFlusher.lock);
+        while (!stackLogFlusher.stopping) {
+            lock.unlock();
+            {
+                std::lock_guard<std::mutex> drainGuard(stackLogFlusher.drainLock);
+                writeStackLogRings();
+            }
+            lock.lock();
+
+            stackLogFlusher.wakeUp.wait_for(lock, std::chrono::milliseconds(intervalMs), []() {
+                return stackLogFlusher.stopping;
+            });
+        }
+    });
+
+    return true;
 }
 
 /**
- * Logs float value into log file.
+ * Stops the flusher thread, writes the rest of the rings and closes the log file.
+ * Logging becomes synchronous. Does nothing if the flusher is not running.
  */
-inline void logValue(float value) {
-    logPrintf("%lg", value);
+inline void stopLogFlusher() {
+    std::thread thread;
+    {
+        std::lock_guard<std::mutex> guard(stackLogFlusher.lock);
+        stackLogFlusher.stopping = true;
+        thread = std::move(stackLogFlusher.thread);
+    }
+    stackLogFlusher.wakeUp.notify_all();
+
+    if (thread.joinable()) {
+        thread.join();
+
+        stackLogFlusher.running.store(false, std::memory_order_release);
+        logFlush();
+        logClose();
+    }
 }
 
 /**
- * Logs double value into log file.
+ * Commits the message of the exiting thread and releases its ring.
  */
-inline void logValue(double value) {
-    logPrintf("%lg", value);
+inline StackLogRingOwner::~StackLogRingOwner() {
+    if (ring != nullptr) {
+        commitStackLogRing();
+        ring->taken.store(false, std::memory_order_release);
+        ring = nullptr;
+    }
 }
 
 /**
- * Logs long double value into log file.
+ * Stops the flusher thread, so it doesn't outlive the rings.
  */
-inline void logValue(long double value) {
-    logPrintf("%Lg", value);
+inline StackLogFlusher::~StackLogFlusher() {
+    stopLogFlusher();
 }
 
+//----------------------------------------------------------------------------------------------------------------------
+
+/** Formatter of the integers: decimal digits, converted with std::to_chars */
+template <typename T>
+struct StackLogFormatter<T, std::enable_if_t<std::is_integral<T>::value &&
+                                             !std::is_same<T, bool>::value && !std::is_same<T, char>::value>> {
+    static void write(const T value) {
+        char digits[std::numeric_limits<T>::digits10 + 3];
+        const std::to_chars_result result = std::to_chars(digits, digits + sizeof(digits), value);
+        logWrite(digits, result.ptr - digits);
+    }
+};
+
+/** Formatter of the floating point numbers: 6 significant digits, as %lg does */
+template <typename T>
+struct StackLogFormatter<T, std::enable_if_t<std::is_floating_point<T>::value>> {
+    static void write(const T value) {
+        char digits[64];
+        #ifdef __cpp_lib_to_chars
+            const std::to_chars_result result =
+                std::to_chars(digits, digits + sizeof(digits), value, std::chars_format::general, 6);
+            logWrite(digits, result.ptr - digits);
+        #else
+            logWrite(digits, snprintf(digits, sizeof(digits), "%Lg", (long double)value));
+        #endif
+    }
+};
+
+/** Formatter of the characters */
+template <>
+struct StackLogFormatter<char> {
+    static void write(const char value) {
+        logWrite(&value, 1);
+    }
+};
+
+/** Formatter of the booleans: true or false */
+template <>
+struct StackLogFormatter<bool> {
+    static void write(const bool value) {
+        logWrite(value ? "true" : "false");
+    }
+};
+
+/** Formatter of the C strings */
+template <>
+struct StackLogFormatter<const char*> {
+    static void write(const char* const value) {
+        logWrite(value);
+    }
+};
+
+/** Formatter of the C strings */
+template <>
+struct StackLogFormatter<char*> : StackLogFormatter<const char*> {};
+
 /**
- * Logs char value into log file.
+ * Logs value of any type, that has StackLogFormatter, into log file.
+ * @param[in] value value to log
  */
-inline void logValue(char value) {
-    logPrintf("%c", value);
+template <typename T>
+void logValue(const T& value) {
+    StackLogFormatter<std::decay_t<T>>::write(value);
 }
 
 /**
- * Logs unsigned char value into log file.
+ * Sets the global mode of logging the arrays.
+ * @param[in] mode mode of logging
  */
-inline void logValue(unsigned char value) {
-    logPrintf("%hhu", value);
+inline void setStackLogMode(const StackLogMode mode) {
+    stackLogMode.store(mode);
 }
 
 /**
- * Logs const char* value into log file.
+ * Gives the mode of logging the arrays: the one of the current thread, or the global one.
+ * @return mode of logging.
  */
-inline void logValue(const char* value) {
-    logPrintf("%s", value);
+inline StackLogMode getStackLogMode() {
+    return (stackThreadLogMode >= 0) ? (StackLogMode)stackThreadLogMode : stackLogMode.load(std::memory_order_relaxed);
 }
 
 /**
- * Logs bool value into log file.
+ * Sets the mode of logging the arrays for the current thread.
+ * @param[in] mode mode of logging
  */
-inline void logValue(bool value) {
-    logPrintf("%s", value ? "true" : "false");
+inline StackLogModeGuard::StackLogModeGuard(const StackLogMode mode) : previousMode(stackThreadLogMode) {
+    stackThreadLogMode = mode;
+}
+
+/**
+ * Restores the mode of logging the arrays of the current thread.
+ */
+inline StackLogModeGuard::~StackLogModeGuard() {
+    stackThreadLogMode = previousMode;
+}
+
+/**
+ * Sorts the ranges, clips them to [from, to) and merges the overlapping ones.
+ * @param[in, out] ranges ranges of the elements
+ * @param[in] number      number of the ranges
+ * @param[in] from        index of the first element of the array
+ * @param[in] to          index after the last element of the array
+ * @return number of the ranges after merging.
+ */
+inline size_t normalizeStackLogRanges(StackLogRange* const ranges, const size_t number, const size_t from,
+                                      const size_t to) {
+    assert(ranges != nullptr);
+
+    // There are a few ranges, so they are sorted by insertion
+    for (size_t i = 1; i < number; ++i) {
+        StackLogRange range = ranges[i];
+        size_t j = i;
+        for (; j > 0 && ranges[j - 1].begin > range.begin; --j) {
+            ranges[j] = ranges[j - 1];
+        }
+        ranges[j] = range;
+    }
+
+    size_t merged = 0;
+    for (size_t i = 0; i < number; ++i) {
+        const size_t begin = (ranges[i].begin < from) ? from : ranges[i].begin;
+        const size_t end   = (ranges[i].end   > to)   ? to   : ranges[i].end;
+        if (begin >= end) continue;
+
+        if (merged > 0 && begin <= ranges[merged - 1].end) {
+            if (end > ranges[merged - 1].end) ranges[merged - 1].end = end;
+        } else {
+            ranges[merged++] = {begin, end};
+        }
+    }
+    return merged;
+}
+
+/**
+ * Logs the elements of the array from the given ranges with their indices. Skipped elements are marked with "...".
+ * @param[in] array  array to log
+ * @param[in] from   index of the first element of the array
+ * @param[in] to     index after the last element of the array
+ * @param[in] ranges sorted disjoint ranges of the logged elements (see normalizeStackLogRanges)
+ * @param[in] number number of the ranges
+ * @param[in] indent indent of the elements
+ */
+template <typename T>
+void logArrayRanges(const T* const array, const size_t from, const size_t to, const StackLogRange* const ranges,
+                    const size_t number, const char* const indent) {
+    const size_t indentLength = strlen(indent);
+    size_t next = from;
+    for (size_t i = 0; i < number; ++i) {
+        if (ranges[i].begin > next) {
+            logWrite(indent, indentLength);
+            logWrite("...\n", 4);
+        }
+        for (size_t j = ranges[i].begin; j < ranges[i].end; ++j) {
+            logWrite(indent, indentLength);
+            logWrite("[", 1);
+            logValue(j);
+            logWrite("] = ", 4);
+            logValue(array[j]);
+            logWrite("\n", 1);
+        }
+        next = ranges[i].end;
+    }
+    if (next < to) {
+        logWrite(indent, indentLength);
+        logWrite("...\n", 4);
+    }
+}
+
+/**
+ * Formats the hexdump line: address, bytes in hex and bytes as characters. Line has hexdumpLineLength characters.
+ * @param[out] line   buffer of hexdumpLineLength characters
+ * @param[in] bytes   bytes of the line
+ * @param[in] size    number of the bytes (not more than hexdumpLineBytes)
+ * @param[in] address address of the first byte
+ */
+inline void formatHexdumpLine(char* line, const unsigned char* const bytes, const size_t size, uintptr_t address) {
+    assert(size <= hexdumpLineBytes);
+    constexpr char digits[] = "0123456789abcdef";
+
+    for (int i = 15; i >= 0; --i, address >>= 4) {
+        line[i] = digits[address & 0xF];
+    }
+    line += 16;
+    *line++ = ' ';
+    *line++ = ' ';
+
+    for (size_t i = 0; i < hexdumpLineBytes; ++i) {
+        if (i == hexdumpLineBytes / 2) *line++ = ' ';
+        line[0] = (i < size) ? digits[bytes[i] >> 4]  : ' ';
+        line[1] = (i < size) ? digits[bytes[i] & 0xF] : ' ';
+        line[2] = ' ';
+        line += 3;
+    }
+
+    *line++ = ' ';
+    *line++ = '|';
+    for (size_t i = 0; i < hexdumpLineBytes; ++i) {
+        *line++ = (i >= size) ? ' ' : (bytes[i] >= 0x20 && bytes[i] < 0x7F) ? (char)bytes[i] : '.';
+    }
+    *line++ = '|';
+    *line = '\n';
+}
+
+/**
+ * Logs the hexdump of the bytes into log file.
+ * @param[in] bytes  bytes to dump
+ * @param[in] size   number of the bytes
+ * @param[in] indent indent of the hexdump lines
+ */
+inline void logHexdump(const void* const bytes, const size_t size, const char* const indent) {
+    assert(bytes != nullptr || size == 0);
+    assert(indent != nullptr);
+
+    const size_t indentLength = strlen(indent);
+    const unsigned char* lineBytes = (const unsigned char*)bytes;
+    char line[hexdumpLineLength];
+    for (size_t offset = 0; offset < size; offset += hexdumpLineBytes, lineBytes += hexdumpLineBytes) {
+        const size_t lineSize = (size - offset < hexdumpLineBytes) ? size - offset : hexdumpLineBytes;
+        formatHexdumpLine(line, lineBytes, lineSize, (uintptr_t)lineBytes);
+        logWrite(indent, indentLength);
+        logWrite(line, hexdumpLineLength);
+    }
+}
+
+/**
+ * Appends the title line and the hexdump of the bytes to the file. Hexdump is formatted straight into the mapped file.
+ * @param[in] fileName name of the file
+ * @param[in] title    title line (without the new line)
+ * @param[in] bytes    bytes to dump
+ * @param[in] size     number of the bytes
+ * @return true, if the hexdump is written, false otherwise.
+ */
+inline bool writeHexdumpFile(const char* const fileName, const char* const title, const void* const bytes,
+                             const size_t size) {
+    assert(fileName != nullptr);
+    assert(title != nullptr);
+    assert(bytes != nullptr || size == 0);
+
+    const size_t titleLength = strlen(title);
+    const size_t linesNumber = (size + hexdumpLineBytes - 1) / hexdumpLineBytes;
+    const size_t dumpLength = titleLength + 1 + linesNumber * hexdumpLineLength;
+    const unsigned char* lineBytes = (const unsigned char*)bytes;
+
+    #if defined(__unix__) || defined(__APPLE__)
+        const int fd = open(fileName, O_RDWR | O_CREAT, 0644);
+        if (fd < 0) return false;
+
+        struct stat fileStat = {};
+        if (fstat(fd, &fileStat) != 0 || ftruncate(fd, fileStat.st_size + dumpLength) != 0) {
+            close(fd);
+            return false;
+        }
+
+        // Mapping starts at the page boundary before the end of the file
+        const size_t pageSize = sysconf(_SC_PAGESIZE);
+        const size_t mappingOffset = fileStat.st_size / pageSize * pageSize;
+        const size_t mappingLength = fileStat.st_size - mappingOffset + dumpLength;
+        void* mapping = mmap(nullptr, mappingLength, PROT_READ | PROT_WRITE, MAP_SHARED, fd, mappingOffset);
+        close(fd);
+        if (mapping == MAP_FAILED) return false;
+
+        char* output = (char*)mapping + (fileStat.st_size - mappingOffset);
+        memcpy(output, title, titleLength);
+        output[titleLength] = '\n';
+        output += titleLength + 1;
+        for (size_t offset = 0; offset < size; offset += hexdumpLineBytes, lineBytes += hexdumpLineBytes) {
+            const size_t lineSize = (size - offset < hexdumpLineBytes) ? size - offset : hexdumpLineBytes;
+            formatHexdumpLine(output, lineBytes, lineSize, (uintptr_t)lineBytes);
+            output += hexdumpLineLength;
+        }
+
+        return munmap(mapping, mappingLength) == 0;
+    #else
+        FILE* file = fopen(fileName, "ab");
+        if (file == nullptr) return false;
+
+        fprintf(file, "%s\n", title);
+        char line[hexdumpLineLength];
+        for (size_t offset = 0; offset < size; offset += hexdumpLineBytes, lineBytes += hexdumpLineBytes) {
+            const size_t lineSize = (size - offset < hexdumpLineBytes) ? size - offset : hexdumpLineBytes;
+            formatHexdumpLine(line, lineBytes, lineSize, (uintptr_t)lineBytes);
+            fwrite(line, 1, hexdumpLineLength, file);
+        }
+        (void)dumpLength;
+        return fclose(file) == 0;
+    #endif
 }
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -164,9 +1047,9 @@ inline void logValue(bool value) {
  * Logged value is preceded by the given indent.
  */
 #define LOG_VALUE_INDENTED(value, indent) do {                                                                         \
-    logPrintf(indent "%s = ", #value);                                                                                 \
+    logWrite(indent #value " = ");                                                                                     \
     logValue(value);                                                                                                   \
-    logPrintf("\n");                                                                                                   \
+    logWrite("\n", 1);                                                                                                 \
 } while (0)
 
 /**
@@ -175,24 +1058,54 @@ inline void logValue(bool value) {
 #define LOG_VALUE(value) LOG_VALUE_INDENTED(value, "")
 
 /**
- * Logs array of any supported type into log file.
+ * Logs the elements of array of any supported type from begin to end (not including it) with their indices into log file.
+ * Logs only the elements at both ends in windowed mode, or the hexdump of the elements in hexdump mode.
  * Logged array is preceded by the given indent.
  */
-#define LOG_ARRAY_INDENTED(array, length, indent) do {                                                                 \
+#define LOG_ARRAY_SLICE_INDENTED(array, begin, end, indent) do {                                                       \
     logPrintf(indent "%s [" PTR_FORMAT "]", #array, (uintptr_t)array);                                                 \
     if (array == nullptr) {                                                                                            \
         logPrintf("\n");                                                                                               \
         break;                                                                                                         \
     }                                                                                                                  \
     logPrintf(" = {\n");                                                                                               \
-    for (size_t i = 0; i < (length); ++i) {                                                                            \
-        logPrintf(indent "\t[%zu] = ", i);                                                                             \
-        logValue(array[i]);                                                                                            \
-        logPrintf("\n");                                                                                               \
+    const size_t loggedBegin = (begin);                                                                                \
+    const size_t loggedEnd   = (end);                                                                                  \
+    const StackLogMode loggedMode = getStackLogMode();                                                                 \
+    if (loggedMode == STACK_LOG_HEXDUMP) {                                                                             \
+        logHexdump(array + loggedBegin, sizeof(*array) * (loggedEnd - loggedBegin), indent "\t");                      \
+    } else if (loggedMode == STACK_LOG_WINDOWED && loggedEnd - loggedBegin > 2 * STACK_LOG_WINDOW) {                   \
+        const StackLogRange loggedRanges[] = {                                                                         \
+            {loggedBegin, loggedBegin + STACK_LOG_WINDOW}, {loggedEnd - STACK_LOG_WINDOW, loggedEnd}                   \
+        };                                                                                                             \
+        logArrayRanges(array, loggedBegin, loggedEnd, loggedRanges, 2, indent "\t");                                   \
+    } else {                                                                                                           \
+        for (size_t i = loggedBegin; i < loggedEnd; ++i) {                                                             \
+            logWrite(indent "\t[");                                                                                    \
+            logValue(i);                                                                                               \
+            logWrite("] = ", 4);                                                                                       \
+            logValue(array[i]);                                                                                        \
+            logWrite("\n", 1);                                                                                         \
+        }                                                                                                              \
     }                                                                                                                  \
     logPrintf(indent "}\n");                                                                                           \
 } while (0)
 
+/**
+ * Logs array of any supported type into log file.
+ * Logged array is preceded by the given indent.
+ */
+#define LOG_ARRAY_INDENTED(array, length, indent) LOG_ARRAY_SLICE_INDENTED(array, 0, length, indent)
+
+/**
+ * Logs array of any supported type into log file in the given mode (see StackLogMode).
+ * Logged array is preceded by the given indent.
+ */
+#define LOG_ARRAY_INDENTED_MODE(array, length, indent, mode) do {                                                      \
+    StackLogModeGuard logModeGuard(mode);                                                                              \
+    LOG_ARRAY_INDENTED(array, length, indent);                                                                         \
+} while (0)
+
 /**
  * Logs array of any supported type into log file.
  */
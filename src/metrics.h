@@ -0,0 +1,473 @@
+/**
+ * @file
+ * @brief Definition and implementation of the stack metrics: per-thread operation counters and their snapshots
+ *
+ * Metrics are compiled in when STACK_METRICS is 1 (it's 0 by default, then the stacks don't touch them at all).
+ * Stacks of each element type form a family of metrics (e.g. Stack_int). Each thread has its own slot of counters
+ * for each family, so the operations only load and store the counters of their thread, without shared atomics.
+ * Slots of the finished threads are folded into the retired slots of the families.
+ *
+ * Snapshot sums the counters of all slots (and takes the maximum of the peaks) and writes them into a file
+ * as JSON lines (appended, one line per family) or as Prometheus text (the file is replaced).
+ * Stacks may allocate in one thread and free in another, so the peak of the allocated bytes isn't tracked
+ * by the slots: it's the maximum of the summed allocated bytes over the snapshots.
+ */
+#ifndef IMMORTAL_STACK_METRICS_H
+#define IMMORTAL_STACK_METRICS_H
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+#endif
+
+/** Metrics are collected by the stack operations, if it's 1 */
+#ifndef STACK_METRICS
+    #define STACK_METRICS 0
+#endif
+
+/** Maximal number of the families of metrics. Stacks of the extra element types share the last family */
+#ifndef STACK_MAX_METRICS_FAMILIES
+    #define STACK_MAX_METRICS_FAMILIES 32
+#endif
+
+/** Metrics of the stack family */
+enum StackMetric {
+    STACK_METRIC_PUSHES,               ///< Pushed elements
+    STACK_METRIC_POPS,                 ///< Popped elements
+    STACK_METRIC_TOPS,                 ///< Calls of top
+    STACK_METRIC_CONSTRUCTS,           ///< Constructed stacks
+    STACK_METRIC_ENLARGES,             ///< Reallocations of the data arrays to the larger capacity
+    STACK_METRIC_RELOCATED_BYTES,      ///< Bytes of the elements, that the reallocations copy (at most, realloc may keep them)
+    STACK_METRIC_CHECK_CYCLES,         ///< Cycles spent in isStackOk
+    STACK_METRIC_HASH_CYCLES,          ///< Cycles spent in getHash
+    STACK_METRIC_PEAK_SIZE,            ///< Maximal size of the stacks
+    STACK_METRIC_ALLOCATED_BYTES,      ///< Bytes of the allocated data arrays (without the inline ones)
+    STACK_METRIC_PEAK_ALLOCATED_BYTES, ///< Maximal number of the allocated bytes, that the snapshots have seen
+    STACK_METRICS_NUMBER
+};
+
+/** Format of the metrics file */
+enum StackMetricsFormat {
+    STACK_METRICS_JSON_LINES = 0, ///< JSON object for each family in a line, appended to the file
+    STACK_METRICS_PROMETHEUS = 1  ///< Prometheus text exposition format, the file is replaced
+};
+
+/** Description of the metric */
+struct StackMetricInfo {
+    /** Name of the metric (Prometheus one is prefixed by immortal_stack_) */
+    const char* name;
+
+    /** Metric only grows, otherwise it's a gauge */
+    bool counter;
+
+    /** Slots are aggregated by the maximum, otherwise by the sum */
+    bool peak;
+};
+
+/** Descriptions of the metrics, in StackMetric order */
+constexpr StackMetricInfo stackMetricInfos[STACK_METRICS_NUMBER] = {
+    {"pushes_total",          true,  false},
+    {"pops_total",            true,  false},
+    {"tops_total",            true,  false},
+    {"constructs_total",      true,  false},
+    {"enlarges_total",        true,  false},
+    {"relocated_bytes_total", true,  false},
+    {"check_cycles_total",    true,  false},
+    {"hash_cycles_total",     true,  false},
+    {"peak_size",             false, true },
+    {"allocated_bytes",       false, false},
+    {"peak_allocated_bytes",  false, true }
+};
+
+/** Counters of one family in one thread. Only the owner thread changes them, snapshots read them */
+struct StackMetricsSlot {
+    std::atomic<long long> values[STACK_METRICS_NUMBER];
+};
+
+/** Slots of the thread for all families */
+struct StackMetricsThread {
+    StackMetricsSlot slots[STACK_MAX_METRICS_FAMILIES];
+};
+
+/** Owner of the slots of the current thread, that retires them when the thread finishes */
+struct StackMetricsOwner {
+    /** Slots of the thread, or nullptr if the thread hasn't used the stacks yet */
+    StackMetricsThread* metrics = nullptr;
+
+    ~StackMetricsOwner();
+};
+
+/** Global registry of the families and the slots */
+struct StackMetricsRegistry {
+    /** Lock of the registry. Taken only by the first operation of each thread and by the snapshots */
+    std::mutex lock;
+
+    /** Names of the families */
+    const char* names[STACK_MAX_METRICS_FAMILIES];
+
+    /** Number of the families */
+    size_t familiesNumber;
+
+    /** Slots of the running threads */
+    std::vector<StackMetricsThread*> threads;
+
+    /** Slots of the finished threads, folded together */
+    StackMetricsThread retired;
+
+    /** Maximal allocated bytes of the families over the snapshots, summed over all slots */
+    long long peakAllocatedBytes[STACK_MAX_METRICS_FAMILIES];
+};
+
+/** Aggregated metrics of the family */
+struct StackMetricsSnapshot {
+    /** Name of the family */
+    const char* name;
+
+    /** Values of the metrics, in StackMetric order */
+    long long values[STACK_METRICS_NUMBER];
+};
+
+/** Global registry of the metrics */
+inline StackMetricsRegistry stackMetricsRegistry;
+
+/** Slots of the current thread */
+inline thread_local StackMetricsOwner stackMetricsOwner;
+
+/**
+ * Gives the family of the metrics with the given name, adds it if there's no such family.
+ * @param[in] name name of the family (string literal, e.g. Stack_int)
+ * @return index of the family.
+ */
+inline size_t registerStackMetricsFamily(const char* name);
+
+/**
+ * Gives the slot of the current thread for the family. Creates the slots of the thread at the first call.
+ * @param[in] family index of the family
+ * @return slot of the family.
+ */
+inline StackMetricsSlot* getThreadStackMetricsSlot(size_t family);
+
+/**
+ * Adds the value to the metric of the slot.
+ * @param[in, out] slot slot of the current thread
+ * @param[in] metric    metric to change
+ * @param[in] value     added value
+ */
+inline void addStackMetric(StackMetricsSlot* slot, StackMetric metric, long long value);
+
+/**
+ * Raises the peak metric of the slot to the value.
+ * @param[in, out] slot slot of the current thread
+ * @param[in] metric    peak metric to change
+ * @param[in] value     value of the metric
+ */
+inline void raiseStackMetric(StackMetricsSlot* slot, StackMetric metric, long long value);
+
+/**
+ * Gives the timestamp to measure the cycles spent in the operations: TSC on x86, nanoseconds of the steady clock otherwise.
+ * @return timestamp.
+ */
+inline unsigned long long readStackCycles();
+
+/**
+ * Folds the slots into the aggregated ones: sums the values, takes the maximum of the peaks.
+ * @param[in, out] total aggregated slots
+ * @param[in] metrics    folded slots
+ * @param[in] families   number of the families
+ */
+inline void foldStackMetrics(StackMetricsThread* total, const StackMetricsThread* metrics, size_t families);
+
+/**
+ * Aggregates the slots of all threads into the snapshots of the families.
+ * Raises the peak of the allocated bytes of each family to the summed allocated bytes.
+ * @param[out] snapshots array of snapshots
+ * @param[in] maxNumber  number of the snapshots in the array
+ * @return number of the families (may be more than maxNumber, then only the first maxNumber are given).
+ */
+inline size_t collectStackMetrics(StackMetricsSnapshot* snapshots, size_t maxNumber);
+
+/**
+ * Writes the snapshots of all families into the file.
+ * @param[in] fileName name of the file
+ * @param[in] format   format of the file
+ * @return true, if the metrics are written, false otherwise.
+ */
+inline bool writeStackMetrics(const char* fileName, StackMetricsFormat format = STACK_METRICS_JSON_LINES);
+
+/**
+ * Measures the cycles between its construction and destruction and adds them to the metric of the stack.
+ * Does nothing if the metrics are turned off. The slot of the stack is given by getStackMetricsSlot(stack).
+ */
+template <typename Stack>
+struct StackMetricsTimer {
+    /** Measured stack */
+    Stack* stack;
+
+    /** Metric of the cycles */
+    StackMetric metric;
+
+    /** Timestamp of the construction */
+    unsigned long long start;
+
+    StackMetricsTimer(Stack* stack, StackMetric metric);
+    ~StackMetricsTimer();
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * Adds the value to the metric of the given stack. Stack slot is given by getStackMetricsSlot(stack).
+ *
+ * Works when the metrics are turned on.
+ */
+#define STACK_METRICS_ADD(stack, metric, value) do {                                                                   \
+    if constexpr (STACK_METRICS) {                                                                                     \
+        addStackMetric(getStackMetricsSlot(stack), metric, value);                                                     \
+    }                                                                                                                  \
+} while (0)
+
+/**
+ * Raises the peak metric of the given stack to the value. Stack slot is given by getStackMetricsSlot(stack).
+ *
+ * Works when the metrics are turned on.
+ */
+#define STACK_METRICS_RAISE(stack, metric, value) do {                                                                 \
+    if constexpr (STACK_METRICS) {                                                                                     \
+        raiseStackMetric(getStackMetricsSlot(stack), metric, value);                                                   \
+    }                                                                                                                  \
+} while (0)
+
+/**
+ * Gives the family of the metrics with the given name, adds it if there's no such family.
+ * @param[in] name name of the family (string literal, e.g. Stack_int)
+ * @return index of the family.
+ */
+inline size_t registerStackMetricsFamily(const char* const name) {
+    assert(name != nullptr);
+    std::lock_guard<std::mutex> lock(stackMetricsRegistry.lock);
+
+    for (size_t i = 0; i < stackMetricsRegistry.familiesNumber; ++i) {
+        if (strcmp(stackMetricsRegistry.names[i], name) == 0) return i;
+    }
+    if (stackMetricsRegistry.familiesNumber == STACK_MAX_METRICS_FAMILIES) {
+        stackMetricsRegistry.names[STACK_MAX_METRICS_FAMILIES - 1] = "Stack_other";
+        return STACK_MAX_METRICS_FAMILIES - 1;
+    }
+
+    stackMetricsRegistry.names[stackMetricsRegistry.familiesNumber] = name;
+    return stackMetricsRegistry.familiesNumber++;
+}
+
+/**
+ * Gives the slot of the current thread for the family. Creates the slots of the thread at the first call.
+ * @param[in] family index of the family
+ * @return slot of the family.
+ */
+inline StackMetricsSlot* getThreadStackMetricsSlot(const size_t family) {
+    assert(family < STACK_MAX_METRICS_FAMILIES);
+
+    StackMetricsThread* metrics = stackMetricsOwner.metrics;
+    if (metrics == nullptr) {
+        metrics = new StackMetricsThread();
+
+        std::lock_guard<std::mutex> lock(stackMetricsRegistry.lock);
+        stackMetricsRegistry.threads.push_back(metrics);
+        stackMetricsOwner.metrics = metrics;
+    }
+
+    return &metrics->slots[family];
+}
+
+/**
+ * Adds the value to the metric of the slot.
+ * @param[in, out] slot slot of the current thread
+ * @param[in] metric    metric to change
+ * @param[in] value     added value
+ */
+inline void addStackMetric(StackMetricsSlot* const slot, const StackMetric metric, const long long value) {
+    // Only this thread changes the slot, so the value is not incremented atomically
+    const long long newValue = slot->values[metric].load(std::memory_order_relaxed) + value;
+    slot->values[metric].store(newValue, std::memory_order_relaxed);
+}
+
+/**
+ * Raises the peak metric of the slot to the value.
+ * @param[in, out] slot slot of the current thread
+ * @param[in] metric    peak metric to change
+ * @param[in] value     value of the metric
+ */
+inline void raiseStackMetric(StackMetricsSlot* const slot, const StackMetric metric, const long long value) {
+    if (value > slot->values[metric].load(std::memory_order_relaxed)) {
+        slot->values[metric].store(value, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Gives the timestamp to measure the cycles spent in the operations: TSC on x86, nanoseconds of the steady clock otherwise.
+ * @return timestamp.
+ */
+inline unsigned long long readStackCycles() {
+    #if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+    #else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count();
+    #endif
+}
+
+/**
+ * Folds the slots into the aggregated ones: sums the values, takes the maximum of the peaks.
+ * @param[in, out] total aggregated slots
+ * @param[in] metrics    folded slots
+ * @param[in] families   number of the families
+ */
+inline void foldStackMetrics(StackMetricsThread* const total, const StackMetricsThread* const metrics,
+                             const size_t families) {
+    for (size_t family = 0; family < families; ++family) {
+        for (size_t metric = 0; metric < STACK_METRICS_NUMBER; ++metric) {
+            const long long value = metrics->slots[family].values[metric].load(std::memory_order_relaxed);
+            std::atomic<long long>& totalValue = total->slots[family].values[metric];
+            if (stackMetricInfos[metric].peak) {
+                if (value > totalValue.load(std::memory_order_relaxed)) totalValue.store(value);
+            } else {
+                totalValue.store(totalValue.load(std::memory_order_relaxed) + value);
+            }
+        }
+    }
+}
+
+/**
+ * Retires the slots of the finishing thread: folds them into the retired slots and frees them.
+ */
+inline StackMetricsOwner::~StackMetricsOwner() {
+    if (metrics == nullptr) return;
+
+    std::lock_guard<std::mutex> lock(stackMetricsRegistry.lock);
+    foldStackMetrics(&stackMetricsRegistry.retired, metrics, STACK_MAX_METRICS_FAMILIES);
+
+    std::vector<StackMetricsThread*>& threads = stackMetricsRegistry.threads;
+    for (size_t i = 0; i < threads.size(); ++i) {
+        if (threads[i] == metrics) {
+            threads[i] = threads.back();
+            threads.pop_back();
+            break;
+        }
+    }
+
+    delete metrics;
+    metrics = nullptr;
+}
+
+/**
+ * Aggregates the slots of all threads into the snapshots of the families.
+ * Raises the peak of the allocated bytes of each family to the summed allocated bytes.
+ * @param[out] snapshots array of snapshots
+ * @param[in] maxNumber  number of the snapshots in the array
+ * @return number of the families (may be more than maxNumber, then only the first maxNumber are given).
+ */
+inline size_t collectStackMetrics(StackMetricsSnapshot* const snapshots, const size_t maxNumber) {
+    assert(snapshots != nullptr || maxNumber == 0);
+
+    StackMetricsThread* total = new StackMetricsThread();
+    size_t families = 0;
+    {
+        std::lock_guard<std::mutex> lock(stackMetricsRegistry.lock);
+        families = stackMetricsRegistry.familiesNumber;
+        foldStackMetrics(total, &stackMetricsRegistry.retired, families);
+        for (const StackMetricsThread* metrics : stackMetricsRegistry.threads) {
+            foldStackMetrics(total, metrics, families);
+        }
+
+        for (size_t family = 0; family < families; ++family) {
+            std::atomic<long long>* values = total->slots[family].values;
+            long long& peak = stackMetricsRegistry.peakAllocatedBytes[family];
+            const long long allocated = values[STACK_METRIC_ALLOCATED_BYTES].load(std::memory_order_relaxed);
+            if (allocated > peak) peak = allocated;
+            values[STACK_METRIC_PEAK_ALLOCATED_BYTES].store(peak);
+        }
+
+        for (size_t family = 0; family < families && family < maxNumber; ++family) {
+            snapshots[family].name = stackMetricsRegistry.names[family];
+            for (size_t metric = 0; metric < STACK_METRICS_NUMBER; ++metric) {
+                snapshots[family].values[metric] = total->slots[family].values[metric].load();
+            }
+        }
+    }
+
+    delete total;
+    return families;
+}
+
+/**
+ * Writes the snapshots of all families into the file.
+ * @param[in] fileName name of the file
+ * @param[in] format   format of the file
+ * @return true, if the metrics are written, false otherwise.
+ */
+inline bool writeStackMetrics(const char* const fileName, const StackMetricsFormat format) {
+    assert(fileName != nullptr);
+
+    StackMetricsSnapshot snapshots[STACK_MAX_METRICS_FAMILIES] = {};
+    const size_t families = collectStackMetrics(snapshots, STACK_MAX_METRICS_FAMILIES);
+
+    FILE* file = fopen(fileName, (format == STACK_METRICS_PROMETHEUS) ? "w" : "a");
+    if (file == nullptr) return false;
+
+    if (format == STACK_METRICS_PROMETHEUS) {
+        for (size_t metric = 0; metric < STACK_METRICS_NUMBER; ++metric) {
+            const StackMetricInfo& info = stackMetricInfos[metric];
+            fprintf(file, "# TYPE immortal_stack_%s %s\n", info.name, info.counter ? "counter" : "gauge");
+            for (size_t family = 0; family < families; ++family) {
+                fprintf(file, "immortal_stack_%s{stack=\"%s\"} %lld\n",
+                        info.name, snapshots[family].name, snapshots[family].values[metric]);
+            }
+        }
+    } else {
+        const long long timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()
+        ).count();
+        for (size_t family = 0; family < families; ++family) {
+            fprintf(file, "{\"timestamp\": %lld, \"stack\": \"%s\"", timestamp, snapshots[family].name);
+            for (size_t metric = 0; metric < STACK_METRICS_NUMBER; ++metric) {
+                fprintf(file, ", \"%s\": %lld", stackMetricInfos[metric].name, snapshots[family].values[metric]);
+            }
+            fprintf(file, "}\n");
+        }
+    }
+
+    return fclose(file) == 0;
+}
+
+/**
+ * Starts measuring the cycles of the stack operation.
+ * @param[in] stack  measured stack
+ * @param[in] metric metric of the cycles
+ */
+template <typename Stack>
+StackMetricsTimer<Stack>::StackMetricsTimer(Stack* const stack, const StackMetric metric) :
+    stack(stack), metric(metric), start(0) {
+    if constexpr (STACK_METRICS) {
+        start = readStackCycles();
+    }
+}
+
+/**
+ * Adds the cycles of the stack operation to the metric of the stack.
+ */
+template <typename Stack>
+StackMetricsTimer<Stack>::~StackMetricsTimer() {
+    if constexpr (STACK_METRICS) {
+        const unsigned long long end = readStackCycles();
+        addStackMetric(getStackMetricsSlot(stack), metric, (long long)(end - start));
+    }
+}
+
+#endif // IMMORTAL_STACK_METRICS_H
@@ -0,0 +1,342 @@
+/**
+ * @file
+ * @brief Definition and implementation of persistent stacks, that are stored in files
+ *
+ * Persistent stack lives in a memory-mapped file: the stack struct is stored in the file header
+ * and its data array follows the header. All stack operations modify the file directly,
+ * so the stack survives process restarts: reattaching the file gives the same stack without rebuilding it.
+ * Reattached stack is verified in place with the usual checks (canaries, hashes) of its security policy.
+ *
+ * File layout:
+ *   - StackFileHeader (format and stack type description);
+ *   - stack struct (ImmortalStack);
+ *   - data array, that starts at the page boundary and grows with ftruncate and mremap.
+ *
+ * Changes reach the file when the kernel writes the pages back, or on checkpointStack.
+ * Works only on Linux.
+ */
+#ifndef IMMORTAL_STACK_PERSISTENT_STACK_H
+#define IMMORTAL_STACK_PERSISTENT_STACK_H
+
+#ifdef __linux__
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "immortal_stack.h"
+
+/** Magic bytes at the beginning of the stack file */
+constexpr char stackFileMagic[8] = { 'I', 'M', 'S', 'T', 'A', 'C', 'K', '\0' };
+
+/** Version of the stack file format */
+constexpr unsigned stackFileVersion = 1;
+
+/**
+ * Header of the stack file. Describes the stored stack type, so a file can't be attached to the stack of another type.
+ */
+struct StackFileHeader {
+    char magic[sizeof(stackFileMagic)];
+    unsigned version;
+
+    /** Size of the stack element */
+    unsigned elementSize;
+
+    /** Size of the stack struct */
+    unsigned stackSize;
+
+    /** Number of the stack canaries */
+    unsigned canariesNumber;
+
+    /** STACK_HASH_ALGORITHM, if stack hashing is turned on, 0 otherwise */
+    unsigned hashAlgorithm;
+};
+
+/**
+ * Stack file that is attached to the process. Keeps the file descriptor and the mappings of the file.
+ * Stack data array is managed by allocator, that maps the file (its context is the stack file),
+ * so the stack file must not be moved while the stack is attached.
+ */
+struct StackFile {
+    /** File descriptor, or -1 if no file is attached */
+    int fd = -1;
+
+    /** Mapping of the file header (with the stack struct) */
+    char* header = nullptr;
+
+    /** Size of the header mapping (multiple of the page size). Data array starts at this offset in the file */
+    size_t headerBytes = 0;
+
+    /** Mapping of the data array, or nullptr if there's no one */
+    char* data = nullptr;
+
+    /** Size of the data mapping (multiple of the page size) */
+    size_t dataBytes = 0;
+
+    /** Allocator that maps the data array of the stack from the file */
+    StackAllocator allocator = {};
+};
+
+/**
+ * Attaches the stack that is stored in the given file (creates the file with an empty stack if it doesn't exist).
+ * Reattached stack is relocated to the new mappings and checked with isStackFullyOk (fails an assertion if it's corrupted).
+ * Stack of type Stack must be ImmortalStack of trivially copyable elements without inline data array.
+ * @param[out] file stack file to attach (must not be attached yet)
+ * @param[in] path  path to the file
+ * @return pointer to the attached stack (it's located in the file mapping), or nullptr if the file can't be opened
+ *         or it contains the stack of another type.
+ */
+template <typename Stack>
+Stack* attachStack(StackFile* file, const char* path);
+
+/**
+ * Writes all changes of the attached stack to the file and waits until they are written.
+ * @param[in] file attached stack file
+ * @return true, if all changes are written, false otherwise.
+ */
+inline bool checkpointStack(StackFile* file);
+
+/**
+ * Checkpoints the attached stack and detaches it: unmaps the file and closes it.
+ * Pointer to the stack becomes invalid, but the stack stays in the file.
+ * @param[in, out] file attached stack file
+ */
+inline void detachStack(StackFile* file);
+
+/**
+ * Maps the data array of the given size from the stack file (after the header). Used as StackAllocator callback.
+ * @param[in] context stack file
+ * @param[in] bytes   size of the data array
+ * @return pointer to the data array, or nullptr if the file can't be extended or mapped.
+ */
+inline void* stackFileAllocate(void* context, size_t bytes);
+
+/**
+ * Changes the size of the data array of the stack file with ftruncate and mremap. Used as StackAllocator callback.
+ * @param[in] context  stack file
+ * @param[in] memory   pointer to the data array
+ * @param[in] oldBytes current size of the data array
+ * @param[in] newBytes new size of the data array
+ * @return pointer to the data array, or nullptr if the file can't be resized or remapped.
+ */
+inline void* stackFileReallocate(void* context, void* memory, size_t oldBytes, size_t newBytes);
+
+/**
+ * Unmaps the data array of the stack file and truncates the file to its header. Used as StackAllocator callback.
+ * @param[in] context stack file
+ * @param[in] memory  pointer to the data array
+ * @param[in] bytes   size of the data array
+ */
+inline void stackFileDeallocate(void* context, void* memory, size_t bytes);
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * Attaches the stack that is stored in the given file (creates the file with an empty stack if it doesn't exist).
+ * Reattached stack is relocated to the new mappings and checked with isStackFullyOk (fails an assertion if it's corrupted).
+ * Stack of type Stack must be ImmortalStack of trivially copyable elements without inline data array.
+ * @param[out] file stack file to attach (must not be attached yet)
+ * @param[in] path  path to the file
+ * @return pointer to the attached stack (it's located in the file mapping), or nullptr if the file can't be opened
+ *         or it contains the stack of another type.
+ */
+template <typename Stack>
+Stack* attachStack(StackFile* const file, const char* const path) {
+    using T = typename Stack::ElementType;
+    using P = typename Stack::SecurityPolicy;
+
+    static_assert(std::is_trivially_copyable<T>::value, "persistent stack elements must be trivially copyable");
+    static_assert(Stack::inlineCapacity == 0, "persistent stack can't have inline data array");
+    static_assert(!P::Verification::background, "persistent stack can't be registered in the background verifier");
+    static_assert(!P::Canaries::guardPages, "persistent stack data is allocated in the file, it can't have guard pages");
+    static_assert(P::Hashing::blockSize == 0, "block hashes aren't stored in the file, use StackStateHashing");
+
+    assert(file != nullptr && file->fd == -1);
+    assert(path != nullptr);
+
+    StackFileHeader expectedHeader = {};
+    memcpy(expectedHeader.magic, stackFileMagic, sizeof(stackFileMagic));
+    expectedHeader.version        = stackFileVersion;
+    expectedHeader.elementSize    = sizeof(T);
+    expectedHeader.stackSize      = sizeof(Stack);
+    expectedHeader.canariesNumber = P::Canaries::number;
+    expectedHeader.hashAlgorithm  = P::Hashing::enabled ? STACK_HASH_ALGORITHM : 0;
+
+    const size_t stackOffset = (sizeof(StackFileHeader) + alignof(Stack) - 1) / alignof(Stack) * alignof(Stack);
+
+    file->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (file->fd == -1) return nullptr;
+
+    file->headerBytes = roundUpToPageSize(stackOffset + sizeof(Stack));
+    file->data = nullptr;
+    file->dataBytes = 0;
+    file->allocator = { stackFileAllocate, stackFileReallocate, stackFileDeallocate, file };
+
+    struct stat fileStat = {};
+    const bool isNewFile = (fstat(file->fd, &fileStat) == 0) && (fileStat.st_size == 0);
+    if (isNewFile && ftruncate(file->fd, file->headerBytes) != 0) {
+        detachStack(file);
+        return nullptr;
+    }
+    if (!isNewFile && (fileStat.st_size < (off_t)file->headerBytes)) {
+        detachStack(file);
+        return nullptr;
+    }
+
+    void* header = mmap(nullptr, file->headerBytes, PROT_READ | PROT_WRITE, MAP_SHARED, file->fd, 0);
+    if (header == MAP_FAILED) {
+        detachStack(file);
+        return nullptr;
+    }
+    file->header = (char*)header;
+    Stack* stack = (Stack*)(file->header + stackOffset);
+
+    if (isNewFile) {
+        memcpy(file->header, &expectedHeader, sizeof(StackFileHeader));
+        new (stack) Stack();
+        constructStack(stack, 0, &file->allocator);
+        return stack;
+    }
+
+    if (memcmp(file->header, &expectedHeader, sizeof(StackFileHeader)) != 0) {
+        detachStack(file);
+        return nullptr;
+    }
+
+    // Header is checked before relocation, as the stored pointers are hashed
+    if constexpr (P::Hashing::enabled) {
+        CHECK_STACK_CONDITION(stack, getHash(stack) == stack->_hash);
+    }
+    CHECK_STACK_CONDITION(stack, stack->_capacity >= 0);
+
+    const size_t dataBytes = getStackDataBytes(stack, stack->_capacity);
+    CHECK_STACK_CONDITION(stack, fileStat.st_size >= (off_t)(file->headerBytes + roundUpToPageSize(dataBytes)));
+
+    stack->_data = (decltype(stack->_data))stackFileAllocate(file, dataBytes);
+    stack->_allocator = &file->allocator;
+    if constexpr (P::Hashing::enabled) {
+        stack->_hash = getHash(stack);
+    }
+
+    CHECK_STACK_FULLY_OK(stack);
+
+    return stack;
+}
+
+/**
+ * Writes all changes of the attached stack to the file and waits until they are written.
+ * @param[in] file attached stack file
+ * @return true, if all changes are written, false otherwise.
+ */
+inline bool checkpointStack(StackFile* const file) {
+    assert(file != nullptr && file->fd != -1);
+
+    if (file->data != nullptr && msync(file->data, file->dataBytes, MS_SYNC) != 0) {
+        return false;
+    }
+    // Header is written after the data, so the stored stack never refers to the data that isn't written yet
+    return msync(file->header, file->headerBytes, MS_SYNC) == 0;
+}
+
+/**
+ * Checkpoints the attached stack and detaches it: unmaps the file and closes it.
+ * Pointer to the stack becomes invalid, but the stack stays in the file.
+ * @param[in, out] file attached stack file
+ */
+inline void detachStack(StackFile* const file) {
+    assert(file != nullptr);
+
+    if (file->header != nullptr) {
+        checkpointStack(file);
+    }
+    if (file->data != nullptr) {
+        munmap(file->data, file->dataBytes);
+    }
+    if (file->header != nullptr) {
+        munmap(file->header, file->headerBytes);
+    }
+    if (file->fd != -1) {
+        close(file->fd);
+    }
+
+    *file = StackFile();
+}
+
+/**
+ * Maps the data array of the given size from the stack file (after the header). Used as StackAllocator callback.
+ * @param[in] context stack file
+ * @param[in] bytes   size of the data array
+ * @return pointer to the data array, or nullptr if the file can't be extended or mapped.
+ */
+inline void* stackFileAllocate(void* const context, size_t bytes) {
+    StackFile* file = (StackFile*)context;
+    if (file->data != nullptr) return nullptr;
+
+    const size_t dataBytes = roundUpToPageSize((bytes == 0) ? 1 : bytes);
+
+    struct stat fileStat = {};
+    if (fstat(file->fd, &fileStat) != 0) return nullptr;
+    if ((size_t)fileStat.st_size < file->headerBytes + dataBytes && ftruncate(file->fd, file->headerBytes + dataBytes) != 0) {
+        return nullptr;
+    }
+
+    void* data = mmap(nullptr, dataBytes, PROT_READ | PROT_WRITE, MAP_SHARED, file->fd, file->headerBytes);
+    if (data == MAP_FAILED) return nullptr;
+
+    file->data = (char*)data;
+    file->dataBytes = dataBytes;
+    return data;
+}
+
+/**
+ * Changes the size of the data array of the stack file with ftruncate and mremap. Used as StackAllocator callback.
+ * @param[in] context  stack file
+ * @param[in] memory   pointer to the data array
+ * @param[in] oldBytes current size of the data array
+ * @param[in] newBytes new size of the data array
+ * @return pointer to the data array, or nullptr if the file can't be resized or remapped.
+ */
+inline void* stackFileReallocate(void* const context, void* const memory, size_t, size_t newBytes) {
+    StackFile* file = (StackFile*)context;
+    if (memory != file->data) return nullptr;
+
+    const size_t dataBytes = roundUpToPageSize((newBytes == 0) ? 1 : newBytes);
+    if (dataBytes == file->dataBytes) return memory;
+
+    // File is extended before the mapping grows and truncated after it shrinks, so the mapping never exceeds the file
+    if (dataBytes > file->dataBytes && ftruncate(file->fd, file->headerBytes + dataBytes) != 0) {
+        return nullptr;
+    }
+    void* data = mremap(file->data, file->dataBytes, dataBytes, MREMAP_MAYMOVE);
+    if (data == MAP_FAILED) return nullptr;
+    if (dataBytes < file->dataBytes && ftruncate(file->fd, file->headerBytes + dataBytes) != 0) {
+        // Unused tail of the file doesn't break the stack, so it's just left there
+    }
+
+    file->data = (char*)data;
+    file->dataBytes = dataBytes;
+    return data;
+}
+
+/**
+ * Unmaps the data array of the stack file and truncates the file to its header. Used as StackAllocator callback.
+ * @param[in] context stack file
+ * @param[in] memory  pointer to the data array
+ * @param[in] bytes   size of the data array
+ */
+inline void stackFileDeallocate(void* const context, void* const memory, size_t) {
+    StackFile* file = (StackFile*)context;
+    if (memory == nullptr || memory != file->data) return;
+
+    munmap(file->data, file->dataBytes);
+    file->data = nullptr;
+    file->dataBytes = 0;
+
+    if (ftruncate(file->fd, file->headerBytes) != 0) {
+        // Unused tail of the file doesn't break the stack, so it's just left there
+    }
+}
+
+#endif // __linux__
+
+#endif // IMMORTAL_STACK_PERSISTENT_STACK_H
@@ -0,0 +1,764 @@
+/**
+ * @file
+ * @brief Definition and implementation of segmented stack template
+ *
+ * SegmentedStack<T, Policy, ChunkCapacity> keeps its elements in a doubly linked list of fixed-size chunks
+ * instead of one contiguous data array. When the stack is full, a new chunk is linked on top, so existing elements
+ * are never moved: push takes bounded time and pointers to the elements stay valid while the elements are in the stack.
+ * The last emptied chunk is cached, so a stack that oscillates around a chunk boundary doesn't allocate memory.
+ *
+ * Security policies are the same as for ImmortalStack: with canaries each chunk is guarded by its own canaries,
+ * with hashing the elements are covered by the data hash, that is updated incrementally.
+ * Operations check only the stack members, the top chunk and the cached one, so they don't depend on the number of chunks.
+ * The whole chain of chunks is checked by isStackFullyOk (e.g. in destructStack).
+ */
+#ifndef IMMORTAL_STACK_SEGMENTED_STACK_H
+#define IMMORTAL_STACK_SEGMENTED_STACK_H
+
+#include "immortal_stack.h"
+
+/** Default size of the segmented stack chunk elements in bytes */
+#ifndef STACK_CHUNK_BYTES
+    #define STACK_CHUNK_BYTES (64 * 1024)
+#endif
+
+/**
+ * Chunk of the segmented stack with ChunkCapacity elements.
+ * Elements are stored in uninitialized memory, only the ones that are in the stack are constructed.
+ */
+template <typename T, typename Policy, size_t ChunkCapacity>
+struct StackChunk {
+    [[no_unique_address]] typename StackCanaryArray<Policy::Canaries::number, 0>::Type _canariesBefore;
+
+    /** Chunk below this one, or nullptr if it's the bottom one */
+    StackChunk* _previous;
+
+    /** Chunk above this one, or nullptr if it's the top one */
+    StackChunk* _next;
+
+    /** Elements of the chunk */
+    alignas(T) char _elements[sizeof(T) * ChunkCapacity];
+
+    [[no_unique_address]] typename StackCanaryArray<Policy::Canaries::number, 1>::Type _canariesAfter;
+};
+
+/**
+ * Generic stack that keeps its elements in a list of chunks with ChunkCapacity elements each.
+ * Stack operations (construct/destruct, push, pop, etc) should be performed using the functions below.
+ * Stack can perform different corruption checking (see StackPolicy): silent verification, canary guards, hash checking.
+ */
+template <
+    typename T,
+    typename Policy = StackSecurityPolicy<0>,
+    size_t ChunkCapacity = (sizeof(T) < STACK_CHUNK_BYTES) ? STACK_CHUNK_BYTES / sizeof(T) : 1
+>
+struct SegmentedStack {
+    using ElementType    = T;
+    using SecurityPolicy = Policy;
+    using Chunk          = StackChunk<T, Policy, ChunkCapacity>;
+
+    static_assert(ChunkCapacity > 0, "chunk must contain at least one element");
+
+    static constexpr size_t chunkCapacity = ChunkCapacity;
+
+    /* !!! Private members !!! */
+
+    [[no_unique_address]] typename StackCanaryArray<Policy::Canaries::number, 0>::Type _canariesBefore;
+
+    /** Hash of the stack members (see getHash) */
+    [[no_unique_address]] StackHashValue<Policy::Hashing::enabled, 1> _hash{};
+
+    /** Number of elements in stack */
+    ssize_t _size = 0;
+
+    /** Number of elements that fit into the linked chunks (cached chunk is not counted) */
+    ssize_t _capacity = 0;
+
+    /** The bottom chunk, or nullptr if there are no chunks */
+    Chunk* _bottom = nullptr;
+
+    /** The top chunk, or nullptr if there are no chunks. Contains the top element, if the stack is not empty */
+    Chunk* _top = nullptr;
+
+    /** Empty chunk that is kept to be linked on the next enlarging, or nullptr */
+    Chunk* _cachedChunk = nullptr;
+
+    /** Hash of the stack elements (see getDataHash). Updated incrementally on push and pop */
+    [[no_unique_address]] StackHashValue<Policy::Hashing::enabled, 2> _dataHash{};
+
+    /** Hash of the stack elements below the top one. The top element is checked with it in constant time */
+    [[no_unique_address]] StackHashValue<Policy::Hashing::enabled, 4> _belowTopHash{};
+
+    /** Allocator of the chunks */
+    const StackAllocator* _allocator = nullptr;
+
+    [[no_unique_address]] typename StackCanaryArray<Policy::Canaries::number, 3>::Type _canariesAfter;
+};
+
+/**
+ * Checks if the given segmented stack is in normal state in constant time: correct size and capacity, correct canary
+ * values and hashes of the stack members. Of the chunks only the top one (with its link to the previous one),
+ * the top element and the cached chunk are checked.
+ * @param[in, out] stack stack to check
+ * @return true, if the given stack is ok, false otherwise.
+ */
+template <typename T, typename P, size_t C>
+bool isStackOk(SegmentedStack<T, P, C>* stack);
+
+/**
+ * Checks the whole segmented stack: the members, all linked chunks and the hash of all elements.
+ * Takes time proportional to the number of chunks (or elements, with hashing).
+ * @param[in] stack stack to check
+ * @return true, if the given stack is ok, false otherwise.
+ */
+template <typename T, typename P, size_t C>
+bool isStackFullyOk(SegmentedStack<T, P, C>* stack);
+
+/**
+ * Creates a new segmented stack. Chunks are allocated on demand.
+ * @param[in, out] thiz       pointer to the stack this operation should be performed on
+ * @param[in] initialCapacity if it's not zero, the first chunk is allocated beforehand
+ * @param[in] allocator       allocator of the chunks
+ */
+template <typename T, typename P, size_t C>
+void constructStack(
+    SegmentedStack<T, P, C>* thiz,
+    size_t initialCapacity = 0,
+    const StackAllocator* allocator = &systemStackAllocator
+);
+
+/**
+ * Destructs the given segmented stack. Frees all its chunks and resets all struct members to initial state.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ */
+template <typename T, typename P, size_t C>
+void destructStack(SegmentedStack<T, P, C>* thiz);
+
+/**
+ * Links a new chunk on top of the given segmented stack. Uses the cached chunk if there's one.
+ * Doesn't check if the stack is ok, it's up to the caller.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ */
+template <typename T, typename P, size_t C>
+void enlarge(SegmentedStack<T, P, C>* thiz);
+
+/**
+ * Unlinks the top chunk of the given segmented stack (it must be empty) and caches it.
+ * The chunk that was cached before is freed. Doesn't check if the stack is ok, it's up to the caller.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ */
+template <typename T, typename P, size_t C>
+void unlinkTopChunk(SegmentedStack<T, P, C>* thiz);
+
+/**
+ * Allocates a new chunk with the stack allocator and sets its canaries.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return pointer to the allocated chunk, or nullptr if there's not enough memory.
+ */
+template <typename T, typename P, size_t C>
+StackChunk<T, P, C>* allocateStackChunk(SegmentedStack<T, P, C>* thiz);
+
+/**
+ * Frees the given chunk with the stack allocator. Elements of the chunk must be already destructed.
+ * @param[in] thiz  pointer to the stack this operation should be performed on
+ * @param[in] chunk pointer to the chunk to free (can be nullptr)
+ */
+template <typename T, typename P, size_t C>
+void freeStackChunk(SegmentedStack<T, P, C>* thiz, StackChunk<T, P, C>* chunk);
+
+/**
+ * Checks if canaries of the given chunk are correct.
+ * @param[in] chunk pointer to the chunk to check
+ * @return true, if the chunk canaries are correct, false otherwise.
+ */
+template <typename T, typename P, size_t C>
+bool isStackChunkOk(StackChunk<T, P, C>* chunk);
+
+/**
+ * Gives the pointer to the slot of the given element.
+ * Walks the chunks from the top, so it's fast for the elements near the top of the stack.
+ * @param[in] thiz  pointer to the stack this operation should be performed on
+ * @param[in] index index of the element (from the bottom of the stack), less than the stack capacity
+ * @return pointer to the element slot.
+ */
+template <typename T, typename P, size_t C>
+T* getStackSlot(SegmentedStack<T, P, C>* thiz, ssize_t index);
+
+/**
+ * Constructs the new element on top of the segmented stack from the given arguments (in place).
+ * Existing elements are never moved.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] args      arguments of the element constructor
+ */
+template <typename T, typename P, size_t C, typename... Args>
+void emplace(SegmentedStack<T, P, C>* thiz, Args&&... args);
+
+/**
+ * Pushes the copy of the given element on top of the segmented stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] x         value to put on top of the stack
+ */
+template <typename T, typename P, size_t C>
+void push(SegmentedStack<T, P, C>* thiz, const StackNonDeduced<T>& x);
+
+/**
+ * Moves the given element on top of the segmented stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] x         value to put on top of the stack
+ */
+template <typename T, typename P, size_t C>
+void push(SegmentedStack<T, P, C>* thiz, StackNonDeduced<T>&& x);
+
+/**
+ * Removes value from top of the segmented stack. The value is moved out of the stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @return value that was on top of the stack.
+ */
+template <typename T, typename P, size_t C>
+T pop(SegmentedStack<T, P, C>* thiz);
+
+/**
+ * Gives value from top of the segmented stack without removing it (unlike pop function).
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return reference to the value that is located on top of the stack
+ */
+template <typename T, typename P, size_t C>
+const T& top(SegmentedStack<T, P, C>* thiz);
+
+/**
+ * Gives the number of elements in the given segmented stack.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return size of the stack.
+ */
+template <typename T, typename P, size_t C>
+ssize_t getStackSize(SegmentedStack<T, P, C>* thiz);
+
+/**
+ * Gives the number of elements that fit into the linked chunks of the given segmented stack.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return capacity of the stack.
+ */
+template <typename T, typename P, size_t C>
+ssize_t getStackCapacity(SegmentedStack<T, P, C>* thiz);
+
+/**
+ * Calculates the hash value of the given segmented stack members (see STACK_HASH_ALGORITHM). Skips _hash member of the stack.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return calculated hash value.
+ */
+template <typename T, typename P, size_t C>
+unsigned long long getHash(SegmentedStack<T, P, C>* thiz);
+
+/**
+ * Calculates the hash value of the segmented stack elements from bottom to top (see STACK_HASH_ALGORITHM).
+ * It's equal to the hash of the same elements in ImmortalStack.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return calculated hash value.
+ */
+template <typename T, typename P, size_t C>
+unsigned long long getDataHash(SegmentedStack<T, P, C>* thiz);
+
+/**
+ * Updates the hash of the elements below the top one (_belowTopHash) after _dataHash is changed.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ */
+template <typename T, typename P, size_t C>
+void updateStackBelowTopHash(SegmentedStack<T, P, C>* thiz);
+
+/**
+ * Logs the members of the given segmented stack (size, capacity, chunks and canaries) into the log file. Used in LOG_STACK.
+ * @param[in] stack stack to log (not nullptr)
+ */
+template <typename T, typename P, size_t C>
+void logStackMembers(SegmentedStack<T, P, C>* stack);
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * Checks if the given segmented stack is in normal state in constant time: correct size and capacity, correct canary
+ * values and hashes of the stack members. Of the chunks only the top one (with its link to the previous one),
+ * the top element and the cached chunk are checked.
+ * @param[in, out] stack stack to check
+ * @return true, if the given stack is ok, false otherwise.
+ */
+template <typename T, typename P, size_t C>
+bool isStackOk(SegmentedStack<T, P, C>* stack) {
+    if (
+        (stack == nullptr)                                  ||
+        (stack->_size < 0)                                  ||
+        (stack->_size > stack->_capacity)                   ||
+        (stack->_capacity % (ssize_t)C != 0)                ||
+        ((stack->_capacity == 0) != (stack->_top == nullptr)) ||
+        ((stack->_top == nullptr) != (stack->_bottom == nullptr)) ||
+        (stack->_allocator == nullptr)
+    ) {
+        return false;
+    }
+
+    // The top chunk contains the top element, so empty chunks are never linked
+    if ((stack->_capacity > 0) && (stack->_size <= stack->_capacity - (ssize_t)C)) {
+        return false;
+    }
+
+    if constexpr (P::Canaries::number > 0) {
+        for (size_t i = 0; i < P::Canaries::number; ++i) {
+            if (stack->_canariesBefore[i] != canaryValue) return false;
+            if (stack->_canariesAfter [i] != canaryValue) return false;
+        }
+    }
+
+    StackChunk<T, P, C>* top = stack->_top;
+    if (top != nullptr) {
+        if ((top->_next != nullptr) || !isStackChunkOk(top)) return false;
+
+        // The bottom chunk is the top one only if there's one chunk, otherwise the previous one links back to the top
+        StackChunk<T, P, C>* previous = top->_previous;
+        if ((previous == nullptr) != (stack->_capacity == (ssize_t)C)) return false;
+        if ((previous == nullptr) != (top == stack->_bottom)) return false;
+        if ((previous != nullptr) && ((previous->_next != top) || !isStackChunkOk(previous))) return false;
+    }
+    if ((stack->_cachedChunk != nullptr) && !isStackChunkOk(stack->_cachedChunk)) {
+        return false;
+    }
+
+    if constexpr (P::Hashing::enabled) {
+        // _hash covers _dataHash and _belowTopHash, so the top element is checked against them in constant time
+        if (getHash(stack) != stack->_hash) return false;
+        if (stack->_size > 0) {
+            const T* topSlot = getStackSlot(stack, stack->_size - 1);
+            if (hashBytes(stack->_belowTopHash, topSlot, sizeof(T)) != stack->_dataHash) return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Checks the whole segmented stack: the members, all linked chunks and the hash of all elements.
+ * Takes time proportional to the number of chunks (or elements, with hashing).
+ * @param[in] stack stack to check
+ * @return true, if the given stack is ok, false otherwise.
+ */
+template <typename T, typename P, size_t C>
+bool isStackFullyOk(SegmentedStack<T, P, C>* stack) {
+    if (!isStackOk(stack)) return false;
+
+    ssize_t chunksCount = 0;
+    StackChunk<T, P, C>* previous = nullptr;
+    for (StackChunk<T, P, C>* chunk = stack->_bottom; chunk != nullptr; chunk = chunk->_next) {
+        if (chunk->_previous != previous || !isStackChunkOk(chunk)) return false;
+        if (++chunksCount > stack->_capacity / (ssize_t)C) return false;
+        previous = chunk;
+    }
+    if ((previous != stack->_top) || (chunksCount != stack->_capacity / (ssize_t)C)) {
+        return false;
+    }
+
+    if constexpr (P::Hashing::enabled) {
+        if (getDataHash(stack) != stack->_dataHash) return false;
+    }
+
+    return true;
+}
+
+/**
+ * Creates a new segmented stack. Chunks are allocated on demand.
+ * @param[in, out] thiz       pointer to the stack this operation should be performed on
+ * @param[in] initialCapacity if it's not zero, the first chunk is allocated beforehand
+ * @param[in] allocator       allocator of the chunks
+ */
+template <typename T, typename P, size_t C>
+void constructStack(SegmentedStack<T, P, C>* const thiz, size_t initialCapacity, const StackAllocator* allocator) {
+    CHECK_STACK_CONDITION(thiz, (thiz != nullptr) && (thiz->_top == nullptr));
+    CHECK_STACK_CONDITION(thiz, allocator != nullptr);
+
+    if constexpr (P::Canaries::number > 0) {
+        for (size_t i = 0; i < P::Canaries::number; ++i) {
+            thiz->_canariesBefore[i] = canaryValue;
+            thiz->_canariesAfter [i] = canaryValue;
+        }
+    }
+
+    thiz->_size = 0;
+    thiz->_capacity = 0;
+    thiz->_bottom = nullptr;
+    thiz->_top = nullptr;
+    thiz->_cachedChunk = nullptr;
+    thiz->_allocator = allocator;
+
+    // Empty chunks are never linked, so the first chunk is cached until the first push
+    if (initialCapacity > 0) {
+        thiz->_cachedChunk = allocateStackChunk(thiz);
+        CHECK_STACK_CONDITION(thiz, thiz->_cachedChunk != nullptr);
+    }
+
+    if constexpr (P::Hashing::enabled) {
+        thiz->_dataHash = 0;
+        thiz->_belowTopHash = 0;
+        thiz->_hash = getHash(thiz);
+    }
+}
+
+/**
+ * Destructs the given segmented stack. Frees all its chunks and resets all struct members to initial state.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ */
+template <typename T, typename P, size_t C>
+void destructStack(SegmentedStack<T, P, C>* const thiz) {
+    CHECK_STACK_FULLY_OK(thiz);
+
+    ssize_t chunkBegin = 0;
+    for (StackChunk<T, P, C>* chunk = thiz->_bottom; chunk != nullptr; chunk = thiz->_bottom) {
+        thiz->_bottom = chunk->_next;
+
+        ssize_t chunkSize = thiz->_size - chunkBegin;
+        destructStackElements((T*)chunk->_elements, (chunkSize < (ssize_t)C) ? chunkSize : C);
+        chunkBegin += C;
+
+        freeStackChunk(thiz, chunk);
+    }
+    freeStackChunk(thiz, thiz->_cachedChunk);
+
+    thiz->_size = 0;
+    thiz->_capacity = 0;
+    thiz->_bottom = nullptr;
+    thiz->_top = nullptr;
+    thiz->_cachedChunk = nullptr;
+    thiz->_allocator = nullptr;
+
+    if constexpr (P::Hashing::enabled) {
+        thiz->_dataHash = 0;
+        thiz->_belowTopHash = 0;
+        thiz->_hash = 0;
+    }
+}
+
+/**
+ * Links a new chunk on top of the given segmented stack. Uses the cached chunk if there's one.
+ * Doesn't check if the stack is ok, it's up to the caller.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ */
+template <typename T, typename P, size_t C>
+void enlarge(SegmentedStack<T, P, C>* const thiz) {
+    StackChunk<T, P, C>* chunk = thiz->_cachedChunk;
+    if (chunk != nullptr) {
+        thiz->_cachedChunk = nullptr;
+    } else {
+        chunk = allocateStackChunk(thiz);
+        CHECK_STACK_CONDITION(thiz, chunk != nullptr);
+    }
+
+    chunk->_previous = thiz->_top;
+    chunk->_next = nullptr;
+    if (thiz->_top != nullptr) {
+        thiz->_top->_next = chunk;
+    } else {
+        thiz->_bottom = chunk;
+    }
+    thiz->_top = chunk;
+    thiz->_capacity += C;
+}
+
+/**
+ * Unlinks the top chunk of the given segmented stack (it must be empty) and caches it.
+ * The chunk that was cached before is freed. Doesn't check if the stack is ok, it's up to the caller.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ */
+template <typename T, typename P, size_t C>
+void unlinkTopChunk(SegmentedStack<T, P, C>* const thiz) {
+    StackChunk<T, P, C>* chunk = thiz->_top;
+
+    thiz->_top = chunk->_previous;
+    if (thiz->_top != nullptr) {
+        thiz->_top->_next = nullptr;
+    } else {
+        thiz->_bottom = nullptr;
+    }
+    thiz->_capacity -= C;
+
+    freeStackChunk(thiz, thiz->_cachedChunk);
+    chunk->_previous = nullptr;
+    thiz->_cachedChunk = chunk;
+}
+
+/**
+ * Allocates a new chunk with the stack allocator and sets its canaries.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return pointer to the allocated chunk, or nullptr if there's not enough memory.
+ */
+template <typename T, typename P, size_t C>
+StackChunk<T, P, C>* allocateStackChunk(SegmentedStack<T, P, C>* const thiz) {
+    auto chunk = (StackChunk<T, P, C>*)thiz->_allocator->allocate(thiz->_allocator->context, sizeof(StackChunk<T, P, C>));
+    if (chunk == nullptr) return nullptr;
+
+    if constexpr (P::Canaries::number > 0) {
+        for (size_t i = 0; i < P::Canaries::number; ++i) {
+            chunk->_canariesBefore[i] = canaryValue;
+            chunk->_canariesAfter [i] = canaryValue;
+        }
+    }
+    chunk->_previous = nullptr;
+    chunk->_next = nullptr;
+
+    return chunk;
+}
+
+/**
+ * Frees the given chunk with the stack allocator. Elements of the chunk must be already destructed.
+ * @param[in] thiz  pointer to the stack this operation should be performed on
+ * @param[in] chunk pointer to the chunk to free (can be nullptr)
+ */
+template <typename T, typename P, size_t C>
+void freeStackChunk(SegmentedStack<T, P, C>* const thiz, StackChunk<T, P, C>* const chunk) {
+    if (chunk != nullptr) {
+        thiz->_allocator->deallocate(thiz->_allocator->context, chunk, sizeof(StackChunk<T, P, C>));
+    }
+}
+
+/**
+ * Checks if canaries of the given chunk are correct.
+ * @param[in] chunk pointer to the chunk to check
+ * @return true, if the chunk canaries are correct, false otherwise.
+ */
+template <typename T, typename P, size_t C>
+bool isStackChunkOk(StackChunk<T, P, C>* const chunk) {
+    if constexpr (P::Canaries::number > 0) {
+        for (size_t i = 0; i < P::Canaries::number; ++i) {
+            if (chunk->_canariesBefore[i] != canaryValue) return false;
+            if (chunk->_canariesAfter [i] != canaryValue) return false;
+        }
+    } else {
+        (void)chunk;
+    }
+
+    return true;
+}
+
+/**
+ * Gives the pointer to the slot of the given element.
+ * Walks the chunks from the top, so it's fast for the elements near the top of the stack.
+ * @param[in] thiz  pointer to the stack this operation should be performed on
+ * @param[in] index index of the element (from the bottom of the stack), less than the stack capacity
+ * @return pointer to the element slot.
+ */
+template <typename T, typename P, size_t C>
+T* getStackSlot(SegmentedStack<T, P, C>* const thiz, ssize_t index) {
+    StackChunk<T, P, C>* chunk = thiz->_top;
+    ssize_t chunkBegin = thiz->_capacity - C;
+    while (index < chunkBegin) {
+        chunk = chunk->_previous;
+        chunkBegin -= C;
+    }
+
+    return (T*)chunk->_elements + (index - chunkBegin);
+}
+
+/**
+ * Constructs the new element on top of the segmented stack from the given arguments (in place).
+ * Existing elements are never moved.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] args      arguments of the element constructor
+ */
+template <typename T, typename P, size_t C, typename... Args>
+void emplace(SegmentedStack<T, P, C>* const thiz, Args&&... args) {
+    CHECK_STACK_OK(thiz);
+
+    if (thiz->_size == thiz->_capacity) {
+        enlarge(thiz);
+    }
+    T* slot = getStackSlot(thiz, thiz->_size);
+    new (slot) T(std::forward<Args>(args)...);
+    ++thiz->_size;
+
+    if constexpr (P::Hashing::enabled) {
+        thiz->_belowTopHash = thiz->_dataHash;
+        thiz->_dataHash = hashBytes(thiz->_dataHash, slot, sizeof(T));
+        thiz->_hash = getHash(thiz);
+    }
+
+    CHECK_STACK_OK(thiz);
+}
+
+/**
+ * Pushes the copy of the given element on top of the segmented stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] x         value to put on top of the stack
+ */
+template <typename T, typename P, size_t C>
+void push(SegmentedStack<T, P, C>* const thiz, const StackNonDeduced<T>& x) {
+    emplace(thiz, x);
+}
+
+/**
+ * Moves the given element on top of the segmented stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @param[in] x         value to put on top of the stack
+ */
+template <typename T, typename P, size_t C>
+void push(SegmentedStack<T, P, C>* const thiz, StackNonDeduced<T>&& x) {
+    emplace(thiz, std::move(x));
+}
+
+/**
+ * Removes value from top of the segmented stack. The value is moved out of the stack.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ * @return value that was on top of the stack.
+ */
+template <typename T, typename P, size_t C>
+T pop(SegmentedStack<T, P, C>* const thiz) {
+    CHECK_STACK_OK(thiz);
+    CHECK_STACK_CONDITION(thiz, thiz->_size > 0);
+
+    T* slot = getStackSlot(thiz, --thiz->_size);
+    if constexpr (P::Hashing::enabled) {
+        thiz->_dataHash = thiz->_belowTopHash;
+    }
+
+    T top = std::move(*slot);
+    destructStackElements(slot, 1);
+
+    if (thiz->_size == thiz->_capacity - (ssize_t)C) {
+        unlinkTopChunk(thiz);
+    }
+
+    if constexpr (P::Hashing::enabled) {
+        updateStackBelowTopHash(thiz);
+        thiz->_hash = getHash(thiz);
+    }
+
+    return top;
+}
+
+/**
+ * Gives value from top of the segmented stack without removing it (unlike pop function).
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return reference to the value that is located on top of the stack
+ */
+template <typename T, typename P, size_t C>
+const T& top(SegmentedStack<T, P, C>* const thiz) {
+    CHECK_STACK_OK(thiz);
+    CHECK_STACK_CONDITION(thiz, thiz->_size > 0);
+
+    return *getStackSlot(thiz, thiz->_size - 1);
+}
+
+/**
+ * Gives the number of elements in the given segmented stack.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return size of the stack.
+ */
+template <typename T, typename P, size_t C>
+ssize_t getStackSize(SegmentedStack<T, P, C>* const thiz) {
+    CHECK_STACK_CONDITION(thiz, thiz != nullptr);
+
+    return thiz->_size;
+}
+
+/**
+ * Gives the number of elements that fit into the linked chunks of the given segmented stack.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return capacity of the stack.
+ */
+template <typename T, typename P, size_t C>
+ssize_t getStackCapacity(SegmentedStack<T, P, C>* const thiz) {
+    CHECK_STACK_CONDITION(thiz, thiz != nullptr);
+
+    return thiz->_capacity;
+}
+
+/**
+ * Calculates the hash value of the given segmented stack members (see STACK_HASH_ALGORITHM). Skips _hash member of the stack.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return calculated hash value.
+ */
+template <typename T, typename P, size_t C>
+unsigned long long getHash(SegmentedStack<T, P, C>* const thiz) {
+    CHECK_STACK_CONDITION(thiz, thiz != nullptr);
+
+    char* hashBegin = (char*)&(thiz->_hash);
+    char* hashEnd   = hashBegin + sizeof(thiz->_hash);
+
+    unsigned long long hash = hashBytes(0, thiz, hashBegin - (char*)thiz);
+    return hashBytes(hash, hashEnd, (char*)thiz + sizeof(SegmentedStack<T, P, C>) - hashEnd);
+}
+
+/**
+ * Calculates the hash value of the segmented stack elements from bottom to top (see STACK_HASH_ALGORITHM).
+ * It's equal to the hash of the same elements in ImmortalStack.
+ * @param[in] thiz pointer to the stack this operation should be performed on
+ * @return calculated hash value.
+ */
+template <typename T, typename P, size_t C>
+unsigned long long getDataHash(SegmentedStack<T, P, C>* const thiz) {
+    CHECK_STACK_CONDITION(thiz, thiz != nullptr && thiz->_size >= 0);
+
+    unsigned long long hash = 0;
+    ssize_t chunkBegin = 0;
+    for (StackChunk<T, P, C>* chunk = thiz->_bottom; chunk != nullptr && chunkBegin < thiz->_size; chunk = chunk->_next) {
+        ssize_t chunkSize = thiz->_size - chunkBegin;
+        hash = hashBytes(hash, chunk->_elements, sizeof(T) * ((chunkSize < (ssize_t)C) ? chunkSize : C));
+        chunkBegin += C;
+    }
+
+    return hash;
+}
+
+/**
+ * Updates the hash of the elements below the top one (_belowTopHash) after _dataHash is changed.
+ * @param[in, out] thiz pointer to the stack this operation should be performed on
+ */
+template <typename T, typename P, size_t C>
+void updateStackBelowTopHash(SegmentedStack<T, P, C>* const thiz) {
+    if (thiz->_size > 0) {
+        thiz->_belowTopHash = unhashBytes(thiz->_dataHash, getStackSlot(thiz, thiz->_size - 1), sizeof(T));
+    } else {
+        thiz->_belowTopHash = thiz->_dataHash;
+    }
+}
+
+/**
+ * Logs the members of the given segmented stack (size, capacity, chunks and canaries) into the log file. Used in LOG_STACK.
+ * @param[in] stack stack to log (not nullptr)
+ */
+template <typename T, typename P, size_t C>
+void logStackMembers(SegmentedStack<T, P, C>* const stack) {
+    ssize_t size = stack->_size;
+    ssize_t capacity = stack->_capacity;
+    LOG_VALUE_INDENTED(size, "\t");
+    LOG_VALUE_INDENTED(capacity, "\t");
+
+    ssize_t chunkBegin = 0;
+    ssize_t maxChunksCount = (capacity < 0) ? 0 : capacity / (ssize_t)C;
+    StackChunk<T, P, C>* chunk = stack->_bottom;
+    for (ssize_t chunkIndex = 0; chunk != nullptr && chunkIndex < maxChunksCount; ++chunkIndex) {
+        logPrintf("\tchunk [%zd] [" PTR_FORMAT "] = {\n", chunkIndex, (uintptr_t)chunk);
+
+        T* data = (T*)chunk->_elements;
+        size_t loggedSize = C;
+        if constexpr (!std::is_trivially_copyable<T>::value) {
+            ssize_t chunkSize = (size < chunkBegin) ? 0 : size - chunkBegin;
+            loggedSize = (chunkSize < (ssize_t)C) ? chunkSize : C;
+        }
+        LOG_ARRAY_INDENTED(data, loggedSize, "\t\t");
+
+        if constexpr (P::Canaries::number > 0) {
+            long long* canariesBefore = chunk->_canariesBefore;
+            long long* canariesAfter  = chunk->_canariesAfter;
+            LOG_ARRAY_INDENTED(canariesBefore, P::Canaries::number, "\t\t");
+            LOG_ARRAY_INDENTED(canariesAfter,  P::Canaries::number, "\t\t");
+        }
+        logPrintf("\t}\n");
+
+        chunkBegin += C;
+        chunk = chunk->_next;
+    }
+
+    if constexpr (P::Canaries::number > 0) {
+        long long* canariesBefore = stack->_canariesBefore;
+        long long* canariesAfter  = stack->_canariesAfter;
+        LOG_ARRAY_INDENTED(canariesBefore, P::Canaries::number, "\t");
+        LOG_ARRAY_INDENTED(canariesAfter,  P::Canaries::number, "\t");
+    }
+}
+
+#endif // IMMORTAL_STACK_SEGMENTED_STACK_H
@@ -0,0 +1,690 @@
+/**
+ * @file
+ * @brief Definition and implementation of the binary stack dump format, its block compression and its decoder
+ *
+ * Stacks with StackBinaryDumpLogging policy dump themselves into stackDumpFileName instead of logging each element
+ * as text. Each dump is a StackDumpHeader, followed by the canaries (struct canaries before and after, then data
+ * canaries before and after) and by the raw bytes of the dumped elements. Raw bytes are written with one write call,
+ * or they are split into blocks of STACK_DUMP_BLOCK_BYTES bytes and compressed with an LZ4-like codec.
+ * Each compressed block is preceded by its raw and stored sizes, blocks that don't shrink are stored as is.
+ *
+ * Dumps are appended to the file, so it may contain several of them. Values are written in the native byte order,
+ * so dumps are decoded on the machine that wrote them. stack-dump-decode tool renders the dumps into the text layout
+ * of LOG_STACK (see decodeStackDumps), or only the elements around the given index.
+ */
+#ifndef IMMORTAL_STACK_STACK_DUMP_H
+#define IMMORTAL_STACK_STACK_DUMP_H
+
+#include <cassert>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+#include "environment.h"
+
+/** Size of the compressed blocks of the dumped elements, in bytes */
+#ifndef STACK_DUMP_BLOCK_BYTES
+    #define STACK_DUMP_BLOCK_BYTES (64 * 1024)
+#endif
+
+/** Maximal length of the names in the dump header, including the terminating zero */
+#define STACK_DUMP_NAME_LENGTH 256
+
+/** Signature at the beginning of each dump */
+constexpr char stackDumpMagic[8] = "STKDUMP";
+
+/** Version of the dump format */
+constexpr uint32_t stackDumpVersion = 1;
+
+/** Dump flag: the stack pointer is nullptr, nothing follows the header */
+constexpr uint32_t stackDumpNullStack = 1u << 0;
+
+/** Dump flag: elements are compressed by blocks */
+constexpr uint32_t stackDumpCompressed = 1u << 1;
+
+/** Dump flag: the stack is hashed, hash and dataHash are valid */
+constexpr uint32_t stackDumpHashed = 1u << 2;
+
+/** Kind of the dumped elements, that tells the decoder how to render them */
+enum StackDumpElementKind : uint32_t {
+    STACK_DUMP_BYTES    = 0, ///< Bytes of the element in hex (non-arithmetic types)
+    STACK_DUMP_SIGNED   = 1, ///< Signed integer
+    STACK_DUMP_UNSIGNED = 2, ///< Unsigned integer
+    STACK_DUMP_FLOAT    = 3, ///< Floating point number
+    STACK_DUMP_CHAR     = 4, ///< Character
+    STACK_DUMP_BOOL     = 5  ///< Boolean
+};
+
+/** Header of the binary stack dump */
+struct StackDumpHeader {
+    /** stackDumpMagic */
+    char magic[8];
+
+    /** stackDumpVersion */
+    uint32_t version;
+
+    /** Combination of the dump flags */
+    uint32_t flags;
+
+    /** Name of the stack type (e.g. Stack_int) */
+    char typeName[STACK_DUMP_NAME_LENGTH];
+
+    /** Name of the dumped stack expression */
+    char stackName[STACK_DUMP_NAME_LENGTH];
+
+    /** Name of the source file, where the stack is dumped */
+    char fileName[STACK_DUMP_NAME_LENGTH];
+
+    /** Line of the source file, where the stack is dumped */
+    uint32_t line;
+
+    /** StackDumpElementKind of the elements */
+    uint32_t elementKind;
+
+    /** Size of each element in bytes */
+    uint64_t elementSize;
+
+    /** Address of the stack */
+    uint64_t stackAddress;
+
+    /** Address of the first element */
+    uint64_t dataAddress;
+
+    /** Addresses of the canaries: struct canaries before and after, data canaries before and after */
+    uint64_t canariesAddresses[4];
+
+    /** Size of the stack */
+    int64_t size;
+
+    /** Capacity of the stack */
+    int64_t capacity;
+
+    /** Hash of the stack members */
+    uint64_t hash;
+
+    /** Hash of the elements */
+    uint64_t dataHash;
+
+    /** Number of the struct canaries at each side of the stack struct */
+    uint64_t canariesNumber;
+
+    /** Number of the data canaries at each side of the data array */
+    uint64_t dataCanariesNumber;
+
+    /** Number of the dumped elements */
+    uint64_t dumpedElements;
+};
+
+/** Window of the elements that are rendered by the decoder */
+struct StackDumpWindow {
+    /** Index of the element in the center of the window */
+    uint64_t index;
+
+    /** Number of the elements that are rendered at each side of the center */
+    uint64_t radius;
+};
+
+/**
+ * Gives the kind of the dumped elements of the given type.
+ * @return kind of the elements (StackDumpElementKind).
+ */
+template <typename T>
+constexpr uint32_t getStackDumpElementKind();
+
+/**
+ * Compresses the block of bytes with LZ4-like codec: sequences of literals, each followed by a match
+ * (offset back into the block and length of at least 4 bytes).
+ * @param[in] source      bytes to compress
+ * @param[in] size        number of the bytes
+ * @param[out] compressed buffer of size bytes for the compressed bytes
+ * @return number of the compressed bytes, or 0 if the block doesn't shrink.
+ */
+inline size_t compressStackDumpBlock(const unsigned char* source, size_t size, unsigned char* compressed);
+
+/**
+ * Decompresses the block of bytes that is compressed by compressStackDumpBlock.
+ * @param[in] compressed     compressed bytes
+ * @param[in] compressedSize number of the compressed bytes
+ * @param[out] block         buffer for the decompressed bytes
+ * @param[in] size           number of the decompressed bytes
+ * @return true, if the block is decompressed, false if it's malformed.
+ */
+inline bool decompressStackDumpBlock(const unsigned char* compressed, size_t compressedSize,
+                                     unsigned char* block, size_t size);
+
+/**
+ * Writes the dumped elements into the file as compressed blocks.
+ * @param[in, out] file dump file
+ * @param[in] bytes     bytes of the elements
+ * @param[in] size      number of the bytes
+ * @return true, if the bytes are written, false otherwise.
+ */
+inline bool writeStackDumpBlocks(FILE* file, const void* bytes, uint64_t size);
+
+/**
+ * Renders all dumps from the dump file into the text layout of LOG_STACK.
+ * @param[in, out] dump dump file
+ * @param[in, out] text file to render into
+ * @param[in] window    window of the rendered elements, or nullptr to render all of them
+ * @return number of the rendered dumps, or -1 if the dump file is malformed.
+ */
+inline long decodeStackDumps(FILE* dump, FILE* text, const StackDumpWindow* window = nullptr);
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * Gives the kind of the dumped elements of the given type.
+ * @return kind of the elements (StackDumpElementKind).
+ */
+template <typename T>
+constexpr uint32_t getStackDumpElementKind() {
+    if constexpr (std::is_same<T, bool>::value) {
+        return STACK_DUMP_BOOL;
+    } else if constexpr (std::is_same<T, char>::value) {
+        return STACK_DUMP_CHAR;
+    } else if constexpr (std::is_floating_point<T>::value) {
+        return STACK_DUMP_FLOAT;
+    } else if constexpr (std::is_integral<T>::value && std::is_signed<T>::value) {
+        return STACK_DUMP_SIGNED;
+    } else if constexpr (std::is_integral<T>::value) {
+        return STACK_DUMP_UNSIGNED;
+    } else {
+        return STACK_DUMP_BYTES;
+    }
+}
+
+/** Minimal length of the match in the compressed block */
+constexpr size_t stackDumpMinMatch = 4;
+
+/** Number of the bytes at the end of the block, that are always literals */
+constexpr size_t stackDumpLastLiterals = 5;
+
+/** Number of the entries in the match finder hash table (a power of two) */
+constexpr size_t stackDumpHashTableSize = 4096;
+
+/**
+ * Reads 4 bytes for the match finder.
+ * @param[in] bytes bytes to read
+ * @return read bytes as a number.
+ */
+inline uint32_t readStackDumpWord(const unsigned char* bytes) {
+    uint32_t word = 0;
+    memcpy(&word, bytes, sizeof(word));
+    return word;
+}
+
+/**
+ * Writes the length of the sequence part, that doesn't fit into its token nibble.
+ * @param[in, out] output position in the compressed block
+ * @param[in] end         end of the compressed block
+ * @param[in] length      length minus 15
+ * @return new position, or nullptr if the block is full.
+ */
+inline unsigned char* writeStackDumpLength(unsigned char* output, const unsigned char* end, size_t length) {
+    for (; length >= 255; length -= 255) {
+        if (output == end) return nullptr;
+        *output++ = 255;
+    }
+    if (output == end) return nullptr;
+    *output++ = (unsigned char)length;
+    return output;
+}
+
+/**
+ * Writes the sequence of literals, optionally followed by a match, into the compressed block.
+ * @param[in, out] output position in the compressed block
+ * @param[in] end         end of the compressed block
+ * @param[in] literals    literal bytes
+ * @param[in] literalsNumber number of the literal bytes
+ * @param[in] offset      offset of the match back from its position
+ * @param[in] matchLength length of the match, or 0 for the last sequence
+ * @return new position, or nullptr if the block is full.
+ */
+inline unsigned char* writeStackDumpSequence(unsigned char* output, const unsigned char* end,
+                                             const unsigned char* literals, size_t literalsNumber,
+                                             size_t offset, size_t matchLength) {
+    if (output == end) return nullptr;
+    unsigned char* token = output++;
+    const size_t matchCode = (matchLength == 0) ? 0 : matchLength - stackDumpMinMatch;
+    *token = (unsigned char)(((literalsNumber < 15) ? literalsNumber : 15) << 4 | ((matchCode < 15) ? matchCode : 15));
+
+    if (literalsNumber >= 15 && (output = writeStackDumpLength(output, end, literalsNumber - 15)) == nullptr) {
+        return nullptr;
+    }
+    if ((size_t)(end - output) < literalsNumber) return nullptr;
+    memcpy(output, literals, literalsNumber);
+    output += literalsNumber;
+
+    if (matchLength == 0) return output;
+
+    if (end - output < 2) return nullptr;
+    *output++ = (unsigned char)(offset & 0xFF);
+    *output++ = (unsigned char)(offset >> 8);
+    if (matchCode >= 15) return writeStackDumpLength(output, end, matchCode - 15);
+    return output;
+}
+
+/**
+ * Compresses the block of bytes with LZ4-like codec: sequences of literals, each followed by a match
+ * (offset back into the block and length of at least 4 bytes).
+ * @param[in] source      bytes to compress
+ * @param[in] size        number of the bytes
+ * @param[out] compressed buffer of size bytes for the compressed bytes
+ * @return number of the compressed bytes, or 0 if the block doesn't shrink.
+ */
+inline size_t compressStackDumpBlock(const unsigned char* const source, const size_t size,
+                                     unsigned char* const compressed) {
+    assert(source != nullptr);
+    assert(compressed != nullptr);
+
+    // Positions are stored plus one, so zero means an empty entry
+    uint32_t positions[stackDumpHashTableSize] = {};
+    unsigned char* output = compressed;
+    const unsigned char* end = compressed + size;
+
+    size_t anchor = 0;
+    size_t position = 0;
+    while (size >= stackDumpLastLiterals + stackDumpMinMatch &&
+           position + stackDumpMinMatch <= size - stackDumpLastLiterals) {
+        const uint32_t word = readStackDumpWord(source + position);
+        const size_t hash = (word * 2654435761u) >> 20 & (stackDumpHashTableSize - 1);
+        const size_t candidate = positions[hash];
+        positions[hash] = (uint32_t)(position + 1);
+
+        if (candidate == 0 || position - (candidate - 1) > 0xFFFF ||
+            readStackDumpWord(source + candidate - 1) != word) {
+            ++position;
+            continue;
+        }
+
+        const size_t match = candidate - 1;
+        size_t matchLength = stackDumpMinMatch;
+        while (position + matchLength < size - stackDumpLastLiterals &&
+               source[match + matchLength] == source[position + matchLength]) {
+            ++matchLength;
+        }
+
+        output = writeStackDumpSequence(output, end, source + anchor, position - anchor, position - match, matchLength);
+        if (output == nullptr) return 0;
+
+        position += matchLength;
+        anchor = position;
+    }
+
+    output = writeStackDumpSequence(output, end, source + anchor, size - anchor, 0, 0);
+    if (output == nullptr || output == end) return 0;
+
+    return output - compressed;
+}
+
+/**
+ * Reads the length of the sequence part, that doesn't fit into its token nibble, and adds it to the length.
+ * @param[in, out] input position in the compressed block
+ * @param[in] end        end of the compressed block
+ * @param[in, out] length length to add to
+ * @return true, if the length is read, false if the block ends.
+ */
+inline bool readStackDumpLength(const unsigned char** input, const unsigned char* end, size_t* length) {
+    unsigned char byte = 255;
+    while (byte == 255) {
+        if (*input == end) return false;
+        byte = *(*input)++;
+        *length += byte;
+    }
+    return true;
+}
+
+/**
+ * Decompresses the block of bytes that is compressed by compressStackDumpBlock.
+ * @param[in] compressed     compressed bytes
+ * @param[in] compressedSize number of the compressed bytes
+ * @param[out] block         buffer for the decompressed bytes
+ * @param[in] size           number of the decompressed bytes
+ * @return true, if the block is decompressed, false if it's malformed.
+ */
+inline bool decompressStackDumpBlock(const unsigned char* const compressed, const size_t compressedSize,
+                                     unsigned char* const block, const size_t size) {
+    assert(compressed != nullptr);
+    assert(block != nullptr);
+
+    const unsigned char* input = compressed;
+    const unsigned char* inputEnd = compressed + compressedSize;
+    size_t position = 0;
+
+    while (input < inputEnd) {
+        const unsigned char token = *input++;
+
+        size_t literalsNumber = token >> 4;
+        if (literalsNumber == 15 && !readStackDumpLength(&input, inputEnd, &literalsNumber)) return false;
+        if ((size_t)(inputEnd - input) < literalsNumber || size - position < literalsNumber) return false;
+        memcpy(block + position, input, literalsNumber);
+        input += literalsNumber;
+        position += literalsNumber;
+
+        // The last sequence has no match
+        if (input == inputEnd) break;
+
+        if (inputEnd - input < 2) return false;
+        const size_t offset = input[0] | (size_t)input[1] << 8;
+        input += 2;
+
+        size_t matchLength = (token & 15);
+        if (matchLength == 15 && !readStackDumpLength(&input, inputEnd, &matchLength)) return false;
+        matchLength += stackDumpMinMatch;
+
+        if (offset == 0 || offset > position || size - position < matchLength) return false;
+        // Match may overlap the bytes it produces, so it's copied byte by byte
+        for (size_t i = 0; i < matchLength; ++i, ++position) {
+            block[position] = block[position - offset];
+        }
+    }
+
+    return position == size;
+}
+
+/**
+ * Writes the dumped elements into the file as compressed blocks.
+ * @param[in, out] file dump file
+ * @param[in] bytes     bytes of the elements
+ * @param[in] size      number of the bytes
+ * @return true, if the bytes are written, false otherwise.
+ */
+inline bool writeStackDumpBlocks(FILE* const file, const void* const bytes, const uint64_t size) {
+    assert(file != nullptr);
+    assert(bytes != nullptr || size == 0);
+
+    unsigned char* compressed = (unsigned char*)malloc(STACK_DUMP_BLOCK_BYTES);
+    if (compressed == nullptr) return false;
+
+    bool isWritten = true;
+    for (uint64_t offset = 0; offset < size && isWritten; offset += STACK_DUMP_BLOCK_BYTES) {
+        const unsigned char* block = (const unsigned char*)bytes + offset;
+        const uint32_t blockSize = (uint32_t)((size - offset < STACK_DUMP_BLOCK_BYTES) ? size - offset
+                                                                                       : STACK_DUMP_BLOCK_BYTES);
+        const uint32_t compressedSize = (uint32_t)compressStackDumpBlock(block, blockSize, compressed);
+        const uint32_t sizes[2] = {blockSize, (compressedSize == 0) ? blockSize : compressedSize};
+
+        isWritten = fwrite(sizes, sizeof(sizes), 1, file) == 1 &&
+                    fwrite((compressedSize == 0) ? block : compressed, sizes[1], 1, file) == 1;
+    }
+
+    free(compressed);
+    return isWritten;
+}
+
+/** Reader of the dumped elements, that decompresses them block by block */
+struct StackDumpReader {
+    /** Dump file */
+    FILE* file;
+
+    /** Elements are compressed */
+    bool compressed;
+
+    /** Number of the raw bytes that are not read yet, including the bytes in the block */
+    uint64_t remaining;
+
+    /** Current block of the raw bytes (used only for the compressed elements) */
+    unsigned char* block;
+
+    /** Buffer for the compressed block */
+    unsigned char* compressedBlock;
+
+    /** Number of the bytes in the current block */
+    size_t blockSize;
+
+    /** Position of the next byte in the current block */
+    size_t blockPosition;
+};
+
+/**
+ * Reads the next compressed block, or skips it without decompressing.
+ * @param[in, out] reader reader of the elements
+ * @param[in] skip        block should be skipped
+ * @return true, if the block is read, false if it's malformed.
+ */
+inline bool readStackDumpBlock(StackDumpReader* const reader, const bool skip) {
+    uint32_t sizes[2] = {};
+    if (fread(sizes, sizeof(sizes), 1, reader->file) != 1) return false;
+    if (sizes[0] > STACK_DUMP_BLOCK_BYTES || sizes[1] > sizes[0] || sizes[0] > reader->remaining) return false;
+
+    reader->blockSize = sizes[0];
+    reader->blockPosition = 0;
+    if (skip) return fseek(reader->file, sizes[1], SEEK_CUR) == 0;
+
+    if (sizes[1] == sizes[0]) return fread(reader->block, sizes[0], 1, reader->file) == 1;
+    return fread(reader->compressedBlock, sizes[1], 1, reader->file) == 1 &&
+           decompressStackDumpBlock(reader->compressedBlock, sizes[1], reader->block, sizes[0]);
+}
+
+/**
+ * Reads (or skips) the next dumped bytes.
+ * @param[in, out] reader reader of the elements
+ * @param[out] bytes      buffer for the bytes, or nullptr to skip them
+ * @param[in] size        number of the bytes
+ * @return true, if the bytes are read, false if the dump is malformed.
+ */
+inline bool readStackDumpBytes(StackDumpReader* const reader, unsigned char* bytes, uint64_t size) {
+    if (size > reader->remaining) return false;
+
+    if (!reader->compressed) {
+        reader->remaining -= size;
+        if (bytes == nullptr) return fseek(reader->file, (long)size, SEEK_CUR) == 0;
+        return size == 0 || fread(bytes, size, 1, reader->file) == 1;
+    }
+
+    while (size > 0) {
+        if (reader->blockPosition == reader->blockSize) {
+            // Blocks, that are skipped entirely, are not decompressed (only the last block is shorter)
+            const uint64_t nextBlockSize = (reader->remaining < STACK_DUMP_BLOCK_BYTES) ? reader->remaining
+                                                                                        : STACK_DUMP_BLOCK_BYTES;
+            const bool skip = (bytes == nullptr && size >= nextBlockSize);
+            if (!readStackDumpBlock(reader, skip)) return false;
+            if (skip) {
+                reader->blockPosition = reader->blockSize;
+                reader->remaining -= reader->blockSize;
+                size -= reader->blockSize;
+                continue;
+            }
+        }
+
+        const size_t available = reader->blockSize - reader->blockPosition;
+        const size_t chunk = (size < available) ? (size_t)size : available;
+        if (bytes != nullptr) {
+            memcpy(bytes, reader->block + reader->blockPosition, chunk);
+            bytes += chunk;
+        }
+        reader->blockPosition += chunk;
+        reader->remaining -= chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+/**
+ * Renders the dumped element as logValue does.
+ * @param[in, out] text  file to render into
+ * @param[in] header     header of the dump
+ * @param[in] element    bytes of the element
+ */
+inline void printStackDumpElement(FILE* const text, const StackDumpHeader* const header,
+                                  const unsigned char* const element) {
+    const size_t size = header->elementSize;
+    switch (header->elementKind) {
+        case STACK_DUMP_BOOL:
+            fprintf(text, "%s", (element[0] != 0) ? "true" : "false");
+            return;
+        case STACK_DUMP_CHAR:
+            fprintf(text, "%c", (char)element[0]);
+            return;
+        case STACK_DUMP_SIGNED:
+            if (size == 1) { int8_t  value; memcpy(&value, element, size); fprintf(text, "%hhd", value); return; }
+            if (size == 2) { int16_t value; memcpy(&value, element, size); fprintf(text, "%hd",  value); return; }
+            if (size == 4) { int32_t value; memcpy(&value, element, size); fprintf(text, "%d",   value); return; }
+            if (size == 8) { int64_t value; memcpy(&value, element, size); fprintf(text, "%" PRId64, value); return; }
+            break;
+        case STACK_DUMP_UNSIGNED:
+            if (size == 1) { uint8_t  value; memcpy(&value, element, size); fprintf(text, "%hhu", value); return; }
+            if (size == 2) { uint16_t value; memcpy(&value, element, size); fprintf(text, "%hu",  value); return; }
+            if (size == 4) { uint32_t value; memcpy(&value, element, size); fprintf(text, "%u",   value); return; }
+            if (size == 8) { uint64_t value; memcpy(&value, element, size); fprintf(text, "%" PRIu64, value); return; }
+            break;
+        case STACK_DUMP_FLOAT:
+            if (size == sizeof(float))  { float  value; memcpy(&value, element, size); fprintf(text, "%lg", value); return; }
+            if (size == sizeof(double)) { double value; memcpy(&value, element, size); fprintf(text, "%lg", value); return; }
+            if (size == sizeof(long double)) {
+                long double value;
+                memcpy(&value, element, size);
+                fprintf(text, "%Lg", value);
+                return;
+            }
+            break;
+        default:
+            break;
+    }
+
+    fprintf(text, "{");
+    for (size_t i = 0; i < size; ++i) {
+        fprintf(text, " %02X", element[i]);
+    }
+    fprintf(text, " }");
+}
+
+/**
+ * Renders the dumped canaries as LOG_ARRAY_INDENTED does.
+ * @param[in, out] text file to render into
+ * @param[in] name      name of the canaries array
+ * @param[in] address   address of the canaries array
+ * @param[in] canaries  values of the canaries
+ * @param[in] number    number of the canaries
+ */
+inline void printStackDumpCanaries(FILE* const text, const char* const name, const uint64_t address,
+                                   const long long* const canaries, const uint64_t number) {
+    fprintf(text, "\t%s [" PTR_FORMAT "] = {\n", name, (uintptr_t)address);
+    for (uint64_t i = 0; i < number; ++i) {
+        fprintf(text, "\t\t[%" PRIu64 "] = %lld\n", i, canaries[i]);
+    }
+    fprintf(text, "\t}\n");
+}
+
+/**
+ * Renders the dump, whose header is already read, into the text layout of LOG_STACK.
+ * @param[in, out] dump dump file
+ * @param[in, out] text file to render into
+ * @param[in] header    header of the dump
+ * @param[in] window    window of the rendered elements, or nullptr to render all of them
+ * @return true, if the dump is rendered, false if it's malformed.
+ */
+inline bool decodeStackDump(FILE* const dump, FILE* const text, const StackDumpHeader* const header,
+                            const StackDumpWindow* const window) {
+    fprintf(text, "%s %s [" PTR_FORMAT "] (%s:%u)", header->typeName, header->stackName,
+            (uintptr_t)header->stackAddress, header->fileName, header->line);
+    if (header->flags & stackDumpNullStack) {
+        fprintf(text, "\n");
+        return true;
+    }
+    fprintf(text, " = {\n");
+    fprintf(text, "\tsize = %" PRId64 "\n", header->size);
+    fprintf(text, "\tcapacity = %" PRId64 "\n", header->capacity);
+    if (header->flags & stackDumpHashed) {
+        fprintf(text, "\thash = %" PRIu64 "\n", header->hash);
+        fprintf(text, "\tdataHash = %" PRIu64 "\n", header->dataHash);
+    }
+
+    const uint64_t canariesNumber = 2 * (header->canariesNumber + header->dataCanariesNumber);
+    if (header->elementSize == 0 || canariesNumber > 1024 || header->elementSize > STACK_DUMP_BLOCK_BYTES) return false;
+    long long canaries[1024] = {};
+    if (canariesNumber > 0 && fread(canaries, sizeof(long long) * canariesNumber, 1, dump) != 1) return false;
+
+    unsigned char* element = (unsigned char*)malloc(header->elementSize);
+    StackDumpReader reader = {dump, (header->flags & stackDumpCompressed) != 0,
+                              header->dumpedElements * header->elementSize, nullptr, nullptr, 0, 0};
+    if (reader.compressed) {
+        reader.block = (unsigned char*)malloc(STACK_DUMP_BLOCK_BYTES);
+        reader.compressedBlock = (unsigned char*)malloc(STACK_DUMP_BLOCK_BYTES);
+    }
+    bool isDecoded = element != nullptr && (!reader.compressed || (reader.block && reader.compressedBlock));
+
+    fprintf(text, "\tdata [" PTR_FORMAT "]", (uintptr_t)header->dataAddress);
+    if (header->dataAddress == 0) {
+        fprintf(text, "\n");
+    } else {
+        uint64_t first = 0;
+        uint64_t last = header->dumpedElements;
+        if (window != nullptr) {
+            first = (window->index > window->radius) ? window->index - window->radius : 0;
+            // Compared without the sum, because index + radius + 1 overflows for the large radius
+            if (window->index < last && window->radius < last - window->index - 1) {
+                last = window->index + window->radius + 1;
+            }
+            if (first > last) first = last;
+        }
+
+        fprintf(text, " = {\n");
+        if (first > 0) fprintf(text, "\t\t...\n");
+        isDecoded = isDecoded && readStackDumpBytes(&reader, nullptr, first * header->elementSize);
+        for (uint64_t i = first; i < last && isDecoded; ++i) {
+            isDecoded = readStackDumpBytes(&reader, element, header->elementSize);
+            if (isDecoded) {
+                fprintf(text, "\t\t[%" PRIu64 "] = ", i);
+                printStackDumpElement(text, header, element);
+                fprintf(text, "\n");
+            }
+        }
+        if (last < header->dumpedElements) fprintf(text, "\t\t...\n");
+        isDecoded = isDecoded && readStackDumpBytes(&reader, nullptr, reader.remaining);
+        fprintf(text, "\t}\n");
+    }
+
+    const long long* canariesPart = canaries;
+    if (header->canariesNumber > 0) {
+        printStackDumpCanaries(text, "canariesBefore", header->canariesAddresses[0], canariesPart, header->canariesNumber);
+        canariesPart += header->canariesNumber;
+        printStackDumpCanaries(text, "canariesAfter",  header->canariesAddresses[1], canariesPart, header->canariesNumber);
+        canariesPart += header->canariesNumber;
+    }
+    if (header->dataCanariesNumber > 0) {
+        printStackDumpCanaries(text, "dataCanariesBefore", header->canariesAddresses[2], canariesPart,
+                               header->dataCanariesNumber);
+        canariesPart += header->dataCanariesNumber;
+        printStackDumpCanaries(text, "dataCanariesAfter",  header->canariesAddresses[3], canariesPart,
+                               header->dataCanariesNumber);
+    }
+    fprintf(text, "}\n");
+
+    free(element);
+    free(reader.block);
+    free(reader.compressedBlock);
+    return isDecoded;
+}
+
+/**
+ * Renders all dumps from the dump file into the text layout of LOG_STACK.
+ * @param[in, out] dump dump file
+ * @param[in, out] text file to render into
+ * @param[in] window    window of the rendered elements, or nullptr to render all of them
+ * @return number of the rendered dumps, or -1 if the dump file is malformed.
+ */
+inline long decodeStackDumps(FILE* const dump, FILE* const text, const StackDumpWindow* const window) {
+    assert(dump != nullptr);
+    assert(text != nullptr);
+
+    long dumpsNumber = 0;
+    StackDumpHeader header = {};
+    while (fread(&header, sizeof(header), 1, dump) == 1) {
+        if (memcmp(header.magic, stackDumpMagic, sizeof(stackDumpMagic)) != 0 || header.version != stackDumpVersion) {
+            return -1;
+        }
+        header.typeName [STACK_DUMP_NAME_LENGTH - 1] = '\0';
+        header.stackName[STACK_DUMP_NAME_LENGTH - 1] = '\0';
+        header.fileName [STACK_DUMP_NAME_LENGTH - 1] = '\0';
+
+        if (!decodeStackDump(dump, text, &header, window)) return -1;
+        ++dumpsNumber;
+    }
+
+    return dumpsNumber;
+}
+
+#endif // IMMORTAL_STACK_STACK_DUMP_H
@@ -0,0 +1,323 @@
+/**
+ * @file
+ * @brief Definition and implementation of the stack tracing: per-thread rings of the operation events
+ *        and their export into Chrome trace_event JSON
+ *
+ * Trace points are compiled in when STACK_TRACE is 1 (it's 0 by default, then STACK_TRACE_SCOPE expands to nothing).
+ * Each trace point records the name of the operation, the stack address and the timestamps of its beginning and end
+ * into the ring of the current thread. Timestamps are TSC ticks on x86 (they are converted into microseconds
+ * when the trace is written) and nanoseconds of the steady clock otherwise.
+ *
+ * Ring keeps the last STACK_TRACE_RING_EVENTS events of the thread, only the thread writes into it.
+ * Ring of the finished thread keeps its events until another thread takes the ring.
+ * writeStackTrace writes the events of all rings as complete ("X") events, that can be opened in Perfetto
+ * or chrome://tracing. Events, that are overwritten while they are written, are skipped.
+ */
+#ifndef IMMORTAL_STACK_TRACE_H
+#define IMMORTAL_STACK_TRACE_H
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "environment.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <unistd.h>
+#endif
+
+/** Trace points record the events of the stack operations, if it's 1 */
+#ifndef STACK_TRACE
+    #define STACK_TRACE 0
+#endif
+
+/** Number of the events in the ring of each thread */
+#ifndef STACK_TRACE_RING_EVENTS
+    #define STACK_TRACE_RING_EVENTS 16384
+#endif
+
+/** Maximal number of threads that record the events at the same time. Other threads record nothing */
+#ifndef STACK_TRACE_MAX_THREADS
+    #define STACK_TRACE_MAX_THREADS 64
+#endif
+
+/** Event of the stack operation */
+struct StackTraceEvent {
+    /** Name of the operation (string literal) */
+    const char* name;
+
+    /** Address of the stack */
+    const void* stack;
+
+    /** Timestamp of the beginning of the operation */
+    unsigned long long begin;
+
+    /** Timestamp of the end of the operation */
+    unsigned long long end;
+};
+
+/** Ring of the events of one thread */
+struct StackTraceRing {
+    /** Ring is taken by a running thread */
+    std::atomic<bool> taken;
+
+    /** Number of the events that are recorded into the ring, the last one is at (head - 1) % STACK_TRACE_RING_EVENTS */
+    std::atomic<size_t> head;
+
+    /** Number of the thread that records the events (tid of the trace) */
+    std::atomic<unsigned> threadNumber;
+
+    /** Events, allocated when the ring is taken for the first time */
+    std::atomic<StackTraceEvent*> events;
+};
+
+/** Owner of the ring of the current thread, that releases the ring when the thread finishes */
+struct StackTraceRingOwner {
+    /** Ring of the thread, or nullptr if the thread hasn't recorded anything yet */
+    StackTraceRing* ring = nullptr;
+
+    /** Thread has found no free ring, so it doesn't record the events */
+    bool untraced = false;
+
+    ~StackTraceRingOwner();
+};
+
+/** Timestamps of the beginning of the trace, that convert the ticks into the time */
+struct StackTraceEpoch {
+    /** Ticks at the beginning of the trace */
+    unsigned long long ticks;
+
+    /** Nanoseconds of the steady clock at the beginning of the trace */
+    long long nanoseconds;
+};
+
+/** Global rings of the threads */
+inline StackTraceRing stackTraceRings[STACK_TRACE_MAX_THREADS];
+
+/** Ring of the current thread */
+inline thread_local StackTraceRingOwner stackTraceRingOwner;
+
+/** Number of the threads that have taken the rings */
+inline std::atomic<unsigned> stackTraceThreadsNumber{0};
+
+/**
+ * Gives the timestamp of the trace events: TSC on x86, nanoseconds of the steady clock otherwise.
+ * @return timestamp in ticks.
+ */
+inline unsigned long long readStackTraceTicks();
+
+/**
+ * Gives nanoseconds of the steady clock.
+ * @return nanoseconds since the clock epoch.
+ */
+inline long long readStackTraceNanoseconds();
+
+/** Beginning of the trace, it's the start of the program */
+inline const StackTraceEpoch stackTraceEpoch = {readStackTraceTicks(), readStackTraceNanoseconds()};
+
+/**
+ * Gives the ring of the current thread, takes a free one at the first call.
+ * @return ring of the thread, or nullptr if there are no free rings.
+ */
+inline StackTraceRing* getStackTraceRing();
+
+/**
+ * Records the event into the ring of the current thread.
+ * @param[in] name  name of the operation (string literal)
+ * @param[in] stack address of the stack
+ * @param[in] begin timestamp of the beginning of the operation
+ * @param[in] end   timestamp of the end of the operation
+ */
+inline void recordStackTraceEvent(const char* name, const void* stack, unsigned long long begin, unsigned long long end);
+
+/**
+ * Writes the events of all rings into the file in Chrome trace_event JSON format.
+ * @param[in] fileName name of the file
+ * @return number of the written events, or -1 if the file can't be written.
+ */
+inline long writeStackTrace(const char* fileName);
+
+/** Records the event of the operation, that lasts while the scope exists */
+struct StackTraceScope {
+    /** Name of the operation */
+    const char* name;
+
+    /** Address of the stack */
+    const void* stack;
+
+    /** Timestamp of the beginning of the operation */
+    unsigned long long begin;
+
+    StackTraceScope(const char* name, const void* stack);
+    ~StackTraceScope();
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * Records the event of the operation on the stack, that lasts till the end of the current scope.
+ *
+ * Works when tracing is turned on.
+ */
+#if STACK_TRACE
+    #define STACK_TRACE_SCOPE(name, stack) StackTraceScope stackTraceScope(name, stack)
+#else
+    #define STACK_TRACE_SCOPE(name, stack) ((void)0)
+#endif
+
+/**
+ * Gives the timestamp of the trace events: TSC on x86, nanoseconds of the steady clock otherwise.
+ * @return timestamp in ticks.
+ */
+inline unsigned long long readStackTraceTicks() {
+    #if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+    #else
+        return readStackTraceNanoseconds();
+    #endif
+}
+
+/**
+ * Gives nanoseconds of the steady clock.
+ * @return nanoseconds since the clock epoch.
+ */
+inline long long readStackTraceNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+}
+
+/**
+ * Gives the ring of the current thread, takes a free one at the first call.
+ * @return ring of the thread, or nullptr if there are no free rings.
+ */
+inline StackTraceRing* getStackTraceRing() {
+    StackTraceRingOwner& owner = stackTraceRingOwner;
+    if (owner.ring != nullptr || owner.untraced) return owner.ring;
+
+    for (StackTraceRing& ring : stackTraceRings) {
+        bool taken = false;
+        if (ring.taken.compare_exchange_strong(taken, true)) {
+            // Events of the previous owner are dropped, so they are not attributed to this thread
+            ring.head.store(0, std::memory_order_release);
+            if (ring.events.load() == nullptr) {
+                ring.events.store(new StackTraceEvent[STACK_TRACE_RING_EVENTS]);
+            }
+            ring.threadNumber.store(++stackTraceThreadsNumber, std::memory_order_release);
+            owner.ring = &ring;
+            return owner.ring;
+        }
+    }
+
+    owner.untraced = true;
+    return nullptr;
+}
+
+/**
+ * Releases the ring of the finishing thread. Events stay in the ring until another thread takes it.
+ */
+inline StackTraceRingOwner::~StackTraceRingOwner() {
+    if (ring != nullptr) {
+        ring->taken.store(false, std::memory_order_release);
+        ring = nullptr;
+    }
+}
+
+/**
+ * Records the event into the ring of the current thread.
+ * @param[in] name  name of the operation (string literal)
+ * @param[in] stack address of the stack
+ * @param[in] begin timestamp of the beginning of the operation
+ * @param[in] end   timestamp of the end of the operation
+ */
+inline void recordStackTraceEvent(const char* const name, const void* const stack, const unsigned long long begin,
+                                  const unsigned long long end) {
+    StackTraceRing* ring = getStackTraceRing();
+    if (ring == nullptr) return;
+
+    const size_t head = ring->head.load(std::memory_order_relaxed);
+    ring->events.load(std::memory_order_relaxed)[head % STACK_TRACE_RING_EVENTS] = {name, stack, begin, end};
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+/**
+ * Starts the event of the operation.
+ * @param[in] name  name of the operation (string literal)
+ * @param[in] stack address of the stack
+ */
+inline StackTraceScope::StackTraceScope(const char* const name, const void* const stack) :
+    name(name), stack(stack), begin(readStackTraceTicks()) {}
+
+/**
+ * Records the event of the operation.
+ */
+inline StackTraceScope::~StackTraceScope() {
+    recordStackTraceEvent(name, stack, begin, readStackTraceTicks());
+}
+
+/**
+ * Writes the events of all rings into the file in Chrome trace_event JSON format.
+ * @param[in] fileName name of the file
+ * @return number of the written events, or -1 if the file can't be written.
+ */
+inline long writeStackTrace(const char* const fileName) {
+    assert(fileName != nullptr);
+
+    // Ticks are converted into the time by the ratio of the ticks and the nanoseconds since the epoch
+    const unsigned long long nowTicks = readStackTraceTicks();
+    const long long nowNanoseconds = readStackTraceNanoseconds();
+    double nanosecondsPerTick = 1;
+    if (nowTicks > stackTraceEpoch.ticks) {
+        nanosecondsPerTick = (double)(nowNanoseconds - stackTraceEpoch.nanoseconds) /
+                             (double)(nowTicks - stackTraceEpoch.ticks);
+    }
+
+    FILE* file = fopen(fileName, "w");
+    if (file == nullptr) return -1;
+
+    #if defined(__unix__) || defined(__APPLE__)
+        const long processId = getpid();
+    #else
+        const long processId = 1;
+    #endif
+
+    long eventsNumber = 0;
+    std::vector<StackTraceEvent> events;
+    fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+    for (StackTraceRing& ring : stackTraceRings) {
+        const StackTraceEvent* ringEvents = ring.events.load();
+        if (ringEvents == nullptr) continue;
+
+        const size_t head = ring.head.load(std::memory_order_acquire);
+        const size_t first = (head > STACK_TRACE_RING_EVENTS) ? head - STACK_TRACE_RING_EVENTS : 0;
+        const unsigned threadNumber = ring.threadNumber.load(std::memory_order_acquire);
+        events.assign(ringEvents, ringEvents + STACK_TRACE_RING_EVENTS);
+
+        // Events, that the thread has overwritten meanwhile, are skipped, and so is the slot it may be writing now
+        const size_t newHead = ring.head.load(std::memory_order_acquire);
+        const size_t keptEnd = ring.taken.load(std::memory_order_acquire) ? newHead + 1 : newHead;
+        const size_t firstKept = (keptEnd > STACK_TRACE_RING_EVENTS) ? keptEnd - STACK_TRACE_RING_EVENTS : 0;
+        for (size_t i = (first > firstKept) ? first : firstKept; i < head; ++i) {
+            const StackTraceEvent& event = events[i % STACK_TRACE_RING_EVENTS];
+            const double begin    = (double)(long long)(event.begin - stackTraceEpoch.ticks) * nanosecondsPerTick;
+            const double duration = (double)(event.end - event.begin) * nanosecondsPerTick;
+            fprintf(file, "%s\n{\"name\": \"%s\", \"cat\": \"stack\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, "
+                          "\"pid\": %ld, \"tid\": %u, \"args\": {\"stack\": \"" PTR_FORMAT "\"}}",
+                    (eventsNumber == 0) ? "" : ",", event.name, begin / 1000, duration / 1000,
+                    processId, threadNumber, (uintptr_t)event.stack);
+            ++eventsNumber;
+        }
+    }
+    fprintf(file, "\n]}\n");
+
+    if (fclose(file) != 0) return -1;
+    return eventsNumber;
+}
+
+#endif // IMMORTAL_STACK_TRACE_H
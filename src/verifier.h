@@ -0,0 +1,451 @@
+/**
+ * @file
+ * @brief Definition and implementation of the stack registry, the background verifier and the check sampling
+ *
+ * Stacks with StackBackgroundVerification policy join the registry when they are constructed
+ * and leave it when they are destructed. Their operations check only the stack members (in constant time),
+ * and the background verifier thread walks the registry and verifies canaries and hashes of each stack.
+ * When it finds a corrupted stack, it logs the stack and calls the corruption handler.
+ *
+ * Stack operations lock the registry entry of the stack, so the verifier never sees a half-done operation.
+ * The entry is locked only while the verifier checks this stack, other stacks are used meanwhile.
+ * The corruption handler is called without any registry locks, so it may unregister or destruct the stack.
+ *
+ * Stacks with StackSampledVerification policy verify canaries and hashes themselves, but only in sampled checks:
+ * every STACK_SAMPLING_PERIOD-th check of each stack, or each check with the given probability (see stackSampling).
+ * The other checks cover only the stack members. Skipped checks are counted per stack.
+ */
+#ifndef IMMORTAL_STACK_VERIFIER_H
+#define IMMORTAL_STACK_VERIFIER_H
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include "logger.h"
+
+/** Default interval between the passes of the background verifier over the registry, in milliseconds */
+#ifndef STACK_VERIFIER_INTERVAL_MS
+    #define STACK_VERIFIER_INTERVAL_MS 1
+#endif
+
+/** Default number of checks of each stack with sampled verification, the last of which verifies canaries and hashes */
+#ifndef STACK_SAMPLING_PERIOD
+    #define STACK_SAMPLING_PERIOD 1000
+#endif
+
+/** Entry of the stack in the registry. Functions of the entry are instantiated for the type of the stack */
+struct StackRegistryEntry {
+    /** Registered stack */
+    void* stack;
+
+    /** Checks all canaries and hashes of the stack */
+    bool (*isOk)(void* stack);
+
+    /** Opens the stack log file, logs the stack into it (LOG_STACK) and closes it */
+    void (*log)(void* stack);
+
+    /** Lock that is held by the stack operations and by the verifier while it checks the stack */
+    std::mutex lock;
+
+    /** Corruption of the stack is already reported, it's not reported again */
+    bool corrupted;
+
+    /** Neighbour entries in the registry */
+    StackRegistryEntry* previous;
+    StackRegistryEntry* next;
+};
+
+/**
+ * Handler that is called by the verifier for each corrupted stack (after the stack is logged).
+ * Handler is called without registry locks, it may destruct the stack. Other threads can't unregister the stack
+ * until the handler returns.
+ * @param[in] stack pointer to the corrupted stack
+ */
+typedef void (*StackCorruptionHandler)(void* stack);
+
+/**
+ * Corruption handler that fails an assertion, as the stack operations do.
+ * @param[in] stack pointer to the corrupted stack
+ */
+inline void failStackAssertion(void* stack);
+
+/** Registry of the stacks that are verified in the background */
+struct StackRegistry {
+    /** Lock of the registry list. Verifier holds it during the whole pass */
+    std::mutex lock;
+
+    /** The first entry, or nullptr if the registry is empty */
+    StackRegistryEntry* first = nullptr;
+
+    /** Number of registered stacks */
+    size_t size = 0;
+
+    /** Handler of the corrupted stacks */
+    std::atomic<StackCorruptionHandler> corruptionHandler{failStackAssertion};
+
+    /** Stack that is reported to the corruption handler right now, or nullptr */
+    void* reportedStack = nullptr;
+
+    /** Thread that calls the corruption handler for reportedStack */
+    std::thread::id reportingThread;
+
+    /** Wakes the threads that wait for the corruption handler to return */
+    std::condition_variable reportDone;
+};
+
+/** Background verifier thread */
+struct StackVerifier {
+    /** Lock of the verifier state */
+    std::mutex lock;
+
+    /** Wakes the verifier when it's stopped */
+    std::condition_variable wakeUp;
+
+    /** Thread of the verifier, not joinable if the verifier is not running */
+    std::thread thread;
+
+    /** Verifier should stop */
+    bool stopping = false;
+
+    /** Number of completed passes over the registry */
+    std::atomic<size_t> passes{0};
+
+    ~StackVerifier();
+};
+
+/** Sampling of the full checks, shared by all stacks with sampled verification. Can be changed at any moment */
+struct StackSamplingSettings {
+    /** Every period-th check of each stack is full, or 0 if the full checks are chosen randomly */
+    std::atomic<size_t> period{STACK_SAMPLING_PERIOD};
+
+    /** Probability of the full check multiplied by 2^32, used if period is 0 */
+    std::atomic<uint64_t> threshold{0};
+};
+
+/** Sampling counters of the stack with sampled verification */
+struct StackSamplingState {
+    /** Number of checks left until the next full one (with the period) */
+    size_t countdown;
+
+    /** Number of checks of the stack */
+    size_t checks;
+
+    /** Number of checks that skipped canaries and hashes */
+    size_t skippedChecks;
+};
+
+/** Global registry of the stacks */
+inline StackRegistry stackRegistry;
+
+/** Global background verifier */
+inline StackVerifier stackVerifier;
+
+/** Global sampling settings */
+inline StackSamplingSettings stackSampling;
+
+/**
+ * Adds the entry to the registry, so the stack is verified in the background.
+ * @param[in, out] entry entry with the stack and its functions
+ */
+inline void registerStack(StackRegistryEntry* entry);
+
+/**
+ * Removes the entry from the registry. Waits for the current pass of the verifier, if it's running,
+ * and for the corruption handler of this stack, unless it's called from the handler itself.
+ * @param[in, out] entry registered entry
+ */
+inline void unregisterStack(StackRegistryEntry* entry);
+
+/**
+ * Sets the handler that is called by the verifier for each corrupted stack.
+ * @param[in] handler corruption handler (failStackAssertion by default)
+ */
+inline void setStackCorruptionHandler(StackCorruptionHandler handler);
+
+/**
+ * Verifies all registered stacks once. Each corrupted stack is logged and reported to the corruption handler once.
+ * @return number of corrupted stacks that are found in this pass.
+ */
+inline size_t verifyRegisteredStacks();
+
+/**
+ * Starts the background verifier thread, that verifies the registered stacks every intervalMs milliseconds.
+ * @param[in] intervalMs interval between the passes
+ * @return true, if the verifier was started, false if it's already running.
+ */
+inline bool startStackVerifier(unsigned intervalMs = STACK_VERIFIER_INTERVAL_MS);
+
+/**
+ * Stops the background verifier thread and waits for it to exit. Does nothing if the verifier is not running.
+ */
+inline void stopStackVerifier();
+
+/**
+ * Makes every period-th check of each stack with sampled verification full.
+ * @param[in] period number of checks per full check (1 makes all checks full)
+ */
+inline void setStackSamplingPeriod(size_t period);
+
+/**
+ * Makes each check of the stacks with sampled verification full with the given probability.
+ * @param[in] probability probability of the full check, from 0 to 1
+ */
+inline void setStackSamplingProbability(double probability);
+
+/**
+ * Decides if the current check of the stack with sampled verification is full and counts it.
+ * @param[in, out] state sampling counters of the stack
+ * @return true, if canaries and hashes should be checked, false otherwise.
+ */
+inline bool sampleStackCheck(StackSamplingState* state);
+
+/**
+ * Guard that locks the registry entry of the stack during the operation, if the stack is verified in the background.
+ * Does nothing for the other stacks.
+ */
+template <bool enabled>
+struct StackRegistryGuard {
+    StackRegistryEntry* entry;
+
+    explicit StackRegistryGuard(StackRegistryEntry* stackEntry) : entry(stackEntry) {
+        entry->lock.lock();
+    }
+
+    ~StackRegistryGuard() {
+        entry->lock.unlock();
+    }
+};
+
+template <>
+struct StackRegistryGuard<false> {
+    template <typename Entry>
+    explicit StackRegistryGuard(const Entry&) {}
+};
+
+/**
+ * Locks the registry entry of the stack until the end of the scope, if the stack is verified in the background.
+ */
+#define STACK_REGISTRY_GUARD(stack)                                                                                    \
+    StackRegistryGuard<StackOf<decltype(stack)>::SecurityPolicy::Verification::background>                             \
+        stackRegistryGuard((stack)->_registryEntry)
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * Corruption handler that fails an assertion, as the stack operations do.
+ * @param[in] stack pointer to the corrupted stack
+ */
+inline void failStackAssertion(void* stack) {
+    (void)stack;
+    logFlush();
+    assert(false && "stack is corrupted, see the log file");
+}
+
+/**
+ * Stops the verifier thread, so it doesn't outlive the registry.
+ */
+inline StackVerifier::~StackVerifier() {
+    stopStackVerifier();
+}
+
+/**
+ * Adds the entry to the registry, so the stack is verified in the background.
+ * @param[in, out] entry entry with the stack and its functions
+ */
+inline void registerStack(StackRegistryEntry* const entry) {
+    assert(entry != nullptr);
+
+    std::lock_guard<std::mutex> guard(stackRegistry.lock);
+    entry->corrupted = false;
+    entry->previous = nullptr;
+    entry->next = stackRegistry.first;
+    if (stackRegistry.first != nullptr) {
+        stackRegistry.first->previous = entry;
+    }
+    stackRegistry.first = entry;
+    ++stackRegistry.size;
+}
+
+/**
+ * Removes the entry from the registry. Waits for the current pass of the verifier, if it's running,
+ * and for the corruption handler of this stack, unless it's called from the handler itself.
+ * @param[in, out] entry registered entry
+ */
+inline void unregisterStack(StackRegistryEntry* const entry) {
+    assert(entry != nullptr);
+
+    std::unique_lock<std::mutex> guard(stackRegistry.lock);
+    stackRegistry.reportDone.wait(guard, [entry]() {
+        return stackRegistry.reportedStack != entry->stack
+            || stackRegistry.reportingThread == std::this_thread::get_id();
+    });
+    if (entry->previous != nullptr) {
+        entry->previous->next = entry->next;
+    } else {
+        stackRegistry.first = entry->next;
+    }
+    if (entry->next != nullptr) {
+        entry->next->previous = entry->previous;
+    }
+    entry->previous = nullptr;
+    entry->next = nullptr;
+    --stackRegistry.size;
+}
+
+/**
+ * Sets the handler that is called by the verifier for each corrupted stack.
+ * @param[in] handler corruption handler (failStackAssertion by default)
+ */
+inline void setStackCorruptionHandler(StackCorruptionHandler handler) {
+    assert(handler != nullptr);
+
+    stackRegistry.corruptionHandler.store(handler);
+}
+
+/**
+ * Verifies all registered stacks once. Each corrupted stack is logged and reported to the corruption handler once.
+ * @return number of corrupted stacks that are found in this pass.
+ */
+inline size_t verifyRegisteredStacks() {
+    std::unique_lock<std::mutex> guard(stackRegistry.lock);
+
+    size_t corruptedNumber = 0;
+    StackRegistryEntry* entry = stackRegistry.first;
+    while (entry != nullptr) {
+        // Another verifier reports a stack, wait for it and walk again, because the registry could change
+        if (stackRegistry.reportedStack != nullptr) {
+            stackRegistry.reportDone.wait(guard, []() { return stackRegistry.reportedStack == nullptr; });
+            entry = stackRegistry.first;
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> entryGuard(entry->lock);
+            if (entry->corrupted || entry->isOk(entry->stack)) {
+                entry = entry->next;
+                continue;
+            }
+
+            entry->corrupted = true;
+            std::lock_guard<std::mutex> logGuard(_logMutex);
+            entry->log(entry->stack);
+        }
+        ++corruptedNumber;
+
+        // Handler runs without the registry lock, other threads keep the stack alive until it returns
+        void* const stack = entry->stack;
+        stackRegistry.reportedStack   = stack;
+        stackRegistry.reportingThread = std::this_thread::get_id();
+        guard.unlock();
+        stackRegistry.corruptionHandler.load()(stack);
+        guard.lock();
+        stackRegistry.reportedStack = nullptr;
+        stackRegistry.reportDone.notify_all();
+
+        // Registry could change meanwhile, reported entries are skipped by the next walk
+        entry = stackRegistry.first;
+    }
+
+    return corruptedNumber;
+}
+
+/**
+ * Starts the background verifier thread, that verifies the registered stacks every intervalMs milliseconds.
+ * @param[in] intervalMs interval between the passes
+ * @return true, if the verifier was started, false if it's already running.
+ */
+inline bool startStackVerifier(unsigned intervalMs) {
+    std::lock_guard<std::mutex> guard(stackVerifier.lock);
+    if (stackVerifier.thread.joinable()) return false;
+
+    stackVerifier.stopping = false;
+    stackVerifier.thread = std::thread([intervalMs]() {
+        std::unique_lock<std::mutex> lock(stackVerifier.lock);
+        while (!stackVerifier.stopping) {
+            lock.unlock();
+            verifyRegisteredStacks();
+            ++stackVerifier.passes;
+            lock.lock();
+
+            stackVerifier.wakeUp.wait_for(lock, std::chrono::milliseconds(intervalMs), []() {
+                return stackVerifier.stopping;
+            });
+        }
+    });
+
+    return true;
+}
+
+/**
+ * Stops the background verifier thread and waits for it to exit. Does nothing if the verifier is not running.
+ */
+inline void stopStackVerifier() {
+    std::thread thread;
+    {
+        std::lock_guard<std::mutex> guard(stackVerifier.lock);
+        stackVerifier.stopping = true;
+        thread = std::move(stackVerifier.thread);
+    }
+    stackVerifier.wakeUp.notify_all();
+
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+/**
+ * Makes every period-th check of each stack with sampled verification full.
+ * @param[in] period number of checks per full check (1 makes all checks full)
+ */
+inline void setStackSamplingPeriod(const size_t period) {
+    assert(period > 0);
+
+    stackSampling.period.store(period);
+}
+
+/**
+ * Makes each check of the stacks with sampled verification full with the given probability.
+ * @param[in] probability probability of the full check, from 0 to 1
+ */
+inline void setStackSamplingProbability(const double probability) {
+    assert(probability >= 0 && probability <= 1);
+
+    stackSampling.threshold.store((uint64_t)(probability * 4294967296.0));
+    stackSampling.period.store(0);
+}
+
+/**
+ * Decides if the current check of the stack with sampled verification is full and counts it.
+ * @param[in, out] state sampling counters of the stack
+ * @return true, if canaries and hashes should be checked, false otherwise.
+ */
+inline bool sampleStackCheck(StackSamplingState* const state) {
+    ++state->checks;
+
+    bool full = false;
+    size_t period = stackSampling.period.load(std::memory_order_relaxed);
+    if (period > 0) {
+        if (state->countdown == 0 || state->countdown > period) {
+            state->countdown = period;
+        }
+        full = (--state->countdown == 0);
+    } else {
+        // xorshift generator, each thread has its own state
+        static thread_local uint64_t random = (uint64_t)(uintptr_t)&random | 1u;
+        random ^= random << 13;
+        random ^= random >> 7;
+        random ^= random << 17;
+        full = (random >> 32) < stackSampling.threshold.load(std::memory_order_relaxed);
+    }
+
+    if (!full) {
+        ++state->skippedChecks;
+    }
+    return full;
+}
+
+#endif // IMMORTAL_STACK_VERIFIER_H
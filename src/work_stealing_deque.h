@@ -0,0 +1,712 @@
+/**
+ * @file
+ * @brief Definition and implementation of work-stealing deque template
+ *
+ * WorkStealingDeque<T, Policy> is Chase-Lev deque: a stack of one owner thread, that other threads can steal from.
+ * The owner pushes and pops elements at the bottom, thieves steal the oldest elements from the top.
+ * Owner's push doesn't use atomic read-modify-write operations, its pop needs compare-and-swap only for the last element.
+ * Elements are kept in a circular array, that is enlarged by the owner (see enlarge). Thieves can still read
+ * the old array, so it's freed only when the deque is destructed.
+ *
+ * Security policies are the same as for ImmortalStack. With canaries the deque struct and each array
+ * are guarded by canaries. With hashing the deque members that are changed only by the owner are hashed,
+ * and each element is stored with the hash of its value and index, that is checked when it's popped or stolen.
+ * Elements must be trivially copyable: thieves copy them before they know if the steal succeeds.
+ */
+#ifndef IMMORTAL_STACK_WORK_STEALING_DEQUE_H
+#define IMMORTAL_STACK_WORK_STEALING_DEQUE_H
+
+#include <atomic>
+#include "immortal_stack.h"
+
+static_assert(
+    (STACK_ENLARGE_MULTIPLIER & (STACK_ENLARGE_MULTIPLIER - 1)) == 0,
+    "capacity of the work-stealing deque must stay a power of two"
+);
+
+/** Element of the work-stealing deque with the hash of its value and index, if hashing is turned on */
+template <typename T, typename Policy>
+struct StackDequeSlot {
+    T value;
+
+    [[no_unique_address]] StackHashValue<Policy::Hashing::enabled, 0> hash;
+};
+
+/**
+ * Header of the circular array of the work-stealing deque.
+ * It's followed by _capacity slots and the canaries after them (see getDequeSlots, getDequeCanariesAfter).
+ */
+template <typename T, typename Policy>
+struct alignas(StackDequeSlot<T, Policy>) alignas(long long) StackDequeArray {
+    [[no_unique_address]] typename StackCanaryArray<Policy::Canaries::number, 0>::Type _canariesBefore;
+
+    /** Number of slots in the array, a power of two */
+    ssize_t _capacity;
+
+    /** Array that was replaced by this one, or nullptr. Old arrays are freed with the deque */
+    StackDequeArray* _previous;
+};
+
+/**
+ * Generic work-stealing deque that can contain trivially copyable values of type T.
+ * Deque operations (construct/destruct, push, pop, steal, etc) should be performed using the functions below.
+ * Only the owner thread can call push and tryPop, any thread can call trySteal and getStackSize.
+ * Deque can perform different corruption checking (see StackPolicy): silent verification, canary guards, hash checking.
+ */
+template <typename T, typename Policy = StackSecurityPolicy<0>>
+struct WorkStealingDeque {
+    using ElementType    = T;
+    using SecurityPolicy = Policy;
+    using Array          = StackDequeArray<T, Policy>;
+
+    static_assert(std::is_trivially_copyable<T>::value, "elements of work-stealing deque must be trivially copyable");
+
+    /* !!! Private members !!! */
+
+    [[no_unique_address]] typename StackCanaryArray<Policy::Canaries::number, 0>::Type _canariesBefore;
+
+    /** Hash of the members that are changed only by the owner (see getHash) */
+    [[no_unique_address]] StackHashValue<Policy::Hashing::enabled, 1> _hash{};
+
+    /** Index after the bottom element. Changed only by the owner */
+    std::atomic<ssize_t> _bottom{0};
+
+    /** Circular array with the elements, or nullptr. Changed only by the owner */
+    std::atomic<Array*> _array{nullptr};
+
+    /** Allocator of the arrays */
+    const StackAllocator* _allocator = nullptr;
+
+    /** Index of the top element. Thieves and the owner take elements by incrementing it */
+    alignas(64) std::atomic<ssize_t> _top{0};
+
+    [[no_unique_address]] typename StackCanaryArray<Policy::Canaries::number, 2>::Type _canariesAfter;
+};
+
+/**
+ * Checks if the given work-stealing deque is in normal state (correct array and canary values).
+ * Can be called by any thread, so it doesn't check the hash (see isStackOwnerStateOk).
+ * @param[in, out] stack stack to check
+ * @return true, if the given stack is ok, false otherwise.
+ */
+template <typename T, typename P>
+bool isStackOk(WorkStealingDeque<T, P>* stack);
+
+/**
+ * Checks if the given work-stealing deque is in normal state, including the hash of the members changed by the owner.
+ * Can be called only by the owner.
+ * @param[in, out] stack stack to check
+ * @return true, if the given stack is ok, false otherwise.
+ */
+template <typename T, typename P>
+bool isStackOwnerStateOk(WorkStealingDeque<T, P>* stack);
+
+/**
+ * Checks if the given slot has the correct hash.
+ * @param[in] slot  pointer to the slot (or its copy)
+ * @param[in] index index of the element in the slot
+ * @return true, if the slot is ok, false otherwise.
+ */
+template <typename T, typename P>
+bool isDequeSlotOk(StackDequeSlot<T, P>* slot, ssize_t index);
+
+/**
+ * Creates a new work-stealing deque.
+ * @param[in, out] thiz       pointer to the deque this operation should be performed on
+ * @param[in] initialCapacity initial size of the array (rounded up to a power of two), it's allocated on the first push if it's zero
+ * @param[in] allocator       allocator of the arrays
+ */
+template <typename T, typename P>
+void constructStack(
+    WorkStealingDeque<T, P>* thiz,
+    size_t initialCapacity = 0,
+    const StackAllocator* allocator = &systemStackAllocator
+);
+
+/**
+ * Destructs the given work-stealing deque. Frees all its arrays and resets all struct members to initial state.
+ * Must not be called while other threads use the deque.
+ * @param[in, out] thiz pointer to the deque this operation should be performed on
+ */
+template <typename T, typename P>
+void destructStack(WorkStealingDeque<T, P>* thiz);
+
+/**
+ * Enlarges the array of the given work-stealing deque. Called only by the owner.
+ * If there's no array, the array of one element is allocated. Otherwise, capacity is multiplied by STACK_ENLARGE_MULTIPLIER.
+ * @param[in, out] thiz pointer to the deque this operation should be performed on
+ */
+template <typename T, typename P>
+void enlarge(WorkStealingDeque<T, P>* thiz);
+
+/**
+ * Replaces the array of the given work-stealing deque with the new one of the given capacity. Keeps the deque elements.
+ * Doesn't check if the deque is ok, it's up to the caller.
+ * @param[in, out] thiz pointer to the deque this operation should be performed on
+ * @param[in] capacity  new capacity of the deque, a power of two not less than its size
+ */
+template <typename T, typename P>
+void reallocateDequeArray(WorkStealingDeque<T, P>* thiz, ssize_t capacity);
+
+/**
+ * Pushes the given element to the bottom of the work-stealing deque. Called only by the owner.
+ * @param[in, out] thiz pointer to the deque this operation should be performed on
+ * @param[in] x         value to put to the bottom of the deque
+ */
+template <typename T, typename P>
+void push(WorkStealingDeque<T, P>* thiz, const StackNonDeduced<T>& x);
+
+/**
+ * Removes the bottom element of the work-stealing deque, if it's not empty. Called only by the owner.
+ * @param[in, out] thiz pointer to the deque this operation should be performed on
+ * @param[out] value    where to copy the value that was at the bottom of the deque
+ * @return true, if the value was popped, false if the deque was empty (or the last element was stolen).
+ */
+template <typename T, typename P>
+bool tryPop(WorkStealingDeque<T, P>* thiz, T* value);
+
+/**
+ * Removes the top (the oldest) element of the work-stealing deque, if it's not empty. Can be called by any thread.
+ * @param[in, out] thiz pointer to the deque this operation should be performed on
+ * @param[out] value    where to copy the value that was at the top of the deque
+ * @return true, if the value was stolen, false if the deque was empty.
+ */
+template <typename T, typename P>
+bool trySteal(WorkStealingDeque<T, P>* thiz, T* value);
+
+/**
+ * Gives the number of elements in the given work-stealing deque.
+ * Thieves can change it at any moment, so it's only an estimate.
+ * @param[in] thiz pointer to the deque this operation should be performed on
+ * @return size of the deque.
+ */
+template <typename T, typename P>
+ssize_t getStackSize(WorkStealingDeque<T, P>* thiz);
+
+/**
+ * Gives the number of elements that fit into the array of the given work-stealing deque.
+ * @param[in] thiz pointer to the deque this operation should be performed on
+ * @return capacity of the deque.
+ */
+template <typename T, typename P>
+ssize_t getStackCapacity(WorkStealingDeque<T, P>* thiz);
+
+/**
+ * Allocates a new array of the given capacity with the deque allocator and sets its canaries.
+ * @param[in] thiz     pointer to the deque this operation should be performed on
+ * @param[in] capacity capacity of the array
+ * @return pointer to the array, or nullptr if there's not enough memory.
+ */
+template <typename T, typename P>
+StackDequeArray<T, P>* allocateDequeArray(WorkStealingDeque<T, P>* thiz, ssize_t capacity);
+
+/**
+ * Gives the size of the array of the given capacity in bytes (with its header and canaries).
+ * @param[in] capacity capacity of the array
+ * @return size of the array.
+ */
+template <typename T, typename P>
+size_t getDequeArrayBytes(ssize_t capacity);
+
+/**
+ * Gives the slots of the given array.
+ * @param[in] array pointer to the array
+ * @return pointer to the first slot.
+ */
+template <typename T, typename P>
+StackDequeSlot<T, P>* getDequeSlots(StackDequeArray<T, P>* array);
+
+/**
+ * Gives the canaries that follow the slots of the given array.
+ * @param[in] array pointer to the array
+ * @return pointer to the canaries.
+ */
+template <typename T, typename P>
+long long* getDequeCanariesAfter(StackDequeArray<T, P>* array);
+
+/**
+ * Checks if canaries of the given array are correct.
+ * @param[in] array pointer to the array to check
+ * @return true, if the array canaries are correct, false otherwise.
+ */
+template <typename T, typename P>
+bool isDequeArrayOk(StackDequeArray<T, P>* array);
+
+/**
+ * Calculates the hash value of the given work-stealing deque members that are changed only by the owner
+ * (see STACK_HASH_ALGORITHM). Skips _hash and _top members of the deque.
+ * @param[in] thiz pointer to the deque this operation should be performed on
+ * @return calculated hash value.
+ */
+template <typename T, typename P>
+unsigned long long getHash(WorkStealingDeque<T, P>* thiz);
+
+/**
+ * Calculates the hash value of the element value with its index (see STACK_HASH_ALGORITHM).
+ * @param[in] slot  pointer to the slot (or its copy)
+ * @param[in] index index of the element in the slot
+ * @return calculated hash value.
+ */
+template <typename T, typename P>
+unsigned long long getDequeSlotHash(StackDequeSlot<T, P>* slot, ssize_t index);
+
+/**
+ * Logs the members of the given work-stealing deque (indices, elements and canaries) into the log file. Used in LOG_STACK.
+ * @param[in] stack deque to log (not nullptr)
+ */
+template <typename T, typename P>
+void logStackMembers(WorkStealingDeque<T, P>* stack);
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * Checks if the given work-stealing deque is in normal state (correct array and canary values).
+ * Can be called by any thread, so it doesn't check the hash (see isStackOwnerStateOk).
+ * @param[in, out] stack stack to check
+ * @return true, if the given stack is ok, false otherwise.
+ */
+template <typename T, typename P>
+bool isStackOk(WorkStealingDeque<T, P>* stack) {
+    if (stack == nullptr || stack->_allocator == nullptr) {
+        return false;
+    }
+
+    if constexpr (P::Canaries::number > 0) {
+        for (size_t i = 0; i < P::Canaries::number; ++i) {
+            if (stack->_canariesBefore[i] != canaryValue) return false;
+            if (stack->_canariesAfter [i] != canaryValue) return false;
+        }
+    }
+
+    StackDequeArray<T, P>* array = stack->_array.load(std::memory_order_acquire);
+    if (array != nullptr) {
+        if ((array->_capacity <= 0) || ((array->_capacity & (array->_capacity - 1)) != 0)) return false;
+        if (!isDequeArrayOk(array)) return false;
+    }
+
+    return true;
+}
+
+/**
+ * Checks if the given work-stealing deque is in normal state, including the hash of the members changed by the owner.
+ * Can be called only by the owner.
+ * @param[in, out] stack stack to check
+ * @return true, if the given stack is ok, false otherwise.
+ */
+template <typename T, typename P>
+bool isStackOwnerStateOk(WorkStealingDeque<T, P>* stack) {
+    if (!isStackOk(stack)) {
+        return false;
+    }
+
+    StackDequeArray<T, P>* array = stack->_array.load(std::memory_order_relaxed);
+    ssize_t size = stack->_bottom.load(std::memory_order_relaxed) - stack->_top.load(std::memory_order_relaxed);
+    if (size > ((array == nullptr) ? 0 : array->_capacity)) {
+        return false;
+    }
+
+    if constexpr (P::Hashing::enabled) {
+        if (getHash(stack) != stack->_hash) return false;
+    }
+
+    return true;
+}
+
+/**
+ * Checks if the given slot has the correct hash.
+ * @param[in] slot  pointer to the slot (or its copy)
+ * @param[in] index index of the element in the slot
+ * @return true, if the slot is ok, false otherwise.
+ */
+template <typename T, typename P>
+bool isDequeSlotOk(StackDequeSlot<T, P>* const slot, ssize_t index) {
+    if constexpr (P::Hashing::enabled) {
+        return getDequeSlotHash(slot, index) == slot->hash;
+    } else {
+        (void)slot;
+        (void)index;
+        return true;
+    }
+}
+
+/**
+ * Creates a new work-stealing deque.
+ * @param[in, out] thiz       pointer to the deque this operation should be performed on
+ * @param[in] initialCapacity initial size of the array (rounded up to a power of two), it's allocated on the first push if it's zero
+ * @param[in] allocator       allocator of the arrays
+ */
+template <typename T, typename P>
+void constructStack(WorkStealingDeque<T, P>* const thiz, size_t initialCapacity, const StackAllocator* allocator) {
+    CHECK_STACK_CONDITION(thiz, (thiz != nullptr) && (thiz->_array.load() == nullptr));
+    CHECK_STACK_CONDITION(thiz, allocator != nullptr);
+
+    if constexpr (P::Canaries::number > 0) {
+        for (size_t i = 0; i < P::Canaries::number; ++i) {
+            thiz->_canariesBefore[i] = canaryValue;
+            thiz->_canariesAfter [i] = canaryValue;
+        }
+    }
+
+    thiz->_top.store(0);
+    thiz->_bottom.store(0);
+    thiz->_array.store(nullptr);
+    thiz->_allocator = allocator;
+
+    if (initialCapacity > 0) {
+        ssize_t capacity = 1;
+        while (capacity < (ssize_t)initialCapacity) {
+            capacity *= 2;
+        }
+        reallocateDequeArray(thiz, capacity);
+    }
+
+    if constexpr (P::Hashing::enabled) {
+        thiz->_hash = getHash(thiz);
+    }
+}
+
+/**
+ * Destructs the given work-stealing deque. Frees all its arrays and resets all struct members to initial state.
+ * Must not be called while other threads use the deque.
+ * @param[in, out] thiz pointer to the deque this operation should be performed on
+ */
+template <typename T, typename P>
+void destructStack(WorkStealingDeque<T, P>* const thiz) {
+    CHECK_STACK_CONDITION(thiz, isStackOwnerStateOk(thiz));
+
+    StackDequeArray<T, P>* array = thiz->_array.exchange(nullptr);
+    while (array != nullptr) {
+        StackDequeArray<T, P>* previous = array->_previous;
+        thiz->_allocator->deallocate(thiz->_allocator->context, array, getDequeArrayBytes<T, P>(array->_capacity));
+        array = previous;
+    }
+
+    thiz->_top.store(0);
+    thiz->_bottom.store(0);
+    thiz->_allocator = nullptr;
+
+    if constexpr (P::Hashing::enabled) {
+        thiz->_hash = 0;
+    }
+}
+
+/**
+ * Enlarges the array of the given work-stealing deque. Called only by the owner.
+ * If there's no array, the array of one element is allocated. Otherwise, capacity is multiplied by STACK_ENLARGE_MULTIPLIER.
+ * @param[in, out] thiz pointer to the deque this operation should be performed on
+ */
+template <typename T, typename P>
+void enlarge(WorkStealingDeque<T, P>* const thiz) {
+    CHECK_STACK_CONDITION(thiz, isStackOwnerStateOk(thiz));
+
+    ssize_t capacity = getStackCapacity(thiz);
+    reallocateDequeArray(thiz, (capacity == 0) ? 1 : capacity * STACK_ENLARGE_MULTIPLIER);
+
+    if constexpr (P::Hashing::enabled) {
+        thiz->_hash = getHash(thiz);
+    }
+
+    CHECK_STACK_CONDITION(thiz, isStackOwnerStateOk(thiz));
+}
+
+/**
+ * Replaces the array of the given work-stealing deque with the new one of the given capacity. Keeps the deque elements.
+ * Doesn't check if the deque is ok, it's up to the caller.
+ * @param[in, out] thiz pointer to the deque this operation should be performed on
+ * @param[in] capacity  new capacity of the deque, a power of two not less than its size
+ */
+template <typename T, typename P>
+void reallocateDequeArray(WorkStealingDeque<T, P>* const thiz, ssize_t capacity) {
+    StackDequeArray<T, P>* oldArray = thiz->_array.load(std::memory_order_relaxed);
+    StackDequeArray<T, P>* array = allocateDequeArray(thiz, capacity);
+    CHECK_STACK_CONDITION(thiz, array != nullptr);
+
+    // Thieves can still read the old array, so the elements are copied, and the old array is kept
+    if (oldArray != nullptr) {
+        StackDequeSlot<T, P>* oldSlots = getDequeSlots(oldArray);
+        StackDequeSlot<T, P>* slots = getDequeSlots(array);
+        ssize_t bottom = thiz->_bottom.load(std::memory_order_relaxed);
+        for (ssize_t i = thiz->_top.load(std::memory_order_acquire); i < bottom; ++i) {
+            slots[i & (capacity - 1)] = oldSlots[i & (oldArray->_capacity - 1)];
+        }
+    }
+    array->_previous = oldArray;
+
+    thiz->_array.store(array, std::memory_order_release);
+}
+
+/**
+ * Pushes the given element to the bottom of the work-stealing deque. Called only by the owner.
+ * @param[in, out] thiz pointer to the deque this operation should be performed on
+ * @param[in] x         value to put to the bottom of the deque
+ */
+template <typename T, typename P>
+void push(WorkStealingDeque<T, P>* const thiz, const StackNonDeduced<T>& x) {
+    CHECK_STACK_CONDITION(thiz, isStackOwnerStateOk(thiz));
+
+    ssize_t bottom = thiz->_bottom.load(std::memory_order_relaxed);
+    ssize_t top = thiz->_top.load(std::memory_order_acquire);
+    if (bottom - top >= getStackCapacity(thiz)) {
+        enlarge(thiz);
+    }
+
+    StackDequeArray<T, P>* array = thiz->_array.load(std::memory_order_relaxed);
+    StackDequeSlot<T, P>* slot = getDequeSlots(array) + (bottom & (array->_capacity - 1));
+    slot->value = x;
+    if constexpr (P::Hashing::enabled) {
+        slot->hash = getDequeSlotHash(slot, bottom);
+    }
+    thiz->_bottom.store(bottom + 1, std::memory_order_release);
+
+    if constexpr (P::Hashing::enabled) {
+        thiz->_hash = getHash(thiz);
+    }
+}
+
+/**
+ * Removes the bottom element of the work-stealing deque, if it's not empty. Called only by the owner.
+ * @param[in, out] thiz pointer to the deque this operation should be performed on
+ * @param[out] value    where to copy the value that was at the bottom of the deque
+ * @return true, if the value was popped, false if the deque was empty (or the last element was stolen).
+ */
+template <typename T, typename P>
+bool tryPop(WorkStealingDeque<T, P>* const thiz, T* const value) {
+    CHECK_STACK_CONDITION(thiz, isStackOwnerStateOk(thiz));
+    CHECK_STACK_CONDITION(thiz, value != nullptr);
+
+    // Bottom is taken before top is read, so thieves can't take the same element
+    ssize_t bottom = thiz->_bottom.load(std::memory_order_relaxed) - 1;
+    StackDequeArray<T, P>* array = thiz->_array.load(std::memory_order_relaxed);
+    thiz->_bottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    ssize_t top = thiz->_top.load(std::memory_order_relaxed);
+
+    bool popped = (top <= bottom);
+    StackDequeSlot<T, P> slot{};
+    if (popped) {
+        slot = getDequeSlots(array)[bottom & (array->_capacity - 1)];
+        if (top == bottom) {
+            // The last element, thieves can take it at the same time
+            popped = thiz->_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            thiz->_bottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+    } else {
+        thiz->_bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    if constexpr (P::Hashing::enabled) {
+        thiz->_hash = getHash(thiz);
+    }
+
+    if (popped) {
+        CHECK_STACK_CONDITION(thiz, isDequeSlotOk(&slot, bottom));
+        *value = slot.value;
+    }
+    return popped;
+}
+
+/**
+ * Removes the top (the oldest) element of the work-stealing deque, if it's not empty. Can be called by any thread.
+ * @param[in, out] thiz pointer to the deque this operation should be performed on
+ * @param[out] value    where to copy the value that was at the top of the deque
+ * @return true, if the value was stolen, false if the deque was empty.
+ */
+template <typename T, typename P>
+bool trySteal(WorkStealingDeque<T, P>* const thiz, T* const value) {
+    CHECK_STACK_OK(thiz);
+    CHECK_STACK_CONDITION(thiz, value != nullptr);
+
+    while (true) {
+        ssize_t top = thiz->_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        ssize_t bottom = thiz->_bottom.load(std::memory_order_acquire);
+        if (top >= bottom) {
+            return false;
+        }
+
+        // Element is copied before it's taken: the owner can overwrite its slot only after it's taken
+        StackDequeArray<T, P>* array = thiz->_array.load(std::memory_order_acquire);
+        StackDequeSlot<T, P> slot = getDequeSlots(array)[top & (array->_capacity - 1)];
+        if (thiz->_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            CHECK_STACK_CONDITION(thiz, isDequeSlotOk(&slot, top));
+            *value = slot.value;
+            return true;
+        }
+    }
+}
+
+/**
+ * Gives the number of elements in the given work-stealing deque.
+ * Thieves can change it at any moment, so it's only an estimate.
+ * @param[in] thiz pointer to the deque this operation should be performed on
+ * @return size of the deque.
+ */
+template <typename T, typename P>
+ssize_t getStackSize(WorkStealingDeque<T, P>* const thiz) {
+    CHECK_STACK_CONDITION(thiz, thiz != nullptr);
+
+    ssize_t size = thiz->_bottom.load(std::memory_order_relaxed) - thiz->_top.load(std::memory_order_relaxed);
+    return (size < 0) ? 0 : size;
+}
+
+/**
+ * Gives the number of elements that fit into the array of the given work-stealing deque.
+ * @param[in] thiz pointer to the deque this operation should be performed on
+ * @return capacity of the deque.
+ */
+template <typename T, typename P>
+ssize_t getStackCapacity(WorkStealingDeque<T, P>* const thiz) {
+    CHECK_STACK_CONDITION(thiz, thiz != nullptr);
+
+    StackDequeArray<T, P>* array = thiz->_array.load(std::memory_order_acquire);
+    return (array == nullptr) ? 0 : array->_capacity;
+}
+
+/**
+ * Allocates a new array of the given capacity with the deque allocator and sets its canaries.
+ * @param[in] thiz     pointer to the deque this operation should be performed on
+ * @param[in] capacity capacity of the array
+ * @return pointer to the array, or nullptr if there's not enough memory.
+ */
+template <typename T, typename P>
+StackDequeArray<T, P>* allocateDequeArray(WorkStealingDeque<T, P>* const thiz, ssize_t capacity) {
+    auto array = (StackDequeArray<T, P>*)thiz->_allocator->allocate(
+        thiz->_allocator->context, getDequeArrayBytes<T, P>(capacity)
+    );
+    if (array == nullptr) return nullptr;
+
+    array->_capacity = capacity;
+    array->_previous = nullptr;
+    if constexpr (P::Canaries::number > 0) {
+        long long* canariesAfter = getDequeCanariesAfter(array);
+        for (size_t i = 0; i < P::Canaries::number; ++i) {
+            array->_canariesBefore[i] = canaryValue;
+            canariesAfter[i] = canaryValue;
+        }
+    }
+
+    return array;
+}
+
+/**
+ * Gives the size of the array of the given capacity in bytes (with its header and canaries).
+ * @param[in] capacity capacity of the array
+ * @return size of the array.
+ */
+template <typename T, typename P>
+size_t getDequeArrayBytes(ssize_t capacity) {
+    size_t slotsEnd = sizeof(StackDequeArray<T, P>) + sizeof(StackDequeSlot<T, P>) * capacity;
+    size_t canariesBegin = (slotsEnd + alignof(long long) - 1) / alignof(long long) * alignof(long long);
+    return canariesBegin + sizeof(long long) * P::Canaries::number;
+}
+
+/**
+ * Gives the slots of the given array.
+ * @param[in] array pointer to the array
+ * @return pointer to the first slot.
+ */
+template <typename T, typename P>
+StackDequeSlot<T, P>* getDequeSlots(StackDequeArray<T, P>* const array) {
+    return (StackDequeSlot<T, P>*)(array + 1);
+}
+
+/**
+ * Gives the canaries that follow the slots of the given array.
+ * @param[in] array pointer to the array
+ * @return pointer to the canaries.
+ */
+template <typename T, typename P>
+long long* getDequeCanariesAfter(StackDequeArray<T, P>* const array) {
+    return (long long*)((char*)array + getDequeArrayBytes<T, P>(array->_capacity)) - P::Canaries::number;
+}
+
+/**
+ * Checks if canaries of the given array are correct.
+ * @param[in] array pointer to the array to check
+ * @return true, if the array canaries are correct, false otherwise.
+ */
+template <typename T, typename P>
+bool isDequeArrayOk(StackDequeArray<T, P>* const array) {
+    if constexpr (P::Canaries::number > 0) {
+        long long* canariesAfter = getDequeCanariesAfter(array);
+        for (size_t i = 0; i < P::Canaries::number; ++i) {
+            if (array->_canariesBefore[i] != canaryValue) return false;
+            if (canariesAfter[i] != canaryValue) return false;
+        }
+    } else {
+        (void)array;
+    }
+
+    return true;
+}
+
+/**
+ * Calculates the hash value of the given work-stealing deque members that are changed only by the owner
+ * (see STACK_HASH_ALGORITHM). Skips _hash and _top members of the deque.
+ * @param[in] thiz pointer to the deque this operation should be performed on
+ * @return calculated hash value.
+ */
+template <typename T, typename P>
+unsigned long long getHash(WorkStealingDeque<T, P>* const thiz) {
+    CHECK_STACK_CONDITION(thiz, thiz != nullptr);
+
+    char* hashBegin = (char*)&(thiz->_hash);
+    char* hashEnd   = hashBegin + sizeof(thiz->_hash);
+    char* ownerEnd  = (char*)&(thiz->_allocator) + sizeof(thiz->_allocator);
+
+    unsigned long long hash = hashBytes(0, thiz, hashBegin - (char*)thiz);
+    return hashBytes(hash, hashEnd, ownerEnd - hashEnd);
+}
+
+/**
+ * Calculates the hash value of the element value with its index (see STACK_HASH_ALGORITHM).
+ * @param[in] slot  pointer to the slot (or its copy)
+ * @param[in] index index of the element in the slot
+ * @return calculated hash value.
+ */
+template <typename T, typename P>
+unsigned long long getDequeSlotHash(StackDequeSlot<T, P>* const slot, ssize_t index) {
+    return hashBytes(hashBytes(0, &index, sizeof(index)), &slot->value, sizeof(T));
+}
+
+/**
+ * Logs the members of the given work-stealing deque (indices, elements and canaries) into the log file. Used in LOG_STACK.
+ * @param[in] stack deque to log (not nullptr)
+ */
+template <typename T, typename P>
+void logStackMembers(WorkStealingDeque<T, P>* const stack) {
+    ssize_t top = stack->_top.load();
+    ssize_t bottom = stack->_bottom.load();
+    StackDequeArray<T, P>* array = stack->_array.load();
+    LOG_VALUE_INDENTED(top, "\t");
+    LOG_VALUE_INDENTED(bottom, "\t");
+
+    logPrintf("\tarray [" PTR_FORMAT "]", (uintptr_t)array);
+    if (array != nullptr) {
+        ssize_t capacity = array->_capacity;
+        logPrintf(" = {\n");
+        LOG_VALUE_INDENTED(capacity, "\t\t");
+        for (ssize_t i = top; i < bottom && i - top < capacity; ++i) {
+            logPrintf("\t\t[%zd] = ", i);
+            logValue(getDequeSlots(array)[i & (capacity - 1)].value);
+            logPrintf("\n");
+        }
+        if constexpr (P::Canaries::number > 0) {
+            long long* canariesBefore = array->_canariesBefore;
+            long long* canariesAfter  = getDequeCanariesAfter(array);
+            LOG_ARRAY_INDENTED(canariesBefore, P::Canaries::number, "\t\t");
+            LOG_ARRAY_INDENTED(canariesAfter,  P::Canaries::number, "\t\t");
+        }
+        logPrintf("\t}");
+    }
+    logPrintf("\n");
+
+    if constexpr (P::Canaries::number > 0) {
+        long long* canariesBefore = stack->_canariesBefore;
+        long long* canariesAfter  = stack->_canariesAfter;
+        LOG_ARRAY_INDENTED(canariesBefore, P::Canaries::number, "\t");
+        LOG_ARRAY_INDENTED(canariesAfter,  P::Canaries::number, "\t");
+    }
+}
+
+#endif // IMMORTAL_STACK_WORK_STEALING_DEQUE_H
@@ -0,0 +1,167 @@
+/**
+ * @file
+ */
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include "testlib.h"
+#include "../src/combining_stack.h"
+
+/** Combining stack with all checks */
+typedef CombiningStack<int, StackSecurityPolicy<3>> CombiningIntStack;
+
+/** Number of pushing threads (and the same number of popping ones) in the concurrent tests */
+constexpr int testPushersNumber = 4;
+
+/** Number of elements that are pushed by each pushing thread in the concurrent tests */
+constexpr int testPusherElementsNumber = 20000;
+
+TEST(combiningStack, correctStackElementsOrder) {
+    CombiningIntStack s{};
+    constructStack(&s);
+
+    for (int i = 0; i < 100; ++i) {
+        push(&s, i);
+    }
+    ASSERT_EQUALS(getStackSize(&s), 100);
+
+    int value = 0;
+    for (int i = 99; i >= 0; --i) {
+        ASSERT_TRUE(tryPop(&s, &value));
+        ASSERT_EQUALS(value, i);
+    }
+    ASSERT_TRUE(!tryPop(&s, &value));
+
+    // Each request of the only thread is a batch
+    StackCombiningStats stats = getCombiningStats(&s);
+    ASSERT_EQUALS(stats.batches, (size_t)201);
+    ASSERT_EQUALS(stats.requests, (size_t)201);
+
+    destructStack(&s);
+}
+
+TEST(combiningStack, everyElementIsPoppedOnce) {
+    CombiningIntStack s{};
+    constructStack(&s);
+
+    std::vector<std::atomic<int>> poppedCounts(testPushersNumber * testPusherElementsNumber);
+    std::atomic<int> poppedTotal{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < testPushersNumber; ++t) {
+        threads.emplace_back([&s, t]() {
+            for (int i = 0; i < testPusherElementsNumber; ++i) {
+                push(&s, t * testPusherElementsNumber + i);
+            }
+        });
+        threads.emplace_back([&s, &poppedCounts, &poppedTotal]() {
+            int value = 0;
+            while (poppedTotal.load() < testPushersNumber * testPusherElementsNumber) {
+                if (tryPop(&s, &value)) {
+                    ++poppedCounts[value];
+                    ++poppedTotal;
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    ASSERT_EQUALS(getStackSize(&s), 0);
+    for (std::atomic<int>& count : poppedCounts) {
+        ASSERT_EQUALS(count.load(), 1);
+    }
+    StackCombiningStats stats = getCombiningStats(&s);
+    ASSERT_TRUE(stats.requests >= (size_t)(2 * testPushersNumber * testPusherElementsNumber));
+    ASSERT_TRUE(stats.batches <= stats.requests);
+
+    destructStack(&s);
+}
+
+TEST(combiningStack, postedRequestsAreAppliedAsOneBatch) {
+    CombiningIntStack s{};
+    constructStack(&s);
+    push(&s, 1);
+
+    // Requests of the other threads, that are waiting for the combiner
+    int pushed = 2;
+    int popped = 0;
+    s._requests[0].value = &pushed;
+    s._requests[0].operation = StackCombiningOperation::push;
+    s._requests[1].value = &popped;
+    s._requests[1].operation = StackCombiningOperation::pop;
+    combineStackRequests(&s);
+
+    ASSERT_TRUE(s._requests[0].operation.load() == StackCombiningOperation::none);
+    ASSERT_TRUE(s._requests[1].operation.load() == StackCombiningOperation::none);
+    ASSERT_TRUE(s._requests[1].popped);
+    ASSERT_EQUALS(popped, 2);
+    ASSERT_EQUALS(getStackSize(&s), 1);
+
+    StackCombiningStats stats = getCombiningStats(&s);
+    ASSERT_EQUALS(stats.batches, (size_t)2);
+    ASSERT_EQUALS(stats.requests, (size_t)3);
+
+    destructStack(&s);
+}
+
+/**
+ * Collects the metrics of the stacks of int.
+ * @return snapshot of the family.
+ */
+static StackMetricsSnapshot getIntStackMetrics() {
+    StackMetricsSnapshot snapshots[STACK_MAX_METRICS_FAMILIES] = {};
+    size_t families = collectStackMetrics(snapshots, STACK_MAX_METRICS_FAMILIES);
+    for (size_t i = 0; i < families; ++i) {
+        if (strcmp(snapshots[i].name, getStackTypeName<int>()) == 0) return snapshots[i];
+    }
+    return {getStackTypeName<int>(), {}};
+}
+
+TEST(combiningStack, combinedRequestsAreCounted) {
+    StackMetricsSnapshot before = getIntStackMetrics();
+
+    CombiningIntStack s{};
+    constructStack(&s);
+    push(&s, 1);
+
+    int pushed = 2;
+    int popped = 0;
+    s._requests[0].value = &pushed;
+    s._requests[0].operation = StackCombiningOperation::push;
+    s._requests[1].value = &popped;
+    s._requests[1].operation = StackCombiningOperation::pop;
+    combineStackRequests(&s);
+    ASSERT_TRUE(tryPop(&s, &popped));
+    ASSERT_TRUE(!tryPop(&s, &popped));
+
+    // Pop from the empty stack isn't counted
+    StackMetricsSnapshot after = getIntStackMetrics();
+    ASSERT_EQUALS(after.values[STACK_METRIC_PUSHES] - before.values[STACK_METRIC_PUSHES], 2);
+    ASSERT_EQUALS(after.values[STACK_METRIC_POPS]   - before.values[STACK_METRIC_POPS],   2);
+    ASSERT_TRUE(after.values[STACK_METRIC_PEAK_SIZE] >= 2);
+
+    destructStack(&s);
+}
+
+TEST(combiningStack, corruptedStackFailsAssertion) {
+    CombiningIntStack s{};
+    constructStack(&s);
+    push(&s, 1);
+    push(&s, 2);
+
+    getStackData(&s._stack)[1] = 3;
+    ASSERT_FAILS_ASSERTION(push(&s, 3));
+    getStackData(&s._stack)[1] = 2;
+
+    s._stack._size = 1;
+    int value = 0;
+    ASSERT_FAILS_ASSERTION(tryPop(&s, &value));
+    s._stack._size = 2;
+
+    ASSERT_TRUE(tryPop(&s, &value));
+    ASSERT_EQUALS(value, 2);
+
+    destructStack(&s);
+}
@@ -0,0 +1,189 @@
+/**
+ * @file
+ */
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "testlib.h"
+#include "../src/concurrent_stack.h"
+
+/** Concurrent stack with all checks */
+typedef ConcurrentStack<int, StackSecurityPolicy<3>> ConcurrentIntStack;
+
+/** Number of threads in the concurrent tests */
+constexpr int testThreadsNumber = 8;
+
+/** Number of elements that are pushed by each thread in the concurrent tests */
+constexpr int testThreadElementsNumber = 20000;
+
+/** Number of nodes that are currently allocated by nodesCountingAllocator */
+static std::atomic<ssize_t> allocatedNodesCount{0};
+
+/** Allocator that counts allocated nodes. Uses systemStackAllocator to manage memory */
+static const StackAllocator nodesCountingAllocator = {
+    [](void* context, size_t bytes) {
+        ++allocatedNodesCount;
+        return systemStackAllocator.allocate(context, bytes);
+    },
+    systemStackAllocator.reallocate,
+    [](void* context, void* memory, size_t bytes) {
+        --allocatedNodesCount;
+        systemStackAllocator.deallocate(context, memory, bytes);
+    },
+    nullptr
+};
+
+TEST(concurrentStack, correctStackElementsOrder) {
+    ConcurrentIntStack s{};
+    constructStack(&s);
+
+    for (int i = 0; i < 100; ++i) {
+        push(&s, i);
+    }
+    ASSERT_EQUALS(getStackSize(&s), 100);
+
+    int value = 0;
+    for (int i = 99; i >= 0; --i) {
+        ASSERT_TRUE(tryPop(&s, &value));
+        ASSERT_EQUALS(value, i);
+    }
+    ASSERT_TRUE(!tryPop(&s, &value));
+    ASSERT_EQUALS(getStackSize(&s), 0);
+
+    destructStack(&s);
+}
+
+TEST(concurrentStack, everyElementIsPoppedOnce) {
+    ConcurrentIntStack s{};
+    constructStack(&s);
+
+    std::vector<std::atomic<int>> poppedCounts(testThreadsNumber * testThreadElementsNumber);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < testThreadsNumber; ++t) {
+        threads.emplace_back([&s, &poppedCounts, t]() {
+            int value = 0;
+            for (int i = 0; i < testThreadElementsNumber; ++i) {
+                push(&s, t * testThreadElementsNumber + i);
+                if (i % 2 == 1 && tryPop(&s, &value)) {
+                    ++poppedCounts[value];
+                }
+            }
+            while (tryPop(&s, &value)) {
+                ++poppedCounts[value];
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    ASSERT_EQUALS(getStackSize(&s), 0);
+    for (std::atomic<int>& count : poppedCounts) {
+        ASSERT_EQUALS(count.load(), 1);
+    }
+
+    destructStack(&s);
+}
+
+TEST(concurrentStack, nodesAreReclaimed) {
+    allocatedNodesCount = 0;
+    ConcurrentIntStack s{};
+    constructStack(&s, &nodesCountingAllocator);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < testThreadsNumber; ++t) {
+        threads.emplace_back([&s]() {
+            int value = 0;
+            for (int i = 0; i < testThreadElementsNumber; ++i) {
+                push(&s, i);
+                tryPop(&s, &value);
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    // Only the recently retired nodes are not freed yet
+    ASSERT_TRUE(allocatedNodesCount.load() <= STACK_RECLAIM_THRESHOLD + testThreadsNumber);
+
+    destructStack(&s);
+    ASSERT_EQUALS(allocatedNodesCount.load(), 0);
+}
+
+TEST(concurrentStack, corruptedNodeFailsAssertion) {
+    ConcurrentIntStack s{};
+    constructStack(&s);
+    push(&s, 1);
+    push(&s, 2);
+
+    int value = 0;
+    s._top.load()->_canariesAfter[0] = 0;
+    ASSERT_FAILS_ASSERTION(tryPop(&s, &value));
+    s._top.load()->_canariesAfter[0] = canaryValue;
+
+    *(int*)s._top.load()->_value = 3;
+    ASSERT_FAILS_ASSERTION(tryPop(&s, &value));
+    *(int*)s._top.load()->_value = 2;
+
+    ASSERT_TRUE(tryPop(&s, &value));
+    ASSERT_EQUALS(value, 2);
+
+    destructStack(&s);
+}
+
+/**
+ * Makes one more thread than STACK_MAX_THREADS use concurrent stacks at the same time.
+ * Threads keep their hazard pointers until all of them have taken one (or for 10 seconds, if some thread is aborted).
+ */
+static void useTooManyStackThreads() {
+    std::atomic<int> startedCount{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t <= STACK_MAX_THREADS; ++t) {
+        threads.emplace_back([&startedCount]() {
+            getStackHazardPointer();
+            ++startedCount;
+
+            std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+            while (startedCount.load() <= STACK_MAX_THREADS && std::chrono::steady_clock::now() < deadline) {
+                std::this_thread::yield();
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+TEST(concurrentStack, tooManyThreadsAbort) {
+    ASSERT_FAILS_ASSERTION(useTooManyStackThreads());
+}
+
+TEST(concurrentStack, stringsArePoppedFromManyThreads) {
+    ConcurrentStack<std::string> s{};
+    constructStack(&s);
+
+    std::vector<std::thread> threads;
+    std::atomic<ssize_t> poppedLength{0};
+    for (int t = 0; t < testThreadsNumber; ++t) {
+        threads.emplace_back([&s, &poppedLength]() {
+            std::string value;
+            for (int i = 0; i < 1000; ++i) {
+                push(&s, std::string(100, 'a'));
+                if (tryPop(&s, &value)) {
+                    poppedLength += value.size();
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    ASSERT_EQUALS(poppedLength.load(), 100 * 1000 * testThreadsNumber);
+
+    destructStack(&s);
+}
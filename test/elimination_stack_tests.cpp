@@ -0,0 +1,128 @@
+/**
+ * @file
+ */
+
+#include <atomic>
+#include <thread>
+#include "testlib.h"
+#include "../src/elimination_stack.h"
+
+/** Elimination stack with all checks */
+typedef EliminationStack<int, StackSecurityPolicy<3>, 4> EliminationIntStack;
+
+/** Number of pushing threads (and the same number of popping ones) in the concurrent tests */
+constexpr int testPushersNumber = 4;
+
+/** Number of elements that are pushed by each pushing thread in the concurrent tests */
+constexpr int testPusherElementsNumber = 20000;
+
+TEST(eliminationStack, correctStackElementsOrder) {
+    EliminationIntStack s{};
+    constructStack(&s);
+
+    for (int i = 0; i < 100; ++i) {
+        push(&s, i);
+    }
+    ASSERT_EQUALS(getStackSize(&s), 100);
+
+    int value = 0;
+    for (int i = 99; i >= 0; --i) {
+        ASSERT_TRUE(tryPop(&s, &value));
+        ASSERT_EQUALS(value, i);
+    }
+    ASSERT_TRUE(!tryPop(&s, &value));
+
+    // There was no contention, so the elimination array wasn't used
+    ASSERT_EQUALS(getEliminationStats(&s).visits, 0);
+
+    destructStack(&s);
+}
+
+TEST(eliminationStack, everyElementIsPoppedOnce) {
+    EliminationIntStack s{};
+    constructStack(&s);
+
+    std::vector<std::atomic<int>> poppedCounts(testPushersNumber * testPusherElementsNumber);
+    std::atomic<int> poppedTotal{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < testPushersNumber; ++t) {
+        threads.emplace_back([&s, t]() {
+            for (int i = 0; i < testPusherElementsNumber; ++i) {
+                push(&s, t * testPusherElementsNumber + i);
+            }
+        });
+        threads.emplace_back([&s, &poppedCounts, &poppedTotal]() {
+            int value = 0;
+            while (poppedTotal.load() < testPushersNumber * testPusherElementsNumber) {
+                if (tryPop(&s, &value)) {
+                    ++poppedCounts[value];
+                    ++poppedTotal;
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    ASSERT_EQUALS(getStackSize(&s), 0);
+    for (std::atomic<int>& count : poppedCounts) {
+        ASSERT_EQUALS(count.load(), 1);
+    }
+    StackEliminationStats stats = getEliminationStats(&s);
+    ASSERT_TRUE(stats.hits <= stats.visits);
+
+    destructStack(&s);
+}
+
+TEST(eliminationStack, pushAndPopMeetInEliminationArray) {
+    EliminationIntStack s{};
+    constructStack(&s);
+
+    // Both threads use the only slot that is in use
+    std::thread pusher([&s]() {
+        auto node = createStackNode(&s._stack, 42);
+        ASSERT_TRUE(offerStackNode(&s, node, 1UL << 28));
+    });
+
+    ConcurrentStackNode<int, StackSecurityPolicy<3>>* node = nullptr;
+    while (node == nullptr) {
+        node = takeStackNode(&s, STACK_BACKOFF_MIN_SPINS);
+    }
+    pusher.join();
+
+    ASSERT_TRUE(isStackNodeOk(node));
+    int value = 0;
+    releaseStackNode(&s._stack, node, &value);
+    ASSERT_EQUALS(value, 42);
+    ASSERT_EQUALS(getStackSize(&s), 0);
+    ASSERT_EQUALS(getEliminationStats(&s).hits, (size_t)2);
+
+    destructStack(&s);
+}
+
+TEST(eliminationStack, eliminationRangeStaysInBounds) {
+    EliminationIntStack s{};
+    constructStack(&s);
+
+    for (int i = 0; i < 10; ++i) {
+        adjustEliminationRange(&s, +1);
+    }
+    ASSERT_EQUALS(s._range.load(), 4);
+
+    for (int i = 0; i < 10; ++i) {
+        adjustEliminationRange(&s, -1);
+    }
+    ASSERT_EQUALS(s._range.load(), 1);
+
+    // Offer that nobody takes is withdrawn
+    auto node = createStackNode(&s._stack, 1);
+    ASSERT_TRUE(!offerStackNode(&s, node, STACK_BACKOFF_MIN_SPINS));
+    ASSERT_TRUE(tryLinkStackNode(&s._stack, node));
+
+    int value = 0;
+    ASSERT_TRUE(tryPop(&s, &value));
+    ASSERT_EQUALS(value, 1);
+
+    destructStack(&s);
+}
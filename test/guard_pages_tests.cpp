@@ -0,0 +1,70 @@
+/**
+ * @file
+ */
+
+#include "testlib.h"
+#include "../src/immortal_stack.h"
+
+/** Stack with all checks, whose data array is surrounded by guard pages instead of canaries */
+typedef ImmortalStack<int, StackPolicy<StackDumpLogging, StackGuardPages<>, StackStateHashing>> GuardedIntStack;
+
+TEST(guardPages, dataArrayGrowsInPlace) {
+    GuardedIntStack s{};
+    constructStack(&s);
+    push(&s, 0);
+
+    // Data array fills the whole pages, so it ends right before the trailing guard page
+    ASSERT_EQUALS(getStackCapacity(&s) * sizeof(int) % roundUpToPageSize(1), (size_t)0);
+
+    int* data = getStackData(&s);
+    for (int i = 1; i < 100000; ++i) {
+        push(&s, i);
+    }
+    ASSERT_TRUE(getStackData(&s) == data);
+
+    for (int i = 99999; i >= 0; --i) {
+        ASSERT_EQUALS(pop(&s), i);
+    }
+    ASSERT_TRUE(getStackData(&s) == data);
+
+    destructStack(&s);
+}
+
+TEST(guardPages, overflowTraps) {
+    GuardedIntStack s{};
+    constructStack(&s, 10);
+    push(&s, 1);
+
+    volatile int* data = getStackData(&s);
+    ASSERT_FAILS_ASSERTION(data[getStackCapacity(&s)] = 2);
+    ASSERT_FAILS_ASSERTION(data[-1] = 2);
+
+    // Reading is trapped too
+    ASSERT_FAILS_ASSERTION(printf("%d", data[getStackCapacity(&s) + 1]));
+
+    ASSERT_EQUALS(pop(&s), 1);
+    destructStack(&s);
+}
+
+TEST(guardPages, structCanariesAreChecked) {
+    GuardedIntStack s{};
+    constructStack(&s);
+    push(&s, 1);
+
+    s._canariesAfter[0] = 0;
+    ASSERT_FAILS_ASSERTION(push(&s, 2));
+    s._canariesAfter[0] = canaryValue;
+
+    ASSERT_EQUALS(pop(&s), 1);
+    destructStack(&s);
+}
+
+TEST(guardPages, otherFaultsArePassedOn) {
+    GuardedIntStack s{};
+    constructStack(&s);
+
+    // Fault outside the guard pages isn't reported as the stack corruption (it doesn't abort)
+    ASSERT_DIES(*(volatile int*)nullptr = 1);
+
+    destructStack(&s);
+}
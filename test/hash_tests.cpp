@@ -0,0 +1,88 @@
+/**
+ * @file
+ */
+
+#include "testlib.h"
+#include "../src/hash.h"
+
+// Hash test targets for the instruction sets (see CMakeLists.txt) must check the SIMD kernels, not their fallbacks
+#if defined(HASH_TESTS_REQUIRE_AVX2) && !defined(__AVX2__)
+    #error "AVX2 kernel isn't compiled, hash_tests_avx2 must be built with -mavx2"
+#endif
+#if defined(HASH_TESTS_REQUIRE_SSE42) && !defined(__SSE4_2__)
+    #error "SSE4.2 kernel isn't compiled, hash_tests_sse42 must be built with -msse4.2"
+#endif
+
+/** Size of the buffers that are hashed in tests */
+#define HASH_TEST_BUFFER_SIZE 300
+
+/**
+ * Fills the given buffer with pseudo random bytes.
+ * @param[out] buffer buffer to fill
+ * @param[in]  size   size of the buffer
+ */
+static void fillRandomBytes(unsigned char* buffer, size_t size) {
+    srand(42);
+    for (size_t i = 0; i < size; ++i) {
+        buffer[i] = (unsigned char)rand();
+    }
+}
+
+TEST(polynomialHash, wordwiseMatchesBytewise) {
+    unsigned char buffer[HASH_TEST_BUFFER_SIZE];
+    fillRandomBytes(buffer, HASH_TEST_BUFFER_SIZE);
+
+    for (size_t offset = 0; offset < 8; ++offset) {
+        for (size_t length = 0; length + offset <= HASH_TEST_BUFFER_SIZE; length += 7) {
+            ASSERT_EQUALS(polynomialHashBytes(1, buffer + offset, length), polynomialHashBytesBytewise(1, buffer + offset, length));
+        }
+    }
+}
+
+TEST(polynomialHash, avx2MatchesBytewise) {
+    unsigned char buffer[HASH_TEST_BUFFER_SIZE];
+    fillRandomBytes(buffer, HASH_TEST_BUFFER_SIZE);
+
+    for (size_t offset = 0; offset < 8; ++offset) {
+        for (size_t length = 0; length + offset <= HASH_TEST_BUFFER_SIZE; length += 7) {
+            ASSERT_EQUALS(polynomialHashBytesAvx2(1, buffer + offset, length), polynomialHashBytesBytewise(1, buffer + offset, length));
+        }
+    }
+}
+
+TEST(polynomialHash, unhashRevertsHash) {
+    unsigned char buffer[HASH_TEST_BUFFER_SIZE];
+    fillRandomBytes(buffer, HASH_TEST_BUFFER_SIZE);
+
+    const unsigned long long prefixHash = polynomialHashBytes(0, buffer, 100);
+    const unsigned long long fullHash   = polynomialHashBytes(prefixHash, buffer + 100, HASH_TEST_BUFFER_SIZE - 100);
+    ASSERT_EQUALS(fullHash, polynomialHashBytes(0, buffer, HASH_TEST_BUFFER_SIZE));
+    ASSERT_EQUALS(polynomialUnhashBytes(fullHash, buffer + 100, HASH_TEST_BUFFER_SIZE - 100), prefixHash);
+}
+
+TEST(crc32cHash, checkValue) {
+    const char* checkString = "123456789";
+    const unsigned long long crc = crc32cHashBytes(0xFFFFFFFFU, checkString, strlen(checkString)) ^ 0xFFFFFFFFU;
+    ASSERT_EQUALS(crc, 0xE3069283U);
+}
+
+TEST(crc32cHash, hardwareMatchesPortable) {
+    unsigned char buffer[HASH_TEST_BUFFER_SIZE];
+    fillRandomBytes(buffer, HASH_TEST_BUFFER_SIZE);
+
+    for (size_t offset = 0; offset < 8; ++offset) {
+        for (size_t length = 0; length + offset <= HASH_TEST_BUFFER_SIZE; length += 7) {
+            ASSERT_EQUALS(crc32cHashBytes(1, buffer + offset, length), crc32cHashBytesPortable(1, buffer + offset, length));
+        }
+    }
+}
+
+TEST(crc32cHash, unhashRevertsHash) {
+    unsigned char buffer[HASH_TEST_BUFFER_SIZE];
+    fillRandomBytes(buffer, HASH_TEST_BUFFER_SIZE);
+
+    const unsigned long long prefixHash = crc32cHashBytes(0x12345678U, buffer, 100);
+    const unsigned long long fullHash   = crc32cHashBytes(prefixHash, buffer + 100, HASH_TEST_BUFFER_SIZE - 100);
+    ASSERT_EQUALS(fullHash, crc32cHashBytes(0x12345678U, buffer, HASH_TEST_BUFFER_SIZE));
+    ASSERT_EQUALS(crc32cUnhashBytes(fullHash, buffer + 100, HASH_TEST_BUFFER_SIZE - 100), prefixHash);
+}
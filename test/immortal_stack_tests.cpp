@@ -0,0 +1,535 @@
+/**
+ * @file
+ */
+
+#include <cstring>
+#include <string>
+#include "testlib.h"
+#include "../src/immortal_stack.h"
+
+/** Stack without any checks */
+typedef ImmortalStack<int, StackSecurityPolicy<0>> UncheckedIntStack;
+
+/** Stack with canary guards, but without hash checking */
+typedef ImmortalStack<int, StackPolicy<StackDumpLogging, StackCanaries<2>, NoStackHashing>> GuardedIntStack;
+
+/** Stack with all checks */
+typedef ImmortalStack<int, StackSecurityPolicy<3>> HashedIntStack;
+
+/** Stack with all checks, that stores the first 16 elements inside the struct */
+typedef ImmortalStack<int, StackSecurityPolicy<3>, 16> InlineIntStack;
+
+/** Stack, whose elements are hashed by blocks of 16 elements */
+typedef ImmortalStack<int, StackPolicy<StackDumpLogging, NoStackCanaries, StackBlockHashing<16>>> BlockHashedIntStack;
+
+/** Stack, that repairs one corrupted block of 16 elements and its corrupted members */
+typedef ImmortalStack<int, StackPolicy<StackDumpLogging, StackCanaries<>, StackBlockHashing<16>, StackSyncVerification,
+                                       StackParityRepair>> RepairedIntStack;
+
+/** Number of allocations that were made by countingAllocator */
+static ssize_t allocationsCount = 0;
+
+/** Allocator that counts allocations. Uses systemStackAllocator to manage memory */
+static const StackAllocator countingAllocator = {
+    [](void* context, size_t bytes) {
+        ++allocationsCount;
+        return systemStackAllocator.allocate(context, bytes);
+    },
+    systemStackAllocator.reallocate,
+    systemStackAllocator.deallocate,
+    nullptr
+};
+
+TEST(securityPolicy, disabledMembersTakeNoSpace) {
+    ASSERT_EQUALS(sizeof(UncheckedIntStack), sizeof(ssize_t) * 2 + sizeof(int*) + sizeof(StackAllocator*));
+    ASSERT_EQUALS(sizeof(GuardedIntStack), sizeof(UncheckedIntStack) + sizeof(long long) * 4);
+    ASSERT_EQUALS(sizeof(HashedIntStack), sizeof(UncheckedIntStack) + sizeof(long long) * 2 + sizeof(unsigned long long) * 3);
+}
+
+TEST(securityPolicy, stacksWithDifferentPoliciesInOneProgram) {
+    UncheckedIntStack unchecked{};
+    GuardedIntStack guarded{};
+    HashedIntStack hashed{};
+    constructStack(&unchecked);
+    constructStack(&guarded);
+    constructStack(&hashed);
+
+    for (int i = 0; i < 100; ++i) {
+        push(&unchecked, i);
+        push(&guarded, i);
+        push(&hashed, i);
+    }
+    for (int i = 99; i >= 0; --i) {
+        ASSERT_EQUALS(pop(&unchecked), i);
+        ASSERT_EQUALS(pop(&guarded), i);
+        ASSERT_EQUALS(pop(&hashed), i);
+    }
+
+    destructStack(&unchecked);
+    destructStack(&guarded);
+    destructStack(&hashed);
+}
+
+TEST(securityPolicy, onlyEnabledChecksFail) {
+    UncheckedIntStack unchecked{};
+    GuardedIntStack guarded{};
+    constructStack(&unchecked);
+    constructStack(&guarded);
+
+    guarded._canariesBefore[1] = 0;
+    ASSERT_FAILS_ASSERTION(push(&guarded, 1));
+    guarded._canariesBefore[1] = canaryValue;
+
+    // Hash checking is turned off, so data modification is not detected
+    push(&guarded, 1);
+    getStackData(&guarded)[0] = 2;
+    ASSERT_EQUALS(pop(&guarded), 2);
+
+    unchecked._size = 1;
+    ASSERT_EQUALS(getStackSize(&unchecked), 1);
+    unchecked._size = 0;
+
+    destructStack(&unchecked);
+    destructStack(&guarded);
+}
+
+TEST(securityPolicy, dumpContainsStackTypeName) {
+    ASSERT_TRUE(strcmp(getStackTypeName<int>(), "Stack_int") == 0);
+    ASSERT_TRUE(strcmp(getStackTypeName<double>(), "Stack_double") == 0);
+}
+
+TEST(inlineStorage, noAllocationsUntilInlineCapacityIsExceeded) {
+    allocationsCount = 0;
+    InlineIntStack s{};
+    constructStack(&s, 0, &countingAllocator);
+    ASSERT_EQUALS(getStackCapacity(&s), 16);
+    ASSERT_TRUE(isStackDataInline(&s));
+
+    for (int i = 0; i < 16; ++i) {
+        push(&s, i);
+    }
+    ASSERT_EQUALS(allocationsCount, 0);
+
+    push(&s, 16);
+    ASSERT_EQUALS(allocationsCount, 1);
+    ASSERT_EQUALS(getStackCapacity(&s), 32);
+    ASSERT_TRUE(!isStackDataInline(&s));
+
+    for (int i = 16; i >= 0; --i) {
+        ASSERT_EQUALS(pop(&s), i);
+    }
+
+    destructStack(&s);
+}
+
+TEST(inlineStorage, shrinkToFitReturnsToInlineData) {
+    InlineIntStack s{};
+    constructStack(&s, 100);
+    ASSERT_TRUE(!isStackDataInline(&s));
+
+    for (int i = 0; i < 10; ++i) {
+        push(&s, i);
+    }
+    shrinkToFit(&s);
+    ASSERT_TRUE(isStackDataInline(&s));
+    ASSERT_EQUALS(getStackCapacity(&s), 16);
+    ASSERT_EQUALS(s._dataHash, getDataHash(&s));
+
+    for (int i = 9; i >= 0; --i) {
+        ASSERT_EQUALS(pop(&s), i);
+    }
+
+    destructStack(&s);
+}
+
+TEST(inlineStorage, inlineDataIsChecked) {
+    InlineIntStack s{};
+    constructStack(&s);
+    push(&s, 1);
+
+    getStackData(&s)[0] = 2;
+    ASSERT_FAILS_ASSERTION(push(&s, 3));
+    getStackData(&s)[0] = 1;
+
+    // Element after the last inline one is the data canary
+    getStackData(&s)[16] = 0;
+    ASSERT_FAILS_ASSERTION(push(&s, 3));
+    getStackData(&s)[16] = (int)canaryValue;
+
+    destructStack(&s);
+}
+
+/** Value that counts its copies, moves and live instances */
+struct TrackedValue {
+    static ssize_t copiesCount;
+    static ssize_t movesCount;
+    static ssize_t liveCount;
+
+    int value;
+
+    TrackedValue(int value) : value(value) { ++liveCount; }
+    TrackedValue(const TrackedValue& other) : value(other.value) { ++liveCount; ++copiesCount; }
+    TrackedValue(TrackedValue&& other) noexcept : value(other.value) { ++liveCount; ++movesCount; }
+    TrackedValue& operator=(const TrackedValue& other) { value = other.value; ++copiesCount; return *this; }
+    TrackedValue& operator=(TrackedValue&& other) noexcept { value = other.value; ++movesCount; return *this; }
+    ~TrackedValue() { --liveCount; }
+
+    static void resetCounters() {
+        copiesCount = 0;
+        movesCount = 0;
+        liveCount = 0;
+    }
+};
+
+ssize_t TrackedValue::copiesCount = 0;
+ssize_t TrackedValue::movesCount = 0;
+ssize_t TrackedValue::liveCount = 0;
+
+/**
+ * Logs TrackedValue into log file.
+ */
+inline void logValue(const TrackedValue& value) {
+    logPrintf("%d", value.value);
+}
+
+TEST(moveSemantics, elementsAreNeverCopied) {
+    TrackedValue::resetCounters();
+    ImmortalStack<TrackedValue, StackSecurityPolicy<3>> s{};
+    constructStack(&s);
+
+    for (int i = 0; i < 100; ++i) {
+        if (i % 2 == 0) {
+            push(&s, TrackedValue(i));
+        } else {
+            emplace(&s, i);
+        }
+    }
+    ASSERT_EQUALS(top(&s).value, 99);
+    ASSERT_EQUALS(s._dataHash, getDataHash(&s));
+
+    for (int i = 99; i >= 0; --i) {
+        ASSERT_EQUALS(pop(&s).value, i);
+    }
+    ASSERT_EQUALS(TrackedValue::copiesCount, 0);
+
+    destructStack(&s);
+}
+
+TEST(moveSemantics, onlyLiveElementsAreDestructed) {
+    TrackedValue::resetCounters();
+    ImmortalStack<TrackedValue, StackSecurityPolicy<2>, 4> s{};
+    constructStack(&s, 100);
+    ASSERT_EQUALS(TrackedValue::liveCount, 0);
+
+    for (int i = 0; i < 10; ++i) {
+        emplace(&s, i);
+    }
+    ASSERT_EQUALS(TrackedValue::liveCount, 10);
+
+    pop(&s);
+    shrinkToFit(&s);
+    ASSERT_EQUALS(TrackedValue::liveCount, 9);
+
+    destructStack(&s);
+    ASSERT_EQUALS(TrackedValue::liveCount, 0);
+}
+
+TEST(moveSemantics, stringsSurviveEnlarging) {
+    ImmortalStack<std::string> s{};
+    constructStack(&s);
+
+    for (int i = 0; i < 1000; ++i) {
+        push(&s, std::to_string(i));
+    }
+    std::string popped[10];
+    popN(&s, popped, 10);
+    ASSERT_TRUE(popped[9] == "999");
+
+    for (int i = 989; i >= 0; --i) {
+        ASSERT_TRUE(pop(&s) == std::to_string(i));
+    }
+
+    destructStack(&s);
+}
+
+TEST(moveSemantics, pushingTopSurvivesEnlarging) {
+    ImmortalStack<int, StackSecurityPolicy<3>> ints{};
+    constructStack(&ints);
+    push(&ints, 42);
+
+    // Capacity is doubled when it's full, so the pushed top is freed by some of these pushes
+    for (int i = 0; i < 100; ++i) {
+        push(&ints, top(&ints));
+    }
+    ASSERT_EQUALS(getStackSize(&ints), 101);
+    for (int i = 0; i < 101; ++i) {
+        ASSERT_EQUALS(pop(&ints), 42);
+    }
+    destructStack(&ints);
+
+    ImmortalStack<std::string> strings{};
+    constructStack(&strings);
+    const std::string value(100, 'x'); // Not a small string, so it's stored in the heap
+    push(&strings, value);
+
+    for (int i = 0; i < 100; ++i) {
+        push(&strings, top(&strings));
+        emplace(&strings, top(&strings));
+    }
+    ASSERT_EQUALS(getStackSize(&strings), 201);
+    for (int i = 0; i < 201; ++i) {
+        ASSERT_TRUE(pop(&strings) == value);
+    }
+    destructStack(&strings);
+}
+
+TEST(blockHashing, hashesFollowOperations) {
+    BlockHashedIntStack s{};
+    constructStack(&s);
+
+    int values[40] = {};
+    for (int i = 0; i < 40; ++i) {
+        values[i] = 100 + i;
+    }
+    for (int i = 0; i < 30; ++i) {
+        push(&s, i);
+    }
+    pushN(&s, values, 40);
+    popN(&s, values, 25);
+    ASSERT_EQUALS(pop(&s), 114);
+    shrinkToFit(&s);
+
+    ASSERT_EQUALS(getStackSize(&s), 44);
+    ASSERT_EQUALS(getStackBlocksNumber(&s, getStackSize(&s)), 3);
+    ASSERT_EQUALS(findCorruptedStackBlock(&s, 0), -1);
+    ASSERT_EQUALS(s._dataHash, getDataHash(&s));
+    ASSERT_TRUE(isStackIntegrityOk(&s));
+
+    destructStack(&s);
+}
+
+TEST(blockHashing, corruptedBlockIsFound) {
+    BlockHashedIntStack s{};
+    constructStack(&s);
+    for (int i = 0; i < 100; ++i) {
+        push(&s, i);
+    }
+
+    // Operations check only the top block
+    getStackData(&s)[40] = -1;
+    push(&s, 100);
+    ASSERT_EQUALS(pop(&s), 100);
+
+    ASSERT_EQUALS(findCorruptedStackBlock(&s, 0), 2);
+    ASSERT_EQUALS(findCorruptedStackBlock(&s, 3), -1);
+    ASSERT_TRUE(!isStackIntegrityOk(&s));
+    ASSERT_TRUE(isStackIntegrityOk(&s, true));
+
+    getStackData(&s)[99] = -1;
+    ASSERT_FAILS_ASSERTION(pop(&s));
+
+    getStackData(&s)[40] = 40;
+    getStackData(&s)[99] = 99;
+    ASSERT_TRUE(isStackIntegrityOk(&s));
+
+    destructStack(&s);
+}
+
+TEST(blockHashing, onlyCorruptedBlocksAreLogged) {
+    const char* logFileName = "block-hashing-test.txt";
+    BlockHashedIntStack s{};
+    constructStack(&s);
+    for (int i = 0; i < 100; ++i) {
+        push(&s, i);
+    }
+    getStackData(&s)[40] = -1;
+
+    logOpen(logFileName, "w");
+    LOG_STACK(&s);
+    logClose();
+    getStackData(&s)[40] = 40;
+
+    char log[4096] = {};
+    FILE* logFile = fopen(logFileName, "r");
+    ASSERT_NOT_NULL(logFile);
+    fread(log, 1, sizeof(log) - 1, logFile);
+    fclose(logFile);
+    remove(logFileName);
+
+    ASSERT_NOT_NULL(strstr(log, "corruptedBlock = 2"));
+    ASSERT_NOT_NULL(strstr(log, "[32] = 32"));
+    ASSERT_NOT_NULL(strstr(log, "[40] = -1"));
+    ASSERT_NULL(strstr(log, "[31] = "));
+    ASSERT_NULL(strstr(log, "[48] = "));
+
+    destructStack(&s);
+}
+
+TEST(parityRepair, corruptedBlockIsRepaired) {
+    RepairedIntStack s{};
+    constructStack(&s);
+    for (int i = 0; i < 100; ++i) {
+        push(&s, i);
+    }
+
+    getStackData(&s)[40] = -1;
+    getStackData(&s)[41] = -1;
+    ASSERT_TRUE(!isStackIntegrityOk(&s));
+    ASSERT_TRUE(repairStack(&s));
+    ASSERT_EQUALS(getStackData(&s)[40], 40);
+    ASSERT_EQUALS(getStackData(&s)[41], 41);
+
+    // Corrupted top block is repaired by the check of the operation
+    getStackData(&s)[99] = -1;
+    push(&s, 100);
+    ASSERT_EQUALS(pop(&s), 100);
+    ASSERT_EQUALS(pop(&s), 99);
+    ASSERT_TRUE(isStackIntegrityOk(&s));
+
+    destructStack(&s);
+}
+
+TEST(parityRepair, membersAreRestoredFromMirror) {
+    RepairedIntStack s{};
+    constructStack(&s);
+    for (int i = 0; i < 100; ++i) {
+        push(&s, i);
+    }
+
+    s._size = 5;
+    s._canariesBefore[0] = 0;
+    push(&s, 100);
+    ASSERT_EQUALS(s._size, 101);
+    ASSERT_EQUALS(s._canariesBefore[0], canaryValue);
+
+    // Corrupted mirror is restored from the members
+    s._mirror.size = 5;
+    ASSERT_TRUE(repairStack(&s));
+    ASSERT_EQUALS(s._mirror.size, 101);
+
+    s._blockHashes[1] = 0;
+    ASSERT_TRUE(repairStack(&s));
+    ASSERT_TRUE(isStackIntegrityOk(&s));
+
+    destructStack(&s);
+}
+
+TEST(parityRepair, severalCorruptedBlocksFailAssertion) {
+    RepairedIntStack s{};
+    constructStack(&s);
+    for (int i = 0; i < 100; ++i) {
+        push(&s, i);
+    }
+
+    getStackData(&s)[90] = -1;
+    getStackData(&s)[99] = -1;
+    ASSERT_TRUE(!repairStack(&s));
+    ASSERT_FAILS_ASSERTION(push(&s, 100));
+
+    getStackData(&s)[90] = 90;
+    getStackData(&s)[99] = 99;
+    destructStack(&s);
+}
+
+TEST(logModes, windowedStackHasTopAndMismatches) {
+    const char* logFileName = "log-modes-test.txt";
+    GuardedIntStack s{};
+    constructStack(&s);
+    for (int i = 0; i < 100; ++i) {
+        push(&s, i);
+    }
+    const ssize_t capacity = s._capacity;
+    long long* dataCanariesAfter = (long long*)(getStackData(&s) + capacity);
+    dataCanariesAfter[0] = 0;
+
+    logOpen(logFileName, "w");
+    LOG_STACK_MODE(&s, STACK_LOG_WINDOWED);
+    logClose();
+    dataCanariesAfter[0] = canaryValue;
+
+    char log[8192] = {};
+    FILE* logFile = fopen(logFileName, "r");
+    ASSERT_NOT_NULL(logFile);
+    fread(log, 1, sizeof(log) - 1, logFile);
+    fclose(logFile);
+    remove(logFileName);
+
+    char lastElement[64] = "";
+    snprintf(lastElement, sizeof(lastElement), "\t\t[%zd] = ", capacity - 1);
+    ASSERT_NOT_NULL(strstr(log, "\t\t[15] = 15\n\t\t...\n\t\t[84] = 84\n"));
+    ASSERT_NOT_NULL(strstr(log, "\t\t[99] = 99\n"));
+    ASSERT_NOT_NULL(strstr(log, lastElement));
+    ASSERT_NULL(strstr(log, "[16] = "));
+    ASSERT_NULL(strstr(log, "[50] = "));
+    ASSERT_NOT_NULL(strstr(log, "dataCanariesAfter ["));
+
+    destructStack(&s);
+}
+
+TEST(logModes, windowedBlocksAreLogged) {
+    const char* logFileName = "log-modes-test.txt";
+    BlockHashedIntStack s{};
+    constructStack(&s);
+    for (int i = 0; i < 200; ++i) {
+        push(&s, i);
+    }
+    getStackData(&s)[100] = -1;
+
+    setStackLogMode(STACK_LOG_WINDOWED);
+    logOpen(logFileName, "w");
+    LOG_STACK(&s);
+    logClose();
+    setStackLogMode(STACK_LOG_DEFAULT_MODE);
+    getStackData(&s)[100] = 100;
+
+    char log[8192] = {};
+    FILE* logFile = fopen(logFileName, "r");
+    ASSERT_NOT_NULL(logFile);
+    fread(log, 1, sizeof(log) - 1, logFile);
+    fclose(logFile);
+    remove(logFileName);
+
+    ASSERT_NOT_NULL(strstr(log, "\t\t[0] = 0\n"));
+    ASSERT_NOT_NULL(strstr(log, "\t\t...\n\t\t[96] = 96\n"));
+    ASSERT_NOT_NULL(strstr(log, "\t\t[100] = -1\n"));
+    ASSERT_NOT_NULL(strstr(log, "\t\t[111] = 111\n\t\t...\n\t\t[184] = 184\n"));
+    ASSERT_NULL(strstr(log, "[50] = "));
+
+    destructStack(&s);
+}
+
+TEST(logModes, hexdumpHasWholeDataArray) {
+    const char* logFileName = "log-modes-test.txt";
+    remove(stackHexdumpFileName);
+    GuardedIntStack s{};
+    constructStack(&s);
+    push(&s, 0x41424344);
+
+    logOpen(logFileName, "w");
+    LOG_STACK_MODE(&s, STACK_LOG_HEXDUMP);
+    logClose();
+
+    char log[4096] = {};
+    FILE* logFile = fopen(logFileName, "r");
+    ASSERT_NOT_NULL(logFile);
+    fread(log, 1, sizeof(log) - 1, logFile);
+    fclose(logFile);
+    remove(logFileName);
+    ASSERT_NOT_NULL(strstr(log, "is hexdumped into " stackHexdumpFileName));
+    ASSERT_NULL(strstr(log, "[0] = "));
+
+    char hexdump[4096] = {};
+    FILE* hexdumpFile = fopen(stackHexdumpFileName, "r");
+    ASSERT_NOT_NULL(hexdumpFile);
+    size_t hexdumpLength = fread(hexdump, 1, sizeof(hexdump) - 1, hexdumpFile);
+    fclose(hexdumpFile);
+    remove(stackHexdumpFileName);
+
+    const size_t bytes = getStackDataBytes(&s, s._capacity);
+    ASSERT_EQUALS(hexdumpLength, strchr(hexdump, '\n') + 1 - hexdump +
+                                 (bytes + hexdumpLineBytes - 1) / hexdumpLineBytes * hexdumpLineLength);
+    ASSERT_NOT_NULL(strstr(hexdump, "ed cc 4e 0c 00 00 00 00  ed cc 4e 0c 00 00 00 00  |..N.......N.....|\n"));
+    ASSERT_NOT_NULL(strstr(hexdump, "|DCBA"));
+
+    destructStack(&s);
+}
@@ -0,0 +1,254 @@
+/**
+ * @file
+ */
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include "testlib.h"
+#include "../src/logger.h"
+
+/** Log file that is written by the tests */
+static const char* loggerTestFileName = "logger-test.txt";
+
+/** User type, that is logged by its own formatter */
+struct LoggedPoint {
+    int x;
+    double y;
+};
+
+/** Formatter of LoggedPoint */
+template <>
+struct StackLogFormatter<LoggedPoint> {
+    static void write(const LoggedPoint& point) {
+        logWrite("{x = ");
+        logValue(point.x);
+        logWrite(", y = ");
+        logValue(point.y);
+        logWrite("}");
+    }
+};
+
+TEST(logger, asyncMessagesAreFlushed) {
+    ASSERT_TRUE(startLogFlusher(1000));
+    ASSERT_TRUE(!startLogFlusher(1000));
+
+    int value = 42;
+    int array[] = {1, 2, 3};
+    logOpen(loggerTestFileName, "w");
+    LOG_VALUE(value);
+    LOG_ARRAY(array, 3);
+    logClose();
+
+    // The flusher sleeps, so the message is written only by logFlush
+    logFlush();
+    std::string log = readAndRemoveTestFile(loggerTestFileName);
+    ASSERT_TRUE(log.find("value = 42\n") != std::string::npos);
+    ASSERT_TRUE(log.find("\t[2] = 3\n") != std::string::npos);
+
+    stopLogFlusher();
+    ASSERT_NULL(_logFile);
+}
+
+TEST(logger, threadsDontMixMessages) {
+    constexpr int threadsNumber = 4;
+    constexpr int messagesNumber = 500;
+
+    logOpen(loggerTestFileName, "w");
+    logClose();
+    ASSERT_TRUE(startLogFlusher(1));
+
+    std::thread threads[threadsNumber];
+    for (int i = 0; i < threadsNumber; ++i) {
+        threads[i] = std::thread([i]() {
+            for (int j = 0; j < messagesNumber; ++j) {
+                logOpen(loggerTestFileName);
+                logPrintf("begin %d %d\n", i, j);
+                logPrintf("end %d %d\n", i, j);
+                logClose();
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    stopLogFlusher();
+
+    std::string log = readAndRemoveTestFile(loggerTestFileName);
+    int messagesCount = 0;
+    int lastMessages[threadsNumber] = {-1, -1, -1, -1};
+    for (size_t position = 0; position < log.size(); ++messagesCount) {
+        int thread = 0;
+        int message = 0;
+        int endThread = 0;
+        int endMessage = 0;
+        int length = 0;
+        ASSERT_EQUALS(sscanf(log.c_str() + position, "begin %d %d\nend %d %d\n%n",
+                             &thread, &message, &endThread, &endMessage, &length), 4);
+        ASSERT_EQUALS(endThread, thread);
+        ASSERT_EQUALS(endMessage, message);
+        ASSERT_EQUALS(message, lastMessages[thread] + 1);
+        lastMessages[thread] = message;
+        position += length;
+    }
+    ASSERT_EQUALS(messagesCount, threadsNumber * messagesNumber);
+}
+
+TEST(logger, messagesLongerThanRingAreWritten) {
+    ASSERT_TRUE(startLogFlusher(1000));
+
+    std::string line(1000, 'x');
+    logOpen(loggerTestFileName, "w");
+    for (int i = 0; i < 3 * STACK_LOG_RING_BYTES / 1000; ++i) {
+        logPrintf("%s\n", line.c_str());
+    }
+    logClose();
+    stopLogFlusher();
+
+    std::string log = readAndRemoveTestFile(loggerTestFileName);
+    ASSERT_EQUALS(log.size(), (size_t)(3 * STACK_LOG_RING_BYTES / 1000 * 1001));
+    ASSERT_EQUALS(log.find_first_not_of("x\n"), std::string::npos);
+}
+
+TEST(logger, messagesLongerThanRingAreNotMixed) {
+    logOpen(loggerTestFileName, "w");
+    logClose();
+    ASSERT_TRUE(startLogFlusher(1));
+
+    // Other thread logs short messages while the long one is written in parts
+    std::atomic<bool> longMessageLogged{false};
+    std::thread shortMessages([&longMessageLogged]() {
+        while (!longMessageLogged.load()) {
+            logOpen(loggerTestFileName);
+            logPrintf("short\n");
+            logClose();
+        }
+    });
+
+    std::string line(1000, 'x');
+    logOpen(loggerTestFileName);
+    for (int i = 0; i < 3 * STACK_LOG_RING_BYTES / 1000; ++i) {
+        logPrintf("%s\n", line.c_str());
+        std::this_thread::yield();
+    }
+    logClose();
+    longMessageLogged = true;
+    shortMessages.join();
+    stopLogFlusher();
+
+    std::string log = readAndRemoveTestFile(loggerTestFileName);
+    const size_t first = log.find('x');
+    const size_t last  = log.rfind('x');
+    ASSERT_TRUE(first != std::string::npos);
+    ASSERT_EQUALS(last + 2 - first, (size_t)(3 * STACK_LOG_RING_BYTES / 1000 * 1001));
+    ASSERT_EQUALS(log.find_first_not_of("x\n", first), last + 2);
+}
+
+TEST(logger, valuesAreFormattedAsPrintf) {
+    const int ints[] = {0, -1, 42, -2147483647 - 1, 2147483647};
+    const unsigned long long bigs[] = {0, 18446744073709551615ull};
+    const double doubles[] = {0.0, -1.5, 3.14159265358979, 1e-7, 123456789.0, 1e300};
+    const long double longDouble = 1e-310L;
+    const unsigned char byte = 200;
+    const bool flag = false;
+    const char letter = 'q';
+    const char* string = "text";
+
+    logOpen(loggerTestFileName, "w");
+    LOG_ARRAY(ints, 5);
+    LOG_ARRAY(bigs, 2);
+    LOG_ARRAY(doubles, 6);
+    LOG_VALUE(longDouble);
+    LOG_VALUE(byte);
+    LOG_VALUE(flag);
+    LOG_VALUE(letter);
+    LOG_VALUE(string);
+    logClose();
+
+    std::string expected;
+    char line[256];
+    for (size_t i = 0; i < 5; ++i) {
+        snprintf(line, sizeof(line), "\t[%zu] = %d\n", i, ints[i]);
+        expected += line;
+    }
+    for (size_t i = 0; i < 2; ++i) {
+        snprintf(line, sizeof(line), "\t[%zu] = %llu\n", i, bigs[i]);
+        expected += line;
+    }
+    for (size_t i = 0; i < 6; ++i) {
+        snprintf(line, sizeof(line), "\t[%zu] = %lg\n", i, doubles[i]);
+        expected += line;
+    }
+    snprintf(line, sizeof(line), "longDouble = %Lg\nbyte = 200\nflag = false\nletter = q\nstring = text\n", longDouble);
+    expected += line;
+
+    std::string log = readAndRemoveTestFile(loggerTestFileName);
+    std::string values;
+    for (size_t position = 0; position < log.size();) {
+        size_t end = log.find('\n', position) + 1;
+        std::string logLine = log.substr(position, end - position);
+        if (logLine.find(" = ") != std::string::npos && logLine.find(" [0x") == std::string::npos) values += logLine;
+        position = end;
+    }
+    ASSERT_TRUE(values == expected);
+}
+
+TEST(logger, userTypesHaveFormatters) {
+    LoggedPoint points[] = {{1, 0.5}, {-2, 1e10}};
+
+    logOpen(loggerTestFileName, "w");
+    LOG_ARRAY(points, 2);
+    logClose();
+
+    std::string log = readAndRemoveTestFile(loggerTestFileName);
+    ASSERT_TRUE(log.find("\t[0] = {x = 1, y = 0.5}\n\t[1] = {x = -2, y = 1e+10}\n") != std::string::npos);
+}
+
+TEST(logger, rangesAreMerged) {
+    StackLogRange ranges[] = {{90, 120}, {0, 16}, {10, 20}, {50, 50}, {20, 30}};
+    ASSERT_EQUALS(normalizeStackLogRanges(ranges, 5, 0, 100), (size_t)2);
+    ASSERT_EQUALS(ranges[0].begin, (size_t)0);
+    ASSERT_EQUALS(ranges[0].end,   (size_t)30);
+    ASSERT_EQUALS(ranges[1].begin, (size_t)90);
+    ASSERT_EQUALS(ranges[1].end,   (size_t)100);
+}
+
+TEST(logger, windowedArrayHasBothEnds) {
+    int array[100] = {};
+    for (int i = 0; i < 100; ++i) {
+        array[i] = i;
+    }
+
+    logOpen(loggerTestFileName, "w");
+    LOG_ARRAY_INDENTED_MODE(array, 100, "", STACK_LOG_WINDOWED);
+    LOG_ARRAY_INDENTED(array, 2 * STACK_LOG_WINDOW + 1, "");
+    logClose();
+    ASSERT_EQUALS(getStackLogMode(), STACK_LOG_DEFAULT_MODE);
+
+    std::string log = readAndRemoveTestFile(loggerTestFileName);
+    ASSERT_TRUE(log.find("\t[15] = 15\n\t...\n\t[84] = 84\n") != std::string::npos);
+    ASSERT_TRUE(log.find("\t[50] = ") == std::string::npos);
+    ASSERT_TRUE(log.find("\t[99] = 99\n}\n") != std::string::npos);
+
+    // Mode of the other call is the global one
+    ASSERT_TRUE(log.find("\t[16] = 16\n") != std::string::npos);
+    ASSERT_TRUE(log.find("\t[32] = 32\n}\n") != std::string::npos);
+}
+
+TEST(logger, hexdumpIsWrittenIntoMappedFile) {
+    const char bytes[] = "Immortal stack hexdump\x01\xFF";
+    remove(loggerTestFileName);
+
+    ASSERT_TRUE(writeHexdumpFile(loggerTestFileName, "first", bytes, sizeof(bytes)));
+    ASSERT_TRUE(writeHexdumpFile(loggerTestFileName, "second", bytes, 3));
+
+    std::string log = readAndRemoveTestFile(loggerTestFileName);
+    ASSERT_EQUALS(log.size(), 6 + 2 * hexdumpLineLength + 7 + hexdumpLineLength);
+    ASSERT_EQUALS(log.find("first\n"), (size_t)0);
+    ASSERT_TRUE(log.find("49 6d 6d 6f 72 74 61 6c  20 73 74 61 63 6b 20 68  |Immortal stack h|\n")
+                != std::string::npos);
+    ASSERT_TRUE(log.find("65 78 64 75 6d 70 01 ff  00                       |exdump...       |\n")
+                != std::string::npos);
+    ASSERT_TRUE(log.find("second\n") == 6 + 2 * hexdumpLineLength);
+    ASSERT_TRUE(log.find("49 6d 6d" + std::string(42, ' ') + "|Imm             |\n") != std::string::npos);
+}
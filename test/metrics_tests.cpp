@@ -0,0 +1,158 @@
+/**
+ * @file
+ */
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include "testlib.h"
+#include "../src/immortal_stack.h"
+
+/** Stack with all checks, whose family of metrics is used only by these tests */
+typedef ImmortalStack<unsigned short, StackSecurityPolicy<3>> MeteredStack;
+
+/** File that the tests write the metrics into */
+static const char* metricsTestFileName = "metrics-test.txt";
+
+/**
+ * Collects the metrics of MeteredStack family.
+ * @return snapshot of the family.
+ */
+static StackMetricsSnapshot getMeteredStackMetrics() {
+    StackMetricsSnapshot snapshots[STACK_MAX_METRICS_FAMILIES] = {};
+    size_t families = collectStackMetrics(snapshots, STACK_MAX_METRICS_FAMILIES);
+    for (size_t i = 0; i < families; ++i) {
+        if (strcmp(snapshots[i].name, getStackTypeName<unsigned short>()) == 0) return snapshots[i];
+    }
+    return {getStackTypeName<unsigned short>(), {}};
+}
+
+TEST(metrics, peakAllocatedBytesAreSummedOverThreads) {
+    StackMetricsSnapshot before = getMeteredStackMetrics();
+
+    // Both threads hold their stacks while the snapshot is taken
+    std::atomic<int> readyThreads{0};
+    std::atomic<bool> released{false};
+    std::atomic<long long> allocatedBytes{0};
+    std::thread threads[2];
+    for (std::thread& thread : threads) {
+        thread = std::thread([&]() {
+            MeteredStack s{};
+            constructStack(&s);
+            for (unsigned short i = 0; i < 1000; ++i) {
+                push(&s, i);
+            }
+            allocatedBytes += (long long)getStackDataBytes(&s, s._capacity);
+            ++readyThreads;
+            while (!released.load()) {
+                std::this_thread::yield();
+            }
+            destructStack(&s);
+        });
+    }
+    while (readyThreads.load() < 2) {
+        std::this_thread::yield();
+    }
+
+    StackMetricsSnapshot during = getMeteredStackMetrics();
+    released = true;
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    const long long duringAllocated = during.values[STACK_METRIC_ALLOCATED_BYTES];
+    ASSERT_EQUALS(duringAllocated - before.values[STACK_METRIC_ALLOCATED_BYTES], allocatedBytes.load());
+    ASSERT_TRUE(during.values[STACK_METRIC_PEAK_ALLOCATED_BYTES] >= duringAllocated);
+
+    StackMetricsSnapshot after = getMeteredStackMetrics();
+    ASSERT_EQUALS(after.values[STACK_METRIC_ALLOCATED_BYTES], before.values[STACK_METRIC_ALLOCATED_BYTES]);
+    ASSERT_TRUE(after.values[STACK_METRIC_PEAK_ALLOCATED_BYTES] >= duringAllocated);
+}
+
+TEST(metrics, operationsAreCounted) {
+    StackMetricsSnapshot before = getMeteredStackMetrics();
+
+    MeteredStack s{};
+    constructStack(&s, 2);
+    for (unsigned short i = 0; i < 100; ++i) {
+        push(&s, i);
+    }
+    ASSERT_EQUALS(top(&s), 99);
+    for (int i = 0; i < 30; ++i) {
+        pop(&s);
+    }
+    unsigned short popped[10] = {};
+    popN(&s, popped, 10);
+
+    StackMetricsSnapshot during = getMeteredStackMetrics();
+    ASSERT_EQUALS(during.values[STACK_METRIC_PUSHES]     - before.values[STACK_METRIC_PUSHES],     100);
+    ASSERT_EQUALS(during.values[STACK_METRIC_POPS]       - before.values[STACK_METRIC_POPS],       40);
+    ASSERT_EQUALS(during.values[STACK_METRIC_TOPS]       - before.values[STACK_METRIC_TOPS],       1);
+    ASSERT_EQUALS(during.values[STACK_METRIC_CONSTRUCTS] - before.values[STACK_METRIC_CONSTRUCTS], 1);
+    ASSERT_TRUE(during.values[STACK_METRIC_ENLARGES] - before.values[STACK_METRIC_ENLARGES] >= 5);
+    ASSERT_TRUE(during.values[STACK_METRIC_RELOCATED_BYTES] > before.values[STACK_METRIC_RELOCATED_BYTES]);
+    ASSERT_TRUE(during.values[STACK_METRIC_CHECK_CYCLES] > before.values[STACK_METRIC_CHECK_CYCLES]);
+    ASSERT_TRUE(during.values[STACK_METRIC_HASH_CYCLES] > before.values[STACK_METRIC_HASH_CYCLES]);
+    ASSERT_TRUE(during.values[STACK_METRIC_PEAK_SIZE] >= 100);
+    ASSERT_EQUALS(during.values[STACK_METRIC_ALLOCATED_BYTES] - before.values[STACK_METRIC_ALLOCATED_BYTES],
+                  (long long)getStackDataBytes(&s, s._capacity));
+    ASSERT_TRUE(during.values[STACK_METRIC_PEAK_ALLOCATED_BYTES] >= (long long)(100 * sizeof(unsigned short)));
+
+    destructStack(&s);
+    StackMetricsSnapshot after = getMeteredStackMetrics();
+    ASSERT_EQUALS(after.values[STACK_METRIC_ALLOCATED_BYTES], before.values[STACK_METRIC_ALLOCATED_BYTES]);
+}
+
+TEST(metrics, threadSlotsAreAggregated) {
+    constexpr int threadsNumber = 4;
+    StackMetricsSnapshot before = getMeteredStackMetrics();
+
+    std::thread threads[threadsNumber];
+    for (int i = 0; i < threadsNumber; ++i) {
+        threads[i] = std::thread([i]() {
+            MeteredStack s{};
+            constructStack(&s);
+            for (int j = 0; j < 1000 * (i + 1); ++j) {
+                push(&s, (unsigned short)j);
+            }
+            destructStack(&s);
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    // Slots of the finished threads are retired, but their counters stay
+    StackMetricsSnapshot after = getMeteredStackMetrics();
+    ASSERT_EQUALS(after.values[STACK_METRIC_PUSHES] - before.values[STACK_METRIC_PUSHES], 10000);
+    ASSERT_EQUALS(after.values[STACK_METRIC_CONSTRUCTS] - before.values[STACK_METRIC_CONSTRUCTS], threadsNumber);
+    ASSERT_TRUE(after.values[STACK_METRIC_PEAK_SIZE] >= 4000);
+    ASSERT_EQUALS(after.values[STACK_METRIC_ALLOCATED_BYTES], before.values[STACK_METRIC_ALLOCATED_BYTES]);
+}
+
+TEST(metrics, snapshotsAreWritten) {
+    MeteredStack s{};
+    constructStack(&s);
+    push(&s, 1);
+    StackMetricsSnapshot snapshot = getMeteredStackMetrics();
+    std::string name = getStackTypeName<unsigned short>();
+
+    remove(metricsTestFileName);
+    ASSERT_TRUE(writeStackMetrics(metricsTestFileName, STACK_METRICS_PROMETHEUS));
+    std::string prometheus = readAndRemoveTestFile(metricsTestFileName);
+    ASSERT_TRUE(prometheus.find("# TYPE immortal_stack_pushes_total counter\n") != std::string::npos);
+    ASSERT_TRUE(prometheus.find("# TYPE immortal_stack_peak_size gauge\n") != std::string::npos);
+    ASSERT_TRUE(prometheus.find("immortal_stack_pushes_total{stack=\"" + name + "\"} " +
+                                std::to_string(snapshot.values[STACK_METRIC_PUSHES]) + "\n") != std::string::npos);
+
+    ASSERT_TRUE(writeStackMetrics(metricsTestFileName));
+    ASSERT_TRUE(writeStackMetrics(metricsTestFileName, STACK_METRICS_JSON_LINES));
+    std::string json = readAndRemoveTestFile(metricsTestFileName);
+    size_t first = json.find("\"stack\": \"" + name + "\"");
+    ASSERT_TRUE(first != std::string::npos);
+    ASSERT_TRUE(json.find("\"stack\": \"" + name + "\"", first + 1) != std::string::npos);
+    ASSERT_TRUE(json.find("\"constructs_total\": ") != std::string::npos);
+    ASSERT_EQUALS(json.front(), '{');
+    ASSERT_EQUALS(json.back(), '\n');
+
+    destructStack(&s);
+}
@@ -0,0 +1,106 @@
+/**
+ * @file
+ */
+
+#include <sys/wait.h>
+#include <unistd.h>
+#include "testlib.h"
+#include "../src/persistent_stack.h"
+
+/** Persistent stack with all checks */
+typedef ImmortalStack<long, StackSecurityPolicy<3>> PersistentLongStack;
+
+/** Path to the stack file that is used in tests */
+#define PERSISTENT_STACK_TEST_FILE "persistent-stack-test.bin"
+
+TEST(persistentStack, stackSurvivesReattaching) {
+    unlink(PERSISTENT_STACK_TEST_FILE);
+
+    StackFile file;
+    PersistentLongStack* s = attachStack<PersistentLongStack>(&file, PERSISTENT_STACK_TEST_FILE);
+    ASSERT_NOT_NULL(s);
+    ASSERT_EQUALS(getStackSize(s), 0);
+
+    for (long i = 0; i < 100000; ++i) {
+        push(s, i);
+    }
+    ASSERT_TRUE(checkpointStack(&file));
+    detachStack(&file);
+
+    s = attachStack<PersistentLongStack>(&file, PERSISTENT_STACK_TEST_FILE);
+    ASSERT_NOT_NULL(s);
+    ASSERT_EQUALS(getStackSize(s), 100000);
+    for (long i = 99999; i >= 50000; --i) {
+        ASSERT_EQUALS(pop(s), i);
+    }
+    detachStack(&file);
+
+    s = attachStack<PersistentLongStack>(&file, PERSISTENT_STACK_TEST_FILE);
+    ASSERT_EQUALS(top(s), 49999);
+    destructStack(s);
+    detachStack(&file);
+
+    unlink(PERSISTENT_STACK_TEST_FILE);
+}
+
+TEST(persistentStack, stackSurvivesProcessRestart) {
+    unlink(PERSISTENT_STACK_TEST_FILE);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        StackFile file;
+        PersistentLongStack* s = attachStack<PersistentLongStack>(&file, PERSISTENT_STACK_TEST_FILE);
+        for (long i = 0; i < 1000; ++i) {
+            push(s, i * i);
+        }
+        // Process exits without detaching the stack
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    ASSERT_EQUALS(status, 0);
+
+    StackFile file;
+    PersistentLongStack* s = attachStack<PersistentLongStack>(&file, PERSISTENT_STACK_TEST_FILE);
+    ASSERT_NOT_NULL(s);
+    ASSERT_EQUALS(getStackSize(s), 1000);
+    ASSERT_EQUALS(pop(s), 999 * 999);
+    detachStack(&file);
+
+    unlink(PERSISTENT_STACK_TEST_FILE);
+}
+
+TEST(persistentStack, corruptedStackFailsAssertion) {
+    unlink(PERSISTENT_STACK_TEST_FILE);
+
+    StackFile file;
+    PersistentLongStack* s = attachStack<PersistentLongStack>(&file, PERSISTENT_STACK_TEST_FILE);
+    for (long i = 0; i < 10; ++i) {
+        push(s, i);
+    }
+    const off_t firstElementOffset = file.headerBytes + sizeof(long long) * canariesNumber;
+    detachStack(&file);
+
+    const long corruptedElement = 42;
+    int fd = open(PERSISTENT_STACK_TEST_FILE, O_WRONLY);
+    ASSERT_EQUALS(pwrite(fd, &corruptedElement, sizeof(corruptedElement), firstElementOffset), sizeof(corruptedElement));
+    close(fd);
+
+    ASSERT_FAILS_ASSERTION(attachStack<PersistentLongStack>(&file, PERSISTENT_STACK_TEST_FILE));
+
+    unlink(PERSISTENT_STACK_TEST_FILE);
+}
+
+TEST(persistentStack, stackOfAnotherTypeIsNotAttached) {
+    unlink(PERSISTENT_STACK_TEST_FILE);
+
+    StackFile file;
+    attachStack<PersistentLongStack>(&file, PERSISTENT_STACK_TEST_FILE);
+    detachStack(&file);
+
+    ASSERT_NULL((attachStack<ImmortalStack<int, StackSecurityPolicy<3>>>(&file, PERSISTENT_STACK_TEST_FILE)));
+    ASSERT_NULL((attachStack<ImmortalStack<long, StackSecurityPolicy<2>>>(&file, PERSISTENT_STACK_TEST_FILE)));
+    ASSERT_EQUALS(file.fd, -1);
+
+    unlink(PERSISTENT_STACK_TEST_FILE);
+}
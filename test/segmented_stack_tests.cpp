@@ -0,0 +1,157 @@
+/**
+ * @file
+ */
+
+#include <string>
+#include "testlib.h"
+#include "../src/segmented_stack.h"
+
+/** Segmented stack with all checks and small chunks */
+typedef SegmentedStack<int, StackSecurityPolicy<3>, 4> SegmentedIntStack;
+
+/** Number of chunks that are currently allocated by chunksCountingAllocator */
+static ssize_t allocatedChunksCount = 0;
+
+/** Number of allocations that were made by chunksCountingAllocator */
+static ssize_t chunkAllocationsCount = 0;
+
+/** Allocator that counts allocated chunks. Uses systemStackAllocator to manage memory */
+static const StackAllocator chunksCountingAllocator = {
+    [](void* context, size_t bytes) {
+        ++allocatedChunksCount;
+        ++chunkAllocationsCount;
+        return systemStackAllocator.allocate(context, bytes);
+    },
+    systemStackAllocator.reallocate,
+    [](void* context, void* memory, size_t bytes) {
+        --allocatedChunksCount;
+        systemStackAllocator.deallocate(context, memory, bytes);
+    },
+    nullptr
+};
+
+TEST(segmentedStack, correctStackElementsOrder) {
+    SegmentedIntStack s{};
+    constructStack(&s);
+
+    for (int i = 0; i < 100; ++i) {
+        push(&s, i);
+        ASSERT_EQUALS(top(&s), i);
+    }
+    ASSERT_EQUALS(getStackSize(&s), 100);
+    ASSERT_EQUALS(getStackCapacity(&s), 100);
+
+    for (int i = 99; i >= 0; --i) {
+        ASSERT_EQUALS(pop(&s), i);
+    }
+    ASSERT_EQUALS(getStackSize(&s), 0);
+    ASSERT_EQUALS(getStackCapacity(&s), 0);
+
+    destructStack(&s);
+}
+
+TEST(segmentedStack, elementsAreNeverMoved) {
+    SegmentedIntStack s{};
+    constructStack(&s);
+
+    push(&s, 42);
+    const int* bottom = &top(&s);
+    for (int i = 0; i < 1000; ++i) {
+        push(&s, i);
+    }
+    ASSERT_EQUALS(*bottom, 42);
+    ASSERT_TRUE((int*)s._bottom->_elements == bottom);
+
+    destructStack(&s);
+}
+
+TEST(segmentedStack, cachedChunkPreventsThrashing) {
+    allocatedChunksCount = 0;
+    chunkAllocationsCount = 0;
+    SegmentedIntStack s{};
+    constructStack(&s, 0, &chunksCountingAllocator);
+
+    for (int i = 0; i < 4; ++i) {
+        push(&s, i);
+    }
+    ASSERT_EQUALS(chunkAllocationsCount, 1);
+
+    for (int i = 0; i < 100; ++i) {
+        push(&s, 4);
+        pop(&s);
+    }
+    ASSERT_EQUALS(chunkAllocationsCount, 2);
+    ASSERT_EQUALS(allocatedChunksCount, 2);
+
+    destructStack(&s);
+    ASSERT_EQUALS(allocatedChunksCount, 0);
+}
+
+TEST(segmentedStack, dataHashIsEqualToContiguousOne) {
+    SegmentedIntStack segmented{};
+    ImmortalStack<int, StackSecurityPolicy<3>> contiguous{};
+    constructStack(&segmented);
+    constructStack(&contiguous);
+
+    for (int i = 0; i < 30; ++i) {
+        push(&segmented, i);
+        push(&contiguous, i);
+    }
+    ASSERT_EQUALS(segmented._dataHash, getDataHash(&segmented));
+    ASSERT_EQUALS(segmented._dataHash, contiguous._dataHash);
+
+    destructStack(&segmented);
+    destructStack(&contiguous);
+}
+
+TEST(segmentedStack, chunkModifyingFailsAssertion) {
+    SegmentedIntStack s{};
+    constructStack(&s);
+    for (int i = 0; i < 10; ++i) {
+        push(&s, i);
+    }
+
+    // Operations check the top chunk, its link to the previous one and the top element
+    s._top->_canariesAfter[0] = 0;
+    ASSERT_FAILS_ASSERTION(push(&s, 10));
+    s._top->_canariesAfter[0] = canaryValue;
+
+    s._top->_previous->_next = s._bottom;
+    ASSERT_FAILS_ASSERTION(pop(&s));
+    s._top->_previous->_next = s._top;
+
+    ((int*)s._top->_elements)[1] = 0;
+    ASSERT_FAILS_ASSERTION(pop(&s));
+    ((int*)s._top->_elements)[1] = 9;
+
+    // Chunks below are checked only by the full checks
+    s._bottom->_canariesAfter[0] = 0;
+    ASSERT_TRUE(isStackOk(&s));
+    ASSERT_TRUE(!isStackFullyOk(&s));
+    ASSERT_FAILS_ASSERTION(destructStack(&s));
+    s._bottom->_canariesAfter[0] = canaryValue;
+
+    s._bottom->_next = s._top;
+    ASSERT_TRUE(!isStackFullyOk(&s));
+    s._bottom->_next = s._top->_previous;
+
+    ((int*)s._bottom->_elements)[1] = 0;
+    ASSERT_TRUE(isStackOk(&s));
+    ASSERT_TRUE(!isStackFullyOk(&s));
+    ((int*)s._bottom->_elements)[1] = 1;
+
+    destructStack(&s);
+}
+
+TEST(segmentedStack, stringsAreDestructed) {
+    SegmentedStack<std::string, StackSecurityPolicy<0>, 3> s{};
+    constructStack(&s, 1);
+
+    for (int i = 0; i < 10; ++i) {
+        emplace(&s, 100, (char)('a' + i));
+    }
+    ASSERT_TRUE(pop(&s) == std::string(100, 'j'));
+    ASSERT_TRUE(top(&s) == std::string(100, 'i'));
+
+    destructStack(&s);
+}
@@ -0,0 +1,145 @@
+/**
+ * @file
+ */
+
+#include <string>
+#include "testlib.h"
+#include "../src/immortal_stack.h"
+
+/** Stack with canaries, that is dumped in the binary format */
+typedef ImmortalStack<int, StackPolicy<StackBinaryDumpLogging<>, StackCanaries<2>, NoStackHashing>> DumpedIntStack;
+
+/** Stack with canaries and hashes, that is dumped in the compressed binary format */
+typedef ImmortalStack<long, StackPolicy<StackBinaryDumpLogging<true>, StackCanaries<>, StackStateHashing>>
+    CompressedLongStack;
+
+/** Text file that the tests log and decode into */
+static const char* stackDumpTestFileName = "stack-dump-test.txt";
+
+/**
+ * Decodes the stack dump file into the text file of the tests and removes the dump file.
+ * @param[in] window window of the decoded elements, or nullptr to decode all of them
+ * @return number of the decoded dumps.
+ */
+static long decodeStackDumpTestFile(const StackDumpWindow* window = nullptr) {
+    FILE* dump = fopen(stackDumpFileName, "rb");
+    if (dump == nullptr) return 0;
+    FILE* text = fopen(stackDumpTestFileName, "w");
+
+    long dumpsNumber = decodeStackDumps(dump, text, window);
+    fclose(text);
+    fclose(dump);
+    remove(stackDumpFileName);
+
+    return dumpsNumber;
+}
+
+TEST(stackDump, blocksAreCompressed) {
+    constexpr size_t size = 10000;
+    unsigned char block[size] = {};
+    unsigned char compressed[size] = {};
+    unsigned char decompressed[size] = {};
+
+    for (size_t i = 0; i < size; ++i) {
+        block[i] = (unsigned char)(i / 64 % 7 + i % 3);
+    }
+    size_t compressedSize = compressStackDumpBlock(block, size, compressed);
+    ASSERT_TRUE(compressedSize > 0 && compressedSize < size / 10);
+    ASSERT_TRUE(decompressStackDumpBlock(compressed, compressedSize, decompressed, size));
+    ASSERT_EQUALS(memcmp(block, decompressed, size), 0);
+    ASSERT_TRUE(!decompressStackDumpBlock(compressed, compressedSize - 1, decompressed, size));
+
+    // Random bytes don't shrink
+    srand(42);
+    for (size_t i = 0; i < size; ++i) {
+        block[i] = (unsigned char)rand();
+    }
+    ASSERT_EQUALS(compressStackDumpBlock(block, size, compressed), (size_t)0);
+    ASSERT_EQUALS(compressStackDumpBlock(block, 3, compressed), (size_t)0);
+}
+
+TEST(stackDump, decodedDumpMatchesLog) {
+    remove(stackDumpFileName);
+    DumpedIntStack s{};
+    constructStack(&s);
+    for (int i = 0; i < 5; ++i) {
+        push(&s, i);
+    }
+
+    logOpen(stackDumpTestFileName, "w");
+    LOG_STACK(&s); ASSERT_TRUE(dumpStack(&s, "&s", __FILENAME__, __LINE__));
+    logClose();
+    std::string log = readAndRemoveTestFile(stackDumpTestFileName);
+
+    ASSERT_EQUALS(decodeStackDumpTestFile(), 1);
+    ASSERT_TRUE(readAndRemoveTestFile(stackDumpTestFileName) == log);
+
+    destructStack(&s);
+}
+
+TEST(stackDump, compressedDumpIsDecoded) {
+    remove(stackDumpFileName);
+    CompressedLongStack s{};
+    constructStack(&s);
+    for (long i = 0; i < 100000; ++i) {
+        push(&s, i / 10);
+    }
+    ASSERT_TRUE(dumpStack(&s, "&s", __FILENAME__, __LINE__));
+    ASSERT_TRUE(dumpStack(&s, "&s", __FILENAME__, __LINE__));
+
+    FILE* dump = fopen(stackDumpFileName, "rb");
+    ASSERT_NOT_NULL(dump);
+    fseek(dump, 0, SEEK_END);
+    ASSERT_TRUE(ftell(dump) < (long)(2 * sizeof(long) * 100000 / 4));
+    fclose(dump);
+
+    StackDumpWindow window = {70000, 2};
+    ASSERT_EQUALS(decodeStackDumpTestFile(&window), 2);
+    std::string text = readAndRemoveTestFile(stackDumpTestFileName);
+    ASSERT_TRUE(text.find("\thash = ") != std::string::npos);
+    ASSERT_TRUE(text.find("\t\t...\n\t\t[69998] = 6999\n") != std::string::npos);
+    ASSERT_TRUE(text.find("\t\t[70002] = 7000\n\t\t...\n") != std::string::npos);
+    ASSERT_TRUE(text.find("[69997]") == std::string::npos);
+    ASSERT_TRUE(text.find("[70003]") == std::string::npos);
+
+    destructStack(&s);
+}
+
+TEST(stackDump, largeWindowRadiusIsClamped) {
+    remove(stackDumpFileName);
+    DumpedIntStack s{};
+    constructStack(&s);
+    for (int i = 0; i < 5; ++i) {
+        push(&s, i);
+    }
+    ASSERT_TRUE(dumpStack(&s, "&s", __FILENAME__, __LINE__));
+
+    // Window covers all elements, its end doesn't wrap around
+    StackDumpWindow window = {3, UINT64_MAX};
+    ASSERT_EQUALS(decodeStackDumpTestFile(&window), 1);
+    std::string text = readAndRemoveTestFile(stackDumpTestFileName);
+    ASSERT_TRUE(text.find("\t\t[0] = 0\n") != std::string::npos);
+    ASSERT_TRUE(text.find("\t\t[4] = 4\n") != std::string::npos);
+    ASSERT_TRUE(text.find("\t\t...\n") == std::string::npos);
+
+    destructStack(&s);
+}
+
+TEST(stackDump, failedCheckDumpsStack) {
+    remove(stackDumpFileName);
+    DumpedIntStack s{};
+    constructStack(&s);
+    push(&s, 1);
+
+    s._canariesAfter[1] = 0;
+    ASSERT_FAILS_ASSERTION(push(&s, 2));
+    s._canariesAfter[1] = canaryValue;
+
+    ASSERT_EQUALS(decodeStackDumpTestFile(), 1);
+    std::string text = readAndRemoveTestFile(stackDumpTestFileName);
+    ASSERT_TRUE(text.find("\t\t[0] = 1\n") != std::string::npos);
+    ASSERT_TRUE(text.find("\tcanariesAfter [") != std::string::npos);
+    ASSERT_TRUE(text.find("\t\t[1] = 0\n") != std::string::npos);
+
+    destructStack(&s);
+}
@@ -2,7 +2,9 @@
  * @file
  */
 
+#include <chrono>
 #include <sys/types.h>
+#include <vector>
 #include "testlib.h"
 
 #define STACK_SECURITY_LEVEL 3
@@ -12,9 +14,14 @@
 #define STACK_TYPE double
 #include "../src/stack.h"
 #undef STACK_TYPE
+#define STACK_TYPE long
+#define STACK_ALLOCATOR &poolStackAllocator
+#include "../src/stack.h"
+#undef STACK_ALLOCATOR
+#undef STACK_TYPE
 
 TEST(constructDestruct, simpleIntStack) {
-    Stack_int s{ {}, 0, 100, 200, nullptr, {} };
+    Stack_int s{ {}, 0, {}, 100, 200, nullptr, 0, 0, {}, {}, nullptr, {}, {}, {}, {} };
     const size_t initialCapacity = 42;
     constructStack(&s, initialCapacity);
 
@@ -50,6 +57,212 @@ TEST(pushTopPop, correctStackElementsOrder) {
     destructStack(&s);
 }
 
+TEST(bulkOperations, pushNPopNRoundTrip) {
+    Stack_int s{};
+    constructStack(&s);
+
+    const int elements[] = { 5, 2, 6, 2, 1, 7, 2, 3 };
+    const size_t elementsCount = sizeof(elements) / sizeof(*elements);
+
+    push(&s, 42);
+    pushN(&s, elements, elementsCount);
+    ASSERT_EQUALS(getStackSize(&s), (ssize_t)elementsCount + 1);
+    ASSERT_EQUALS(top(&s), elements[elementsCount - 1]);
+
+    int peeked[elementsCount] = {};
+    peekN(&s, peeked, elementsCount);
+    ASSERT_EQUALS(getStackSize(&s), (ssize_t)elementsCount + 1);
+
+    int popped[elementsCount] = {};
+    popN(&s, popped, elementsCount);
+    for (size_t i = 0; i < elementsCount; ++i) {
+        ASSERT_EQUALS(peeked[i], elements[i]);
+        ASSERT_EQUALS(popped[i], elements[i]);
+    }
+    ASSERT_EQUALS(getStackSize(&s), 1);
+    ASSERT_EQUALS(pop(&s), 42);
+
+    destructStack(&s);
+}
+
+TEST(bulkOperations, pushNEnlargesOnce) {
+    Stack_double s{};
+    constructStack(&s, 4);
+
+    double elements[1000] = {};
+    for (size_t i = 0; i < 1000; ++i) {
+        elements[i] = (double)i / 2;
+    }
+
+    pushN(&s, elements, 1000);
+    ASSERT_EQUALS(getStackCapacity(&s), 1000);
+    ASSERT_EQUALS(s._dataHash, getDataHash(&s));
+
+    pushN(&s, elements, 1);
+    ASSERT_EQUALS(getStackCapacity(&s), 2000);
+    ASSERT_DOUBLE_EQUALS(pop(&s), 0.0);
+    ASSERT_DOUBLE_EQUALS(pop(&s), 499.5);
+
+    double popped[999] = {};
+    popN(&s, popped, 999);
+    ASSERT_EQUALS(getStackSize(&s), 0);
+    ASSERT_EQUALS(s._dataHash, getDataHash(&s));
+
+    destructStack(&s);
+}
+
+TEST(bulkOperations, pushNOfStackElementsSurvivesEnlarging) {
+    Stack_int s{};
+    constructStack(&s, 4);
+    for (int i = 0; i < 4; ++i) {
+        push(&s, i);
+    }
+
+    // Source is in the data array, that is reallocated by these pushes
+    pushN(&s, getStackData(&s), 4);
+    ASSERT_EQUALS(getStackCapacity(&s), 8);
+    pushN(&s, getStackData(&s) + 2, 6);
+    ASSERT_EQUALS(getStackCapacity(&s), 16);
+
+    const int expected[14] = { 0, 1, 2, 3, 0, 1, 2, 3, 2, 3, 0, 1, 2, 3 };
+    int popped[14] = {};
+    popN(&s, popped, 14);
+    for (size_t i = 0; i < 14; ++i) {
+        ASSERT_EQUALS(popped[i], expected[i]);
+    }
+
+    destructStack(&s);
+}
+
+TEST(bulkOperations, popNMoreThanSizeFailsAssertion) {
+    Stack_int s{};
+    constructStack(&s);
+
+    const int elements[] = { 1, 2, 3 };
+    pushN(&s, elements, 3);
+
+    int popped[4] = {};
+    ASSERT_FAILS_ASSERTION(popN(&s, popped, 4));
+    ASSERT_FAILS_ASSERTION(peekN(&s, popped, 4));
+
+    destructStack(&s);
+}
+
+TEST(growth, mappedDataKeepsElements) {
+    Stack_int s{};
+    constructStack(&s);
+
+    const size_t elementsCount = 2 * STACK_MMAP_THRESHOLD / sizeof(int);
+    std::vector<int> elements(elementsCount);
+    for (size_t i = 0; i < elementsCount; ++i) {
+        elements[i] = (int)i;
+    }
+
+    pushN(&s, elements.data(), elementsCount / 4);     // Allocated with malloc
+    pushN(&s, elements.data() + elementsCount / 4, elementsCount / 4);
+    pushN(&s, elements.data() + elementsCount / 2, elementsCount / 2);
+    ASSERT_TRUE(isStackMemoryMapped(getStackDataBytes(&s, getStackCapacity(&s))));
+
+    std::vector<int> popped(elementsCount);
+    popN(&s, popped.data(), elementsCount);
+    ASSERT_TRUE(popped == elements);
+
+    destructStack(&s);
+}
+
+TEST(growth, shrinkToFit) {
+    Stack_int s{};
+    constructStack(&s, 100);
+
+    push(&s, 1);
+    push(&s, 2);
+    shrinkToFit(&s);
+    ASSERT_EQUALS(getStackCapacity(&s), 2);
+    ASSERT_EQUALS(pop(&s), 2);
+
+    shrinkToFit(&s);
+    ASSERT_EQUALS(getStackCapacity(&s), 1);
+    ASSERT_EQUALS(pop(&s), 1);
+
+    shrinkToFit(&s);
+    ASSERT_EQUALS(getStackCapacity(&s), 0);
+    push(&s, 3);
+    ASSERT_EQUALS(top(&s), 3);
+
+    destructStack(&s);
+}
+
+TEST(growth, popShrinksSparseStack) {
+    Stack_int s{};
+    constructStack(&s);
+
+    const size_t elementsCount = 4 * STACK_SHRINK_MIN_BYTES / sizeof(int);
+    std::vector<int> elements(elementsCount, 42);
+    pushN(&s, elements.data(), elementsCount);
+    ASSERT_EQUALS(getStackCapacity(&s), (ssize_t)elementsCount);
+
+    popN(&s, elements.data(), elementsCount / 2);
+    ASSERT_EQUALS(getStackCapacity(&s), (ssize_t)elementsCount);
+
+    popN(&s, elements.data(), elementsCount / 4);
+    ASSERT_EQUALS(getStackCapacity(&s), (ssize_t)elementsCount / 2);
+
+    pop(&s);
+    ASSERT_EQUALS(getStackCapacity(&s), (ssize_t)elementsCount / 2);
+
+    destructStack(&s);
+}
+
+/** Number of blocks that are currently allocated by countingAllocator */
+static ssize_t allocatedBlocksCount = 0;
+
+/** Allocator that counts allocated blocks. Uses systemStackAllocator to manage memory */
+static const StackAllocator countingAllocator = {
+    [](void* context, size_t bytes) {
+        ++allocatedBlocksCount;
+        return systemStackAllocator.allocate(context, bytes);
+    },
+    systemStackAllocator.reallocate,
+    [](void* context, void* memory, size_t bytes) {
+        --allocatedBlocksCount;
+        systemStackAllocator.deallocate(context, memory, bytes);
+    },
+    nullptr
+};
+
+TEST(allocator, customAllocatorIsUsed) {
+    Stack_int s{};
+    constructStack(&s, 0, &countingAllocator);
+    ASSERT_EQUALS(allocatedBlocksCount, 1);
+
+    for (int i = 0; i < 100; ++i) {
+        push(&s, i);
+    }
+    ASSERT_EQUALS(allocatedBlocksCount, 1);
+
+    destructStack(&s);
+    ASSERT_EQUALS(allocatedBlocksCount, 0);
+}
+
+TEST(allocator, poolAllocatorRecyclesBuffers) {
+    Stack_long s{};
+    constructStack(&s, 16);
+    ASSERT_TRUE(s._allocator == &poolStackAllocator);
+    char* data = s._data;
+    destructStack(&s);
+
+    constructStack(&s, 15);
+    ASSERT_TRUE(s._data == data);
+
+    for (long i = 0; i < 1000; ++i) {
+        push(&s, i);
+    }
+    for (long i = 999; i >= 0; --i) {
+        ASSERT_EQUALS(pop(&s), i);
+    }
+    destructStack(&s);
+}
+
 TEST(canaryTest, canaryModifyingFailsAssertion) {
     struct {
         long long canaryKillerBefore[1]{};
@@ -121,7 +334,7 @@ TEST(hashTest, stackMembersModifyingFailsAssertion) {
 
     ASSERT_EQUALS(top(&s), topValue); // Just checking that hash is ok before next test
 
-    int realHash = s._hash;
+    unsigned long long realHash = s._hash;
     s._hash = realHash + 1;
     ASSERT_FAILS_ASSERTION(top(&s));
     s._hash = realHash; // Restoring real value to properly destruct stack
@@ -143,6 +356,72 @@ TEST(hashTest, stackDataModifyingFailsAssertion) {
     destructStack(&s);
 }
 
+TEST(hashTest, incrementalHashMatchesRecalculated) {
+    Stack_int s{};
+
+    constructStack(&s);
+    const unsigned long long emptyDataHash = s._dataHash;
+
+    for (int i = 0; i < 100; ++i) {
+        push(&s, i);
+        ASSERT_EQUALS(s._dataHash, getDataHash(&s));
+    }
+    for (int i = 0; i < 100; ++i) {
+        pop(&s);
+        ASSERT_EQUALS(s._dataHash, getDataHash(&s));
+    }
+    ASSERT_EQUALS(s._dataHash, emptyDataHash);
+
+    destructStack(&s);
+}
+
+TEST(hashTest, checksDontDependOnStackSize) {
+    Stack_int s{};
+    constructStack(&s);
+
+    // Each operation checks only the top element, so a million of them take about a second even without optimizations
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 1000000; ++i) {
+        push(&s, i);
+    }
+    for (int i = 999999; i >= 0; --i) {
+        ASSERT_EQUALS(pop(&s), i);
+    }
+    ASSERT_TRUE(std::chrono::steady_clock::now() - start < std::chrono::seconds(10));
+
+    destructStack(&s);
+}
+
+TEST(hashTest, stackDataBelowTopModifyingFailsFullCheck) {
+    Stack_int s{};
+
+    constructStack(&s);
+    push(&s, 1);
+    push(&s, 2);
+
+    getStackData(&s)[0] = 3;
+    ASSERT_TRUE(!isStackFullyOk(&s));
+    ASSERT_FAILS_ASSERTION(destructStack(&s));
+    getStackData(&s)[0] = 1; // Restoring real value to properly destruct stack
+
+    destructStack(&s);
+}
+
+TEST(hashTest, stackDataHashModifyingFailsAssertion) {
+    Stack_int s{};
+
+    constructStack(&s);
+    push(&s, 1);
+    push(&s, 2);
+
+    unsigned long long realDataHash = s._dataHash;
+    s._dataHash = realDataHash + 1;
+    ASSERT_FAILS_ASSERTION(top(&s));
+    s._dataHash = realDataHash; // Restoring real value to properly destruct stack
+
+    destructStack(&s);
+}
+
 TEST(nullptrPassing, construct) {
     ASSERT_FAILS_ASSERTION(constructStack((Stack_int*)nullptr));
 }
@@ -163,6 +442,18 @@ TEST(nullptrPassing, top) {
     ASSERT_FAILS_ASSERTION(top((Stack_int*)nullptr));
 }
 
+TEST(nullptrPassing, pushN) {
+    ASSERT_FAILS_ASSERTION(pushN((Stack_int*)nullptr, nullptr, 0));
+}
+
+TEST(nullptrPassing, popN) {
+    ASSERT_FAILS_ASSERTION(popN((Stack_int*)nullptr, nullptr, 0));
+}
+
+TEST(nullptrPassing, peekN) {
+    ASSERT_FAILS_ASSERTION(peekN((Stack_int*)nullptr, nullptr, 0));
+}
+
 TEST(nullptrPassing, enlarge) {
     ASSERT_FAILS_ASSERTION(enlarge((Stack_int*)nullptr));
 }
@@ -182,3 +473,7 @@ TEST(nullptrPassing, getStackData) {
 TEST(nullptrPassing, getHash) {
     ASSERT_FAILS_ASSERTION(getHash((Stack_int*)nullptr));
 }
+
+TEST(nullptrPassing, getDataHash) {
+    ASSERT_FAILS_ASSERTION(getDataHash((Stack_int*)nullptr));
+}
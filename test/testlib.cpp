@@ -145,3 +145,28 @@ TestRunner* TestRunner::getInstance() {
     static TestRunner runner;
     return &runner;
 }
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * Reads the whole file that is written by a test and removes it.
+ * @param[in] fileName name of the file
+ * @return contents of the file, or empty string if there's no such file.
+ */
+std::string readAndRemoveTestFile(const char* fileName) {
+    assert(fileName != nullptr);
+
+    std::string contents;
+    FILE* file = fopen(fileName, "r");
+    if (file == nullptr) return contents;
+
+    char buffer[4096];
+    size_t read = 0;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        contents.append(buffer, read);
+    }
+    fclose(file);
+    remove(fileName);
+
+    return contents;
+}
@@ -16,9 +16,11 @@
 #include <cassert>
 #include <cmath>
 #include <csignal>
+#include <cstdio>
 #include <functional>
 #include <fcntl.h>
 #include <iostream>
+#include <string>
 #include <unistd.h>
 #include <vector>
 #include <wait.h>
@@ -163,6 +165,15 @@ public:
 
 //----------------------------------------------------------------------------------------------------------------------
 
+/**
+ * Reads the whole file that is written by a test and removes it.
+ * @param[in] fileName name of the file
+ * @return contents of the file, or empty string if there's no such file.
+ */
+std::string readAndRemoveTestFile(const char* fileName);
+
+//----------------------------------------------------------------------------------------------------------------------
+
 #define TESTLIB_ANSI_COLOR_RED   "\x1b[31m"
 #define TESTLIB_ANSI_COLOR_GREEN "\x1b[32m"
 #define TESTLIB_ANSI_COLOR_RESET "\x1b[0m"
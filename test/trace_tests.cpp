@@ -0,0 +1,117 @@
+/**
+ * @file
+ */
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include "testlib.h"
+#include "../src/immortal_stack.h"
+
+/** Stack with all checks, that is traced by the tests */
+typedef ImmortalStack<int, StackSecurityPolicy<3>> TracedIntStack;
+
+/** File that the tests write the trace into */
+static const char* traceTestFileName = "trace-test.json";
+
+/**
+ * Counts the occurrences of the substring.
+ * @param[in] text      text to search in
+ * @param[in] substring substring to count
+ * @return number of the occurrences.
+ */
+static size_t countOccurrences(const std::string& text, const std::string& substring) {
+    size_t count = 0;
+    for (size_t position = text.find(substring); position != std::string::npos;
+         position = text.find(substring, position + 1)) {
+        ++count;
+    }
+    return count;
+}
+
+TEST(trace, operationsAreExported) {
+    TracedIntStack s{};
+    constructStack(&s);
+    for (int i = 0; i < 100; ++i) {
+        push(&s, i);
+    }
+    for (int i = 0; i < 10; ++i) {
+        pop(&s);
+    }
+
+    long eventsNumber = writeStackTrace(traceTestFileName);
+    std::string trace = readAndRemoveTestFile(traceTestFileName);
+    ASSERT_TRUE(eventsNumber > 0);
+    ASSERT_EQUALS(trace.find("{\"displayTimeUnit\": \"ns\", \"traceEvents\": ["), (size_t)0);
+    ASSERT_TRUE(trace.size() > 4 && trace.compare(trace.size() - 4, 4, "\n]}\n") == 0);
+    ASSERT_EQUALS(countOccurrences(trace, "\"ph\": \"X\""), (size_t)eventsNumber);
+
+    char stackAddress[64] = "";
+    snprintf(stackAddress, sizeof(stackAddress), "{\"stack\": \"" PTR_FORMAT "\"}", (uintptr_t)&s);
+    ASSERT_TRUE(countOccurrences(trace, stackAddress) >= 100 + 10);
+    ASSERT_TRUE(trace.find("\"name\": \"push\"") != std::string::npos);
+    ASSERT_TRUE(trace.find("\"name\": \"pop\"") != std::string::npos);
+    ASSERT_TRUE(trace.find("\"name\": \"enlarge\"") != std::string::npos);
+    ASSERT_TRUE(trace.find("\"name\": \"isStackOk\"") != std::string::npos);
+    ASSERT_TRUE(trace.find("\"name\": \"getHash\"") != std::string::npos);
+
+    destructStack(&s);
+}
+
+TEST(trace, ringKeepsLastEvents) {
+    constexpr size_t extraEvents = 10;
+
+    // Finished thread keeps its events in the ring
+    std::thread thread([]() {
+        for (size_t i = 0; i < STACK_TRACE_RING_EVENTS + extraEvents; ++i) {
+            unsigned long long now = readStackTraceTicks();
+            recordStackTraceEvent("ringEvent", (const void*)(i + 1), now, now);
+        }
+    });
+    thread.join();
+
+    ASSERT_TRUE(writeStackTrace(traceTestFileName) >= (long)STACK_TRACE_RING_EVENTS);
+    std::string trace = readAndRemoveTestFile(traceTestFileName);
+    ASSERT_EQUALS(countOccurrences(trace, "\"name\": \"ringEvent\""), (size_t)STACK_TRACE_RING_EVENTS);
+
+    char firstKept[64] = "";
+    char lastDropped[64] = "";
+    snprintf(firstKept,   sizeof(firstKept),   "\"" PTR_FORMAT "\"", (uintptr_t)(extraEvents + 1));
+    snprintf(lastDropped, sizeof(lastDropped), "\"" PTR_FORMAT "\"", (uintptr_t)extraEvents);
+    ASSERT_TRUE(trace.find(firstKept) != std::string::npos);
+    ASSERT_TRUE(trace.find(lastDropped) == std::string::npos);
+}
+
+TEST(trace, runningThreadSlotIsSkipped) {
+    constexpr size_t extraEvents = 10;
+
+    // Running thread may be writing the slot after its last event, so the oldest event in this slot isn't written
+    std::atomic<bool> recorded{false};
+    std::atomic<bool> written{false};
+    std::thread thread([&recorded, &written]() {
+        for (size_t i = 0; i < STACK_TRACE_RING_EVENTS + extraEvents; ++i) {
+            unsigned long long now = readStackTraceTicks();
+            recordStackTraceEvent("runningEvent", (const void*)(i + 1), now, now);
+        }
+        recorded = true;
+        while (!written.load()) {
+            std::this_thread::yield();
+        }
+    });
+    while (!recorded.load()) {
+        std::this_thread::yield();
+    }
+
+    ASSERT_TRUE(writeStackTrace(traceTestFileName) >= (long)STACK_TRACE_RING_EVENTS - 1);
+    written = true;
+    thread.join();
+    std::string trace = readAndRemoveTestFile(traceTestFileName);
+    ASSERT_EQUALS(countOccurrences(trace, "\"name\": \"runningEvent\""), (size_t)STACK_TRACE_RING_EVENTS - 1);
+
+    char firstKept[64] = "";
+    char lastDropped[64] = "";
+    snprintf(firstKept,   sizeof(firstKept),   "\"" PTR_FORMAT "\"", (uintptr_t)(extraEvents + 2));
+    snprintf(lastDropped, sizeof(lastDropped), "\"" PTR_FORMAT "\"", (uintptr_t)(extraEvents + 1));
+    ASSERT_TRUE(trace.find(firstKept) != std::string::npos);
+    ASSERT_TRUE(trace.find(lastDropped) == std::string::npos);
+}
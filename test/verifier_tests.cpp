@@ -0,0 +1,206 @@
+/**
+ * @file
+ */
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "testlib.h"
+#include "../src/immortal_stack.h"
+
+/** Stack with all checks, whose canaries and hashes are verified in the background */
+typedef ImmortalStack<int, StackSecurityPolicy<3, StackBackgroundVerification>> VerifiedIntStack;
+
+/** Number of stacks that are reported by countingCorruptionHandler */
+static std::atomic<int> reportedStacksCount{0};
+
+/** The last stack that is reported by countingCorruptionHandler */
+static std::atomic<void*> reportedStack{nullptr};
+
+/** Corruption handler that counts the reported stacks instead of failing an assertion */
+static void countingCorruptionHandler(void* stack) {
+    reportedStack = stack;
+    ++reportedStacksCount;
+}
+
+TEST(verifier, stacksJoinAndLeaveRegistry) {
+    size_t registeredNumber = stackRegistry.size;
+
+    VerifiedIntStack first{};
+    VerifiedIntStack second{};
+    constructStack(&first);
+    constructStack(&second);
+    ASSERT_EQUALS(stackRegistry.size, registeredNumber + 2);
+    ASSERT_TRUE(stackRegistry.first == second._registryEntry);
+
+    destructStack(&second);
+    ASSERT_EQUALS(stackRegistry.size, registeredNumber + 1);
+    destructStack(&first);
+    ASSERT_EQUALS(stackRegistry.size, registeredNumber);
+
+    // Stacks that are verified by each operation don't join the registry
+    ImmortalStack<int, StackSecurityPolicy<3>> synchronous{};
+    constructStack(&synchronous);
+    ASSERT_EQUALS(stackRegistry.size, registeredNumber);
+    destructStack(&synchronous);
+}
+
+TEST(verifier, corruptionIsReportedOnce) {
+    setStackCorruptionHandler(countingCorruptionHandler);
+    reportedStacksCount = 0;
+
+    VerifiedIntStack s{};
+    constructStack(&s);
+    for (int i = 0; i < 100; ++i) {
+        push(&s, i);
+    }
+    ASSERT_EQUALS(verifyRegisteredStacks(), (size_t)0);
+
+    // Operations check only the stack members, so they don't notice the corrupted element
+    getStackData(&s)[10] = -1;
+    push(&s, 100);
+    ASSERT_EQUALS(pop(&s), 100);
+
+    ASSERT_EQUALS(verifyRegisteredStacks(), (size_t)1);
+    ASSERT_EQUALS(verifyRegisteredStacks(), (size_t)0);
+    ASSERT_EQUALS(reportedStacksCount.load(), 1);
+    ASSERT_TRUE(reportedStack.load() == &s);
+
+    getStackData(&s)[10] = 10;
+    destructStack(&s);
+    setStackCorruptionHandler(failStackAssertion);
+}
+
+TEST(verifier, backgroundThreadFindsCorruption) {
+    setStackCorruptionHandler(countingCorruptionHandler);
+    reportedStacksCount = 0;
+
+    VerifiedIntStack s{};
+    constructStack(&s);
+    ASSERT_TRUE(startStackVerifier(1));
+    ASSERT_TRUE(!startStackVerifier(1));
+
+    // Owner thread works with the stack while the verifier checks it
+    for (int i = 0; i < 10000; ++i) {
+        push(&s, i);
+        if (i % 3 == 0) pop(&s);
+    }
+    ASSERT_EQUALS(reportedStacksCount.load(), 0);
+
+    s._canariesAfter[0] = 0;
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (reportedStacksCount.load() == 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    stopStackVerifier();
+    ASSERT_EQUALS(reportedStacksCount.load(), 1);
+    ASSERT_TRUE(stackVerifier.passes.load() > 0);
+
+    s._canariesAfter[0] = canaryValue;
+    destructStack(&s);
+    setStackCorruptionHandler(failStackAssertion);
+}
+
+/** Corruption handler that repairs the data hash of the VerifiedIntStack and destructs the stack */
+static void destructingCorruptionHandler(void* stack) {
+    VerifiedIntStack* const corrupted = (VerifiedIntStack*)stack;
+    corrupted->_dataHash = getDataHash(corrupted);
+    destructStack(corrupted);
+    ++reportedStacksCount;
+}
+
+TEST(verifier, handlerDestructsStacks) {
+    setStackCorruptionHandler(destructingCorruptionHandler);
+    reportedStacksCount = 0;
+    size_t registeredNumber = stackRegistry.size;
+
+    VerifiedIntStack first{};
+    VerifiedIntStack second{};
+    VerifiedIntStack third{};
+    constructStack(&first);
+    constructStack(&second);
+    constructStack(&third);
+    push(&first, 1);
+    push(&third, 3);
+
+    // Handler unregisters the stacks, so the registry changes during the pass
+    first._dataHash = 0;
+    third._dataHash = 0;
+    ASSERT_EQUALS(verifyRegisteredStacks(), (size_t)2);
+    ASSERT_EQUALS(reportedStacksCount.load(), 2);
+    ASSERT_EQUALS(stackRegistry.size, registeredNumber + 1);
+    ASSERT_TRUE(stackRegistry.first == second._registryEntry);
+
+    destructStack(&second);
+    setStackCorruptionHandler(failStackAssertion);
+}
+
+TEST(verifier, defaultHandlerFailsAssertion) {
+    VerifiedIntStack s{};
+    constructStack(&s);
+    push(&s, 1);
+
+    s._dataHash = 0;
+    ASSERT_FAILS_ASSERTION(verifyRegisteredStacks());
+
+    // Members are still checked by each operation
+    s._size = 2;
+    ASSERT_FAILS_ASSERTION(push(&s, 2));
+    s._size = 1;
+
+    s._dataHash = getDataHash(&s);
+    destructStack(&s);
+}
+
+TEST(verifier, sampledChecksFollowPeriod) {
+    typedef ImmortalStack<int, StackSecurityPolicy<3, StackSampledVerification>> SampledIntStack;
+    setStackSamplingPeriod(4);
+
+    SampledIntStack s{};
+    constructStack(&s);
+    push(&s, 1);
+    ASSERT_EQUALS(getStackSamplingState(&s).checks, (size_t)2);
+    ASSERT_EQUALS(getStackSamplingState(&s).skippedChecks, (size_t)2);
+
+    // The third check skips the hash too, the fourth one is full
+    getStackData(&s)[0] = 2;
+    ASSERT_EQUALS(top(&s), 2);
+    ASSERT_FAILS_ASSERTION(top(&s));
+    getStackData(&s)[0] = 1;
+    ASSERT_EQUALS(top(&s), 1);
+    ASSERT_EQUALS(getStackSamplingState(&s).skippedChecks, (size_t)3);
+
+    destructStack(&s);
+    setStackSamplingPeriod(STACK_SAMPLING_PERIOD);
+}
+
+TEST(verifier, sampledChecksFollowProbability) {
+    typedef ImmortalStack<int, StackSecurityPolicy<3, StackSampledVerification>> SampledIntStack;
+
+    SampledIntStack s{};
+    constructStack(&s);
+
+    setStackSamplingProbability(0);
+    for (int i = 0; i < 1000; ++i) {
+        push(&s, i);
+    }
+    StackSamplingState state = getStackSamplingState(&s);
+    ASSERT_EQUALS(state.skippedChecks, state.checks);
+
+    // Sampling counters change on each check, but they are not hashed, so full checks pass
+    setStackSamplingProbability(1);
+    for (int i = 999; i >= 0; --i) {
+        ASSERT_EQUALS(pop(&s), i);
+    }
+    ASSERT_EQUALS(getStackSamplingState(&s).skippedChecks, state.skippedChecks);
+
+    setStackSamplingProbability(0.5);
+    for (int i = 0; i < 1000; ++i) {
+        push(&s, i);
+    }
+    size_t skippedChecks = getStackSamplingState(&s).skippedChecks - state.skippedChecks;
+    ASSERT_TRUE(skippedChecks > 800 && skippedChecks < 1200);
+
+    destructStack(&s);
+    setStackSamplingPeriod(STACK_SAMPLING_PERIOD);
+}
@@ -0,0 +1,126 @@
+/**
+ * @file
+ */
+
+#include <atomic>
+#include <thread>
+#include "testlib.h"
+#include "../src/work_stealing_deque.h"
+
+/** Work-stealing deque with all checks */
+typedef WorkStealingDeque<int, StackSecurityPolicy<3>> IntDeque;
+
+/** Number of workers in the scheduler test */
+constexpr int testWorkersNumber = 4;
+
+/** Depth of the task tree in the scheduler test. Each task spawns two tasks of the next depth */
+constexpr int testTasksDepth = 14;
+
+TEST(workStealingDeque, ownerPopsNewestThievesStealOldest) {
+    IntDeque d{};
+    constructStack(&d);
+
+    for (int i = 0; i < 100; ++i) {
+        push(&d, i);
+    }
+    ASSERT_EQUALS(getStackSize(&d), 100);
+    ASSERT_EQUALS(getStackCapacity(&d), 128);
+
+    int value = 0;
+    for (int i = 0; i < 50; ++i) {
+        ASSERT_TRUE(trySteal(&d, &value));
+        ASSERT_EQUALS(value, i);
+        ASSERT_TRUE(tryPop(&d, &value));
+        ASSERT_EQUALS(value, 99 - i);
+    }
+    ASSERT_TRUE(!tryPop(&d, &value));
+    ASSERT_TRUE(!trySteal(&d, &value));
+
+    destructStack(&d);
+}
+
+TEST(workStealingDeque, enlargingKeepsWrappedElements) {
+    IntDeque d{};
+    constructStack(&d, 3);
+    ASSERT_EQUALS(getStackCapacity(&d), 4);
+
+    // Top moves forward, so the elements wrap around the array before it's enlarged
+    int value = 0;
+    int next = 0;
+    for (int i = 0; i < 1000; ++i) {
+        push(&d, i);
+        if (i % 3 == 0) {
+            ASSERT_TRUE(trySteal(&d, &value));
+            ASSERT_EQUALS(value, next++);
+        }
+    }
+    while (trySteal(&d, &value)) {
+        ASSERT_EQUALS(value, next++);
+    }
+    ASSERT_EQUALS(next, 1000);
+
+    destructStack(&d);
+}
+
+TEST(workStealingDeque, schedulerRunsEveryTaskOnce) {
+    IntDeque deques[testWorkersNumber] = {};
+    for (IntDeque& d : deques) {
+        constructStack(&d);
+    }
+
+    // All work starts in the first deque, the other workers have to steal it
+    push(&deques[0], 0);
+    std::atomic<int> executedCount{0};
+    const int tasksNumber = (1 << (testTasksDepth + 1)) - 1;
+
+    std::vector<std::thread> workers;
+    for (int w = 0; w < testWorkersNumber; ++w) {
+        workers.emplace_back([&deques, &executedCount, tasksNumber, w]() {
+            int depth = 0;
+            int victim = w;
+            while (executedCount.load() < tasksNumber) {
+                if (!tryPop(&deques[w], &depth)) {
+                    victim = (victim + 1) % testWorkersNumber;
+                    if (victim == w || !trySteal(&deques[victim], &depth)) continue;
+                }
+
+                if (depth < testTasksDepth) {
+                    push(&deques[w], depth + 1);
+                    push(&deques[w], depth + 1);
+                }
+                ++executedCount;
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    ASSERT_EQUALS(executedCount.load(), tasksNumber);
+    for (IntDeque& d : deques) {
+        ASSERT_EQUALS(getStackSize(&d), 0);
+        destructStack(&d);
+    }
+}
+
+TEST(workStealingDeque, corruptedDequeFailsAssertion) {
+    IntDeque d{};
+    constructStack(&d, 4);
+    push(&d, 1);
+    push(&d, 2);
+
+    auto slots = getDequeSlots(d._array.load());
+    slots[0].value = 3;
+    ASSERT_FAILS_ASSERTION(trySteal(&d, &slots[1].value));
+    slots[0].value = 1;
+
+    getDequeCanariesAfter(d._array.load())[0] = 0;
+    ASSERT_FAILS_ASSERTION(push(&d, 3));
+    getDequeCanariesAfter(d._array.load())[0] = canaryValue;
+
+    d._bottom = 1;
+    ASSERT_FAILS_ASSERTION(push(&d, 3));
+    d._bottom = 2;
+
+    destructStack(&d);
+}
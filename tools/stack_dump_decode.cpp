@@ -0,0 +1,41 @@
+/**
+ * @file
+ * @brief Tool that renders the binary stack dumps (see stack_dump.h) into the text layout of LOG_STACK
+ *
+ * Usage: stack-dump-decode [dump file] [index radius]
+ * Dump file is stack-dump.bin by default. If the index is given, only the elements from index - radius
+ * to index + radius are rendered.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include "../src/stack_dump.h"
+
+int main(int argc, char* argv[]) {
+    if (argc != 1 && argc != 2 && argc != 4) {
+        fprintf(stderr, "Usage: %s [dump file] [index radius]\n", argv[0]);
+        return 1;
+    }
+
+    const char* dumpFileName = (argc >= 2) ? argv[1] : "stack-dump.bin";
+    FILE* dump = fopen(dumpFileName, "rb");
+    if (dump == nullptr) {
+        fprintf(stderr, "Can't open %s\n", dumpFileName);
+        return 1;
+    }
+
+    StackDumpWindow window = {};
+    if (argc == 4) {
+        window.index  = strtoull(argv[2], nullptr, 10);
+        window.radius = strtoull(argv[3], nullptr, 10);
+    }
+
+    long dumpsNumber = decodeStackDumps(dump, stdout, (argc == 4) ? &window : nullptr);
+    fclose(dump);
+    if (dumpsNumber < 0) {
+        fprintf(stderr, "%s is malformed\n", dumpFileName);
+        return 1;
+    }
+
+    return 0;
+}